@@ -87,6 +87,7 @@
 #include <math.h>
 #include "builtin_functions.h"
 #include "util/hash_table.h"
+#include "util/set.h"
 
 #ifndef M_PIf
 #define M_PIf   ((float) M_PI)
@@ -1004,7 +1005,8 @@ namespace {
  * function module.
  *
  * It generates IR for every built-in function signature, and organizes them
- * into functions.
+ * into functions.  Apart from the intrinsics, a function is only generated
+ * the first time a shader looks it up by name.
  */
 class builtin_builder {
 public:
@@ -1016,21 +1018,31 @@ public:
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
 
+   ir_function *get_function(const char *name);
+
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * This includes signatures for every built-in looked up so far,
+    * regardless of version or enabled extensions.  The availability
+    * predicate associated with each signature allows matching_signature() to
+    * filter out the irrelevant ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /** Names get_function() already ran create_builtins() for. */
+   struct set *created_functions;
+
+   /** When set, create_builtins() only creates the function of this name. */
+   const char *only_function;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
+   bool skip_function(const char *name) const;
 
    /**
     * IR builder helpers:
@@ -1421,6 +1433,8 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   created_functions = NULL;
+   only_function = NULL;
 }
 
 builtin_builder::~builtin_builder()
@@ -1449,7 +1463,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1461,6 +1475,37 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+/**
+ * Look up a built-in function, generating it on the first lookup.
+ *
+ * Building the IR of all built-ins is a large part of the first shader
+ * compile, while a shader only ever calls a handful of them.
+ */
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL)
+      return f;
+
+   /* Don't run create_builtins() again for names that aren't built-ins. */
+   if (_mesa_set_search(created_functions, name) != NULL)
+      return NULL;
+   _mesa_set_add(created_functions, ralloc_strdup(mem_ctx, name));
+
+   only_function = name;
+   create_builtins();
+   only_function = NULL;
+
+   return shader->symbols->get_function(name);
+}
+
+bool
+builtin_builder::skip_function(const char *name) const
+{
+   return only_function != NULL && strcmp(name, only_function) != 0;
+}
+
 void
 builtin_builder::initialize()
 {
@@ -1471,9 +1516,10 @@ builtin_builder::initialize()
    glsl_type_singleton_init_or_ref();
 
    mem_ctx = ralloc_context(NULL);
+   created_functions = _mesa_set_create(mem_ctx, _mesa_hash_string,
+                                        _mesa_key_string_equal);
    create_shader();
    create_intrinsics();
-   create_builtins();
 }
 
 void
@@ -1481,6 +1527,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   created_functions = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1752,13 +1799,19 @@ builtin_builder::create_intrinsics()
 }
 
 /**
- * Create ir_function and ir_function_signature objects for each built-in.
- *
- * Contains a list of every available built-in.
+ * Create ir_function and ir_function_signature objects for each built-in,
+ * or only for only_function if set.
  */
 void
 builtin_builder::create_builtins()
 {
+   /* Don't generate the signatures of functions that are skipped. */
+#define add_function(NAME, ...)                  \
+   do {                                          \
+      if (!skip_function(NAME))                  \
+         add_function(NAME, __VA_ARGS__);        \
+   } while (0)
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(&glsl_type_builtin_float), \
@@ -5768,6 +5821,7 @@ builtin_builder::create_builtins()
 #undef FIUDHF_VEC
 #undef FIUBDHF_VEC
 #undef FIU2_MIXED
+#undef add_function
 }
 
 void
@@ -5840,6 +5894,9 @@ builtin_builder::add_image_function(const char *name,
       &glsl_type_builtin_uimage2DMSArray
    };
 
+   if (skip_function(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -8995,7 +9052,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    simple_mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -9009,10 +9066,21 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
-gl_shader *
-_mesa_glsl_get_builtin_function_shader()
+/**
+ * Look up a built-in function by name, building it first if needed.
+ *
+ * The returned function is complete and isn't modified afterwards, so its
+ * signatures can be walked without holding the lock.
+ */
+ir_function *
+_mesa_glsl_get_builtin_function(const char *name)
 {
-   return builtins.shader;
+   ir_function *f;
+   simple_mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   simple_mtx_unlock(&builtins_lock);
+
+   return f;
 }
 
 
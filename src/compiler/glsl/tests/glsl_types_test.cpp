@@ -0,0 +1,149 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Looking up and creating array, struct and explicit matrix types from
+ * several threads at once.
+ */
+
+#include <stdio.h>
+#include <gtest/gtest.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "glsl_types.h"
+
+#define NUM_THREADS 8
+#define NUM_ARRAY_SIZES 2048
+#define NUM_STRUCTS 256
+
+struct lookup_thread {
+   unsigned seed;
+   unsigned passes;
+   const glsl_type *arrays[NUM_ARRAY_SIZES];
+   const glsl_type *structs[NUM_STRUCTS];
+   const glsl_type *matrices[NUM_STRUCTS];
+};
+
+static const glsl_type *
+make_struct(unsigned i)
+{
+   char name[32];
+   glsl_struct_field fields[2] = {
+      glsl_struct_field(&glsl_type_builtin_vec4, "a"),
+      glsl_struct_field(glsl_array_type(&glsl_type_builtin_float, i + 1, 0),
+                        "b"),
+   };
+
+   snprintf(name, sizeof(name), "s%u", i);
+   return glsl_struct_type(fields, 2, name, false);
+}
+
+/* Every thread walks the keys in a different order, so that lookups of
+ * existing types race with insertions and with the tables growing.
+ */
+static int
+lookup_func(void *data)
+{
+   struct lookup_thread *thread = (struct lookup_thread *)data;
+
+   for (unsigned pass = 0; pass < thread->passes; pass++) {
+      for (unsigned n = 0; n < NUM_ARRAY_SIZES; n++) {
+         const unsigned i = (n * 7 + thread->seed * 131) % NUM_ARRAY_SIZES;
+         thread->arrays[i] = glsl_array_type(&glsl_type_builtin_vec4, i + 1, 0);
+      }
+
+      for (unsigned n = 0; n < NUM_STRUCTS; n++) {
+         const unsigned i = (n * 5 + thread->seed * 37) % NUM_STRUCTS;
+         thread->structs[i] = make_struct(i);
+         thread->matrices[i] =
+            glsl_explicit_matrix_type(&glsl_type_builtin_mat4, 16 * (i + 1),
+                                      i & 1);
+      }
+   }
+   return 0;
+}
+
+class glsl_types_test : public ::testing::Test {
+protected:
+   glsl_types_test()
+   {
+      glsl_type_singleton_init_or_ref();
+   }
+
+   ~glsl_types_test()
+   {
+      glsl_type_singleton_decref();
+   }
+
+   int64_t run_threads(struct lookup_thread *threads, unsigned passes)
+   {
+      thrd_t handles[NUM_THREADS];
+
+      for (unsigned t = 0; t < NUM_THREADS; t++) {
+         threads[t].seed = t;
+         threads[t].passes = passes;
+      }
+
+      int64_t start = os_time_get_nano();
+
+      for (unsigned t = 0; t < NUM_THREADS; t++)
+         thrd_create(&handles[t], lookup_func, &threads[t]);
+      for (unsigned t = 0; t < NUM_THREADS; t++)
+         thrd_join(handles[t], NULL);
+
+      return os_time_get_nano() - start;
+   }
+};
+
+TEST_F(glsl_types_test, concurrent_lookups)
+{
+   struct lookup_thread *threads = new lookup_thread[NUM_THREADS];
+
+   run_threads(threads, 1);
+
+   /* All threads must have gotten the same types, which are also the ones
+    * found afterwards.
+    */
+   for (unsigned i = 0; i < NUM_ARRAY_SIZES; i++) {
+      const glsl_type *t = glsl_array_type(&glsl_type_builtin_vec4, i + 1, 0);
+      EXPECT_EQ(t->length, i + 1);
+      for (unsigned j = 0; j < NUM_THREADS; j++)
+         EXPECT_EQ(threads[j].arrays[i], t);
+   }
+
+   for (unsigned i = 0; i < NUM_STRUCTS; i++) {
+      const glsl_type *s = make_struct(i);
+      const glsl_type *m =
+         glsl_explicit_matrix_type(&glsl_type_builtin_mat4, 16 * (i + 1),
+                                   i & 1);
+      EXPECT_EQ(s->length, 2u);
+      EXPECT_EQ(m->explicit_stride, 16 * (i + 1));
+      for (unsigned j = 0; j < NUM_THREADS; j++) {
+         EXPECT_EQ(threads[j].structs[i], s);
+         EXPECT_EQ(threads[j].matrices[i], m);
+      }
+   }
+
+   delete[] threads;
+}
+
+/* Reports the throughput of looking up existing types from several threads
+ * at once.  Disabled in the unit tests, run it with
+ * "meson test --benchmark glsl_types_bench".
+ */
+TEST_F(glsl_types_test, DISABLED_benchmark)
+{
+   struct lookup_thread *threads = new lookup_thread[NUM_THREADS];
+   const unsigned passes = 20;
+
+   /* Create all the types first. */
+   run_threads(threads, 1);
+
+   int64_t elapsed = run_threads(threads, passes);
+   unsigned lookups = NUM_THREADS * passes * (NUM_ARRAY_SIZES + 3 * NUM_STRUCTS);
+
+   printf("%u threads: %.2f Mlookups/s\n", NUM_THREADS,
+          lookups * 1000.0 / elapsed);
+
+   delete[] threads;
+}
@@ -29,12 +29,35 @@
 #include "util/hash_table.h"
 #include "util/macros.h"
 #include "util/ralloc.h"
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_string.h"
 #include "util/simple_mtx.h"
 
 static simple_mtx_t glsl_type_cache_mutex = SIMPLE_MTX_INITIALIZER;
 
+/* Insert-only open addressing hash table of types, which can be searched
+ * without holding glsl_type_cache_mutex.  Inserting and growing the table
+ * requires the mutex.
+ *
+ * An entry is published by storing its type last, so a reader seeing the
+ * type also sees the hash and key.  When the table grows, the new table is
+ * filled before being published, and the old one is kept alive until the
+ * cache is released, so readers still probing it are fine.  They may miss
+ * a type added since, and then look it up again with the mutex held.
+ */
+struct type_table_entry {
+   uint32_t hash;
+   const void *key;
+   const glsl_type *type;
+};
+
+struct type_table {
+   uint32_t size;    /* power of two */
+   uint32_t count;
+   struct type_table_entry entries[];
+};
+
 static struct {
    void *mem_ctx;
 
@@ -49,14 +72,78 @@ static struct {
     */
    uint32_t users;
 
-   struct hash_table *explicit_matrix_types;
-   struct hash_table *array_types;
-   struct hash_table *cmat_types;
-   struct hash_table *struct_types;
-   struct hash_table *interface_types;
-   struct hash_table *subroutine_types;
+   struct type_table *explicit_matrix_types;
+   struct type_table *array_types;
+   struct type_table *cmat_types;
+   struct type_table *struct_types;
+   struct type_table *interface_types;
+   struct type_table *subroutine_types;
 } glsl_type_cache;
 
+static const glsl_type *
+type_table_search(struct type_table **table_ptr, uint32_t hash,
+                  const void *key, bool (*equal)(const void *a, const void *b))
+{
+   const struct type_table *table = p_atomic_read(table_ptr);
+   if (table == NULL)
+      return NULL;
+
+   const uint32_t mask = table->size - 1;
+   for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+      const struct type_table_entry *entry = &table->entries[i];
+      const glsl_type *t = p_atomic_read(&entry->type);
+
+      if (t == NULL)
+         return NULL;
+      if (entry->hash == hash && equal(entry->key, key))
+         return t;
+   }
+}
+
+static void
+type_table_add(struct type_table *table, uint32_t hash, const void *key,
+               const glsl_type *t)
+{
+   const uint32_t mask = table->size - 1;
+   uint32_t i = hash & mask;
+
+   while (table->entries[i].type != NULL)
+      i = (i + 1) & mask;
+
+   table->entries[i].hash = hash;
+   table->entries[i].key = key;
+   p_atomic_set(&table->entries[i].type, t);
+   table->count++;
+}
+
+/* Must be called with glsl_type_cache_mutex held. */
+static void
+type_table_insert(struct type_table **table_ptr, uint32_t hash,
+                  const void *key, const glsl_type *t)
+{
+   struct type_table *table = *table_ptr;
+
+   /* Keep the load factor under 1/2, so probes stay short. */
+   if (table == NULL || (table->count + 1) * 2 > table->size) {
+      const uint32_t size = table ? table->size * 2 : 64;
+      struct type_table *grown =
+         rzalloc_size(glsl_type_cache.mem_ctx,
+                      sizeof(*grown) + size * sizeof(grown->entries[0]));
+      grown->size = size;
+
+      for (uint32_t i = 0; table && i < table->size; i++) {
+         const struct type_table_entry *entry = &table->entries[i];
+         if (entry->type != NULL)
+            type_table_add(grown, entry->hash, entry->key, entry->type);
+      }
+
+      p_atomic_set(table_ptr, grown);
+      table = grown;
+   }
+
+   type_table_add(table, hash, key, t);
+}
+
 static const glsl_type *
 make_vector_matrix_type(linear_ctx *lin_ctx, uint32_t gl_type,
                         enum glsl_base_type base_type, unsigned vector_elements,
@@ -736,7 +823,17 @@ struct PACKED explicit_matrix_key {
    uintptr_t row_major;
 };
 
-DERIVE_HASH_TABLE(explicit_matrix_key);
+static uint32_t
+explicit_matrix_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct explicit_matrix_key));
+}
+
+static bool
+explicit_matrix_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct explicit_matrix_key)) == 0;
+}
 
 static const glsl_type *
 get_explicit_matrix_instance(unsigned int base_type, unsigned int rows, unsigned int columns,
@@ -765,42 +862,39 @@ get_explicit_matrix_instance(unsigned int base_type, unsigned int rows, unsigned
 
    const uint32_t key_hash = explicit_matrix_key_hash(&key);
 
+   const glsl_type *t =
+      type_table_search(&glsl_type_cache.explicit_matrix_types, key_hash,
+                        &key, explicit_matrix_key_equal);
+   if (t != NULL)
+      goto found;
+
    simple_mtx_lock(&glsl_type_cache_mutex);
    assert(glsl_type_cache.users > 0);
-   void *mem_ctx = glsl_type_cache.mem_ctx;
-
-   if (glsl_type_cache.explicit_matrix_types == NULL) {
-      glsl_type_cache.explicit_matrix_types =
-         explicit_matrix_key_table_create(mem_ctx);
-   }
-   struct hash_table *explicit_matrix_types = glsl_type_cache.explicit_matrix_types;
-
-   const struct hash_entry *entry =
-      _mesa_hash_table_search_pre_hashed(explicit_matrix_types, key_hash, &key);
-   if (entry == NULL) {
 
+   /* Another thread might have added it in the meantime. */
+   t = type_table_search(&glsl_type_cache.explicit_matrix_types, key_hash,
+                         &key, explicit_matrix_key_equal);
+   if (t == NULL) {
       char name[128];
       snprintf(name, sizeof(name), "%sx%ua%uB%s", glsl_get_type_name(bare_type),
                explicit_stride, explicit_alignment, row_major ? "RM" : "");
 
       linear_ctx *lin_ctx = glsl_type_cache.lin_ctx;
-      const glsl_type *t =
-         make_vector_matrix_type(lin_ctx, bare_type->gl_type,
-                                 (enum glsl_base_type)base_type,
-                                 rows, columns, name,
-                                 explicit_stride, row_major,
-                                 explicit_alignment);
+      t = make_vector_matrix_type(lin_ctx, bare_type->gl_type,
+                                  (enum glsl_base_type)base_type,
+                                  rows, columns, name,
+                                  explicit_stride, row_major,
+                                  explicit_alignment);
 
       struct explicit_matrix_key *stored_key = linear_zalloc(lin_ctx, struct explicit_matrix_key);
       memcpy(stored_key, &key, sizeof(key));
 
-      entry = _mesa_hash_table_insert_pre_hashed(explicit_matrix_types,
-                                                 key_hash, stored_key, (void *)t);
+      type_table_insert(&glsl_type_cache.explicit_matrix_types, key_hash,
+                        stored_key, t);
    }
-
-   const glsl_type *t = (const glsl_type *) entry->data;
    simple_mtx_unlock(&glsl_type_cache_mutex);
 
+found:
    assert(t->base_type == base_type);
    assert(t->vector_elements == rows);
    assert(t->matrix_columns == columns);
@@ -1239,7 +1333,17 @@ struct PACKED array_key {
    uintptr_t explicit_stride;
 };
 
-DERIVE_HASH_TABLE(array_key);
+static uint32_t
+array_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct array_key));
+}
+
+static bool
+array_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct array_key)) == 0;
+}
 
 const glsl_type *
 glsl_array_type(const glsl_type *element,
@@ -1256,30 +1360,28 @@ glsl_array_type(const glsl_type *element,
 
    const uint32_t key_hash = array_key_hash(&key);
 
+   const glsl_type *t = type_table_search(&glsl_type_cache.array_types,
+                                          key_hash, &key, array_key_equal);
+   if (t != NULL)
+      goto found;
+
    simple_mtx_lock(&glsl_type_cache_mutex);
    assert(glsl_type_cache.users > 0);
-   void *mem_ctx = glsl_type_cache.mem_ctx;
 
-   if (glsl_type_cache.array_types == NULL) {
-      glsl_type_cache.array_types = array_key_table_create(mem_ctx);
-   }
-   struct hash_table *array_types = glsl_type_cache.array_types;
-
-   const struct hash_entry *entry = _mesa_hash_table_search_pre_hashed(array_types, key_hash, &key);
-   if (entry == NULL) {
+   /* Another thread might have added it in the meantime. */
+   t = type_table_search(&glsl_type_cache.array_types, key_hash, &key,
+                         array_key_equal);
+   if (t == NULL) {
       linear_ctx *lin_ctx = glsl_type_cache.lin_ctx;
-      const glsl_type *t = make_array_type(lin_ctx, element, array_size, explicit_stride);
+      t = make_array_type(lin_ctx, element, array_size, explicit_stride);
       struct array_key *stored_key = linear_zalloc(lin_ctx, struct array_key);
       memcpy(stored_key, &key, sizeof(key));
 
-      entry = _mesa_hash_table_insert_pre_hashed(array_types, key_hash,
-                                                 stored_key,
-                                                 (void *) t);
+      type_table_insert(&glsl_type_cache.array_types, key_hash, stored_key, t);
    }
-
-   const glsl_type *t = (const glsl_type *) entry->data;
    simple_mtx_unlock(&glsl_type_cache_mutex);
 
+found:
    assert(t->base_type == GLSL_TYPE_ARRAY);
    assert(t->length == array_size);
    assert(t->fields.array == element);
@@ -1318,27 +1420,27 @@ glsl_cmat_type(const struct glsl_cmat_description *desc)
                         desc->use << 24;
    const uint32_t key_hash = _mesa_hash_uint(&key);
 
+   const glsl_type *t = type_table_search(&glsl_type_cache.cmat_types,
+                                          key_hash, (void *) (uintptr_t) key,
+                                          _mesa_key_pointer_equal);
+   if (t != NULL)
+      goto found;
+
    simple_mtx_lock(&glsl_type_cache_mutex);
    assert(glsl_type_cache.users > 0);
-   void *mem_ctx = glsl_type_cache.mem_ctx;
-
-   if (glsl_type_cache.cmat_types == NULL) {
-      glsl_type_cache.cmat_types =
-         _mesa_hash_table_create_u32_keys(mem_ctx);
-   }
-   struct hash_table *cmat_types = glsl_type_cache.cmat_types;
 
-   const struct hash_entry *entry = _mesa_hash_table_search_pre_hashed(
-      cmat_types, key_hash, (void *) (uintptr_t) key);
-   if (entry == NULL) {
-      const glsl_type *t = make_cmat_type(glsl_type_cache.lin_ctx, *desc);
-      entry = _mesa_hash_table_insert_pre_hashed(cmat_types, key_hash,
-                                                 (void *) (uintptr_t) key, (void *) t);
+   /* Another thread might have added it in the meantime. */
+   t = type_table_search(&glsl_type_cache.cmat_types, key_hash,
+                         (void *) (uintptr_t) key, _mesa_key_pointer_equal);
+   if (t == NULL) {
+      t = make_cmat_type(glsl_type_cache.lin_ctx, *desc);
+      type_table_insert(&glsl_type_cache.cmat_types, key_hash,
+                        (void *) (uintptr_t) key, t);
    }
-
-   const glsl_type *t = (const glsl_type *)entry->data;
    simple_mtx_unlock(&glsl_type_cache_mutex);
 
+found:
+
    assert(t->base_type == GLSL_TYPE_COOPERATIVE_MATRIX);
    assert(t->cmat_desc.element_type == desc->element_type);
    assert(t->cmat_desc.scope == desc->scope);
@@ -1534,28 +1636,27 @@ glsl_struct_type_with_explicit_alignment(const glsl_struct_field *fields,
    fill_struct_type(&key, fields, num_fields, name, packed, explicit_alignment);
    const uint32_t key_hash = record_key_hash(&key);
 
+   const glsl_type *t = type_table_search(&glsl_type_cache.struct_types,
+                                          key_hash, &key, record_key_compare);
+   if (t != NULL)
+      goto found;
+
    simple_mtx_lock(&glsl_type_cache_mutex);
    assert(glsl_type_cache.users > 0);
-   void *mem_ctx = glsl_type_cache.mem_ctx;
 
-   if (glsl_type_cache.struct_types == NULL) {
-      glsl_type_cache.struct_types =
-         _mesa_hash_table_create(mem_ctx, record_key_hash, record_key_compare);
-   }
-   struct hash_table *struct_types = glsl_type_cache.struct_types;
+   /* Another thread might have added it in the meantime. */
+   t = type_table_search(&glsl_type_cache.struct_types, key_hash, &key,
+                         record_key_compare);
+   if (t == NULL) {
+      t = make_struct_type(glsl_type_cache.lin_ctx, fields, num_fields,
+                           name, packed, explicit_alignment);
 
-   const struct hash_entry *entry = _mesa_hash_table_search_pre_hashed(struct_types,
-                                                                       key_hash, &key);
-   if (entry == NULL) {
-      const glsl_type *t = make_struct_type(glsl_type_cache.lin_ctx, fields, num_fields,
-                                            name, packed, explicit_alignment);
-
-      entry = _mesa_hash_table_insert_pre_hashed(struct_types, key_hash, t, (void *) t);
+      type_table_insert(&glsl_type_cache.struct_types, key_hash, t, t);
    }
-
-   const glsl_type *t = (const glsl_type *) entry->data;
    simple_mtx_unlock(&glsl_type_cache_mutex);
 
+found:
+
    assert(t->base_type == GLSL_TYPE_STRUCT);
    assert(t->length == num_fields);
    assert(strcmp(glsl_get_type_name(t), name) == 0);
@@ -1577,28 +1678,27 @@ glsl_interface_type(const glsl_struct_field *fields,
    fill_interface_type(&key, fields, num_fields, packing, row_major, block_name);
    const uint32_t key_hash = record_key_hash(&key);
 
+   const glsl_type *t = type_table_search(&glsl_type_cache.interface_types,
+                                          key_hash, &key, record_key_compare);
+   if (t != NULL)
+      goto found;
+
    simple_mtx_lock(&glsl_type_cache_mutex);
    assert(glsl_type_cache.users > 0);
-   void *mem_ctx = glsl_type_cache.mem_ctx;
 
-   if (glsl_type_cache.interface_types == NULL) {
-      glsl_type_cache.interface_types =
-         _mesa_hash_table_create(mem_ctx, record_key_hash, record_key_compare);
-   }
-   struct hash_table *interface_types = glsl_type_cache.interface_types;
-
-   const struct hash_entry *entry = _mesa_hash_table_search_pre_hashed(interface_types,
-                                                                       key_hash, &key);
-   if (entry == NULL) {
-      const glsl_type *t = make_interface_type(glsl_type_cache.lin_ctx, fields, num_fields,
-                                               packing, row_major, block_name);
+   /* Another thread might have added it in the meantime. */
+   t = type_table_search(&glsl_type_cache.interface_types, key_hash, &key,
+                         record_key_compare);
+   if (t == NULL) {
+      t = make_interface_type(glsl_type_cache.lin_ctx, fields, num_fields,
+                              packing, row_major, block_name);
 
-      entry = _mesa_hash_table_insert_pre_hashed(interface_types, key_hash, t, (void *) t);
+      type_table_insert(&glsl_type_cache.interface_types, key_hash, t, t);
    }
-
-   const glsl_type *t = (const glsl_type *) entry->data;
    simple_mtx_unlock(&glsl_type_cache_mutex);
 
+found:
+
    assert(t->base_type == GLSL_TYPE_INTERFACE);
    assert(t->length == num_fields);
    assert(strcmp(glsl_get_type_name(t), block_name) == 0);
@@ -1611,27 +1711,28 @@ glsl_subroutine_type(const char *subroutine_name)
 {
    const uint32_t key_hash = _mesa_hash_string(subroutine_name);
 
+   const glsl_type *t = type_table_search(&glsl_type_cache.subroutine_types,
+                                          key_hash, subroutine_name,
+                                          _mesa_key_string_equal);
+   if (t != NULL)
+      goto found;
+
    simple_mtx_lock(&glsl_type_cache_mutex);
    assert(glsl_type_cache.users > 0);
-   void *mem_ctx = glsl_type_cache.mem_ctx;
 
-   if (glsl_type_cache.subroutine_types == NULL) {
-      glsl_type_cache.subroutine_types =
-         _mesa_hash_table_create(mem_ctx, _mesa_hash_string, _mesa_key_string_equal);
-   }
-   struct hash_table *subroutine_types = glsl_type_cache.subroutine_types;
-
-   const struct hash_entry *entry = _mesa_hash_table_search_pre_hashed(subroutine_types,
-                                                                       key_hash, subroutine_name);
-   if (entry == NULL) {
-      const glsl_type *t = make_subroutine_type(glsl_type_cache.lin_ctx, subroutine_name);
+   /* Another thread might have added it in the meantime. */
+   t = type_table_search(&glsl_type_cache.subroutine_types, key_hash,
+                         subroutine_name, _mesa_key_string_equal);
+   if (t == NULL) {
+      t = make_subroutine_type(glsl_type_cache.lin_ctx, subroutine_name);
 
-      entry = _mesa_hash_table_insert_pre_hashed(subroutine_types, key_hash, glsl_get_type_name(t), (void *) t);
+      type_table_insert(&glsl_type_cache.subroutine_types, key_hash,
+                        glsl_get_type_name(t), t);
    }
-
-   const glsl_type *t = (const glsl_type *) entry->data;
    simple_mtx_unlock(&glsl_type_cache_mutex);
 
+found:
+
    assert(t->base_type == GLSL_TYPE_SUBROUTINE);
    assert(strcmp(glsl_get_type_name(t), subroutine_name) == 0);
 
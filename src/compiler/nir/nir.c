@@ -201,6 +201,7 @@ nir_shader_create(void *mem_ctx,
 #ifndef NDEBUG
    nir_process_debug_variable();
 #endif
+   nir_profile_init();
 
    exec_list_make_empty(&shader->variables);
 
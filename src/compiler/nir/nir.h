@@ -5058,6 +5058,19 @@ should_print_nir(UNUSED nir_shader *shader)
 }
 #endif /* NDEBUG */
 
+extern bool nir_profile_enabled;
+
+struct nir_profile_start {
+   int64_t time_ns;
+   int64_t num_instrs;
+};
+
+void nir_profile_init(void);
+void nir_profile_pass_start(nir_shader *nir, struct nir_profile_start *start);
+void nir_profile_pass_end(nir_shader *nir, const char *pass,
+                          const struct nir_profile_start *start,
+                          const bool *progress);
+
 #define _PASS(pass, nir, do_pass)                                       \
    do {                                                                 \
       if (should_skip_nir(#pass)) {                                     \
@@ -5078,7 +5091,13 @@ should_print_nir(UNUSED nir_shader *shader)
    nir_metadata_set_validation_flag(nir);                       \
    if (should_print_nir(nir))                                   \
       printf("%s\n", #pass);                                    \
-   if (pass(nir, ##__VA_ARGS__)) {                              \
+   struct nir_profile_start _profile = { 0 };                   \
+   if (unlikely(nir_profile_enabled))                           \
+      nir_profile_pass_start(nir, &_profile);                   \
+   bool _pass_progress = pass(nir, ##__VA_ARGS__);              \
+   if (unlikely(nir_profile_enabled))                           \
+      nir_profile_pass_end(nir, #pass, &_profile, &_pass_progress); \
+   if (_pass_progress) {                                        \
       nir_validate_shader(nir, "after " #pass " in " __FILE__); \
       UNUSED bool _;                                            \
       progress = true;                                          \
@@ -5091,7 +5110,12 @@ should_print_nir(UNUSED nir_shader *shader)
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir, {        \
    if (should_print_nir(nir))                                \
       printf("%s\n", #pass);                                 \
+   struct nir_profile_start _profile = { 0 };                \
+   if (unlikely(nir_profile_enabled))                        \
+      nir_profile_pass_start(nir, &_profile);                \
    pass(nir, ##__VA_ARGS__);                                 \
+   if (unlikely(nir_profile_enabled))                        \
+      nir_profile_pass_end(nir, #pass, &_profile, NULL);     \
    nir_validate_shader(nir, "after " #pass " in " __FILE__); \
    if (should_print_nir(nir))                                \
       nir_print_shader(nir, stdout);                         \
@@ -5100,12 +5124,12 @@ should_print_nir(UNUSED nir_shader *shader)
 #define _NIR_LOOP_PASS(progress, idempotent, skip, nir, pass, ...)   \
 do {                                                                 \
    bool nir_loop_pass_progress = false;                              \
-   if (!_mesa_set_search(skip, (void (*)())&pass))                   \
+   if (!_mesa_set_search(skip, (const void *)(uintptr_t)&pass))      \
       NIR_PASS(nir_loop_pass_progress, nir, pass, ##__VA_ARGS__);    \
    if (nir_loop_pass_progress)                                       \
       _mesa_set_clear(skip, NULL);                                   \
    if (idempotent || !nir_loop_pass_progress)                        \
-      _mesa_set_add(skip, (void (*)())&pass);                        \
+      _mesa_set_add(skip, (const void *)(uintptr_t)&pass);           \
    UNUSED bool _ = false;                                            \
    progress |= nir_loop_pass_progress;                               \
 } while (0)
@@ -5132,6 +5156,10 @@ do {                                                                 \
  *
  * You shouldn't mix usage of this with the NIR_PASS set of helpers, without
  * using a new "skip" in-between.
+ *
+ * Changes are tracked for the whole shader: any progress makes every pass
+ * eligible again, as passes don't report which functions or blocks they
+ * changed, nor which other passes they can enable.
  */
 #define NIR_LOOP_PASS(progress, skip, nir, pass, ...) \
    _NIR_LOOP_PASS(progress, true, skip, nir, pass, ##__VA_ARGS__)
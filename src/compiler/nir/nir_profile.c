@@ -0,0 +1,185 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * NIR pass profiler, enabled with NIR_PROFILE=true.
+ *
+ * Records how often every pass run with NIR_PASS/NIR_PASS_V was called per
+ * shader stage, how often it made progress, the time it took and how it
+ * changed the number of instructions, and prints a report sorted by time
+ * when the process exits.  NIR_PASS_V doesn't know whether the pass made
+ * progress, so those calls are counted separately as unknown.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/simple_mtx.h"
+#include "util/u_call_once.h"
+#include "util/u_debug.h"
+#include "nir.h"
+
+bool nir_profile_enabled = false;
+
+struct nir_pass_profile {
+   const char *name;
+   gl_shader_stage stage;
+   uint64_t calls;
+   uint64_t progress;
+   uint64_t unknown;
+   int64_t time_ns;
+   int64_t instr_delta;
+};
+
+static simple_mtx_t profile_mutex = SIMPLE_MTX_INITIALIZER;
+static void *profile_mem_ctx;
+static struct hash_table *profile_passes[MESA_SHADER_KERNEL + 1];
+
+static int64_t
+count_instrs(nir_shader *nir)
+{
+   int64_t count = 0;
+
+   nir_foreach_function_impl(impl, nir) {
+      nir_foreach_block(block, impl)
+         count += exec_list_length(&block->instr_list);
+   }
+
+   return count;
+}
+
+void
+nir_profile_pass_start(nir_shader *nir, struct nir_profile_start *start)
+{
+   start->num_instrs = count_instrs(nir);
+   start->time_ns = os_time_get_nano();
+}
+
+void
+nir_profile_pass_end(nir_shader *nir, const char *pass,
+                     const struct nir_profile_start *start,
+                     const bool *progress)
+{
+   const int64_t time_ns = os_time_get_nano() - start->time_ns;
+   const int64_t instr_delta = count_instrs(nir) - start->num_instrs;
+   const gl_shader_stage stage = nir->info.stage;
+
+   if (stage < 0 || stage > MESA_SHADER_KERNEL)
+      return;
+
+   simple_mtx_lock(&profile_mutex);
+
+   if (profile_passes[stage] == NULL) {
+      profile_passes[stage] =
+         _mesa_hash_table_create(profile_mem_ctx, _mesa_hash_string,
+                                 _mesa_key_string_equal);
+   }
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(profile_passes[stage], pass);
+   struct nir_pass_profile *profile;
+   if (entry) {
+      profile = entry->data;
+   } else {
+      /* Copy the name, the string might belong to a driver which is
+       * unloaded before the report is printed.
+       */
+      profile = rzalloc(profile_mem_ctx, struct nir_pass_profile);
+      profile->name = ralloc_strdup(profile, pass);
+      profile->stage = stage;
+      _mesa_hash_table_insert(profile_passes[stage], profile->name, profile);
+   }
+
+   profile->calls++;
+   if (progress)
+      profile->progress += *progress;
+   else
+      profile->unknown++;
+   profile->time_ns += time_ns;
+   profile->instr_delta += instr_delta;
+
+   simple_mtx_unlock(&profile_mutex);
+}
+
+static int
+compare_time(const void *a, const void *b)
+{
+   const struct nir_pass_profile *pa = *(const struct nir_pass_profile **)a;
+   const struct nir_pass_profile *pb = *(const struct nir_pass_profile **)b;
+
+   if (pa->time_ns != pb->time_ns)
+      return pa->time_ns < pb->time_ns ? 1 : -1;
+   return strcmp(pa->name, pb->name);
+}
+
+static void
+nir_profile_report(void)
+{
+   simple_mtx_lock(&profile_mutex);
+
+   unsigned num_profiles = 0;
+   for (unsigned i = 0; i <= MESA_SHADER_KERNEL; i++)
+      num_profiles += profile_passes[i] ? profile_passes[i]->entries : 0;
+
+   struct nir_pass_profile **profiles =
+      ralloc_array(profile_mem_ctx, struct nir_pass_profile *, num_profiles);
+   int64_t total_ns = 0;
+   unsigned n = 0;
+
+   for (unsigned i = 0; i <= MESA_SHADER_KERNEL; i++) {
+      if (profile_passes[i] == NULL)
+         continue;
+
+      hash_table_foreach(profile_passes[i], entry) {
+         profiles[n] = entry->data;
+         total_ns += profiles[n]->time_ns;
+         n++;
+      }
+   }
+
+   qsort(profiles, num_profiles, sizeof(*profiles), compare_time);
+
+   fprintf(stderr, "NIR pass profile, %.3f ms total:\n", total_ns / 1e6);
+   fprintf(stderr, "%-40s %-5s %10s %10s %10s %12s %7s %12s\n",
+           "pass", "stage", "calls", "progress", "unknown", "ms", "%",
+           "instr delta");
+
+   for (unsigned i = 0; i < num_profiles; i++) {
+      const struct nir_pass_profile *p = profiles[i];
+
+      fprintf(stderr, "%-40s %-5s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12.3f %6.2f%% %12" PRId64 "\n",
+              p->name, _mesa_shader_stage_to_abbrev(p->stage),
+              p->calls, p->progress, p->unknown, p->time_ns / 1e6,
+              total_ns ? 100.0 * p->time_ns / total_ns : 0.0,
+              p->instr_delta);
+   }
+
+   ralloc_free(profile_mem_ctx);
+   profile_mem_ctx = NULL;
+   memset(profile_passes, 0, sizeof(profile_passes));
+   nir_profile_enabled = false;
+
+   simple_mtx_unlock(&profile_mutex);
+}
+
+static void
+nir_profile_init_once(void)
+{
+   if (!debug_get_bool_option("NIR_PROFILE", false))
+      return;
+
+   profile_mem_ctx = ralloc_context(NULL);
+   atexit(nir_profile_report);
+   nir_profile_enabled = true;
+}
+
+void
+nir_profile_init(void)
+{
+   static once_flag flag = ONCE_FLAG_INIT;
+   call_once(&flag, nir_profile_init_once);
+}
@@ -0,0 +1,321 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Optimization loops written with NIR_LOOP_PASS must produce the same shader
+ * as the same loop written with NIR_PASS, they only skip passes which can't
+ * make progress.
+ */
+
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "nir_test.h"
+
+enum shape {
+   SHAPE_LOOPS,
+   SHAPE_ARRAY,
+   SHAPE_BRANCHES,
+   NUM_SHAPES,
+};
+
+static const char *shape_names[NUM_SHAPES] = {
+   "loops",
+   "array",
+   "branches",
+};
+
+class nir_loop_pass_test : public nir_test {
+protected:
+   nir_loop_pass_test()
+      : nir_test::nir_test("nir_loop_pass_test")
+   {
+      options.max_unroll_iterations = 32;
+   }
+
+   void build_shader(enum shape shape, unsigned size, unsigned param);
+   void build_loops(unsigned num_loops, unsigned trip_count);
+   void build_array(unsigned length, unsigned stride);
+   void build_branches(unsigned depth, unsigned mask);
+};
+
+/* A few loops with constant trip counts, each accumulating into a local
+ * variable with redundant arithmetic and control flow, so that most passes
+ * of the loop have something to do at some point.
+ */
+void
+nir_loop_pass_test::build_loops(unsigned num_loops, unsigned trip_count)
+{
+   nir_def *index = nir_load_local_invocation_index(b);
+   nir_variable *acc = nir_local_variable_create(b->impl, glsl_uint_type(),
+                                                 "acc");
+   nir_variable *i = nir_local_variable_create(b->impl, glsl_uint_type(), "i");
+
+   nir_store_var(b, acc, index, 1);
+
+   for (unsigned l = 0; l < num_loops; l++) {
+      nir_store_var(b, i, nir_imm_int(b, 0), 1);
+
+      nir_loop *loop = nir_push_loop(b);
+      {
+         nir_def *iv = nir_load_var(b, i);
+         nir_push_if(b, nir_uge_imm(b, iv, trip_count + l));
+         nir_jump(b, nir_jump_break);
+         nir_pop_if(b, NULL);
+
+         nir_def *a = nir_load_var(b, acc);
+         nir_def *x = nir_iadd(b, nir_imul(b, iv, index),
+                               nir_imul(b, index, iv));
+         x = nir_iadd(b, x, nir_imul_imm(b, nir_imm_int(b, l), 3));
+
+         nir_push_if(b, nir_ieq_imm(b, nir_iand_imm(b, iv, 1), 0));
+         {
+            nir_store_var(b, acc, nir_iadd(b, a, x), 1);
+         }
+         nir_push_else(b, NULL);
+         {
+            nir_store_var(b, acc, nir_isub(b, a, nir_ishl_imm(b, x, 1)), 1);
+         }
+         nir_pop_if(b, NULL);
+
+         nir_store_var(b, i, nir_iadd_imm(b, iv, 1), 1);
+      }
+      nir_pop_loop(b, loop);
+   }
+
+   nir_def *addr = nir_u2u64(b, nir_imul_imm(b, index, 4));
+   nir_store_global(b, addr, 4, nir_load_var(b, acc), 0x1);
+}
+
+/* A local array filled with constants and partial sums, read back with
+ * direct and indirect indices, so that the loop has variables to promote and
+ * copies, dead stores and constant expressions to clean up.
+ */
+void
+nir_loop_pass_test::build_array(unsigned length, unsigned stride)
+{
+   nir_def *index = nir_load_local_invocation_index(b);
+   nir_variable *arr =
+      nir_local_variable_create(b->impl,
+                                glsl_array_type(glsl_uint_type(), length, 4),
+                                "arr");
+   nir_variable *sum = nir_local_variable_create(b->impl, glsl_uint_type(),
+                                                 "sum");
+
+   nir_store_var(b, sum, nir_imm_int(b, 0), 1);
+
+   for (unsigned k = 0; k < length; k++) {
+      nir_deref_instr *elem =
+         nir_build_deref_array_imm(b, nir_build_deref_var(b, arr), k);
+      nir_def *value = nir_imul_imm(b, nir_imm_int(b, k + 1), stride);
+
+      /* Overwritten by the next store: dead. */
+      nir_store_deref(b, elem, index, 1);
+      nir_store_deref(b, elem, nir_iadd(b, value, nir_load_var(b, sum)), 1);
+      nir_store_var(b, sum, nir_iadd_imm(b, nir_load_var(b, sum), k), 1);
+   }
+
+   nir_def *total = nir_load_var(b, sum);
+   for (unsigned k = 0; k < length; k += stride) {
+      nir_deref_instr *elem =
+         nir_build_deref_array_imm(b, nir_build_deref_var(b, arr), k);
+      total = nir_iadd(b, total, nir_load_deref(b, elem));
+   }
+
+   nir_deref_instr *indirect =
+      nir_build_deref_array(b, nir_build_deref_var(b, arr),
+                            nir_umod_imm(b, index, length));
+   total = nir_iadd(b, total, nir_load_deref(b, indirect));
+
+   nir_def *addr = nir_u2u64(b, nir_imul_imm(b, index, 4));
+   nir_store_global(b, addr, 4, total, 0x1);
+}
+
+/* Nested branches on bits of the invocation index, some of them constant,
+ * with selects of constants, duplicated expressions and undefined values,
+ * so that the control-flow passes have ifs to flatten, fold and remove.
+ */
+void
+nir_loop_pass_test::build_branches(unsigned depth, unsigned mask)
+{
+   nir_def *index = nir_load_local_invocation_index(b);
+   nir_variable *result = nir_local_variable_create(b->impl, glsl_uint_type(),
+                                                    "result");
+
+   nir_store_var(b, result, index, 1);
+
+   for (unsigned d = 0; d < depth; d++) {
+      nir_def *cond = (mask >> d) & 1 ?
+         nir_ine_imm(b, nir_iand_imm(b, index, 1u << d), 0) :
+         nir_ieq_imm(b, nir_imm_int(b, d), d + 1);
+      nir_def *r = nir_load_var(b, result);
+
+      nir_push_if(b, cond);
+      {
+         nir_store_var(b, result,
+                       nir_iadd(b, r, nir_iadd_imm(b, index, d)), 1);
+      }
+      nir_push_else(b, NULL);
+      {
+         nir_def *v = d % 3 == 2 ? nir_undef(b, 1, 32) : nir_imm_int(b, d);
+         nir_store_var(b, result,
+                       nir_iadd(b, r, nir_iadd_imm(b, index, d)), 1);
+         nir_store_var(b, result, nir_ixor(b, nir_load_var(b, result), v),
+                       1);
+      }
+   }
+
+   for (unsigned d = 0; d < depth; d++)
+      nir_pop_if(b, NULL);
+
+   nir_def *addr = nir_u2u64(b, nir_imul_imm(b, index, 4));
+   nir_store_global(b, addr, 4, nir_load_var(b, result), 0x1);
+}
+
+void
+nir_loop_pass_test::build_shader(enum shape shape, unsigned size,
+                                 unsigned param)
+{
+   nir_shader *shader = b->shader;
+
+   /* Start from a fresh shader every time. */
+   _b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, &options,
+                                       "nir_loop_pass_test");
+   b = &_b;
+   ralloc_free(shader);
+
+   switch (shape) {
+   case SHAPE_LOOPS:
+      build_loops(size, param);
+      break;
+   case SHAPE_ARRAY:
+      build_array(size * 4, param % 3 + 1);
+      break;
+   case SHAPE_BRANCHES:
+      build_branches(size + 1, param);
+      break;
+   default:
+      unreachable("invalid shape");
+   }
+}
+
+/* The pass list of both loops, so that they can't diverge. LOOP_PASS is
+ * invoked for idempotent passes and LOOP_PASS_NOT_IDEMPOTENT for the others.
+ */
+#define OPTIMIZE_PASSES(LOOP_PASS, LOOP_PASS_NOT_IDEMPOTENT)                 \
+   LOOP_PASS(nir_lower_vars_to_ssa);                                         \
+   LOOP_PASS(nir_copy_prop);                                                 \
+   LOOP_PASS(nir_opt_dce);                                                   \
+   LOOP_PASS(nir_opt_peephole_select, 8, true, true);                        \
+   LOOP_PASS_NOT_IDEMPOTENT(nir_opt_algebraic);                              \
+   LOOP_PASS(nir_opt_constant_folding);                                      \
+   LOOP_PASS(nir_opt_remove_phis);                                           \
+   LOOP_PASS_NOT_IDEMPOTENT(nir_opt_loop);                                   \
+   LOOP_PASS_NOT_IDEMPOTENT(nir_opt_if, nir_opt_if_optimize_phi_true_false); \
+   LOOP_PASS(nir_opt_dead_cf);                                               \
+   LOOP_PASS(nir_opt_cse);                                                   \
+   LOOP_PASS(nir_opt_undef);                                                 \
+   LOOP_PASS_NOT_IDEMPOTENT(nir_opt_loop_unroll)
+
+/* Both return the number of passes which were run. */
+static unsigned
+optimize(nir_shader *nir)
+{
+   unsigned runs = 0;
+   bool progress;
+
+#define RUN_PASS(pass, ...)                                 \
+   do {                                                     \
+      runs++;                                               \
+      NIR_PASS(progress, nir, pass, ##__VA_ARGS__);         \
+   } while (0)
+
+   do {
+      progress = false;
+      OPTIMIZE_PASSES(RUN_PASS, RUN_PASS);
+   } while (progress);
+
+#undef RUN_PASS
+
+   return runs;
+}
+
+static unsigned
+optimize_with_skip(nir_shader *nir)
+{
+   struct set *skip = _mesa_pointer_set_create(NULL);
+   unsigned runs = 0;
+   bool progress;
+
+#define COUNT_RUN(pass) \
+   runs += !_mesa_set_search(skip, (const void *)(uintptr_t)&pass)
+#define RUN_PASS(pass, ...)                                          \
+   do {                                                              \
+      COUNT_RUN(pass);                                               \
+      NIR_LOOP_PASS(progress, skip, nir, pass, ##__VA_ARGS__);       \
+   } while (0)
+#define RUN_PASS_NOT_IDEMPOTENT(pass, ...)                           \
+   do {                                                              \
+      COUNT_RUN(pass);                                               \
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, pass,        \
+                                   ##__VA_ARGS__);                   \
+   } while (0)
+
+   do {
+      progress = false;
+      OPTIMIZE_PASSES(RUN_PASS, RUN_PASS_NOT_IDEMPOTENT);
+   } while (progress);
+
+#undef RUN_PASS_NOT_IDEMPOTENT
+#undef RUN_PASS
+#undef COUNT_RUN
+
+   _mesa_set_destroy(skip, NULL);
+   return runs;
+}
+
+/* Runs both loops over a corpus of generated shaders of every shape and
+ * several sizes, checks that they produce the same shaders, and reports how
+ * many passes each ran and how long they took.
+ */
+TEST_F(nir_loop_pass_test, same_output)
+{
+   unsigned runs = 0, runs_with_skip = 0;
+   int64_t time = 0, time_with_skip = 0;
+
+   for (unsigned shape = 0; shape < NUM_SHAPES; shape++) {
+      for (unsigned size = 1; size <= 4; size++) {
+         for (unsigned param = 1; param <= 40; param += 13) {
+            build_shader((enum shape)shape, size, param);
+
+            nir_shader *clone = nir_shader_clone(NULL, b->shader);
+
+            int64_t start = os_time_get_nano();
+            runs += optimize(b->shader);
+            int64_t mid = os_time_get_nano();
+            runs_with_skip += optimize_with_skip(clone);
+            time += mid - start;
+            time_with_skip += os_time_get_nano() - mid;
+
+            /* Skipped passes may leave holes in the SSA numbering. */
+            nir_index_ssa_defs(nir_shader_get_entrypoint(b->shader));
+            nir_index_ssa_defs(nir_shader_get_entrypoint(clone));
+
+            char *expected = nir_shader_as_str(b->shader, NULL);
+            char *got = nir_shader_as_str(clone, NULL);
+            EXPECT_STREQ(expected, got)
+               << shape_names[shape] << ", size " << size
+               << ", param " << param;
+
+            ralloc_free(expected);
+            ralloc_free(got);
+            ralloc_free(clone);
+         }
+      }
+   }
+
+   EXPECT_LT(runs_with_skip, runs);
+
+   printf("NIR_PASS: %u passes, %.2f ms\n", runs, time / 1e6);
+   printf("NIR_LOOP_PASS: %u passes, %.2f ms\n", runs_with_skip,
+          time_with_skip / 1e6);
+}
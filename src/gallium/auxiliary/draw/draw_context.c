@@ -34,6 +34,7 @@
 #include "pipe/p_context.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_inlines.h"
 #include "util/u_helpers.h"
 #include "util/u_prim.h"
@@ -151,6 +152,8 @@ draw_init(struct draw_context *draw)
    draw->pt.user.planes = (float (*) [DRAW_TOTAL_CLIP_PLANES][4]) &(draw->plane[0]);
    draw->pt.user.eltMax = ~0;
 
+   draw->vs_threads = MIN2(util_get_cpu_caps()->nr_cpus, 4) - 1;
+
    if (!draw_pipeline_init(draw))
       return false;
 
@@ -1311,3 +1314,14 @@ draw_set_constant_buffer_stride(struct draw_context *draw, unsigned num_bytes)
 {
    draw->constant_buffer_stride = num_bytes;
 }
+
+
+/**
+ * Set how many extra threads may fetch and shade the vertices of large
+ * draws.  Must be called before the first draw.
+ */
+void
+draw_set_vs_threads(struct draw_context *draw, unsigned num_threads)
+{
+   draw->vs_threads = num_threads;
+}
@@ -181,6 +181,9 @@ struct draw_context
       uint8_t vertices_per_patch;
       bool rebind_parameters;
 
+      /** bumped for every instance drawn, invalidates cached vertices */
+      unsigned draw_serial;
+
       unsigned opt;     /**< bitmask of PT_x flags */
       unsigned eltSize; /* saved eltSize for flushing */
       unsigned viewid; /* saved viewid for flushing */
@@ -368,6 +371,7 @@ struct draw_context
    unsigned start_instance;
    unsigned start_index;
    unsigned constant_buffer_stride;
+   unsigned vs_threads;  /**< extra threads for shading large draws */
    struct draw_llvm *llvm;
 
    /** Texture sampler and sampler view state.
@@ -485,6 +485,7 @@ draw_instances(struct draw_context *draw,
       }
 
       draw->pt.user.drawid = drawid_offset;
+      draw->pt.draw_serial++;
       draw_new_instance(draw);
 
       if (info->primitive_restart) {
@@ -25,9 +25,11 @@
  *
  **************************************************************************/
 
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -41,6 +43,64 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/*
+ * Draws with at least twice this many vertices get their vertices fetched
+ * and shaded in chunks, in parallel on the vertex shading threads.  This
+ * is well below the vsplit segment size so that the vertex cache misses of
+ * indexed draws get split too.
+ */
+#define LLVM_VS_MIN_CHUNK_SIZE 256
+#define LLVM_VS_MAX_THREADS 8
+
+/*
+ * Post-transform vertex cache for indexed draws, direct mapped on the fetch
+ * index.  Unlike the vsplit fetch cache it survives the segments a draw is
+ * split into.
+ */
+#define LLVM_VCACHE_SIZE 2048
+#define LLVM_VCACHE_MAX_FETCH 4096
+
+DEBUG_GET_ONCE_BOOL_OPTION(draw_no_vcache, "DRAW_NO_VCACHE", false)
+
+
+struct llvm_middle_end;
+
+struct llvm_vcache {
+   uint8_t *verts;
+   unsigned vertex_size;
+
+   /* the cached vertices are only valid for this draw state */
+   unsigned draw_serial;
+   unsigned drawid;
+   int elt_bias;
+   const struct draw_llvm_variant *variant;
+
+   unsigned tags[LLVM_VCACHE_SIZE];
+   /* whether the batch that shaded the vertex was clipped */
+   bool clipped[LLVM_VCACHE_SIZE];
+
+   /* misses of the batch being shaded */
+   unsigned miss_elts[LLVM_VCACHE_MAX_FETCH];
+   uint16_t miss_pos[LLVM_VCACHE_MAX_FETCH];
+
+   /* statistics, printed with GALLIVM_PERF=perf */
+   uint64_t num_indices;
+   uint64_t num_fetches;
+   uint64_t num_shaded;
+   uint64_t num_prims;
+};
+
+struct llvm_vs_chunk {
+   struct util_queue_fence fence;
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start;
+   const unsigned *elts;
+   bool clipped;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,6 +118,14 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   bool vs_threads_init;
+   unsigned num_vs_threads;
+   struct util_queue vs_queue;
+   struct llvm_vs_chunk vs_chunks[LLVM_VS_MAX_THREADS];
+
+   bool use_vcache;
+   struct llvm_vcache *vcache;
 };
 
 
@@ -393,6 +461,12 @@ llvm_middle_end_prepare(struct draw_pt_middle_end *middle,
       fpme->current_variant = variant;
    }
 
+   /* Shading a vertex once per index is only observable with side effects,
+    * which GL and Vulkan leave undefined for repeated indices anyway, but
+    * don't skip invocations of shaders writing memory.
+    */
+   fpme->use_vcache = fpme->vcache && !vs->info.writes_memory;
+
    if (gs) {
       llvm_middle_end_prepare_gs(fpme);
    }
@@ -491,6 +565,229 @@ emit(struct pt_emit *emit,
 }
 
 
+static bool
+llvm_run_vs(struct llvm_middle_end *fpme,
+            struct vertex_header *verts,
+            unsigned count,
+            unsigned start,
+            const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+   const unsigned vertex_id_offset =
+      elts ? draw->pt.user.eltBias : draw->start_index;
+
+   return fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
+                                          &fpme->llvm->jit_resources[PIPE_SHADER_VERTEX],
+                                          verts,
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vertex_id_offset,
+                                          draw->start_instance,
+                                          elts,
+                                          draw->pt.user.drawid,
+                                          draw->pt.user.viewid);
+}
+
+
+static void
+llvm_vs_chunk_execute(void *data, void *gdata, int thread_index)
+{
+   struct llvm_vs_chunk *chunk = (struct llvm_vs_chunk *)data;
+
+   chunk->clipped = llvm_run_vs(chunk->fpme, chunk->verts, chunk->count,
+                                chunk->start, chunk->elts);
+}
+
+
+/**
+ * Start the vertex shading threads on first use, so that the driver can
+ * size them with draw_set_vs_threads() after creating the draw context.
+ */
+static unsigned
+llvm_get_vs_threads(struct llvm_middle_end *fpme)
+{
+   if (fpme->vs_threads_init)
+      return fpme->num_vs_threads;
+
+   fpme->vs_threads_init = true;
+   fpme->num_vs_threads =
+      MIN2(debug_get_num_option("DRAW_VS_THREADS", fpme->draw->vs_threads),
+           LLVM_VS_MAX_THREADS);
+   if (fpme->num_vs_threads &&
+       !util_queue_init(&fpme->vs_queue, "drawvs", LLVM_VS_MAX_THREADS,
+                        fpme->num_vs_threads,
+                        UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY, NULL))
+      fpme->num_vs_threads = 0;
+   for (unsigned i = 0; i < fpme->num_vs_threads; i++)
+      util_queue_fence_init(&fpme->vs_chunks[i].fence);
+
+   return fpme->num_vs_threads;
+}
+
+
+/**
+ * Fetch and shade the vertices, splitting large draws into chunks which are
+ * shaded in parallel.  The chunks are multiples of the shader's vector
+ * length, so that they don't write each other's vertices, and the vertices
+ * end up in the same order as when shaded at once.
+ */
+static bool
+llvm_fetch_shade(struct llvm_middle_end *fpme,
+                 const struct draw_fetch_info *fetch_info,
+                 struct vertex_header *verts)
+{
+   struct draw_context *draw = fpme->draw;
+   const unsigned count = fetch_info->count;
+   const unsigned *elts = fetch_info->linear ? NULL : fetch_info->elts;
+   const unsigned start = fetch_info->linear ?
+      fetch_info->start : draw->pt.user.eltMax;
+   const unsigned num_chunks = count < 2 * LLVM_VS_MIN_CHUNK_SIZE ? 1 :
+      MIN2(count / LLVM_VS_MIN_CHUNK_SIZE, llvm_get_vs_threads(fpme) + 1);
+
+   if (num_chunks < 2)
+      return llvm_run_vs(fpme, verts, count, start, elts);
+
+   const unsigned chunk_size =
+      align(DIV_ROUND_UP(count, num_chunks), lp_native_vector_width / 32);
+   unsigned first = chunk_size;
+   unsigned i;
+
+   for (i = 0; i < num_chunks - 1 && first < count; i++) {
+      struct llvm_vs_chunk *chunk = &fpme->vs_chunks[i];
+
+      chunk->fpme = fpme;
+      chunk->verts = (struct vertex_header *)
+         ((uint8_t *)verts + first * fpme->vertex_size);
+      chunk->count = MIN2(chunk_size, count - first);
+      chunk->start = elts ? start : start + first;
+      chunk->elts = elts ? elts + first : NULL;
+      util_queue_add_job(&fpme->vs_queue, chunk, &chunk->fence,
+                         llvm_vs_chunk_execute, NULL, 0);
+      first += chunk_size;
+   }
+
+   /* The first chunk is shaded here while waiting. */
+   bool clipped = llvm_run_vs(fpme, verts, chunk_size, start, elts);
+
+   while (i--) {
+      util_queue_fence_wait(&fpme->vs_chunks[i].fence);
+      clipped |= fpme->vs_chunks[i].clipped;
+   }
+
+   return clipped;
+}
+
+
+/**
+ * Fetch and shade the vertices of an indexed batch, only running the shader
+ * for vertices not found in the post-transform cache.
+ *
+ * The misses are shaded into the start of the vertex buffer and moved to
+ * their place from the back, which is safe since the i-th miss never lands
+ * before position i.  Hits are copied from the cache before the new vertices
+ * are added to it, because a miss may evict an entry hit by the same batch.
+ */
+static bool
+llvm_fetch_shade_cached(struct llvm_middle_end *fpme,
+                        const struct draw_fetch_info *fetch_info,
+                        struct vertex_header *verts,
+                        unsigned *num_shaded)
+{
+   struct draw_context *draw = fpme->draw;
+   struct llvm_vcache *vcache = fpme->vcache;
+   const unsigned vertex_size = fpme->vertex_size;
+   const unsigned count = fetch_info->count;
+   uint8_t *dst = (uint8_t *)verts;
+
+   if (vcache->draw_serial != draw->pt.draw_serial ||
+       vcache->drawid != draw->pt.user.drawid ||
+       vcache->elt_bias != draw->pt.user.eltBias ||
+       vcache->variant != fpme->current_variant ||
+       vcache->vertex_size != vertex_size) {
+      if (vcache->vertex_size < vertex_size) {
+         FREE(vcache->verts);
+         vcache->verts = MALLOC(LLVM_VCACHE_SIZE * vertex_size);
+         if (!vcache->verts) {
+            vcache->vertex_size = 0;
+            *num_shaded = count;
+            return llvm_fetch_shade(fpme, fetch_info, verts);
+         }
+      }
+      vcache->vertex_size = vertex_size;
+      vcache->draw_serial = draw->pt.draw_serial;
+      vcache->drawid = draw->pt.user.drawid;
+      vcache->elt_bias = draw->pt.user.eltBias;
+      vcache->variant = fpme->current_variant;
+      /* DRAW_MAX_FETCH_IDX is never cached, so it marks empty entries */
+      memset(vcache->tags, 0xff, sizeof(vcache->tags));
+   }
+
+   bool clipped = false;
+   unsigned num_misses = 0;
+
+   for (unsigned i = 0; i < count; i++) {
+      const unsigned elt = fetch_info->elts[i];
+      const unsigned slot = elt % LLVM_VCACHE_SIZE;
+
+      if (elt == DRAW_MAX_FETCH_IDX || vcache->tags[slot] != elt) {
+         vcache->miss_elts[num_misses] = elt;
+         vcache->miss_pos[num_misses++] = i;
+      }
+   }
+
+   *num_shaded = num_misses;
+
+   if (num_misses) {
+      struct draw_fetch_info miss_info = *fetch_info;
+
+      miss_info.elts = vcache->miss_elts;
+      miss_info.count = num_misses;
+      clipped = llvm_fetch_shade(fpme, &miss_info, verts);
+
+      for (unsigned j = num_misses; j--; ) {
+         const unsigned i = vcache->miss_pos[j];
+         if (i != j)
+            memcpy(dst + i * vertex_size, dst + j * vertex_size, vertex_size);
+      }
+   }
+
+   if (num_misses < count) {
+      unsigned j = 0;
+
+      for (unsigned i = 0; i < count; i++) {
+         if (j < num_misses && vcache->miss_pos[j] == i) {
+            j++;
+            continue;
+         }
+
+         const unsigned slot = fetch_info->elts[i] % LLVM_VCACHE_SIZE;
+         memcpy(dst + i * vertex_size,
+                vcache->verts + slot * vertex_size, vertex_size);
+         clipped |= vcache->clipped[slot];
+      }
+   }
+
+   for (unsigned j = 0; j < num_misses; j++) {
+      const unsigned elt = vcache->miss_elts[j];
+      const unsigned slot = elt % LLVM_VCACHE_SIZE;
+
+      if (elt == DRAW_MAX_FETCH_IDX)
+         continue;
+
+      memcpy(vcache->verts + slot * vertex_size,
+             dst + vcache->miss_pos[j] * vertex_size, vertex_size);
+      vcache->tags[slot] = elt;
+      vcache->clipped[slot] = clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -515,6 +812,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    unsigned opt = fpme->opt;
    bool clipped = 0;
    uint16_t *tes_elts_out = NULL;
+   unsigned num_shaded = fetch_info->count;
 
    assert(fetch_info->count > 0);
 
@@ -530,6 +828,23 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       return;
    }
 
+   /* Run vertex fetch shader */
+   if (!fetch_info->linear && fpme->use_vcache &&
+       fetch_info->count <= LLVM_VCACHE_MAX_FETCH) {
+      struct llvm_vcache *vcache = fpme->vcache;
+
+      clipped = llvm_fetch_shade_cached(fpme, fetch_info,
+                                        llvm_vert_info.verts, &num_shaded);
+
+      vcache->num_indices += prim_info->count;
+      vcache->num_fetches += fetch_info->count;
+      vcache->num_shaded += num_shaded;
+      vcache->num_prims +=
+         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
+   } else {
+      clipped = llvm_fetch_shade(fpme, fetch_info, llvm_vert_info.verts);
+   }
+
    if (draw->collect_statistics) {
       draw->statistics.ia_vertices += prim_info->count;
       if (prim_info->prim == MESA_PRIM_PATCHES)
@@ -538,42 +853,12 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       else
          draw->statistics.ia_primitives +=
             u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
+      draw->statistics.vs_invocations += num_shaded;
    }
 
-   {
-      unsigned start, vertex_id_offset;
-      const unsigned *elts;
-
-      if (fetch_info->linear) {
-         start = fetch_info->start;
-         vertex_id_offset = draw->start_index;
-         elts = NULL;
-      } else {
-         start = draw->pt.user.eltMax;
-         vertex_id_offset = draw->pt.user.eltBias;
-         elts = fetch_info->elts;
-      }
-      /* Run vertex fetch shader */
-      clipped = fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
-                                                &fpme->llvm->jit_resources[PIPE_SHADER_VERTEX],
-                                                llvm_vert_info.verts,
-                                                draw->pt.user.vbuffer,
-                                                fetch_info->count,
-                                                start,
-                                                fpme->vertex_size,
-                                                draw->pt.vertex_buffer,
-                                                draw->instance_id,
-                                                vertex_id_offset,
-                                                draw->start_instance,
-                                                elts,
-                                                draw->pt.user.drawid,
-                                                draw->pt.user.viewid);
-
-      /* Finished with fetch and vs */
-      fetch_info = NULL;
-      vert_info = &llvm_vert_info;
-   }
+   /* Finished with fetch and vs */
+   fetch_info = NULL;
+   vert_info = &llvm_vert_info;
 
    if (opt & PT_SHADE) {
       struct draw_vertex_shader *vshader = draw->vs.vertex_shader;
@@ -829,6 +1114,28 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   if (fpme->vcache) {
+      struct llvm_vcache *vcache = fpme->vcache;
+
+      if ((gallivm_debug & GALLIVM_DEBUG_PERF) && vcache->num_prims) {
+         debug_printf("draw: vertex cache: %" PRIu64 " indices, %" PRIu64
+                      " fetches, %" PRIu64 " shaded, ACMR %.3f, hit rate %.1f%%\n",
+                      vcache->num_indices, vcache->num_fetches,
+                      vcache->num_shaded,
+                      (double)vcache->num_shaded / vcache->num_prims,
+                      100.0 * (vcache->num_fetches - vcache->num_shaded) /
+                      vcache->num_fetches);
+      }
+      FREE(vcache->verts);
+      FREE(vcache);
+   }
+
+   if (fpme->num_vs_threads) {
+      util_queue_destroy(&fpme->vs_queue);
+      for (unsigned i = 0; i < fpme->num_vs_threads; i++)
+         util_queue_fence_destroy(&fpme->vs_chunks[i].fence);
+   }
+
    if (fpme->fetch)
       draw_pt_fetch_destroy(fpme->fetch);
 
@@ -889,6 +1196,9 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   if (!debug_get_option_draw_no_vcache())
+      fpme->vcache = CALLOC_STRUCT(llvm_vcache);
+
    return &fpme->base;
 
  fail:
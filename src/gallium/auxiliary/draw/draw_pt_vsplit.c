@@ -33,7 +33,7 @@
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
+#define SEGMENT_SIZE 4096
 #define MAP_SIZE     256
 
 struct vsplit_frontend {
@@ -213,12 +213,21 @@ gallivm_free_ir(struct gallivm_state *gallivm)
 #endif
 #endif
 
+#if GALLIVM_USE_ORCJIT
+   /* The JIT only got an object file, the module is still ours */
+   if (gallivm->module)
+      LLVMDisposeModule(gallivm->module);
+
+   if (gallivm->tm)
+      LLVMDisposeTargetMachine(gallivm->tm);
+#else
    if (gallivm->engine) {
       /* This will already destroy any associated module */
       LLVMDisposeExecutionEngine(gallivm->engine);
    } else if (gallivm->module) {
       LLVMDisposeModule(gallivm->module);
    }
+#endif
 
    if (gallivm->cache) {
       lp_free_objcache(gallivm->cache->jit_obj_cache);
@@ -235,7 +244,11 @@ gallivm_free_ir(struct gallivm_state *gallivm)
 
    /* The LLVMContext should be owned by the parent of gallivm. */
 
+#if GALLIVM_USE_ORCJIT
+   gallivm->tm = NULL;
+#else
    gallivm->engine = NULL;
+#endif
    gallivm->target = NULL;
    gallivm->module = NULL;
    gallivm->module_name = NULL;
@@ -258,12 +271,52 @@ static void
 gallivm_free_code(struct gallivm_state *gallivm)
 {
    assert(!gallivm->module);
+#if GALLIVM_USE_ORCJIT
+   lp_jit_dylib_destroy(gallivm->jd);
+   gallivm->jd = NULL;
+#else
    assert(!gallivm->engine);
    lp_free_generated_code(gallivm->code);
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
    gallivm->memorymgr = NULL;
+#endif
+}
+
+
+#if GALLIVM_USE_ORCJIT
+/**
+ * Create the module's JITDylib in the ORC session.  The target machine is
+ * only needed to generate code, so it isn't created if the module's object
+ * code comes from the cache.
+ */
+static int
+init_gallivm_jit(struct gallivm_state *gallivm, unsigned optlevel,
+                 char **error)
+{
+   gallivm->jd = lp_jit_dylib_create(gallivm->module_name, error);
+   if (!gallivm->jd)
+      return 1;
+
+   if (gallivm->cache && gallivm->cache->data_size)
+      return 0;
+
+   gallivm->tm = lp_create_jit_target_machine(optlevel, error);
+   if (!gallivm->tm)
+      return 1;
+
+   /* The optimization passes need the real data layout, as with MCJIT */
+   LLVMTargetDataRef target = LLVMCreateTargetDataLayout(gallivm->tm);
+   LLVMSetModuleDataLayout(gallivm->module, target);
+   LLVMDisposeTargetData(target);
+
+   char *triple = LLVMGetTargetMachineTriple(gallivm->tm);
+   LLVMSetTarget(gallivm->module, triple);
+   LLVMDisposeMessage(triple);
+
+   return 0;
 }
+#endif
 
 
 static bool
@@ -281,6 +334,9 @@ init_gallivm_engine(struct gallivm_state *gallivm)
          optlevel = Default;
       }
 
+#if GALLIVM_USE_ORCJIT
+      ret = init_gallivm_jit(gallivm, (unsigned) optlevel, &error);
+#else
       ret = lp_build_create_jit_compiler_for_module(&gallivm->engine,
                                                     &gallivm->code,
                                                     gallivm->cache,
@@ -288,6 +344,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     &error);
+#endif
       if (ret) {
          _debug_printf("%s\n", error);
          LLVMDisposeMessage(error);
@@ -295,6 +352,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       }
    }
 
+#if !GALLIVM_USE_ORCJIT
    if (0) {
        /*
         * Dump the data layout strings.
@@ -315,6 +373,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
        free(data_layout);
        free(engine_data_layout);
    }
+#endif
 
    return true;
 
@@ -364,9 +423,11 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    if (!gallivm->builder)
       goto fail;
 
+#if !GALLIVM_USE_ORCJIT
    gallivm->memorymgr = lp_get_default_memory_manager();
    if (!gallivm->memorymgr)
       goto fail;
+#endif
 
    /* FIXME: MC-JIT only allows compiling one module at a time, and it must be
     * complete when MC-JIT is created. So defer the MC-JIT engine creation for
@@ -445,7 +506,9 @@ lp_build_init(void)
     * component is linked at buildtime, which is sufficient for its static
     * constructors to be called at load time.
     */
+#if !GALLIVM_USE_ORCJIT
    LLVMLinkInMCJIT();
+#endif
 
    gallivm_debug = debug_get_option_gallivm_debug();
 
@@ -549,6 +612,34 @@ void lp_init_clock_hook(struct gallivm_state *gallivm)
    gallivm->get_time_hook = LLVMAddFunction(gallivm->module, "get_time_hook", get_time_type);
 }
 
+/**
+ * Map a global the module declares to an address in this process.
+ */
+void
+gallivm_add_global_mapping(struct gallivm_state *gallivm,
+                           LLVMValueRef global, void *addr)
+{
+#if GALLIVM_USE_ORCJIT
+   lp_jit_dylib_add_symbol(gallivm->jd, LLVMGetValueName(global), addr);
+#else
+   LLVMAddGlobalMapping(gallivm->engine, global, addr);
+#endif
+}
+
+
+static void *
+get_function_code(struct gallivm_state *gallivm, LLVMValueRef func)
+{
+#if GALLIVM_USE_ORCJIT
+   assert(gallivm->jd);
+   return lp_jit_dylib_lookup(gallivm->jd, LLVMGetValueName(func));
+#else
+   assert(gallivm->engine);
+   return LLVMGetPointerToGlobal(gallivm->engine, func);
+#endif
+}
+
+
 /**
  * Compile a module.
  * This does IR optimization on all functions in the module.
@@ -565,12 +656,13 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+#if !GALLIVM_USE_ORCJIT
    LLVMSetDataLayout(gallivm->module, "");
    assert(!gallivm->engine);
+#endif
    if (!init_gallivm_engine(gallivm)) {
       assert(0);
    }
-   assert(gallivm->engine);
 
    if (gallivm->cache && gallivm->cache->data_size) {
       goto skip_cached;
@@ -596,6 +688,11 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       time_begin = os_time_get();
 
 #if GALLIVM_USE_NEW_PASS == 1
+#if GALLIVM_USE_ORCJIT
+   LLVMTargetMachineRef tm = gallivm->tm;
+#else
+   LLVMTargetMachineRef tm = LLVMGetExecutionEngineTargetMachine(gallivm->engine);
+#endif
    char passes[1024];
    passes[0] = 0;
 
@@ -606,7 +703,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    strcpy(passes, "default<O0>");
 
    LLVMPassBuilderOptionsRef opts = LLVMCreatePassBuilderOptions();
-   LLVMRunPasses(gallivm->module, passes, LLVMGetExecutionEngineTargetMachine(gallivm->engine), opts);
+   LLVMRunPasses(gallivm->module, passes, tm, opts);
 
    if (!(gallivm_perf & GALLIVM_PERF_NO_OPT))
 #if LLVM_VERSION_MAJOR >= 18
@@ -617,7 +714,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    else
       strcpy(passes, "mem2reg");
 
-   LLVMRunPasses(gallivm->module, passes, LLVMGetExecutionEngineTargetMachine(gallivm->engine), opts);
+   LLVMRunPasses(gallivm->module, passes, tm, opts);
    LLVMDisposePassBuilderOptions(opts);
 #else
 #if GALLIVM_HAVE_CORO == 1
@@ -674,13 +771,26 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    ++gallivm->compiled;
 
    lp_init_printf_hook(gallivm);
-   LLVMAddGlobalMapping(gallivm->engine, gallivm->debug_printf_hook, debug_printf);
+   gallivm_add_global_mapping(gallivm, gallivm->debug_printf_hook, debug_printf);
 
    lp_init_clock_hook(gallivm);
-   LLVMAddGlobalMapping(gallivm->engine, gallivm->get_time_hook, os_time_get_nano);
+   gallivm_add_global_mapping(gallivm, gallivm->get_time_hook, os_time_get_nano);
 
    lp_build_coro_add_malloc_hooks(gallivm);
 
+#if GALLIVM_USE_ORCJIT
+   /* Unlike MCJIT, the module isn't compiled lazily, so it must be complete
+    * by now.  Cached object code is linked as is.
+    */
+   char *error = NULL;
+   if (lp_jit_dylib_add_module(gallivm->jd, gallivm->module, gallivm->tm,
+                               gallivm->cache, &error)) {
+      _debug_printf("%s\n", error);
+      LLVMDisposeMessage(error);
+      assert(0);
+   }
+#endif
+
    if (gallivm_debug & GALLIVM_DEBUG_ASM) {
       LLVMValueRef llvm_func = LLVMGetFirstFunction(gallivm->module);
 
@@ -691,8 +801,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
           * LLVMGetPointerToGlobal() will abort otherwise.
           */
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
-            lp_disassemble(llvm_func, func_code);
+            void *func_code = get_function_code(gallivm, llvm_func);
+            if (func_code)
+               lp_disassemble(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
       }
@@ -704,8 +815,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
       while (llvm_func) {
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
-            lp_profile(llvm_func, func_code);
+            void *func_code = get_function_code(gallivm, llvm_func);
+            if (func_code)
+               lp_profile(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
       }
@@ -724,12 +836,11 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    int64_t time_begin = 0;
 
    assert(gallivm->compiled);
-   assert(gallivm->engine);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   code = get_function_code(gallivm, func);
    assert(code);
    jit_func = pointer_to_func(code);
 
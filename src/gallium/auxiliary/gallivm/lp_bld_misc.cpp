@@ -88,6 +88,15 @@
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
 
+#if GALLIVM_USE_ORCJIT
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+
+#include "util/u_atomic.h"
+#endif
+
 static void lp_run_atexit_for_destructors(void);
 
 namespace {
@@ -321,69 +330,15 @@ public:
 };
 
 /**
- * Same as LLVMCreateJITCompilerForModule, but:
- * - allows using MCJIT and enabling AVX feature where available.
- * - set target options
- *
- * See also:
- * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
- * - llvm/tools/lli/lli.cpp
- * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ * Get the target features and CPU to generate code for, from the detected
+ * CPU caps.
  */
-extern "C"
-LLVMBool
-lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
-                                        lp_generated_code **OutCode,
-                                        struct lp_cached_code *cache_out,
-                                        LLVMModuleRef M,
-                                        LLVMMCJITMemoryManagerRef CMM,
-                                        unsigned OptLevel,
-                                        char **OutError)
+static void
+lp_get_target_features(llvm::SmallVectorImpl<std::string> &MAttrs,
+                       llvm::StringRef &MCPU)
 {
    using namespace llvm;
 
-   std::string Error;
-   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
-
-   /**
-    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
-    * friends for configuring code generation options, like stack alignment.
-    */
-   TargetOptions options;
-#if DETECT_ARCH_X86 && LLVM_VERSION_MAJOR < 13
-   options.StackAlignmentOverride = 4;
-#endif
-
-   builder.setEngineKind(EngineKind::JIT)
-          .setErrorStr(&Error)
-          .setTargetOptions(options)
-#if LLVM_VERSION_MAJOR >= 18
-          .setOptLevel((CodeGenOptLevel)OptLevel);
-#else
-          .setOptLevel((CodeGenOpt::Level)OptLevel);
-#endif
-
-#if DETECT_OS_WINDOWS
-    /*
-     * MCJIT works on Windows, but currently only through ELF object format.
-     *
-     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
-     * different strings for MinGW/MSVC, so better play it safe and be
-     * explicit.
-     */
-#  if DETECT_ARCH_X86_64
-    LLVMSetTarget(M, "x86_64-pc-win32-elf");
-#  elif DETECT_ARCH_X86
-    LLVMSetTarget(M, "i686-pc-win32-elf");
-#  elif DETECT_ARCH_AARCH64
-    LLVMSetTarget(M, "aarch64-pc-win32-elf");
-#  else
-#    error Unsupported architecture for MCJIT on Windows.
-#  endif
-#endif
-
-   llvm::SmallVector<std::string, 16> MAttrs;
-
 #if DETECT_ARCH_ARM
    /* llvm-3.3+ implements sys::getHostCPUFeatures for Arm,
     * which allows us to enable/disable code generation based
@@ -467,8 +422,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    MAttrs.push_back("+fp64");
 #endif
 
-   builder.setMAttrs(MAttrs);
-
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       int n = MAttrs.size();
       if (n > 0) {
@@ -479,7 +432,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       }
    }
 
-   StringRef MCPU = llvm::sys::getHostCPUName();
+   MCPU = llvm::sys::getHostCPUName();
    /*
     * The cpu bits are no longer set automatically, so need to set mcpu manually.
     * Note that the MAttrs set above will be sort of ignored (since we should
@@ -494,17 +447,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
     */
 
 #if DETECT_ARCH_PPC_64
-   /*
-    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
-    * of the Medium code model once dynamically generated JIT-compiled shader
-    * programs are linked in and relocated.  Yet the default code model as of
-    * LLVM 8 is Medium or even Small.
-    * The cost of changing from Medium to Large is negligible:
-    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
-    * - change an add-immediate (addis) instruction to a load (ld).
-    */
-   builder.setCodeModel(CodeModel::Large);
-
 #if UTIL_ARCH_LITTLE_ENDIAN
    /*
     * Versions of LLVM prior to 4.0 lacked a table entry for "POWER8NVL",
@@ -532,10 +474,93 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MCPU = util_get_cpu_caps()->has_msa ? "mips64r5" : "mips64r2";
 #endif
 
-   builder.setMCPU(MCPU);
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       debug_printf("llc -mcpu option: %s\n", MCPU.str().c_str());
    }
+}
+
+
+/**
+ * Same as LLVMCreateJITCompilerForModule, but:
+ * - allows using MCJIT and enabling AVX feature where available.
+ * - set target options
+ *
+ * See also:
+ * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
+ * - llvm/tools/lli/lli.cpp
+ * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ */
+extern "C"
+LLVMBool
+lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
+                                        lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
+                                        LLVMModuleRef M,
+                                        LLVMMCJITMemoryManagerRef CMM,
+                                        unsigned OptLevel,
+                                        char **OutError)
+{
+   using namespace llvm;
+
+   std::string Error;
+   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+
+   /**
+    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
+    * friends for configuring code generation options, like stack alignment.
+    */
+   TargetOptions options;
+#if DETECT_ARCH_X86 && LLVM_VERSION_MAJOR < 13
+   options.StackAlignmentOverride = 4;
+#endif
+
+   builder.setEngineKind(EngineKind::JIT)
+          .setErrorStr(&Error)
+          .setTargetOptions(options)
+#if LLVM_VERSION_MAJOR >= 18
+          .setOptLevel((CodeGenOptLevel)OptLevel);
+#else
+          .setOptLevel((CodeGenOpt::Level)OptLevel);
+#endif
+
+#if DETECT_OS_WINDOWS
+    /*
+     * MCJIT works on Windows, but currently only through ELF object format.
+     *
+     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
+     * different strings for MinGW/MSVC, so better play it safe and be
+     * explicit.
+     */
+#  if DETECT_ARCH_X86_64
+    LLVMSetTarget(M, "x86_64-pc-win32-elf");
+#  elif DETECT_ARCH_X86
+    LLVMSetTarget(M, "i686-pc-win32-elf");
+#  elif DETECT_ARCH_AARCH64
+    LLVMSetTarget(M, "aarch64-pc-win32-elf");
+#  else
+#    error Unsupported architecture for MCJIT on Windows.
+#  endif
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   StringRef MCPU;
+   lp_get_target_features(MAttrs, MCPU);
+
+   builder.setMAttrs(MAttrs);
+   builder.setMCPU(MCPU);
+
+#if DETECT_ARCH_PPC_64
+   /*
+    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
+    * of the Medium code model once dynamically generated JIT-compiled shader
+    * programs are linked in and relocated.  Yet the default code model as of
+    * LLVM 8 is Medium or even Small.
+    * The cost of changing from Medium to Large is negligible:
+    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
+    * - change an add-immediate (addis) instruction to a load (ld).
+    */
+   builder.setCodeModel(CodeModel::Large);
+#endif
 
    ShaderMemoryManager *MM = NULL;
    BaseMemoryManager* JMM = reinterpret_cast<BaseMemoryManager*>(CMM);
@@ -601,6 +626,219 @@ lp_free_objcache(void *objcache_ptr)
    delete objcache;
 }
 
+#if GALLIVM_USE_ORCJIT
+
+/*
+ * All gallivm modules are linked in one ORC session.  Each module gets its
+ * own JITDylib, so that modules can define the same symbols and their code
+ * can be freed independently.  They all link against the session's main
+ * JITDylib, which resolves symbols from the process.
+ *
+ * The session is never destroyed, see lp_run_atexit_for_destructors().
+ */
+static llvm::orc::LLJIT *lp_jit_session;
+static once_flag lp_jit_session_once_flag = ONCE_FLAG_INIT;
+static unsigned lp_jit_dylib_count;
+
+
+static llvm::orc::JITTargetMachineBuilder
+lp_jit_target_machine_builder(unsigned OptLevel)
+{
+   using namespace llvm;
+
+   Triple TT(sys::getProcessTriple());
+#if DETECT_OS_WINDOWS
+   /* See lp_build_create_jit_compiler_for_module() */
+   TT.setObjectFormat(Triple::ELF);
+#endif
+
+   SmallVector<std::string, 16> MAttrs;
+   StringRef MCPU;
+   lp_get_target_features(MAttrs, MCPU);
+
+   orc::JITTargetMachineBuilder JTMB(TT);
+   JTMB.setCPU(MCPU.str());
+   JTMB.addFeatures(std::vector<std::string>(MAttrs.begin(), MAttrs.end()));
+#if DETECT_ARCH_PPC_64
+   /* See lp_build_create_jit_compiler_for_module() */
+   JTMB.setCodeModel(CodeModel::Large);
+#endif
+#if LLVM_VERSION_MAJOR >= 18
+   JTMB.setCodeGenOptLevel((CodeGenOptLevel)OptLevel);
+#else
+   JTMB.setCodeGenOptLevel((CodeGenOpt::Level)OptLevel);
+#endif
+
+   return JTMB;
+}
+
+
+static void
+lp_jit_session_init(void)
+{
+   using namespace llvm;
+
+   auto JIT = orc::LLJITBuilder()
+      .setJITTargetMachineBuilder(lp_jit_target_machine_builder(2))
+      .create();
+   if (!JIT) {
+      _debug_printf("gallivm: creating the ORC JIT failed: %s\n",
+                    toString(JIT.takeError()).c_str());
+      return;
+   }
+
+   auto Generator = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*JIT)->getDataLayout().getGlobalPrefix());
+   if (!Generator) {
+      _debug_printf("gallivm: %s\n", toString(Generator.takeError()).c_str());
+      return;
+   }
+   (*JIT)->getMainJITDylib().addGenerator(std::move(*Generator));
+
+   lp_jit_session = JIT->release();
+}
+
+
+static inline llvm::orc::JITDylib *
+unwrap_jd(struct lp_jit_dylib *jd)
+{
+   return reinterpret_cast<llvm::orc::JITDylib *>(jd);
+}
+
+
+extern "C" LLVMTargetMachineRef
+lp_create_jit_target_machine(unsigned OptLevel, char **OutError)
+{
+   auto TM = lp_jit_target_machine_builder(OptLevel).createTargetMachine();
+   if (!TM) {
+      *OutError = strdup(llvm::toString(TM.takeError()).c_str());
+      return NULL;
+   }
+   return reinterpret_cast<LLVMTargetMachineRef>(TM->release());
+}
+
+
+extern "C" struct lp_jit_dylib *
+lp_jit_dylib_create(const char *name, char **OutError)
+{
+   call_once(&lp_jit_session_once_flag, lp_jit_session_init);
+   if (!lp_jit_session) {
+      *OutError = strdup("no ORC JIT session");
+      return NULL;
+   }
+
+   /* JITDylib names must be unique within the session */
+   std::string Name = std::string(name ? name : "gallivm") + "." +
+      std::to_string(p_atomic_inc_return(&lp_jit_dylib_count));
+
+   auto JD = lp_jit_session->createJITDylib(std::move(Name));
+   if (!JD) {
+      *OutError = strdup(llvm::toString(JD.takeError()).c_str());
+      return NULL;
+   }
+   JD->addToLinkOrder(lp_jit_session->getMainJITDylib());
+
+   return reinterpret_cast<struct lp_jit_dylib *>(&*JD);
+}
+
+
+extern "C" void
+lp_jit_dylib_destroy(struct lp_jit_dylib *jd)
+{
+   if (!jd)
+      return;
+
+   /* This frees the code, too */
+   llvm::Error Err =
+      lp_jit_session->getExecutionSession().removeJITDylib(*unwrap_jd(jd));
+   if (Err)
+      _debug_printf("gallivm: %s\n", llvm::toString(std::move(Err)).c_str());
+}
+
+
+/**
+ * Add the module's code to the JITDylib: generate it with the target
+ * machine and store it in the cache, or take it from the cache.
+ */
+extern "C" int
+lp_jit_dylib_add_module(struct lp_jit_dylib *jd, LLVMModuleRef M,
+                        LLVMTargetMachineRef TM,
+                        struct lp_cached_code *cache,
+                        char **OutError)
+{
+   using namespace llvm;
+
+   std::unique_ptr<MemoryBuffer> Obj;
+
+   if (cache && cache->data_size) {
+      Obj = MemoryBuffer::getMemBufferCopy(
+         StringRef((const char *)cache->data, cache->data_size));
+   } else {
+      orc::SimpleCompiler Compiler(*reinterpret_cast<TargetMachine *>(TM));
+      auto Compiled = Compiler(*unwrap(M));
+      if (!Compiled) {
+         *OutError = strdup(toString(Compiled.takeError()).c_str());
+         return 1;
+      }
+      Obj = std::move(*Compiled);
+
+      if (cache) {
+         cache->data_size = Obj->getBufferSize();
+         cache->data = malloc(cache->data_size);
+         memcpy(cache->data, Obj->getBufferStart(), cache->data_size);
+      }
+   }
+
+   if (Error Err = lp_jit_session->addObjectFile(*unwrap_jd(jd),
+                                                 std::move(Obj))) {
+      *OutError = strdup(toString(std::move(Err)).c_str());
+      return 1;
+   }
+
+   return 0;
+}
+
+
+extern "C" void
+lp_jit_dylib_add_symbol(struct lp_jit_dylib *jd, const char *name,
+                        void *addr)
+{
+   using namespace llvm;
+
+   orc::SymbolMap Symbols;
+#if LLVM_VERSION_MAJOR >= 17
+   Symbols[lp_jit_session->mangleAndIntern(name)] =
+      orc::ExecutorSymbolDef(orc::ExecutorAddr::fromPtr(addr),
+                             JITSymbolFlags::Exported);
+#else
+   Symbols[lp_jit_session->mangleAndIntern(name)] =
+      JITEvaluatedSymbol(pointerToJITTargetAddress(addr),
+                         JITSymbolFlags::Exported);
+#endif
+
+   if (Error Err = unwrap_jd(jd)->define(orc::absoluteSymbols(std::move(Symbols))))
+      _debug_printf("gallivm: %s\n", toString(std::move(Err)).c_str());
+}
+
+
+extern "C" void *
+lp_jit_dylib_lookup(struct lp_jit_dylib *jd, const char *name)
+{
+   auto Sym = lp_jit_session->lookup(*unwrap_jd(jd), name);
+   if (!Sym) {
+      _debug_printf("gallivm: %s\n", llvm::toString(Sym.takeError()).c_str());
+      return NULL;
+   }
+
+#if LLVM_VERSION_MAJOR >= 15
+   return Sym->toPtr<void *>();
+#else
+   return llvm::jitTargetAddressToPointer<void *>(Sym->getAddress());
+#endif
+}
+
+#endif /* GALLIVM_USE_ORCJIT */
+
 extern "C" LLVMValueRef
 lp_get_called_value(LLVMValueRef call)
 {
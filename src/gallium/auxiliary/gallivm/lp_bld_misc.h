@@ -34,6 +34,7 @@
 #include <llvm/Config/llvm-config.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
 
 
 #ifdef __cplusplus
@@ -77,6 +78,33 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
+#if GALLIVM_USE_ORCJIT
+/* A JITDylib of the process wide ORC session, holding one module's code */
+struct lp_jit_dylib;
+
+extern LLVMTargetMachineRef
+lp_create_jit_target_machine(unsigned OptLevel, char **OutError);
+
+extern struct lp_jit_dylib *
+lp_jit_dylib_create(const char *name, char **OutError);
+
+extern void
+lp_jit_dylib_destroy(struct lp_jit_dylib *jd);
+
+extern int
+lp_jit_dylib_add_module(struct lp_jit_dylib *jd, LLVMModuleRef M,
+                        LLVMTargetMachineRef TM,
+                        struct lp_cached_code *cache,
+                        char **OutError);
+
+extern void
+lp_jit_dylib_add_symbol(struct lp_jit_dylib *jd, const char *name,
+                        void *addr);
+
+extern void *
+lp_jit_dylib_lookup(struct lp_jit_dylib *jd, const char *name);
+#endif
+
 extern LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager();
 
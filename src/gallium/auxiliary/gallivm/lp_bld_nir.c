@@ -2968,14 +2968,16 @@ lp_build_opt_nir(struct nir_shader *nir)
 
    NIR_PASS_V(nir, nir_lower_flrp, 16|32|64, true);
    NIR_PASS_V(nir, nir_lower_fp16_casts, nir_lower_fp16_all | nir_lower_fp16_split_fp64);
+
+   struct set *skip = _mesa_pointer_set_create(NULL);
    do {
       progress = false;
-      NIR_PASS(progress, nir, nir_opt_constant_folding);
-      NIR_PASS(progress, nir, nir_opt_algebraic);
-      NIR_PASS(progress, nir, nir_lower_pack);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_constant_folding);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_algebraic);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_pack);
 
       nir_lower_tex_options options = { .lower_invalid_implicit_lod = true, };
-      NIR_PASS_V(nir, nir_lower_tex, &options);
+      NIR_LOOP_PASS(_, skip, nir, nir_lower_tex, &options);
 
       const nir_lower_subgroups_options subgroups_options = {
          .subgroup_size = lp_native_vector_width / 32,
@@ -2986,18 +2988,21 @@ lp_build_opt_nir(struct nir_shader *nir)
          .lower_relative_shuffle = true,
          .lower_inverse_ballot = true,
       };
-      NIR_PASS(progress, nir, nir_lower_subgroups, &subgroups_options);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_subgroups, &subgroups_options);
    } while (progress);
+   _mesa_set_destroy(skip, NULL);
 
+   skip = _mesa_pointer_set_create(NULL);
    do {
       progress = false;
-      NIR_PASS(progress, nir, nir_opt_algebraic_late);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_algebraic_late);
       if (progress) {
-         NIR_PASS_V(nir, nir_copy_prop);
-         NIR_PASS_V(nir, nir_opt_dce);
-         NIR_PASS_V(nir, nir_opt_cse);
+         NIR_LOOP_PASS(_, skip, nir, nir_copy_prop);
+         NIR_LOOP_PASS(_, skip, nir, nir_opt_dce);
+         NIR_LOOP_PASS(_, skip, nir, nir_opt_cse);
       }
    } while (progress);
+   _mesa_set_destroy(skip, NULL);
 
    if (nir_lower_bool_to_int32(nir)) {
       NIR_PASS_V(nir, nir_copy_prop);
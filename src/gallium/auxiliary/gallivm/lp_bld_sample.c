@@ -2141,16 +2141,73 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the partial offset of a coordinate along the x (axis 0) or y
+ * (axis 1) axis of a texture in the tiled layout.
+ *
+ * Tiled textures are stored in 4x4 texel micro-tiles, with the texels of
+ * a micro-tile in morton order and the micro-tiles of a row of them one
+ * after the other, so that the 2x2 footprint of bilinear filtering mostly
+ * falls into a single cache line. As width and height are padded to
+ * multiples of 4, the row stride stays the same as in the linear layout and
+ * the offset is still the sum of separate x and y offsets:
+ *
+ *   x_offset = ((x & ~3) * 4 + (x & 1) + ((x & 2) << 1)) * texel_bytes
+ *   y_offset = (y & ~3) * row_stride + (((y & 1) << 1) + ((y & 2) << 2)) * texel_bytes
+ *
+ * \param texel_bytes  size of a texel, the format must not be compressed
+ * \param stride       the row stride for axis 1, unused for axis 0
+ */
+void
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     unsigned texel_bytes,
+                                     unsigned axis,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef *out_offset)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   LLVMValueRef one = lp_build_const_int_vec(bld->gallivm, bld->type, 1);
+   LLVMValueRef two = lp_build_const_int_vec(bld->gallivm, bld->type, 2);
+   LLVMValueRef not_three = lp_build_const_int_vec(bld->gallivm, bld->type, ~3);
+   LLVMValueRef block, bit0, bit1, texel;
+
+   assert(axis < 2);
+
+   block = LLVMBuildAnd(builder, coord, not_three, "");
+   bit0 = LLVMBuildAnd(builder, coord, one, "");
+   bit1 = LLVMBuildAnd(builder, coord, two, "");
+
+   if (axis == 0) {
+      /* x bits go to bits 0 and 2 of the texel index within the tile */
+      bit1 = LLVMBuildShl(builder, bit1, one, "");
+      block = LLVMBuildShl(builder, block, two, "");
+      texel = LLVMBuildOr(builder, block, LLVMBuildOr(builder, bit0, bit1, ""), "");
+      *out_offset = lp_build_mul_imm(bld, texel, texel_bytes);
+   } else {
+      /* y bits go to bits 1 and 3 of the texel index within the tile */
+      bit0 = LLVMBuildShl(builder, bit0, one, "");
+      bit1 = LLVMBuildShl(builder, bit1, two, "");
+      texel = LLVMBuildOr(builder, bit0, bit1, "");
+      *out_offset = lp_build_add(bld, lp_build_mul(bld, block, stride),
+                                 lp_build_mul_imm(bld, texel, texel_bytes));
+   }
+}
+
+
 /**
  * Compute the offset of a pixel block.
  *
  * x, y, z, y_stride, z_stride are vectors, and they refer to pixels.
+ * If tiled is set, x and y are addressed in the tiled layout described in
+ * lp_build_sample_tiled_partial_offset().
  *
  * Returns the relative offset and i,j sub-block coordinates
  */
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       bool tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -2166,17 +2223,30 @@ lp_build_sample_offset(struct lp_build_context *bld,
    x_stride = lp_build_const_vec(bld->gallivm, bld->type,
                                  format_desc->block.bits/8);
 
-   lp_build_sample_partial_offset(bld,
-                                  format_desc->block.width,
-                                  x, x_stride,
-                                  &offset, out_i);
+   if (tiled) {
+      assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+      lp_build_sample_tiled_partial_offset(bld, format_desc->block.bits/8,
+                                           0, x, x_stride, &offset);
+      *out_i = bld->zero;
+   } else {
+      lp_build_sample_partial_offset(bld,
+                                     format_desc->block.width,
+                                     x, x_stride,
+                                     &offset, out_i);
+   }
 
    if (y && y_stride) {
       LLVMValueRef y_offset;
-      lp_build_sample_partial_offset(bld,
-                                     format_desc->block.height,
-                                     y, y_stride,
-                                     &y_offset, out_j);
+      if (tiled) {
+         lp_build_sample_tiled_partial_offset(bld, format_desc->block.bits/8,
+                                              1, y, y_stride, &y_offset);
+         *out_j = bld->zero;
+      } else {
+         lp_build_sample_partial_offset(bld,
+                                        format_desc->block.height,
+                                        y, y_stride,
+                                        &y_offset, out_j);
+      }
       offset = lp_build_add(bld, offset, y_offset);
    } else {
       *out_j = bld->zero;
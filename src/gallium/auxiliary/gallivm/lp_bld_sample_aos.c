@@ -59,11 +59,38 @@
 #include "lp_bld_quad.h"
 
 
+/**
+ * Compute the offset along one axis, taking the tiled layout into account.
+ * \param axis  0, 1 or 2 for the s, t or r coordinate
+ */
+static void
+lp_build_sample_partial_offset_aos(struct lp_build_sample_context *bld,
+                                   unsigned block_length,
+                                   unsigned axis,
+                                   LLVMValueRef coord,
+                                   LLVMValueRef stride,
+                                   LLVMValueRef *out_offset,
+                                   LLVMValueRef *out_i)
+{
+   if (bld->static_texture_state->tiled && axis < 2) {
+      assert(block_length == 1);
+      lp_build_sample_tiled_partial_offset(&bld->int_coord_bld,
+                                           bld->format_desc->block.bits/8,
+                                           axis, coord, stride, out_offset);
+      *out_i = bld->int_coord_bld.zero;
+   } else {
+      lp_build_sample_partial_offset(&bld->int_coord_bld, block_length,
+                                     coord, stride, out_offset, out_i);
+   }
+}
+
+
 /**
  * Build LLVM code for texture coord wrapping, for nearest filtering,
  * for scaled integer texcoords.
  * \param block_length  is the length of the pixel block along the
  *                      coordinate axis
+ * \param axis  0, 1 or 2 for the s, t or r coordinate
  * \param coord  the incoming texcoord (s,t or r) scaled to the texture size
  * \param coord_f  the incoming texcoord (s,t or r) as float vec
  * \param length  the texture size along one dimension
@@ -77,6 +104,7 @@
 static void
 lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
                                  unsigned block_length,
+                                 unsigned axis,
                                  LLVMValueRef coord,
                                  LLVMValueRef coord_f,
                                  LLVMValueRef length,
@@ -126,8 +154,8 @@ lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
       assert(0);
    }
 
-   lp_build_sample_partial_offset(int_coord_bld, block_length, coord, stride,
-                                  out_offset, out_i);
+   lp_build_sample_partial_offset_aos(bld, block_length, axis, coord, stride,
+                                      out_offset, out_i);
 }
 
 
@@ -198,6 +226,7 @@ lp_build_coord_repeat_npot_linear_int(struct lp_build_sample_context *bld,
  * for scaled integer texcoords.
  * \param block_length  is the length of the pixel block along the
  *                      coordinate axis
+ * \param axis  0, 1 or 2 for the s, t or r coordinate
  * \param coord0  the incoming texcoord (s,t or r) scaled to the texture size
  * \param coord_f  the incoming texcoord (s,t or r) as float vec
  * \param length  the texture size along one dimension
@@ -213,6 +242,7 @@ lp_build_coord_repeat_npot_linear_int(struct lp_build_sample_context *bld,
 static void
 lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
                                 unsigned block_length,
+                                unsigned axis,
                                 LLVMValueRef coord0,
                                 LLVMValueRef *weight_i,
                                 LLVMValueRef coord_f,
@@ -232,15 +262,16 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
    LLVMValueRef lmask, umask, mask;
 
    /*
-    * If the pixel block covers more than one pixel then there is no easy
-    * way to calculate offset1 relative to offset0. Instead, compute them
-    * independently. Otherwise, try to compute offset0 and offset1 with
-    * a single stride multiplication.
+    * If the pixel block covers more than one pixel, or the texture is
+    * tiled, then there is no easy way to calculate offset1 relative to
+    * offset0. Instead, compute them independently. Otherwise, try to
+    * compute offset0 and offset1 with a single stride multiplication.
     */
 
    length_minus_one = lp_build_sub(int_coord_bld, length, int_coord_bld->one);
 
-   if (block_length != 1) {
+   if (block_length != 1 ||
+       (bld->static_texture_state->tiled && axis < 2)) {
       LLVMValueRef coord1;
       switch(wrap_mode) {
       case PIPE_TEX_WRAP_REPEAT:
@@ -289,10 +320,10 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
          coord1 = int_coord_bld->zero;
          break;
       }
-      lp_build_sample_partial_offset(int_coord_bld, block_length, coord0, stride,
-                                     offset0, i0);
-      lp_build_sample_partial_offset(int_coord_bld, block_length, coord1, stride,
-                                     offset1, i1);
+      lp_build_sample_partial_offset_aos(bld, block_length, axis, coord0,
+                                         stride, offset0, i0);
+      lp_build_sample_partial_offset_aos(bld, block_length, axis, coord1,
+                                         stride, offset1, i1);
       return;
    }
 
@@ -507,6 +538,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    /* Do texcoord wrapping, compute texel offset */
    lp_build_sample_wrap_nearest_int(bld,
                                     bld->format_desc->block.width,
+                                    0,
                                     s_ipart, s_float,
                                     width_vec, x_stride, offsets[0],
                                     bld->static_texture_state->pot_width,
@@ -517,6 +549,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
       LLVMValueRef y_offset;
       lp_build_sample_wrap_nearest_int(bld,
                                        bld->format_desc->block.height,
+                                       1,
                                        t_ipart, t_float,
                                        height_vec, row_stride_vec, offsets[1],
                                        bld->static_texture_state->pot_height,
@@ -527,6 +560,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
          LLVMValueRef z_offset;
          lp_build_sample_wrap_nearest_int(bld,
                                           1, /* block length (depth) */
+                                          2,
                                           r_ipart, r_float,
                                           depth_vec, img_stride_vec, offsets[2],
                                           bld->static_texture_state->pot_depth,
@@ -855,6 +889,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    /* do texcoord wrapping and compute texel offsets */
    lp_build_sample_wrap_linear_int(bld,
                                    bld->format_desc->block.width,
+                                   0,
                                    s_ipart, &s_fpart, s_float,
                                    width_vec, x_stride, offsets[0],
                                    bld->static_texture_state->pot_width,
@@ -885,6 +920,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    if (dims >= 2) {
       lp_build_sample_wrap_linear_int(bld,
                                       bld->format_desc->block.height,
+                                      1,
                                       t_ipart, &t_fpart, t_float,
                                       height_vec, y_stride, offsets[1],
                                       bld->static_texture_state->pot_height,
@@ -905,6 +941,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    if (dims >= 3) {
       lp_build_sample_wrap_linear_int(bld,
                                       1, /* block length (depth) */
+                                      2,
                                       r_ipart, &r_fpart, r_float,
                                       depth_vec, z_stride, offsets[2],
                                       bld->static_texture_state->pot_depth,
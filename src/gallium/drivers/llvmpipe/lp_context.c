@@ -77,6 +77,8 @@ llvmpipe_destroy(struct pipe_context *pipe)
    if (llvmpipe->pipe.stream_uploader)
       u_upload_destroy(llvmpipe->pipe.stream_uploader);
 
+   llvmpipe_drop_fs_compile_jobs(llvmpipe, NULL);
+
    /* This will also destroy llvmpipe->setup:
     */
    if (llvmpipe->draw)
@@ -104,6 +106,7 @@ llvmpipe_destroy(struct pipe_context *pipe)
    }
 
    lp_delete_setup_variants(llvmpipe);
+   lp_delete_cs_variants(llvmpipe);
 
    llvmpipe_sampler_matrix_destroy(llvmpipe);
 
@@ -121,6 +124,19 @@ do_flush(struct pipe_context *pipe,
          struct pipe_fence_handle **fence,
          unsigned flags)
 {
+   /* The threaded context already handed out the fence, attach the fence of
+    * this flush to it.
+    */
+   if (fence && *fence && (flags & TC_FLUSH_ASYNC)) {
+      struct pipe_fence_handle *flushed = NULL;
+
+      llvmpipe_flush(pipe, &flushed, __func__);
+      lp_fence_set_flushed((struct lp_fence *)*fence,
+                           (struct lp_fence *)flushed);
+      pipe->screen->fence_reference(pipe->screen, &flushed, NULL);
+      return;
+   }
+
    llvmpipe_flush(pipe, fence, __func__);
 }
 
@@ -131,6 +147,10 @@ llvmpipe_fence_server_sync(struct pipe_context *pipe,
 {
    struct lp_fence *f = (struct lp_fence *)fence;
 
+   util_queue_fence_wait(&f->ready);
+   if (f->flushed)
+      f = f->flushed;
+
    if (!f->issued)
       return;
    lp_fence_wait(f);
@@ -216,10 +236,12 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    memset(llvmpipe, 0, sizeof *llvmpipe);
 
    list_inithead(&llvmpipe->fs_variants_list.list);
+   list_inithead(&llvmpipe->fs_compile_jobs);
 
    list_inithead(&llvmpipe->setup_variants_list.list);
 
    list_inithead(&llvmpipe->cs_variants_list.list);
+   list_inithead(&llvmpipe->cs_variants_retired.list);
 
    llvmpipe->pipe.screen = screen;
    llvmpipe->pipe.priv = priv;
@@ -285,6 +307,12 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    draw_set_constant_buffer_stride(llvmpipe->draw,
                                    lp_get_constant_buffer_stride(screen));
 
+   /* Shade large draws on as many threads as the rasterizer uses,
+    * counting the calling thread.
+    */
+   draw_set_vs_threads(llvmpipe->draw,
+                       lp_screen->num_threads ? lp_screen->num_threads - 1 : 0);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create(&llvmpipe->pipe, llvmpipe->draw);
@@ -344,7 +372,23 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    mtx_lock(&lp_screen->ctx_mutex);
    list_addtail(&llvmpipe->list, &lp_screen->ctx_list);
    mtx_unlock(&lp_screen->ctx_mutex);
-   return &llvmpipe->pipe;
+
+   /* Without rasterizer threads the user asked for everything to happen on
+    * the calling thread.
+    */
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       (flags & PIPE_CONTEXT_COMPUTE_ONLY) ||
+       lp_screen->num_threads == 0)
+      return &llvmpipe->pipe;
+
+   return threaded_context_create(&llvmpipe->pipe, &lp_screen->transfer_pool,
+                                  llvmpipe_replace_buffer_storage,
+                                  &(struct threaded_context_options){
+                                     .create_fence = lp_fence_create_tc,
+                                     .is_resource_busy = llvmpipe_is_resource_busy,
+                                     .unsynchronized_get_device_reset_status = true,
+                                  },
+                                  NULL);
 
  fail:
    llvmpipe_destroy(&llvmpipe->pipe);
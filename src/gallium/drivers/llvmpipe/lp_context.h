@@ -67,7 +67,7 @@ struct llvmpipe_context {
    const struct pipe_depth_stencil_alpha_state *depth_stencil;
    const struct pipe_rasterizer_state *rasterizer;
    struct lp_fragment_shader *fs;
-   struct draw_vertex_shader *vs;
+   struct lp_vertex_shader *vs;
    const struct lp_geometry_shader *gs;
    const struct lp_tess_ctrl_shader *tcs;
    const struct lp_tess_eval_shader *tes;
@@ -159,12 +159,16 @@ struct llvmpipe_context {
    struct blitter_context *blitter;
 
    unsigned tex_timestamp;
+   unsigned cs_tex_timestamp;
 
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Variants being compiled ahead of use, see LP_ASYNC_COMPILE */
+   struct list_head fs_compile_jobs;
+
    bool permit_linear_rasterizer;
    bool single_vp;
 
@@ -175,6 +179,8 @@ struct llvmpipe_context {
    struct lp_cs_variant_list_item cs_variants_list;
    unsigned nr_cs_variants;
    unsigned nr_cs_instrs;
+   /** Variants of shaders deleted through other contexts, to free */
+   struct lp_cs_variant_list_item cs_variants_retired;
    struct lp_cs_context *csctx;
 
    struct lp_cs_context *task_ctx;
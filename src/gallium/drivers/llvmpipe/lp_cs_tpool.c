@@ -30,20 +30,55 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
 #include "lp_cs_tpool.h"
 
+/* Each range is handed out in about this many chunks, small enough for
+ * stealing to even out iterations of different cost, large enough to
+ * keep the atomics off the profile.
+ */
+#define LP_CS_TPOOL_CHUNKS_PER_RANGE 8
+
+/**
+ * Claim the next chunk of iterations, from range 'first_range' if it has
+ * any left, else from the other ranges in turn.
+ */
+static bool
+lp_cs_tpool_claim(struct lp_cs_tpool_task *task, unsigned first_range,
+                  unsigned *start, unsigned *count)
+{
+   for (unsigned r = 0; r < task->num_ranges; r++) {
+      struct lp_cs_tpool_range *range =
+         &task->ranges[(first_range + r) % task->num_ranges];
+
+      if (p_atomic_read_relaxed(&range->next) >= range->end)
+         continue;
+
+      unsigned next = p_atomic_fetch_add(&range->next, task->iter_chunk);
+      if (next < range->end) {
+         *start = next;
+         *count = MIN2(task->iter_chunk, range->end - next);
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static int
 lp_cs_tpool_worker(void *data)
 {
    struct lp_cs_tpool *pool = data;
    struct lp_cs_local_mem lmem;
+   const unsigned thread_index = p_atomic_inc_return(&pool->next_thread_index) - 1;
 
    memset(&lmem, 0, sizeof(lmem));
    mtx_lock(&pool->m);
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
+      unsigned start, count, done = 0;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -53,29 +88,26 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
+      task->num_workers++;
+      mtx_unlock(&pool->m);
 
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
+      while (lp_cs_tpool_claim(task, thread_index, &start, &count)) {
+         for (unsigned i = 0; i < count; i++)
+            task->work(task->data, start + i, &lmem);
+         done += count;
       }
 
-      task->iter_start += iter_per_thread;
+      mtx_lock(&pool->m);
 
-      if (task->iter_start == task->iter_total)
+      /* Every iteration has been claimed, let the other threads move on
+       * to the next task while the last chunks of this one finish.
+       */
+      if (list_is_linked(&task->list))
          list_del(&task->list);
 
-      mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
-
-      mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
+      task->iter_finished += done;
+      task->num_workers--;
+      if (task->iter_finished == task->iter_total && !task->num_workers)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -142,7 +174,7 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       FREE(lmem.local_mem_ptr);
       return NULL;
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+   task = CALLOC_STRUCT_CL(lp_cs_tpool_task);
    if (!task) {
       return NULL;
    }
@@ -151,8 +183,13 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->data = data;
    task->iter_total = num_iters;
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
+   task->num_ranges = MAX2(MIN2(pool->num_threads, num_iters), 1);
+   for (unsigned r = 0; r < task->num_ranges; r++) {
+      task->ranges[r].next = (uint64_t)num_iters * r / task->num_ranges;
+      task->ranges[r].end = (uint64_t)num_iters * (r + 1) / task->num_ranges;
+   }
+   task->iter_chunk = MAX2(num_iters / task->num_ranges /
+                           LP_CS_TPOOL_CHUNKS_PER_RANGE, 1);
 
    cnd_init(&task->finish);
 
@@ -175,11 +212,11 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
       return;
 
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (task->iter_finished < task->iter_total || task->num_workers)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
    cnd_destroy(&task->finish);
-   FREE(task);
+   FREE_CL(task);
    *task_handle = NULL;
 }
@@ -30,6 +30,12 @@
  * structs with just unique indexes in them.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
+ *
+ * The iterations of a task are split into one range per thread.  Each
+ * thread claims small chunks of its own range with atomic adds, and once
+ * that is drained steals chunks from the other ranges, so iterations of
+ * uneven cost still keep all threads busy.  The pool mutex is only taken
+ * to pick up a task and to report it finished.
  */
 #ifndef LP_CS_QUEUE
 #define LP_CS_QUEUE
@@ -37,6 +43,7 @@
 #include "util/compiler.h"
 
 #include "util/u_thread.h"
+#include "util/u_memory.h"
 #include "util/list.h"
 
 #include "lp_limits.h"
@@ -47,6 +54,7 @@ struct lp_cs_tpool {
 
    thrd_t threads[LP_MAX_THREADS];
    unsigned num_threads;
+   unsigned next_thread_index;
    struct list_head workqueue;
    bool shutdown;
 };
@@ -58,16 +66,30 @@ struct lp_cs_local_mem {
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
 
+/* A range of a task's iterations, preferably run by one thread.  'next'
+ * is bumped atomically by every thread claiming from the range.
+ */
+struct lp_cs_tpool_range {
+   EXCLUSIVE_CACHELINE(struct {
+      unsigned next;
+      unsigned end;
+   });
+};
+
+/* Allocated with CALLOC_STRUCT_CL, the ranges come first so that each of
+ * them starts on a cache line.
+ */
 struct lp_cs_tpool_task {
+   struct lp_cs_tpool_range ranges[LP_MAX_THREADS];
    lp_cs_tpool_task_func work;
    void *data;
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+   unsigned iter_chunk;     /* iterations claimed at once */
+   unsigned iter_finished;  /* protected by the pool mutex */
+   unsigned num_workers;    /* threads currently looking at the task */
+   unsigned num_ranges;
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -45,7 +45,7 @@
 #define DEBUG_MEM           0x4000
 #define DEBUG_FS            0x8000
 #define DEBUG_CS            0x10000
-// unused                   0x40000
+#define DEBUG_RASTER_ORDER  0x40000
 #define DEBUG_NO_FASTPATH   0x80000
 #define DEBUG_LINEAR        0x100000
 #define DEBUG_LINEAR2       0x200000
@@ -65,6 +65,8 @@
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
 #define PERF_NO_RAST_LINEAR 0x100  	/* disable linear rast */
 #define PERF_NO_SHADE       0x200  	/* disable fragment shaders */
+#define PERF_NO_HIZ         0x400  	/* disable hierarchical depth culling */
+#define PERF_NO_TILED_TEX   0x800  	/* keep all textures linear */
 
 
 extern int LP_PERF;
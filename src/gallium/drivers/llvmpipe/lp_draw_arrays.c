@@ -135,7 +135,7 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       /* we have an empty geometry shader with stream output, so
          attach the stream output info to the current vertex shader */
       if (lp->vs) {
-         draw_vs_attach_so(lp->vs, &lp->gs->stream_output);
+         draw_vs_attach_so(lp->vs->dvs, &lp->gs->stream_output);
       }
    }
    draw_collect_pipeline_statistics(draw,
@@ -164,7 +164,7 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       /* we have attached stream output to the vs for rendering,
          now lets reset it */
       if (lp->vs) {
-         draw_vs_reset_so(lp->vs);
+         draw_vs_reset_so(lp->vs->dvs);
       }
    }
 
@@ -28,6 +28,7 @@
 
 #include "pipe/p_screen.h"
 #include "util/u_memory.h"
+#include "util/u_threaded_context.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
 
@@ -60,6 +61,7 @@ lp_fence_create(unsigned rank)
 
    fence->id = p_atomic_inc_return(&fence_id) - 1;
    fence->rank = rank;
+   util_queue_fence_init(&fence->ready);
 
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __func__, fence->id);
@@ -75,12 +77,48 @@ lp_fence_destroy(struct lp_fence *fence)
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __func__, fence->id);
 
+   lp_fence_reference(&fence->flushed, NULL);
+   tc_unflushed_batch_token_reference(&fence->tc_token, NULL);
+   util_queue_fence_destroy(&fence->ready);
    mtx_destroy(&fence->mutex);
    cnd_destroy(&fence->signalled);
    FREE(fence);
 }
 
 
+/**
+ * Create a fence for an asynchronous flush of the threaded context. Called
+ * from the application thread, the flush sets the actual fence later.
+ */
+struct pipe_fence_handle *
+lp_fence_create_tc(struct pipe_context *pipe,
+                   struct tc_unflushed_batch_token *token)
+{
+   struct lp_fence *fence = lp_fence_create(0);
+
+   if (!fence)
+      return NULL;
+
+   util_queue_fence_reset(&fence->ready);
+   tc_unflushed_batch_token_reference(&fence->tc_token, token);
+
+   return (struct pipe_fence_handle *)fence;
+}
+
+
+/**
+ * Called by the asynchronous flush of a fence from lp_fence_create_tc().
+ */
+void
+lp_fence_set_flushed(struct lp_fence *fence, struct lp_fence *flushed)
+{
+   assert(!fence->flushed);
+   lp_fence_reference(&fence->flushed, flushed);
+   tc_unflushed_batch_token_reference(&fence->tc_token, NULL);
+   util_queue_fence_signal(&fence->ready);
+}
+
+
 /**
  * Called by the rendering threads to increment the fence counter.
  * When the counter == the rank, the fence is finished.
@@ -31,11 +31,13 @@
 
 
 #include "util/u_thread.h"
+#include "util/u_queue.h"
 #include "pipe/p_state.h"
 #include "util/u_inlines.h"
 
 
 struct pipe_screen;
+struct tc_unflushed_batch_token;
 
 
 struct lp_fence
@@ -49,12 +51,27 @@ struct lp_fence
    bool issued;
    unsigned rank;
    unsigned count;
+
+   /* Fences created by the threaded context before the flush runs in the
+    * driver thread.  ready is signalled once it ran, and flushed is then the
+    * fence of that flush.
+    */
+   struct tc_unflushed_batch_token *tc_token;
+   struct util_queue_fence ready;
+   struct lp_fence *flushed;
 };
 
 
 struct lp_fence *
 lp_fence_create(unsigned rank);
 
+struct pipe_fence_handle *
+lp_fence_create_tc(struct pipe_context *pipe,
+                   struct tc_unflushed_batch_token *token);
+
+void
+lp_fence_set_flushed(struct lp_fence *fence, struct lp_fence *flushed);
+
 
 void
 lp_fence_signal(struct lp_fence *fence);
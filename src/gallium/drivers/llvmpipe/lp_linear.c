@@ -41,9 +41,6 @@
 #include "lp_linear_priv.h"
 
 
-#if DETECT_ARCH_SSE
-
-
 /* For debugging (LP_DEBUG=linear), shade areas of run-time fallback
  * purple.  Keep blending active so we can see more of what's going
  * on.
@@ -368,11 +365,3 @@ fail:
       debug_printf("    ----> no linear path for this variant\n");
    }
 }
-
-
-#else
-void
-lp_linear_check_variant(struct lp_fragment_shader_variant *variant)
-{
-}
-#endif
@@ -51,8 +51,6 @@
  */
 
 
-#if DETECT_ARCH_SSE
-
 /* Linear shader which implements the BLIT_RGBA shader with the
  * additional constraints imposed by lp_setup_is_blit().
  */
@@ -117,6 +115,7 @@ lp_linear_blit_rgb1_blit(const struct lp_rast_state *state,
 {
    const struct lp_jit_resources *resources = &state->jit_resources;
    const struct lp_jit_texture *texture = &resources->textures[0];
+   const struct lp_linear_kernels *kernels = lp_linear_get_kernels();
 
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
@@ -144,13 +143,7 @@ lp_linear_blit_rgb1_blit(const struct lp_rast_state *state,
       return false;
 
    for (y = 0; y < height; y++) {
-      const uint32_t *src_row = (const uint32_t *)src;
-      uint32_t *dst_row = (uint32_t *)color;
-
-      for (x = 0; x < width; x++) {
-         *dst_row++ = *src_row++ | 0xff000000;
-      }
-
+      kernels->blit_rgb1_row((uint32_t *)color, (const uint32_t *)src, width);
       color += stride;
       src += src_stride;
    }
@@ -198,7 +191,7 @@ lp_linear_check_fastpath(struct lp_fragment_shader_variant *variant)
    struct lp_sampler_static_state *samp0 =
       lp_fs_variant_key_sampler_idx(&variant->key, 0);
 
-   if (!samp0)
+   if (!samp0 || samp0->texture_state.tiled)
       return false;
 
    const enum pipe_format tex_format = samp0->texture_state.format;
@@ -227,13 +220,3 @@ lp_linear_check_fastpath(struct lp_fragment_shader_variant *variant)
     */
    return variant->jit_linear != NULL;
 }
-
-#else
-
-bool
-lp_linear_check_fastpath(struct lp_fragment_shader_variant *variant)
-{
-   return false;
-}
-
-#endif
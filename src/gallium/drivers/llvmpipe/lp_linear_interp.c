@@ -41,7 +41,6 @@
 #include "lp_linear_priv.h"
 
 
-#if DETECT_ARCH_SSE
 
 #define FIXED15_ONE 0x7fff
 
@@ -70,24 +69,14 @@ static const uint32_t *
 interp_0_8(struct lp_linear_elem *elem)
 {
    struct lp_linear_interp *interp = (struct lp_linear_interp *)elem;
-   uint32_t *row = interp->row;
-   __m128i a0 = interp->a0;
-   const __m128i dadx = interp->dadx;
    const int width = (interp->width + 3) & ~3;
 
-   for (int i = 0; i < width; i += 4) {
-      __m128i l = _mm_srai_epi16(a0, 7); // l = a0 >> 7
-      a0 = _mm_add_epi16(a0, dadx);      // a0 += dadx
-
-      __m128i h = _mm_srai_epi16(a0, 7); // h = a0 >> 7
-      a0 = _mm_add_epi16(a0, dadx);      // a0 += dadx
-
-      // pack l[0..7] and h[0..7] as 16 bytes
-      *(__m128i *)&row[i] =  _mm_packus_epi16(l, h);
-   }
+   interp->kernels->interp_row(interp->row, interp->a0, interp->dadx, width);
 
    // advance to next row
-   interp->a0 = _mm_add_epi16(interp->a0, interp->dady);
+   for (unsigned j = 0; j < 8; j++)
+      interp->a0[j] += interp->dady[j];
+
    return interp->row;
 }
 
@@ -202,15 +191,25 @@ lp_linear_init_interp(struct lp_linear_interp *interp,
    }
 
    interp->width = align(width, 4);
-   /* RGBA->BGRA swizzle here */
-   interp->a0    = _mm_setr_epi16(s0_fp[2], s0_fp[1], s0_fp[0], s0_fp[3],
-                                  s0_fp[6], s0_fp[5], s0_fp[4], s0_fp[7]);
-
-   interp->dadx  = _mm_setr_epi16(dsdx_fp[2], dsdx_fp[1], dsdx_fp[0], dsdx_fp[3],
-                                  dsdx_fp[2], dsdx_fp[1], dsdx_fp[0], dsdx_fp[3]);
+   interp->kernels = lp_linear_get_kernels();
 
-   interp->dady  = _mm_setr_epi16(dsdy_fp[2], dsdy_fp[1], dsdy_fp[0], dsdy_fp[3],
-                                  dsdy_fp[2], dsdy_fp[1], dsdy_fp[0], dsdy_fp[3]);
+   /* RGBA->BGRA swizzle here */
+   for (unsigned i = 0; i < 8; i += 4) {
+      interp->a0[i + 0]   = s0_fp[i + 2];
+      interp->a0[i + 1]   = s0_fp[i + 1];
+      interp->a0[i + 2]   = s0_fp[i + 0];
+      interp->a0[i + 3]   = s0_fp[i + 3];
+
+      interp->dadx[i + 0] = dsdx_fp[2];
+      interp->dadx[i + 1] = dsdx_fp[1];
+      interp->dadx[i + 2] = dsdx_fp[0];
+      interp->dadx[i + 3] = dsdx_fp[3];
+
+      interp->dady[i + 0] = dsdy_fp[2];
+      interp->dady[i + 1] = dsdy_fp[1];
+      interp->dady[i + 2] = dsdy_fp[0];
+      interp->dady[i + 3] = dsdy_fp[3];
+   }
 
    /* If the value is y-invariant, eagerly calculate it here and then
     * always return the precalculated value.
@@ -227,20 +226,3 @@ lp_linear_init_interp(struct lp_linear_interp *interp,
 
    return true;
 }
-
-#else //DETECT_ARCH_SSE
-
-bool
-lp_linear_init_interp(struct lp_linear_interp *interp,
-                      int x, int y, int width, int height,
-                      unsigned usage_mask,
-                      bool perspective,
-                      float oow,
-                      const float *a0,
-                      const float *dadx,
-                      const float *dady)
-{
-   return false;
-}
-
-#endif //DETECT_ARCH_SSE
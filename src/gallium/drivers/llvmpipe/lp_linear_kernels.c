@@ -0,0 +1,211 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Portable and SSE2 row kernels of the linear path, and runtime selection
+ * of the best kernels for the CPU.
+ */
+
+#include <string.h>
+
+#include "util/detect.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/u_sse.h"
+
+#include "lp_linear_kernels.h"
+
+
+static void
+interp_row_c(uint32_t *row, const int16_t a0[8], const int16_t dadx[8],
+             int width)
+{
+   uint8_t *dst = (uint8_t *)row;
+   int16_t a[8];
+
+   memcpy(a, a0, sizeof a);
+
+   for (int i = 0; i < width; i += 2) {
+      for (unsigned j = 0; j < 8; j++) {
+         dst[j] = CLAMP(a[j] >> 7, 0, 255);
+         a[j] += dadx[j];
+      }
+      dst += 8;
+   }
+}
+
+
+static void
+lerp_rows_c(uint32_t *row, const uint32_t *src0, const uint32_t *src1,
+            int weight, int width)
+{
+   uint8_t *dst = (uint8_t *)row;
+   const uint8_t *a = (const uint8_t *)src0;
+   const uint8_t *b = (const uint8_t *)src1;
+
+   for (int i = 0; i < width * 4; i++)
+      dst[i] = lp_linear_lerp_8unorm(a[i], b[i], weight);
+}
+
+
+static void
+fetch_linear_row_c(uint32_t *row, const uint32_t *data, int stride,
+                   int s, int t, int dsdx, int dtdx, int width)
+{
+   for (int i = 0; i < width; i++) {
+      const uint8_t *src0 =
+         (const uint8_t *)(data + (t >> 16) * stride + (s >> 16));
+      const uint8_t *src1 = src0 + stride * 4;
+      const unsigned ws = (s >> 8) & 0xff;
+      const unsigned wt = (t >> 8) & 0xff;
+      uint8_t *dst = (uint8_t *)&row[i];
+
+      for (unsigned c = 0; c < 4; c++) {
+         uint8_t c02 = lp_linear_lerp_8unorm(src0[c], src1[c], wt);
+         uint8_t c13 = lp_linear_lerp_8unorm(src0[4 + c], src1[4 + c], wt);
+         dst[c] = lp_linear_lerp_8unorm(c02, c13, ws);
+      }
+
+      s += dsdx;
+      t += dtdx;
+   }
+}
+
+
+static void
+blit_rgb1_row_c(uint32_t *dst, const uint32_t *src, int width)
+{
+   for (int i = 0; i < width; i++)
+      dst[i] = src[i] | 0xff000000;
+}
+
+
+const struct lp_linear_kernels lp_linear_kernels_c = {
+   .name = "c",
+   .interp_row = interp_row_c,
+   .lerp_rows = lerp_rows_c,
+   .fetch_linear_row = fetch_linear_row_c,
+   .blit_rgb1_row = blit_rgb1_row_c,
+};
+
+
+#if DETECT_ARCH_SSE
+
+static void
+interp_row_sse2(uint32_t *row, const int16_t a0[8], const int16_t dadx[8],
+                int width)
+{
+   __m128i a = _mm_loadu_si128((const __m128i *)a0);
+   const __m128i d = _mm_loadu_si128((const __m128i *)dadx);
+
+   for (int i = 0; i < width; i += 4) {
+      __m128i l = _mm_srai_epi16(a, 7); // l = a0 >> 7
+      a = _mm_add_epi16(a, d);          // a0 += dadx
+
+      __m128i h = _mm_srai_epi16(a, 7); // h = a0 >> 7
+      a = _mm_add_epi16(a, d);          // a0 += dadx
+
+      // pack l[0..7] and h[0..7] as 16 bytes
+      _mm_storeu_si128((__m128i *)&row[i], _mm_packus_epi16(l, h));
+   }
+}
+
+
+static void
+lerp_rows_sse2(uint32_t *row, const uint32_t *src0, const uint32_t *src1,
+               int weight, int width)
+{
+   const __m128i wt = _mm_set1_epi16(weight);
+
+   for (int i = 0; i < width; i += 4) {
+      __m128i srca = _mm_loadu_si128((const __m128i *)&src0[i]);
+      __m128i srcb = _mm_loadu_si128((const __m128i *)&src1[i]);
+
+      _mm_storeu_si128((__m128i *)&row[i],
+                       util_sse2_lerp_epi8_fixed88(srca, srcb, &wt, &wt));
+   }
+}
+
+
+static void
+fetch_linear_row_sse2(uint32_t *row, const uint32_t *data, int stride,
+                      int s, int t, int dsdx, int dtdx, int width)
+{
+   for (int i = 0; i < width; i += 4) {
+      union m128i si0, si1, si2, si3, ws, wt;
+      __m128i si02, si13;
+
+      for (int j = 0; j < 4; j++) {
+         const uint32_t *src = data + (t >> 16) * stride + (s >> 16);
+
+         si0.ui[j] = src[0];
+         si1.ui[j] = src[1];
+         si2.ui[j] = src[stride + 0];
+         si3.ui[j] = src[stride + 1];
+
+         ws.ui[j] = (s>>8) & 0xff;
+         wt.ui[j] = (t>>8) & 0xff;
+
+         s += dsdx;
+         t += dtdx;
+      }
+
+      ws.m = _mm_or_si128(ws.m, _mm_slli_epi32(ws.m, 16));
+      ws.m = _mm_or_si128(ws.m, _mm_slli_epi32(ws.m, 8));
+
+      wt.m = _mm_or_si128(wt.m, _mm_slli_epi32(wt.m, 16));
+      wt.m = _mm_or_si128(wt.m, _mm_slli_epi32(wt.m, 8));
+
+      si02 = util_sse2_lerp_epi8_fixed08(si0.m, si2.m, wt.m);
+      si13 = util_sse2_lerp_epi8_fixed08(si1.m, si3.m, wt.m);
+
+      _mm_storeu_si128((__m128i *)&row[i],
+                       util_sse2_lerp_epi8_fixed08(si02, si13, ws.m));
+   }
+}
+
+
+static void
+blit_rgb1_row_sse2(uint32_t *dst, const uint32_t *src, int width)
+{
+   const __m128i rgb1 = _mm_set1_epi32(0xff000000);
+   int i;
+
+   for (i = 0; i + 3 < width; i += 4) {
+      __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+      _mm_storeu_si128((__m128i *)&dst[i], _mm_or_si128(s, rgb1));
+   }
+
+   for (; i < width; i++)
+      dst[i] = src[i] | 0xff000000;
+}
+
+
+const struct lp_linear_kernels lp_linear_kernels_sse2 = {
+   .name = "sse2",
+   .interp_row = interp_row_sse2,
+   .lerp_rows = lerp_rows_sse2,
+   .fetch_linear_row = fetch_linear_row_sse2,
+   .blit_rgb1_row = blit_rgb1_row_sse2,
+};
+
+#endif /* DETECT_ARCH_SSE */
+
+
+const struct lp_linear_kernels *
+lp_linear_get_kernels(void)
+{
+#if DETECT_ARCH_SSE
+   if (util_get_cpu_caps()->has_avx2)
+      return &lp_linear_kernels_avx2;
+   return &lp_linear_kernels_sse2;
+#elif defined(LP_LINEAR_KERNELS_NEON)
+   /* On arm64 NEON is implied. */
+   if (DETECT_ARCH_AARCH64 || util_get_cpu_caps()->has_neon)
+      return &lp_linear_kernels_neon;
+   return &lp_linear_kernels_c;
+#else
+   return &lp_linear_kernels_c;
+#endif
+}
@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Row kernels of the linear rasterization path.
+ *
+ * The linear path works on rows of up to TILE_SIZE packed 8-bit BGRA
+ * pixels.  The inner loops which produce those rows are collected here, so
+ * that wider implementations can be selected at runtime according to the
+ * CPU.  All implementations must produce bit-identical results.
+ */
+
+#ifndef LP_LINEAR_KERNELS_H
+#define LP_LINEAR_KERNELS_H
+
+#include <stdint.h>
+
+#include "util/detect_arch.h"
+
+
+struct lp_linear_kernels {
+   const char *name;
+
+   /**
+    * Produce a row of 0.8 unorm pixels from interpolants in 1.15 fixed
+    * point.  a0 holds the BGRA values of the first two pixels and dadx the
+    * increment from one pair of pixels to the next.  width must be a
+    * multiple of 4.
+    */
+   void (*interp_row)(uint32_t *row, const int16_t a0[8],
+                      const int16_t dadx[8], int width);
+
+   /**
+    * Linear interpolation of two rows with a constant 0.8 weight.
+    * width must be a multiple of 4.
+    */
+   void (*lerp_rows)(uint32_t *row, const uint32_t *src0,
+                     const uint32_t *src1, int weight, int width);
+
+   /**
+    * Bilinear filtering of texels along a row, from 16.16 texture
+    * coordinates which don't need any clamping.  stride is in texels.
+    * width must be a multiple of 4.
+    */
+   void (*fetch_linear_row)(uint32_t *row, const uint32_t *data, int stride,
+                            int s, int t, int dsdx, int dtdx, int width);
+
+   /**
+    * Copy a row of pixels, setting alpha to one.
+    */
+   void (*blit_rgb1_row)(uint32_t *dst, const uint32_t *src, int width);
+};
+
+
+extern const struct lp_linear_kernels lp_linear_kernels_c;
+
+#if DETECT_ARCH_SSE
+extern const struct lp_linear_kernels lp_linear_kernels_sse2;
+extern const struct lp_linear_kernels lp_linear_kernels_avx2;
+#endif
+
+#if (DETECT_ARCH_AARCH64 || DETECT_ARCH_ARM) && !defined(__SOFTFP__)
+#define LP_LINEAR_KERNELS_NEON 1
+extern const struct lp_linear_kernels lp_linear_kernels_neon;
+#endif
+
+
+/**
+ * Linear interpolation of 0.8 unorm values, with the same arithmetic as
+ * util_sse2_lerp_epi16(), where the product wraps around in 16 bits.
+ */
+static inline uint8_t
+lp_linear_lerp_8unorm(uint8_t a, uint8_t b, unsigned w)
+{
+   return a + ((uint16_t)((b - a) * (int)w) >> 8);
+}
+
+
+/**
+ * Return the fastest kernels supported by the CPU.
+ */
+const struct lp_linear_kernels *
+lp_linear_get_kernels(void);
+
+
+#endif /* LP_LINEAR_KERNELS_H */
@@ -0,0 +1,208 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * AVX2 row kernels of the linear path.
+ *
+ * This file is built with -mavx2, and must only be called after checking
+ * util_get_cpu_caps()->has_avx2.  Rows are processed eight pixels at a
+ * time, a remainder of four pixels is handed to the SSE2 kernels.
+ */
+
+#include "util/detect.h"
+
+#if DETECT_ARCH_SSE
+
+#include <immintrin.h>
+
+#include "util/u_sse.h"
+
+#include "lp_linear_kernels.h"
+
+
+/* 256-bit version of util_sse2_lerp_epi16().
+ */
+static ALWAYS_INLINE __m256i
+lerp_epi16(__m256i w, __m256i a, __m256i b)
+{
+   __m256i res;
+
+   res = _mm256_sub_epi16(b, a);
+   res = _mm256_mullo_epi16(res, w);
+   res = _mm256_srli_epi16(res, 8);
+   res = _mm256_add_epi8(res, a);
+
+   return res;
+}
+
+
+/* 256-bit version of util_sse2_lerp_epi8_fixed08().  Unpacking and packing
+ * both work within 128-bit lanes, so the pixel order is preserved.
+ */
+static ALWAYS_INLINE __m256i
+lerp_epi8_fixed08(__m256i src0, __m256i src1, __m256i weight)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   __m256i lo, hi;
+
+   lo = lerp_epi16(_mm256_unpacklo_epi8(weight, zero),
+                   _mm256_unpacklo_epi8(src0, zero),
+                   _mm256_unpacklo_epi8(src1, zero));
+   hi = lerp_epi16(_mm256_unpackhi_epi8(weight, zero),
+                   _mm256_unpackhi_epi8(src0, zero),
+                   _mm256_unpackhi_epi8(src1, zero));
+
+   return _mm256_packus_epi16(lo, hi);
+}
+
+
+/* Replicate the low byte of each pixel into all four channels.
+ */
+static ALWAYS_INLINE __m256i
+splat_weight(__m256i w)
+{
+   w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+   return _mm256_or_si256(w, _mm256_slli_epi32(w, 8));
+}
+
+
+static void
+interp_row_avx2(uint32_t *row, const int16_t a0[8], const int16_t dadx[8],
+                int width)
+{
+   const __m128i d = _mm_loadu_si128((const __m128i *)dadx);
+   const __m128i a_0 = _mm_loadu_si128((const __m128i *)a0);
+   const __m128i a_1 = _mm_add_epi16(a_0, d);
+   const __m128i a_2 = _mm_add_epi16(a_1, d);
+   const __m128i a_3 = _mm_add_epi16(a_2, d);
+
+   /* Pixel pairs 0 and 2 go in x, pairs 1 and 3 in y, so that packing x
+    * and y lane by lane gives the eight pixels in order.
+    */
+   __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(a_0), a_2, 1);
+   __m256i y = _mm256_inserti128_si256(_mm256_castsi128_si256(a_1), a_3, 1);
+   const __m256i d4 = _mm256_broadcastsi128_si256(_mm_slli_epi16(d, 2));
+   int i;
+
+   for (i = 0; i + 7 < width; i += 8) {
+      __m256i l = _mm256_srai_epi16(x, 7);
+      __m256i h = _mm256_srai_epi16(y, 7);
+
+      _mm256_storeu_si256((__m256i *)&row[i], _mm256_packus_epi16(l, h));
+
+      x = _mm256_add_epi16(x, d4);
+      y = _mm256_add_epi16(y, d4);
+   }
+
+   if (i < width) {
+      __m128i l = _mm_srai_epi16(_mm256_castsi256_si128(x), 7);
+      __m128i h = _mm_srai_epi16(_mm256_castsi256_si128(y), 7);
+
+      _mm_storeu_si128((__m128i *)&row[i], _mm_packus_epi16(l, h));
+   }
+}
+
+
+static void
+lerp_rows_avx2(uint32_t *row, const uint32_t *src0, const uint32_t *src1,
+               int weight, int width)
+{
+   const __m256i wt = _mm256_set1_epi16(weight);
+   const __m256i zero = _mm256_setzero_si256();
+   int i;
+
+   for (i = 0; i + 7 < width; i += 8) {
+      __m256i srca = _mm256_loadu_si256((const __m256i *)&src0[i]);
+      __m256i srcb = _mm256_loadu_si256((const __m256i *)&src1[i]);
+      __m256i lo, hi;
+
+      lo = lerp_epi16(wt, _mm256_unpacklo_epi8(srca, zero),
+                      _mm256_unpacklo_epi8(srcb, zero));
+      hi = lerp_epi16(wt, _mm256_unpackhi_epi8(srca, zero),
+                      _mm256_unpackhi_epi8(srcb, zero));
+
+      _mm256_storeu_si256((__m256i *)&row[i], _mm256_packus_epi16(lo, hi));
+   }
+
+   if (i < width)
+      lp_linear_kernels_sse2.lerp_rows(row + i, src0 + i, src1 + i,
+                                       weight, width - i);
+}
+
+
+static void
+fetch_linear_row_avx2(uint32_t *row, const uint32_t *data, int stride,
+                      int s, int t, int dsdx, int dtdx, int width)
+{
+   const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   const __m256i dsdx8 = _mm256_set1_epi32(8 * dsdx);
+   const __m256i dtdx8 = _mm256_set1_epi32(8 * dtdx);
+   const __m256i stride8 = _mm256_set1_epi32(stride);
+   const __m256i mask = _mm256_set1_epi32(0xff);
+   const int *row0 = (const int *)data;
+   const int *row1 = (const int *)(data + stride);
+   __m256i s8, t8;
+   int i;
+
+   s8 = _mm256_add_epi32(_mm256_set1_epi32(s),
+                         _mm256_mullo_epi32(lane, _mm256_set1_epi32(dsdx)));
+   t8 = _mm256_add_epi32(_mm256_set1_epi32(t),
+                         _mm256_mullo_epi32(lane, _mm256_set1_epi32(dtdx)));
+
+   for (i = 0; i + 7 < width; i += 8) {
+      __m256i addr, si0, si1, si2, si3, si02, si13, ws, wt;
+
+      addr = _mm256_mullo_epi32(_mm256_srai_epi32(t8, 16), stride8);
+      addr = _mm256_add_epi32(addr, _mm256_srai_epi32(s8, 16));
+
+      si0 = _mm256_i32gather_epi32(row0, addr, 4);
+      si1 = _mm256_i32gather_epi32(row0 + 1, addr, 4);
+      si2 = _mm256_i32gather_epi32(row1, addr, 4);
+      si3 = _mm256_i32gather_epi32(row1 + 1, addr, 4);
+
+      ws = splat_weight(_mm256_and_si256(_mm256_srli_epi32(s8, 8), mask));
+      wt = splat_weight(_mm256_and_si256(_mm256_srli_epi32(t8, 8), mask));
+
+      si02 = lerp_epi8_fixed08(si0, si2, wt);
+      si13 = lerp_epi8_fixed08(si1, si3, wt);
+
+      _mm256_storeu_si256((__m256i *)&row[i],
+                          lerp_epi8_fixed08(si02, si13, ws));
+
+      s8 = _mm256_add_epi32(s8, dsdx8);
+      t8 = _mm256_add_epi32(t8, dtdx8);
+   }
+
+   if (i < width)
+      lp_linear_kernels_sse2.fetch_linear_row(row + i, data, stride,
+                                              s + i * dsdx, t + i * dtdx,
+                                              dsdx, dtdx, width - i);
+}
+
+
+static void
+blit_rgb1_row_avx2(uint32_t *dst, const uint32_t *src, int width)
+{
+   const __m256i rgb1 = _mm256_set1_epi32(0xff000000);
+   int i;
+
+   for (i = 0; i + 7 < width; i += 8) {
+      __m256i s = _mm256_loadu_si256((const __m256i *)&src[i]);
+      _mm256_storeu_si256((__m256i *)&dst[i], _mm256_or_si256(s, rgb1));
+   }
+
+   if (i < width)
+      lp_linear_kernels_sse2.blit_rgb1_row(dst + i, src + i, width - i);
+}
+
+
+const struct lp_linear_kernels lp_linear_kernels_avx2 = {
+   .name = "avx2",
+   .interp_row = interp_row_avx2,
+   .lerp_rows = lerp_rows_avx2,
+   .fetch_linear_row = fetch_linear_row_avx2,
+   .blit_rgb1_row = blit_rgb1_row_avx2,
+};
+
+#endif /* DETECT_ARCH_SSE */
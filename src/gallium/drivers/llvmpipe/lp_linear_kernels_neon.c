@@ -0,0 +1,146 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * NEON row kernels of the linear path.
+ */
+
+#include "util/detect_arch.h"
+
+#include "lp_linear_kernels.h"
+
+#ifdef LP_LINEAR_KERNELS_NEON
+
+/* armhf builds default to vfp, not neon, and refuses to compile neon intrinsics
+ * unless you tell it "no really".
+ */
+#if DETECT_ARCH_ARM
+#pragma GCC target ("fpu=neon")
+#endif
+
+#include <arm_neon.h>
+
+
+/* Same arithmetic as util_sse2_lerp_epi16(), where the product wraps around
+ * in 16 bits.
+ */
+static inline uint8x8_t
+lerp_u8x8(uint8x8_t a, uint8x8_t b, uint8x8_t w)
+{
+   const uint16x8_t a16 = vmovl_u8(a);
+   uint16x8_t res;
+
+   res = vsubq_u16(vmovl_u8(b), a16);
+   res = vmulq_u16(res, vmovl_u8(w));
+   res = vshrq_n_u16(res, 8);
+
+   return vmovn_u16(vaddq_u16(res, a16));
+}
+
+
+static inline uint8x16_t
+lerp_u8x16(uint8x16_t a, uint8x16_t b, uint8x16_t w)
+{
+   return vcombine_u8(lerp_u8x8(vget_low_u8(a), vget_low_u8(b),
+                                vget_low_u8(w)),
+                      lerp_u8x8(vget_high_u8(a), vget_high_u8(b),
+                                vget_high_u8(w)));
+}
+
+
+static void
+interp_row_neon(uint32_t *row, const int16_t a0[8], const int16_t dadx[8],
+                int width)
+{
+   int16x8_t a = vld1q_s16(a0);
+   const int16x8_t d = vld1q_s16(dadx);
+
+   for (int i = 0; i < width; i += 4) {
+      /* Saturating narrow of a >> 7, like srai + packus on SSE2. */
+      uint8x8_t l = vqshrun_n_s16(a, 7);
+      a = vaddq_s16(a, d);
+
+      uint8x8_t h = vqshrun_n_s16(a, 7);
+      a = vaddq_s16(a, d);
+
+      vst1q_u8((uint8_t *)&row[i], vcombine_u8(l, h));
+   }
+}
+
+
+static void
+lerp_rows_neon(uint32_t *row, const uint32_t *src0, const uint32_t *src1,
+               int weight, int width)
+{
+   const uint8x16_t w = vdupq_n_u8(weight);
+
+   for (int i = 0; i < width; i += 4) {
+      uint8x16_t a = vld1q_u8((const uint8_t *)&src0[i]);
+      uint8x16_t b = vld1q_u8((const uint8_t *)&src1[i]);
+
+      vst1q_u8((uint8_t *)&row[i], lerp_u8x16(a, b, w));
+   }
+}
+
+
+static void
+fetch_linear_row_neon(uint32_t *row, const uint32_t *data, int stride,
+                      int s, int t, int dsdx, int dtdx, int width)
+{
+   for (int i = 0; i < width; i += 4) {
+      uint32_t si0[4], si1[4], si2[4], si3[4], ws[4], wt[4];
+
+      for (int j = 0; j < 4; j++) {
+         const uint32_t *src = data + (t >> 16) * stride + (s >> 16);
+
+         si0[j] = src[0];
+         si1[j] = src[1];
+         si2[j] = src[stride + 0];
+         si3[j] = src[stride + 1];
+
+         ws[j] = ((s >> 8) & 0xff) * 0x01010101;
+         wt[j] = ((t >> 8) & 0xff) * 0x01010101;
+
+         s += dsdx;
+         t += dtdx;
+      }
+
+      const uint8x16_t wt8 = vreinterpretq_u8_u32(vld1q_u32(wt));
+      const uint8x16_t si02 =
+         lerp_u8x16(vreinterpretq_u8_u32(vld1q_u32(si0)),
+                    vreinterpretq_u8_u32(vld1q_u32(si2)), wt8);
+      const uint8x16_t si13 =
+         lerp_u8x16(vreinterpretq_u8_u32(vld1q_u32(si1)),
+                    vreinterpretq_u8_u32(vld1q_u32(si3)), wt8);
+
+      vst1q_u8((uint8_t *)&row[i],
+               lerp_u8x16(si02, si13,
+                          vreinterpretq_u8_u32(vld1q_u32(ws))));
+   }
+}
+
+
+static void
+blit_rgb1_row_neon(uint32_t *dst, const uint32_t *src, int width)
+{
+   const uint32x4_t rgb1 = vdupq_n_u32(0xff000000);
+   int i;
+
+   for (i = 0; i + 3 < width; i += 4)
+      vst1q_u32(&dst[i], vorrq_u32(vld1q_u32(&src[i]), rgb1));
+
+   for (; i < width; i++)
+      dst[i] = src[i] | 0xff000000;
+}
+
+
+const struct lp_linear_kernels lp_linear_kernels_neon = {
+   .name = "neon",
+   .interp_row = interp_row_neon,
+   .lerp_rows = lerp_rows_neon,
+   .fetch_linear_row = fetch_linear_row_neon,
+   .blit_rgb1_row = blit_rgb1_row_neon,
+};
+
+#endif /* LP_LINEAR_KERNELS_NEON */
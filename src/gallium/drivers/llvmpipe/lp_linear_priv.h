@@ -2,6 +2,8 @@
 #ifndef LP_LINEAR_PRIV_H
 #define LP_LINEAR_PRIV_H
 
+#include "lp_linear_kernels.h"
+
 struct lp_linear_elem;
 
 typedef const uint32_t *(*lp_linear_func)(struct lp_linear_elem *base);
@@ -29,6 +31,8 @@ struct lp_linear_sampler {
    int width;
    bool axis_aligned;
 
+   const struct lp_linear_kernels *kernels;
+
    alignas(16) uint32_t row[64];
    alignas(16) uint32_t stretched_row[2][64];
 
@@ -52,11 +56,12 @@ struct lp_linear_sampler {
 struct lp_linear_interp {
    struct lp_linear_elem base;
 
-#if DETECT_ARCH_SSE
-   __m128i a0;
-   __m128i dadx;
-   __m128i dady;
-#endif
+   /* 1.15 fixed point BGRA values of a pair of pixels */
+   alignas(16) int16_t a0[8];
+   alignas(16) int16_t dadx[8];
+   alignas(16) int16_t dady[8];
+
+   const struct lp_linear_kernels *kernels;
 
    int width;                   /* rounded up to multiple of 4 */
 
@@ -39,8 +39,6 @@
 #include "lp_state_fs.h"
 #include "lp_linear_priv.h"
 
-#if DETECT_ARCH_SSE
-
 #define FIXED16_SHIFT  16
 #define FIXED16_ONE    (1<<16)
 #define FIXED16_HALF   (1<<15)
@@ -108,6 +106,8 @@ rbx_swap(uint32_t src_val)
    return dst_val;
 }
 
+#if DETECT_ARCH_SSE
+
 /* set alpha channel of 128-bit 4xrgba values to 0xff. */
 static inline __m128i
 rgbx_128(const __m128i src_val)
@@ -155,6 +155,8 @@ rbx_swap_128(const __m128i src_val)
    return rgbx;
 }
 
+#endif /* DETECT_ARCH_SSE */
+
 /*
  * Unstretched blit of a bgra texture.
  */
@@ -230,14 +232,19 @@ fetch_and_stretch_bgra_row(struct lp_linear_sampler *samp,
       }
 
       /* Copy the source texture */
-      for (int i = 0; i < width; i += 4) {
-         __m128i src = _mm_loadu_si128((const __m128i *)&src_row[i]);
-         *(__m128i *)&dst_row[i] = src;
-      }
+      memcpy(dst_row, src_row, align(width, 4) * sizeof *dst_row);
    } else {
+#if DETECT_ARCH_SSE
       util_sse2_stretch_row_8unorm((__m128i *)dst_row,
                                    align(width, 4),
                                    src_row, samp->s, samp->dsdx);
+#else
+      /* A bilinear fetch with t = 0 and no row below is the same lerp
+       * between neighbour texels as util_sse2_stretch_row_8unorm().
+       */
+      samp->kernels->fetch_linear_row(dst_row, src_row, 0, samp->s, 0,
+                                      samp->dsdx, 0, align(width, 4));
+#endif
    }
 
    samp->stretched_row_y[samp->stretched_row_index] = y;
@@ -270,16 +277,9 @@ fetch_axis_aligned_linear_bgra(struct lp_linear_elem *elem)
 
    const uint32_t * restrict src_row1 = fetch_and_stretch_bgra_row(samp, y + 1);
 
-   __m128i wt = _mm_set1_epi16(w);
-
    /* Combine the two rows using a constant weight.
     */
-   for (int i = 0; i < width; i += 4) {
-      __m128i srca = _mm_load_si128((const __m128i *)&src_row0[i]);
-      __m128i srcb = _mm_load_si128((const __m128i *)&src_row1[i]);
-
-      *(__m128i *)&row[i] = util_sse2_lerp_epi8_fixed88(srca, srcb, &wt, &wt);
-   }
+   samp->kernels->lerp_rows(row, src_row0, src_row1, w, align(width, 4));
 
    return row;
 }
@@ -295,43 +295,11 @@ fetch_linear_bgra(struct lp_linear_elem *elem)
    const struct lp_jit_texture *texture = samp->texture;
    const int stride     = texture->row_stride[0] / sizeof(uint32_t);
    const uint32_t *data  = (const uint32_t *)texture->base;
-   const int dsdx  = samp->dsdx;
-   const int dtdx  = samp->dtdx;
-   const int width = samp->width;
    uint32_t *row   = samp->row;
-   int s = samp->s;
-   int t = samp->t;
-
-   for (int i = 0; i < width; i += 4) {
-      union m128i si0, si1, si2, si3, ws, wt;
-      __m128i si02, si13;
-
-      for (int j = 0; j < 4; j++) {
-         const uint32_t *src = data + (t >> 16) * stride + (s >> 16);
 
-         si0.ui[j] = src[0];
-         si1.ui[j] = src[1];
-         si2.ui[j] = src[stride + 0];
-         si3.ui[j] = src[stride + 1];
-
-         ws.ui[j] = (s>>8) & 0xff;
-         wt.ui[j] = (t>>8) & 0xff;
-
-         s += dsdx;
-         t += dtdx;
-      }
-
-      ws.m = _mm_or_si128(ws.m, _mm_slli_epi32(ws.m, 16));
-      ws.m = _mm_or_si128(ws.m, _mm_slli_epi32(ws.m, 8));
-
-      wt.m = _mm_or_si128(wt.m, _mm_slli_epi32(wt.m, 16));
-      wt.m = _mm_or_si128(wt.m, _mm_slli_epi32(wt.m, 8));
-
-      si02 = util_sse2_lerp_epi8_fixed08(si0.m, si2.m, wt.m);
-      si13 = util_sse2_lerp_epi8_fixed08(si1.m, si3.m, wt.m);
-
-      *(__m128i *)&row[i] = util_sse2_lerp_epi8_fixed08(si02, si13, ws.m);
-   }
+   samp->kernels->fetch_linear_row(row, data, stride, samp->s, samp->t,
+                                   samp->dsdx, samp->dtdx,
+                                   align(samp->width, 4));
 
    samp->s += samp->dsdy;
    samp->t += samp->dtdy;
@@ -358,6 +326,7 @@ fetch_clamp_linear_bgra(struct lp_linear_elem *elem)
    int s = samp->s;
    int t = samp->t;
 
+#if DETECT_ARCH_SSE
    /* width, height, stride (in pixels) must be smaller than 32768 */
    __m128i dsdx4, dtdx4, s4, t4, stride4, w4, h4, zero, one;
    s4 = _mm_set1_epi32(s);
@@ -411,29 +380,6 @@ fetch_clamp_linear_bgra(struct lp_linear_elem *elem)
       s4 = _mm_add_epi32(s4, dsdx4);
       t4 = _mm_add_epi32(t4, dtdx4);
 
-#if 0
-/* scalar code for reference */
-      for (int j = 0; j < 4; j++) {
-         int s0 = s >> FIXED16_SHIFT;
-         int t0 = t >> FIXED16_SHIFT;
-         int cs0 = CLAMP(s0    , 0, tex_width);
-         int cs1 = CLAMP(s0 + 1, 0, tex_width);
-         int ct0 = CLAMP(t0    , 0, tex_height);
-         int ct1 = CLAMP(t0 + 1, 0, tex_height);
-
-         si0.ui[j] = data[ct0 * stride + cs0];
-         si1.ui[j] = data[ct0 * stride + cs1];
-         si2.ui[j] = data[ct1 * stride + cs0];
-         si3.ui[j] = data[ct1 * stride + cs1];
-
-         ws.ui[j] = (s>>8) & 0xff;
-         wt.ui[j] = (t>>8) & 0xff;
-
-         s += dsdx;
-         t += dtdx;
-      }
-#endif
-
       ws = _mm_or_si128(ws, _mm_slli_epi32(ws, 16));
       wsl = _mm_shuffle_epi32(ws, _MM_SHUFFLE(1,1,0,0));
       wsh = _mm_shuffle_epi32(ws, _MM_SHUFFLE(3,3,2,2));
@@ -447,6 +393,32 @@ fetch_clamp_linear_bgra(struct lp_linear_elem *elem)
                                                            &wtl, &wth,
                                                            &wsl, &wsh);
    }
+#else
+   for (int i = 0; i < width; i++) {
+      const int s0 = s >> FIXED16_SHIFT;
+      const int t0 = t >> FIXED16_SHIFT;
+      const int cs0 = CLAMP(s0    , 0, tex_width);
+      const int cs1 = CLAMP(s0 + 1, 0, tex_width);
+      const int ct0 = CLAMP(t0    , 0, tex_height);
+      const int ct1 = CLAMP(t0 + 1, 0, tex_height);
+      const uint8_t *si0 = (const uint8_t *)&data[ct0 * stride + cs0];
+      const uint8_t *si1 = (const uint8_t *)&data[ct0 * stride + cs1];
+      const uint8_t *si2 = (const uint8_t *)&data[ct1 * stride + cs0];
+      const uint8_t *si3 = (const uint8_t *)&data[ct1 * stride + cs1];
+      const unsigned ws = (s >> 8) & 0xff;
+      const unsigned wt = (t >> 8) & 0xff;
+      uint8_t *dst = (uint8_t *)&row[i];
+
+      for (unsigned c = 0; c < 4; c++) {
+         uint8_t c02 = lp_linear_lerp_8unorm(si0[c], si2[c], wt);
+         uint8_t c13 = lp_linear_lerp_8unorm(si1[c], si3[c], wt);
+         dst[c] = lp_linear_lerp_8unorm(c02, c13, ws);
+      }
+
+      s += dsdx;
+      t += dtdx;
+   }
+#endif
 
    samp->s += samp->dsdy;
    samp->t += samp->dtdy;
@@ -582,6 +554,7 @@ lp_linear_init_sampler(struct lp_linear_sampler *samp,
 
    samp->texture = texture;
    samp->width = width;
+   samp->kernels = lp_linear_get_kernels();
 
    samp->s = float_to_fixed16(fdsdx * x0 +
                               fdsdy * y0 +
@@ -915,6 +888,10 @@ lp_linear_check_sampler(const struct lp_sampler_static_state *sampler,
        sampler->texture_state.format != PIPE_FORMAT_R8G8B8X8_UNORM)
       return false;
 
+   /* The linear samplers address the texels directly */
+   if (sampler->texture_state.tiled)
+      return false;
+
    /* We don't support sampler view swizzling on the linear path */
    if (sampler->texture_state.swizzle_r != PIPE_SWIZZLE_X ||
        sampler->texture_state.swizzle_g != PIPE_SWIZZLE_Y ||
@@ -925,14 +902,3 @@ lp_linear_check_sampler(const struct lp_sampler_static_state *sampler,
 
    return true;
 }
-
-#else  // DETECT_ARCH_SSE
-
-bool
-lp_linear_check_sampler(const struct lp_sampler_static_state *sampler,
-                        const struct lp_tgsi_texture_info *tex)
-{
-   return false;
-}
-
-#endif  // DETECT_ARCH_SSE
@@ -136,11 +136,16 @@ CONCAT2(fetch_axis_aligned_linear_, FETCH_TYPE)(struct lp_linear_elem *elem)
    const uint32_t *src_row = fetch_axis_aligned_linear_bgra(&samp->base);
    const int width = samp->width;
 
+#if DETECT_ARCH_SSE
    for (int i = 0; i < width; i += 4) {
       __m128i bgra = *(__m128i *)&src_row[i];
       __m128i rgba = OP128(bgra);
       *(__m128i *)&dst_row[i] = rgba;
    }
+#else
+   for (int i = 0; i < width; i++)
+      dst_row[i] = OP(src_row[i]);
+#endif
 
    return dst_row;
 }
@@ -154,11 +159,16 @@ CONCAT2(fetch_clamp_linear_, FETCH_TYPE)(struct lp_linear_elem *elem)
 
    fetch_clamp_linear_bgra(&samp->base);
 
+#if DETECT_ARCH_SSE
    for (int i = 0; i < width; i += 4) {
       __m128i bgra = *(__m128i *)&row[i];
       __m128i rgba = OP128(bgra);
       *(__m128i *)&row[i] = rgba;
    }
+#else
+   for (int i = 0; i < width; i++)
+      row[i] = OP(row[i]);
+#endif
 
    return row;
 }
@@ -172,11 +182,16 @@ CONCAT2(fetch_linear_, FETCH_TYPE)(struct lp_linear_elem *elem)
 
    fetch_linear_bgra(&samp->base);
 
+#if DETECT_ARCH_SSE
    for (int i = 0; i < width; i += 4) {
       __m128i bgra = *(__m128i *)&row[i];
       __m128i rgba = OP128(bgra);
       *(__m128i *)&row[i] = rgba;
    }
+#else
+   for (int i = 0; i < width; i++)
+      row[i] = OP(row[i]);
+#endif
 
    return row;
 }
@@ -45,11 +45,12 @@ void
 lp_print_counters(void)
 {
    if (LP_DEBUG & DEBUG_COUNTERS) {
-      unsigned total_64, total_16, total_4;
+      unsigned total_64, total_16, total_4, total_fs;
       float p1, p2, p3, p4, p5, p6;
 
       debug_printf("llvmpipe: nr_triangles:                 %9u\n", lp_count.nr_tris);
       debug_printf("llvmpipe: nr_culled_triangles:          %9u\n", lp_count.nr_culled_tris);
+      debug_printf("llvmpipe: nr_parallel_binned_triangles: %9u\n", lp_count.nr_parallel_binned_tris);
       debug_printf("llvmpipe: nr_rectangles:                %9u\n", lp_count.nr_rects);
       debug_printf("llvmpipe: nr_culled_rectangles:         %9u\n", lp_count.nr_culled_rects);
 
@@ -114,13 +115,36 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_rect_part_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_rect_partially_covered_4, p2, total_4);
 
 
+      debug_printf("llvmpipe: nr_hiz_culled_64x64:          %9u\n", lp_count.nr_hiz_culled_64);
+      debug_printf("llvmpipe: nr_hiz_culled_16x16:          %9u\n", lp_count.nr_hiz_culled_16);
+      debug_printf("llvmpipe: nr_hiz_culled_4x4:            %9u\n", lp_count.nr_hiz_culled_4);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_rast_bins:                 %9u\n", lp_count.nr_rast_bins);
+      debug_printf("llvmpipe:   nr_stolen_bins:             %9u (%3.0f%% of %u)\n", lp_count.nr_stolen_bins,
+                   100.0 * (float) lp_count.nr_stolen_bins / (float) lp_count.nr_rast_bins, lp_count.nr_rast_bins);
+      debug_printf("llvmpipe: total rast thread wait time:  %.2f sec\n", lp_count.rast_wait_time / 1000000.0);
+      debug_printf("llvmpipe: nr_scene_stalls:              %9u\n", lp_count.nr_scene_stalls);
+      debug_printf("llvmpipe: total scene stall time:       %.2f sec\n", lp_count.scene_stall_time / 1000000.0);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      total_fs = (lp_count.nr_fs_variant_hits +
+                  lp_count.nr_fs_variant_shared_hits +
+                  lp_count.nr_fs_variant_misses);
+
+      debug_printf("llvmpipe: nr_fs_variant_lookups:        %9u\n", total_fs);
+      debug_printf("llvmpipe:   nr_fs_variant_hits:         %9u (%3.0f%% of %u)\n", lp_count.nr_fs_variant_hits,
+                   100.0 * (float) lp_count.nr_fs_variant_hits / (float) total_fs, total_fs);
+      debug_printf("llvmpipe:   nr_fs_variant_shared_hits:  %9u (%3.0f%% of %u)\n", lp_count.nr_fs_variant_shared_hits,
+                   100.0 * (float) lp_count.nr_fs_variant_shared_hits / (float) total_fs, total_fs);
+      debug_printf("llvmpipe:   nr_fs_variant_misses:       %9u (%3.0f%% of %u)\n", lp_count.nr_fs_variant_misses,
+                   100.0 * (float) lp_count.nr_fs_variant_misses / (float) total_fs, total_fs);
+
    }
 }
@@ -42,6 +42,7 @@ struct lp_counters
 {
    unsigned nr_tris;
    unsigned nr_culled_tris;
+   unsigned nr_parallel_binned_tris;
    unsigned nr_rects;
    unsigned nr_culled_rects;
    unsigned nr_empty_64;
@@ -62,12 +63,26 @@ struct lp_counters
    unsigned nr_rect_fully_covered_4;
    unsigned nr_rect_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_culled_64;  /**< triangles/rects culled in a whole tile */
+   unsigned nr_hiz_culled_16;
+   unsigned nr_hiz_culled_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
+   unsigned nr_fs_variant_hits;         /**< found in the shader's table */
+   unsigned nr_fs_variant_shared_hits;  /**< compiled by another context */
+   unsigned nr_fs_variant_misses;
+
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_rast_bins;
+   unsigned nr_stolen_bins;
+   int64_t rast_wait_time;  /**< total, in microseconds */
+
+   unsigned nr_scene_stalls;
+   int64_t scene_stall_time;  /**< total, in microseconds */
 };
 
 
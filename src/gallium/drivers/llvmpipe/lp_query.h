@@ -35,6 +35,7 @@
 
 #include <limits.h>
 #include "util/u_thread.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 
 
@@ -42,6 +43,7 @@ struct llvmpipe_context;
 
 
 struct llvmpipe_query {
+   struct threaded_query b;         /* must be first */
    uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
    uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
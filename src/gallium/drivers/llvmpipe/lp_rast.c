@@ -78,7 +78,7 @@ lp_rast_begin(struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, rast->num_threads);
 }
 
 
@@ -114,6 +114,8 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->thread_data.ps_invocations = 0;
 
+   task->hiz.valid = false;
+
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
@@ -129,6 +131,69 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Initialize the hierarchical Z bounds of the tile from a depth clear.
+ */
+static void
+lp_rast_hiz_clear(struct lp_rasterizer_task *task,
+                  uint64_t clear_value64, uint64_t clear_mask64)
+{
+   const struct lp_scene *scene = task->scene;
+   const enum pipe_format format = scene->fb.zsbuf->format;
+   const uint64_t zmask = util_pack64_mask_z(format, ~0);
+
+   if ((clear_mask64 & zmask) == 0) {
+      /* stencil only */
+      return;
+   }
+
+   if ((clear_mask64 & zmask) != zmask ||
+       scene->fb_max_layer != 0 ||
+       (LP_PERF & PERF_NO_HIZ)) {
+      task->hiz.valid = false;
+      return;
+   }
+
+   union {
+      uint16_t u16;
+      uint32_t u32;
+      uint64_t u64;
+   } packed;
+   float z;
+
+   switch (util_format_get_blocksize(format)) {
+   case 2:
+      packed.u16 = (uint16_t)clear_value64;
+      break;
+   case 4:
+      packed.u32 = (uint32_t)clear_value64;
+      break;
+   case 8:
+      packed.u64 = clear_value64;
+      break;
+   default:
+      task->hiz.valid = false;
+      return;
+   }
+   util_format_unpack_z_float(format, &z, &packed, 1);
+
+   /* Allow for a couple of units in the last place of unorm depth. */
+   if (util_format_is_float(format)) {
+      task->hiz.eps = 0.0f;
+   } else {
+      const unsigned bits =
+         util_format_get_component_bits(format, UTIL_FORMAT_COLORSPACE_ZS, 0);
+      task->hiz.eps = 2.0f / (float)((1ull << bits) - 1);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(task->hiz.zmin); i++) {
+      task->hiz.zmin[i] = z;
+      task->hiz.zmax[i] = z;
+   }
+   task->hiz.valid = true;
+}
+
+
 /**
  * Clear the rasterizer's current color tile.
  * This is a bin command called during bin processing.
@@ -203,6 +268,8 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
     */
 
    if (scene->fb.zsbuf) {
+      lp_rast_hiz_clear(task, clear_value64, clear_mask64);
+
       for (unsigned s = 0; s < scene->zsbuf.nr_samples; s++) {
          uint8_t *dst_layer =
             task->depth_tile + (s * scene->zsbuf.sample_stride);
@@ -317,9 +384,29 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
 
    const struct lp_fragment_shader_variant *variant = state->variant;
 
+   if (lp_rast_hiz_cull(task, inputs, tile_x, tile_y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_culled_64);
+      return;
+   }
+
+   /* hierarchical Z bounds of the 16x16 blocks once the tile is shaded */
+   float hiz_zmin[LP_HIZ_BLOCKS * LP_HIZ_BLOCKS];
+   float hiz_zmax[LP_HIZ_BLOCKS * LP_HIZ_BLOCKS];
+   bool hiz_full[LP_HIZ_BLOCKS * LP_HIZ_BLOCKS];
+   for (unsigned b = 0; b < LP_HIZ_BLOCKS * LP_HIZ_BLOCKS; b++) {
+      hiz_full[b] =
+         lp_rast_hiz_full_block(task, inputs,
+                                tile_x + (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                                tile_y + (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                                &hiz_zmin[b], &hiz_zmax[b]);
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (unsigned y = 0; y < task->height; y += 4){
       for (unsigned x = 0; x < task->width; x += 4) {
+         if (!lp_rast_hiz_quad(task, inputs, tile_x + x, tile_y + y))
+            continue;
+
          /* color buffer */
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
          unsigned stride[PIPE_MAX_COLOR_BUFS];
@@ -378,6 +465,15 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          END_JIT_CALL();
       }
    }
+
+   for (unsigned b = 0; b < LP_HIZ_BLOCKS * LP_HIZ_BLOCKS; b++) {
+      if (hiz_full[b]) {
+         lp_rast_hiz_set_block(task,
+                               tile_x + (b % LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                               tile_y + (b / LP_HIZ_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                               hiz_zmin[b], hiz_zmax[b]);
+      }
+   }
 }
 
 
@@ -461,7 +557,8 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
     * The rasterizer may produce fragments outside our
     * allocated 4x4 blocks hence need to filter them out here.
     */
-   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height &&
+       lp_rast_hiz_quad(task, inputs, x, y)) {
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
@@ -1062,9 +1159,12 @@ rasterize_scene(struct lp_rasterizer_task *task,
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-         if (!is_empty_bin(bin))
+      while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                           &i, &j))) {
+         if (!is_empty_bin(bin)) {
+            LP_COUNT(nr_rast_bins);
             rasterize_bin(task, bin, i, j);
+         }
       }
    }
 
@@ -1202,7 +1302,13 @@ thread_function(void *init_data)
       rasterize_scene(task, rast->curr_scene);
 
       /* wait for all threads to finish with this scene */
-      util_barrier_wait(&rast->barrier);
+      if (LP_DEBUG & DEBUG_COUNTERS) {
+         int64_t wait_start = os_time_get();
+         util_barrier_wait(&rast->barrier);
+         LP_COUNT_ADD(rast_wait_time, os_time_get() - wait_start);
+      } else {
+         util_barrier_wait(&rast->barrier);
+      }
 
       /* XXX: shouldn't be necessary:
        */
@@ -37,6 +37,7 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
@@ -76,6 +77,26 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+/**
+ * Hierarchical Z.
+ *
+ * Conservative bounds of the depth values in each 16x16 block of the
+ * current tile, used to skip fragments which are known to fail the depth
+ * test before running the shader.  The bounds are only known once the
+ * depth buffer has been cleared in the scene, so they are reset for every
+ * tile.  Only the first layer is tracked.
+ */
+#define LP_HIZ_BLOCK_SIZE 16
+#define LP_HIZ_BLOCKS (TILE_SIZE / LP_HIZ_BLOCK_SIZE)
+
+struct lp_rast_hiz
+{
+   bool valid;
+   float eps;   /**< precision of the depth buffer */
+   float zmin[LP_HIZ_BLOCKS * LP_HIZ_BLOCKS];
+   float zmax[LP_HIZ_BLOCKS * LP_HIZ_BLOCKS];
+};
+
 /**
  * Per-thread rasterization state
  */
@@ -91,6 +112,8 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   struct lp_rast_hiz hiz;
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
@@ -218,6 +241,196 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Index of the hierarchical Z block containing x, y.
+ */
+static inline unsigned
+lp_rast_hiz_block(unsigned x, unsigned y)
+{
+   return ((y % TILE_SIZE) / LP_HIZ_BLOCK_SIZE) * LP_HIZ_BLOCKS +
+          (x % TILE_SIZE) / LP_HIZ_BLOCK_SIZE;
+}
+
+
+/**
+ * Conservative bounds of the depth values a primitive can produce in the
+ * size x size area at x, y, after the depth clamp.
+ */
+static inline void
+lp_rast_hiz_depth_bounds(const struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs,
+                         unsigned x, unsigned y, unsigned size,
+                         float *zmin, float *zmax)
+{
+   const struct lp_jit_viewport *viewports =
+      task->state->jit_context.viewports;
+
+   if (!viewports) {
+      *zmin = -INFINITY;
+      *zmax = INFINITY;
+      return;
+   }
+
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float cx = x + size * 0.5f;
+   const float cy = y + size * 0.5f;
+   const float z = a0 + dzdx * cx + dzdy * cy;
+
+   /* Any sample of the area, plus some slack for the shader evaluating the
+    * plane in a different order and for the depth buffer precision.
+    */
+   const float d = (fabsf(dzdx) + fabsf(dzdy)) * (size * 0.5f + 1.0f) +
+                   (fabsf(a0) + fabsf(dzdx * cx) + fabsf(dzdy * cy)) *
+                   4.0f * FLT_EPSILON +
+                   task->hiz.eps;
+
+   /* The shader may clamp to [0, 1] and to the viewport depth range. */
+   const struct lp_jit_viewport *vp = &viewports[inputs->viewport_index];
+   *zmin = MIN3(z - d, 1.0f, vp->max_depth);
+   *zmax = MAX3(z + d, 0.0f, vp->min_depth);
+
+   if (isnan(*zmin) || isnan(*zmax)) {
+      *zmin = -INFINITY;
+      *zmax = INFINITY;
+   }
+}
+
+
+/**
+ * Whether all fragments of a primitive in the size x size area at x, y
+ * are known to fail the depth test.
+ */
+static inline bool
+lp_rast_hiz_cull(const struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 unsigned x, unsigned y, unsigned size)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+
+   if (!task->hiz.valid || !variant->hiz_cull ||
+       inputs->layer + inputs->view_index != 0)
+      return false;
+
+   float zmin, zmax;
+   lp_rast_hiz_depth_bounds(task, inputs, x, y, size, &zmin, &zmax);
+
+   const bool less = variant->key.depth.func == PIPE_FUNC_LESS ||
+                     variant->key.depth.func == PIPE_FUNC_LEQUAL;
+   const unsigned blocks = MAX2(size / LP_HIZ_BLOCK_SIZE, 1);
+   const unsigned first = lp_rast_hiz_block(x, y);
+
+   for (unsigned by = 0; by < blocks; by++) {
+      for (unsigned bx = 0; bx < blocks; bx++) {
+         const unsigned b = first + by * LP_HIZ_BLOCKS + bx;
+         if (less ? zmin <= task->hiz.zmax[b] : zmax >= task->hiz.zmin[b])
+            return false;
+      }
+   }
+
+   return true;
+}
+
+
+/**
+ * Hierarchical Z for a 4x4 block about to be shaded.  Returns false if
+ * the block can be skipped, otherwise accounts for the depth values the
+ * shader may write.
+ */
+static inline bool
+lp_rast_hiz_quad(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 unsigned x, unsigned y)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+
+   if (!task->hiz.valid)
+      return true;
+
+   if (lp_rast_hiz_cull(task, inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_culled_4);
+      return false;
+   }
+
+   if (variant->hiz_writes_z) {
+      if (variant->hiz_shader_z || inputs->layer + inputs->view_index != 0) {
+         task->hiz.valid = false;
+      } else {
+         const unsigned b = lp_rast_hiz_block(x, y);
+         float zmin, zmax;
+
+         lp_rast_hiz_depth_bounds(task, inputs, x, y, 4, &zmin, &zmax);
+         task->hiz.zmin[b] = MIN2(task->hiz.zmin[b], zmin);
+         task->hiz.zmax[b] = MAX2(task->hiz.zmax[b], zmax);
+      }
+   }
+
+   return true;
+}
+
+
+/**
+ * Depth bounds of the 16x16 block at x, y once a primitive covering all of
+ * it has been shaded, computed beforehand from the current bounds.
+ * Returns false if they can't be tightened.
+ */
+static inline bool
+lp_rast_hiz_full_block(const struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       unsigned x, unsigned y,
+                       float *zmin, float *zmax)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+
+   if (!task->hiz.valid || !variant->hiz_full_write ||
+       inputs->layer + inputs->view_index != 0 ||
+       (x % TILE_SIZE) + LP_HIZ_BLOCK_SIZE > task->width ||
+       (y % TILE_SIZE) + LP_HIZ_BLOCK_SIZE > task->height)
+      return false;
+
+   const unsigned b = lp_rast_hiz_block(x, y);
+   float lo, hi;
+
+   lp_rast_hiz_depth_bounds(task, inputs, x, y, LP_HIZ_BLOCK_SIZE, &lo, &hi);
+
+   switch (variant->key.depth.func) {
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      *zmin = MIN2(task->hiz.zmin[b], lo);
+      *zmax = MIN2(task->hiz.zmax[b], hi);
+      break;
+   case PIPE_FUNC_GREATER:
+   case PIPE_FUNC_GEQUAL:
+      *zmin = MAX2(task->hiz.zmin[b], lo);
+      *zmax = MAX2(task->hiz.zmax[b], hi);
+      break;
+   default:
+      *zmin = lo;
+      *zmax = hi;
+      break;
+   }
+
+   return true;
+}
+
+
+/**
+ * Store the bounds from lp_rast_hiz_full_block() after shading the block.
+ */
+static inline void
+lp_rast_hiz_set_block(struct lp_rasterizer_task *task,
+                      unsigned x, unsigned y,
+                      float zmin, float zmax)
+{
+   if (task->hiz.valid) {
+      const unsigned b = lp_rast_hiz_block(x, y);
+      task->hiz.zmin[b] = zmin;
+      task->hiz.zmax[b] = zmax;
+   }
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -266,7 +479,8 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
     * The rasterizer may produce fragments outside our
     * allocated 4x4 blocks hence need to filter them out here.
     */
-   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height &&
+       lp_rast_hiz_quad(task, inputs, x, y)) {
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
@@ -160,6 +160,11 @@ lp_rast_rectangle(struct lp_rasterizer_task *task,
       return;
    }
 
+   if (lp_rast_hiz_cull(task, &rect->inputs, task->x, task->y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_culled_64);
+      return;
+   }
+
    /* Intersect the rectangle with this tile.
     */
    struct u_rect box;
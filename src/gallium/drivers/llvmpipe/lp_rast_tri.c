@@ -57,9 +57,17 @@ block_full_16(struct lp_rasterizer_task *task,
 {
    assert(x % 16 == 0);
    assert(y % 16 == 0);
+
+   float hiz_zmin, hiz_zmax;
+   const bool hiz_full = lp_rast_hiz_full_block(task, &tri->inputs, x, y,
+                                                &hiz_zmin, &hiz_zmax);
+
    for (unsigned iy = 0; iy < 16; iy += 4)
       for (unsigned ix = 0; ix < 16; ix += 4)
          block_full_4(task, tri, x + ix, y + iy);
+
+   if (hiz_full)
+      lp_rast_hiz_set_block(task, x, y, hiz_zmin, hiz_zmax);
 }
 
 static inline unsigned
@@ -210,6 +210,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       return;
    }
 
+   if (lp_rast_hiz_cull(task, &tri->inputs, x, y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_culled_64);
+      return;
+   }
+
    outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
@@ -315,13 +320,18 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       int py = y + iy;
       int64_t cx[NR_PLANES];
 
+      partial_mask &= ~(1 << i);
+
+      if (lp_rast_hiz_cull(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j]
                   - IMUL64(plane[j].dcdx, ix)
                   + IMUL64(plane[j].dcdy, iy));
 
-      partial_mask &= ~(1 << i);
-
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -337,6 +347,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (lp_rast_hiz_cull(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
    }
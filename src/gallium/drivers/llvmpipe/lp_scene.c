@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -34,6 +35,7 @@
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 #include "lp_context.h"
 #include "lp_state_fs.h"
 #include "lp_setup_context.h"
@@ -69,6 +71,17 @@ lp_scene_create(struct lp_setup_context *setup)
       return NULL;
 
    memset(scene, 0, sizeof(struct lp_scene));
+
+   /* The scene slab doesn't align its entries, allocate the ranges
+    * separately so each one really gets a cache line of its own.
+    */
+   scene->bin_range = align_calloc(LP_MAX_THREADS * sizeof(*scene->bin_range),
+                                   CACHE_LINE_SIZE);
+   if (!scene->bin_range) {
+      slab_free_st(&setup->scene_slab, scene);
+      return NULL;
+   }
+
    scene->pipe = setup->pipe;
    scene->setup = setup;
    scene->data.head = &scene->data.first;
@@ -103,6 +116,9 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->bin_order);
+   free(scene->bin_sort_keys);
+   align_free(scene->bin_range);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -147,6 +163,8 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
    struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
 
    bin->last_state = NULL;
+   bin->cost = 0;
+   bin->reset = true;
    bin->head = bin->tail;
    if (bin->tail) {
       bin->tail->next = NULL;
@@ -261,6 +279,7 @@ lp_scene_end_rasterization(struct lp_scene *scene)
                          llvmpipe_resource_size(ref->resource[i]));
          j++;
          llvmpipe_resource_unmap(ref->resource[i], 0, 0);
+         p_atomic_dec(&llvmpipe_resource(ref->resource[i])->scene_refs);
          pipe_resource_reference(&ref->resource[i], NULL);
       }
    }
@@ -277,6 +296,7 @@ lp_scene_end_rasterization(struct lp_scene *scene)
                          llvmpipe_resource_size(ref->resource[i]));
          j++;
          llvmpipe_resource_unmap(ref->resource[i], 0, 0);
+         p_atomic_dec(&llvmpipe_resource(ref->resource[i])->scene_refs);
          pipe_resource_reference(&ref->resource[i], NULL);
       }
    }
@@ -392,14 +412,11 @@ lp_scene_data_size(const struct lp_scene *scene)
 
 
 
-/**
- * Add a reference to a resource by the scene.
- */
-bool
-lp_scene_add_resource_reference(struct lp_scene *scene,
-                                struct pipe_resource *resource,
-                                bool initializing_scene,
-                                bool writeable)
+static bool
+scene_add_resource_reference(struct lp_scene *scene,
+                             struct pipe_resource *resource,
+                             bool initializing_scene,
+                             bool writeable)
 {
    struct resource_ref *ref;
    int i;
@@ -451,6 +468,7 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
    /* Append the reference to the reference block.
     */
    pipe_resource_reference(&ref->resource[ref->count++], resource);
+   p_atomic_inc(&llvmpipe_resource(resource)->scene_refs);
    scene->resource_reference_size += llvmpipe_resource_size(resource);
 
    /* Heuristic to advise scene flushes.  This isn't helpful in the
@@ -463,6 +481,32 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
    return flush;
 }
 
+/**
+ * Add a reference to a resource by the scene.
+ */
+bool
+lp_scene_add_resource_reference(struct lp_scene *scene,
+                                struct pipe_resource *resource,
+                                bool initializing_scene,
+                                bool writeable)
+{
+   struct pipe_resource *storage =
+      (struct pipe_resource *)llvmpipe_resource_storage(resource);
+   bool flush;
+
+   flush = scene_add_resource_reference(scene, resource, initializing_scene,
+                                        writeable);
+
+   /* The scene reads and writes the storage owner's data, keep the owner
+    * busy as well.
+    */
+   if (storage != resource)
+      flush &= scene_add_resource_reference(scene, storage,
+                                            initializing_scene, writeable);
+
+   return flush;
+}
+
 /**
  * Add a reference to a fragment shader variant
  * Return FALSE if out of memory, TRUE otherwise.
@@ -520,6 +564,7 @@ unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
+   const struct pipe_resource *storage = llvmpipe_resource_storage(resource);
    const struct resource_ref *ref;
 
    /* check the render targets */
@@ -531,15 +576,16 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
+   /* Buffers sharing storage count as the same resource. */
    for (ref = scene->resources; ref; ref = ref->next) {
       for (int i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
+         if (llvmpipe_resource_storage(ref->resource[i]) == storage)
             return LP_REFERENCED_FOR_READ;
    }
 
    for (ref = scene->writeable_resources; ref; ref = ref->next) {
       for (int i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
+         if (llvmpipe_resource_storage(ref->resource[i]) == storage)
             return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
@@ -564,24 +610,137 @@ next_bin(struct lp_scene *scene)
 }
 
 
+static int
+compare_bin_sort_keys(const void *a, const void *b)
+{
+   const uint64_t ka = *(const uint64_t *)a;
+   const uint64_t kb = *(const uint64_t *)b;
+   return ka < kb ? -1 : ka > kb;
+}
+
+
+/* Bins are dealt out to the per-thread ranges in runs of this many
+ * consecutive (sorted) bins, so that threads tend to work on
+ * neighbouring tiles.
+ */
+#define LP_BIN_RUN 4
+
+
+/** Which range the k-th bin in cost order is dealt to */
+static inline unsigned
+bin_run_range(unsigned k, unsigned num_ranges)
+{
+   unsigned run = k / LP_BIN_RUN;
+   unsigned pos = run % num_ranges;
+   return (run / num_ranges) & 1 ? num_ranges - 1 - pos : pos;
+}
+
+
+/**
+ * Set up the bin schedule for rasterizing the scene with the given
+ * number of threads.  Called once per scene by one thread, before any
+ * thread calls lp_scene_bin_iter_next().
+ *
+ * Non-empty bins are sorted by estimated cost so the most expensive ones
+ * get started first.  Costs are bucketed by powers of two, which keeps
+ * bins of similar cost in raster order.  The sorted list is then dealt
+ * out to one range per thread in a serpentine pattern so each thread
+ * starts with a similar share of the expensive bins.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_threads)
 {
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+   const unsigned num_ranges = CLAMP(num_threads, 1, LP_MAX_THREADS);
+   unsigned range_start[LP_MAX_THREADS] = {0};
+   unsigned num_sorted = 0;
+
    scene->curr_x = scene->curr_y = -1;
+   scene->num_bin_ranges = 0;
+
+   if ((LP_DEBUG & DEBUG_RASTER_ORDER) || !scene->bin_order)
+      return;
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      const struct cmd_bin *bin = &scene->tiles[i];
+      if (bin->head) {
+         uint64_t bucket = 31 - util_logbase2(bin->cost | 1);
+         scene->bin_sort_keys[num_sorted++] = (bucket << 32) | i;
+      }
+   }
+
+   /* A single thread is best served by plain raster order. */
+   if (num_ranges > 1)
+      qsort(scene->bin_sort_keys, num_sorted, sizeof(uint64_t),
+            compare_bin_sort_keys);
+
+   /* Count the bins in each range, then lay the ranges out back to back
+    * in bin_order.
+    */
+   for (unsigned k = 0; k < num_sorted; k++)
+      range_start[bin_run_range(k, num_ranges)]++;
+
+   unsigned start = 0;
+   for (unsigned r = 0; r < num_ranges; r++) {
+      unsigned count = range_start[r];
+      range_start[r] = start;
+      scene->bin_range[r].next = start;
+      scene->bin_range[r].end = start + count;
+      start += count;
+   }
+
+   for (unsigned k = 0; k < num_sorted; k++) {
+      unsigned r = bin_run_range(k, num_ranges);
+      scene->bin_order[range_start[r]++] = (unsigned)scene->bin_sort_keys[k];
+   }
+
+   scene->num_bin_ranges = num_ranges;
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
  * Multiple rendering threads will call this function to get a chunk
  * of work (a bin) to work on.
+ *
+ * Each thread first drains its own range of the bin order, then steals
+ * from the ranges of the other threads.  Claiming a bin is a single
+ * atomic increment; no locks are taken.
+ *
+ * With LP_DEBUG=raster_order the bins are handed out one at a time in
+ * raster order, advancing lp_scene::curr_x and ::curr_y under the scene
+ * mutex.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread_index,
+                       int *x, int *y)
 {
    struct cmd_bin *bin = NULL;
 
+   if (scene->num_bin_ranges) {
+      const unsigned num_ranges = scene->num_bin_ranges;
+
+      for (unsigned i = 0; i < num_ranges; i++) {
+         struct lp_scene_bin_range *range =
+            &scene->bin_range[(thread_index + i) % num_ranges];
+
+         if (p_atomic_read_relaxed(&range->next) >= range->end)
+            continue;
+
+         unsigned pos = p_atomic_fetch_add(&range->next, 1);
+         if (pos < range->end) {
+            unsigned idx = scene->bin_order[pos];
+            if (i)
+               LP_COUNT(nr_stolen_bins);
+            *x = idx % scene->tiles_x;
+            *y = idx / scene->tiles_x;
+            return &scene->tiles[idx];
+         }
+      }
+
+      return NULL;
+   }
+
    mtx_lock(&scene->mutex);
 
    if (scene->curr_x < 0) {
@@ -625,6 +784,20 @@ lp_scene_begin_binning(struct lp_scene *scene,
          return;
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
       scene->num_alloced_tiles = num_required_tiles;
+
+      /* Bin schedule storage.  On failure we fall back to handing out
+       * the bins in raster order.
+       */
+      free(scene->bin_order);
+      free(scene->bin_sort_keys);
+      scene->bin_order = malloc(num_required_tiles * sizeof(unsigned));
+      scene->bin_sort_keys = malloc(num_required_tiles * sizeof(uint64_t));
+      if (!scene->bin_order || !scene->bin_sort_keys) {
+         free(scene->bin_order);
+         free(scene->bin_sort_keys);
+         scene->bin_order = NULL;
+         scene->bin_sort_keys = NULL;
+      }
    }
 
    /*
@@ -662,6 +835,164 @@ lp_scene_begin_binning(struct lp_scene *scene,
 }
 
 
+/**
+ * Prepare 'chunk' for binning a run of primitives belonging to 'scene',
+ * typically on another thread than the one building 'scene'.
+ *
+ * The chunk gets its own bins and data blocks and may allocate at most
+ * 'max_size' bytes of the latter.  Its bins start out with the state last
+ * set in the scene's bins.  Once done, lp_scene_merge_chunk() appends its
+ * commands to those already in 'scene', or lp_scene_discard_chunk() throws
+ * them away.
+ */
+bool
+lp_scene_begin_chunk(struct lp_scene *chunk,
+                     const struct lp_scene *scene,
+                     unsigned max_size)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   if (chunk->num_alloced_tiles < num_bins) {
+      free(chunk->tiles);
+      chunk->tiles = calloc(num_bins, sizeof(struct cmd_bin));
+      if (!chunk->tiles) {
+         chunk->num_alloced_tiles = 0;
+         return false;
+      }
+      chunk->num_alloced_tiles = num_bins;
+   }
+
+   for (unsigned i = 0; i < num_bins; i++)
+      chunk->tiles[i].last_state = scene->tiles[i].last_state;
+
+   chunk->tiles_x = scene->tiles_x;
+   chunk->tiles_y = scene->tiles_y;
+   chunk->fb_max_layer = scene->fb_max_layer;
+   chunk->fb_max_samples = scene->fb_max_samples;
+   memcpy(chunk->fixed_sample_pos, scene->fixed_sample_pos,
+          sizeof(chunk->fixed_sample_pos));
+   chunk->had_queries = scene->had_queries;
+
+   /* Binning only looks at whether there is a depth/stencil buffer.  The
+    * surface is borrowed, not referenced, and cleared again once the chunk
+    * is merged or discarded.
+    */
+   chunk->fb.zsbuf = scene->fb.zsbuf;
+
+   /* The chunk (and its embedded first data block) is reused for the next
+    * run while the scene may still be waiting to be rasterized, so only
+    * ever allocate from freshly malloc'ed blocks.
+    */
+   assert(chunk->data.head == &chunk->data.first);
+   chunk->data.first.used = DATA_BLOCK_SIZE;
+   chunk->scene_size = LP_SCENE_MAX_SIZE - MIN2(max_size, LP_SCENE_MAX_SIZE);
+   chunk->alloc_failed = false;
+
+   return true;
+}
+
+
+/**
+ * Append the commands binned into 'chunk' to the end of the corresponding
+ * bins of 'scene', and hand the chunk's data blocks over to the scene.
+ *
+ * The result is what binning the chunk's primitives straight into 'scene'
+ * would have produced: bins the chunk reset for an opaque tile drop the
+ * scene's commands, and the chunk's first state command is dropped when an
+ * earlier chunk merged into the scene already set that state.
+ */
+void
+lp_scene_merge_chunk(struct lp_scene *scene,
+                     struct lp_scene *chunk)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      struct cmd_bin *src = &chunk->tiles[i];
+      struct cmd_bin *dst = &scene->tiles[i];
+
+      if (src->reset) {
+         dst->head = src->head;
+         dst->tail = src->tail;
+         dst->last_state = src->last_state;
+         dst->cost = src->cost;
+         memset(src, 0, sizeof *src);
+         continue;
+      }
+
+      if (!src->head)
+         continue;
+
+      /* Binned with the same state throughout, so a state command can only
+       * come first.
+       */
+      struct cmd_block *head = src->head;
+      if (head->count && head->cmd[0] == LP_RAST_OP_SET_STATE &&
+          head->arg[0].set_state == dst->last_state) {
+         head->count--;
+         memmove(&head->cmd[0], &head->cmd[1],
+                 head->count * sizeof head->cmd[0]);
+         memmove(&head->arg[0], &head->arg[1],
+                 head->count * sizeof head->arg[0]);
+         src->cost--;
+      }
+
+      if (dst->tail)
+         dst->tail->next = src->head;
+      else
+         dst->head = src->head;
+      dst->tail = src->tail;
+      dst->last_state = src->last_state;
+      dst->cost += src->cost;
+
+      memset(src, 0, sizeof *src);
+   }
+
+   /* Splice the chunk's blocks in behind the scene's current block, so
+    * the scene keeps filling that one.
+    */
+   struct data_block *first = NULL, *last = NULL;
+   for (struct data_block *block = chunk->data.head;
+        block != &chunk->data.first; block = block->next) {
+      if (!first)
+         first = block;
+      last = block;
+      scene->scene_size += sizeof *block;
+   }
+
+   if (first) {
+      last->next = scene->data.head->next;
+      scene->data.head->next = first;
+   }
+
+   chunk->data.head = &chunk->data.first;
+   chunk->data.first.next = NULL;
+   chunk->data.first.used = 0;
+   chunk->fb.zsbuf = NULL;
+}
+
+
+/**
+ * Throw away everything binned into 'chunk'.
+ */
+void
+lp_scene_discard_chunk(struct lp_scene *chunk)
+{
+   memset(chunk->tiles, 0, sizeof(struct cmd_bin) * chunk->num_alloced_tiles);
+
+   struct data_block *block, *tmp;
+   for (block = chunk->data.head; block != &chunk->data.first; block = tmp) {
+      tmp = block->next;
+      FREE(block);
+   }
+
+   chunk->data.head = &chunk->data.first;
+   chunk->data.first.next = NULL;
+   chunk->data.first.used = 0;
+   chunk->fb.zsbuf = NULL;
+}
+
+
 void
 lp_scene_end_binning(struct lp_scene *scene)
 {
@@ -35,9 +35,11 @@
 #ifndef LP_SCENE_H
 #define LP_SCENE_H
 
+#include "util/u_memory.h"
 #include "util/u_thread.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
+#include "lp_limits.h"
 
 struct lp_scene_queue;
 struct lp_rast_state;
@@ -98,6 +100,22 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;  /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   unsigned cost;  /* estimated rasterization cost (commands binned) */
+   bool reset;     /* chunks only: drop the scene's commands when merging */
+};
+
+
+/**
+ * A range of the scene's bin order owned by one rasterizer thread.
+ * Threads claim bins from their own range first and steal from the
+ * other ranges once it is drained.  Kept on its own cache line since
+ * 'next' is bumped atomically by every thread working on the range.
+ */
+struct lp_scene_bin_range {
+   EXCLUSIVE_CACHELINE(struct {
+      unsigned next;
+      unsigned end;
+   });
 };
 
 
@@ -195,9 +213,19 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
+   int curr_x, curr_y;  /**< for iterating over bins (raster order) */
    mtx_t mutex;
 
+   /**
+    * Bin scheduling, set up by lp_scene_bin_iter_begin().  When
+    * num_bin_ranges is zero bins are handed out in raster order under
+    * the scene mutex instead.
+    */
+   unsigned num_bin_ranges;
+   struct lp_scene_bin_range *bin_range;  /**< LP_MAX_THREADS, cache aligned */
+   unsigned *bin_order;
+   uint64_t *bin_sort_keys;
+
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
    struct data_block_list data;
@@ -342,6 +370,8 @@ lp_scene_bin_command(struct lp_scene *scene,
       tail->count++;
    }
 
+   bin->cost++;
+
    return true;
 }
 
@@ -396,11 +426,28 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_threads);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread_index,
+                       int *x, int *y);
+
+
+
+/* Binning of a run of primitives into a chunk scene on another thread,
+ * see lp_setup_parallel.c.
+ */
+bool
+lp_scene_begin_chunk(struct lp_scene *chunk,
+                     const struct lp_scene *scene,
+                     unsigned max_size);
+
+void
+lp_scene_merge_chunk(struct lp_scene *scene,
+                     struct lp_scene *chunk);
 
+void
+lp_scene_discard_chunk(struct lp_scene *chunk);
 
 
 /* Begin/end binning of a scene
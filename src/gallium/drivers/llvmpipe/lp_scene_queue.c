@@ -36,10 +36,9 @@
 #include "util/u_memory.h"
 #include "lp_scene_queue.h"
 #include "util/u_math.h"
-#include "lp_setup_context.h"
 
 
-#define SCENE_QUEUE_SIZE MAX_SCENES
+#define SCENE_QUEUE_INITIAL_SIZE 64
 
 
 
@@ -48,7 +47,8 @@
  */
 struct lp_scene_queue
 {
-   struct lp_scene *scenes[SCENE_QUEUE_SIZE];
+   struct lp_scene **scenes;
+   unsigned size;
 
    mtx_t mutex;
    cnd_t change;
@@ -68,14 +68,22 @@ struct lp_scene_queue *
 lp_scene_queue_create(void)
 {
    /* Circular queue behavior depends on size being a power of two. */
-   STATIC_ASSERT(SCENE_QUEUE_SIZE > 0);
-   STATIC_ASSERT((SCENE_QUEUE_SIZE & (SCENE_QUEUE_SIZE - 1)) == 0);
+   STATIC_ASSERT(SCENE_QUEUE_INITIAL_SIZE > 0);
+   STATIC_ASSERT((SCENE_QUEUE_INITIAL_SIZE &
+                  (SCENE_QUEUE_INITIAL_SIZE - 1)) == 0);
 
    struct lp_scene_queue *queue = CALLOC_STRUCT(lp_scene_queue);
 
    if (!queue)
       return NULL;
 
+   queue->scenes = CALLOC(SCENE_QUEUE_INITIAL_SIZE, sizeof(*queue->scenes));
+   if (!queue->scenes) {
+      FREE(queue);
+      return NULL;
+   }
+   queue->size = SCENE_QUEUE_INITIAL_SIZE;
+
    (void) mtx_init(&queue->mutex, mtx_plain);
    cnd_init(&queue->change);
 
@@ -89,10 +97,37 @@ lp_scene_queue_destroy(struct lp_scene_queue *queue)
 {
    cnd_destroy(&queue->change);
    mtx_destroy(&queue->mutex);
+   FREE(queue->scenes);
    FREE(queue);
 }
 
 
+/**
+ * Double the queue size, keeping the queued scenes in order.
+ * Called with the queue mutex held.
+ */
+static bool
+lp_scene_queue_grow(struct lp_scene_queue *queue)
+{
+   const unsigned count = queue->tail - queue->head;
+   struct lp_scene **scenes = CALLOC(2 * queue->size, sizeof(*scenes));
+
+   if (!scenes)
+      return false;
+
+   for (unsigned i = 0; i < count; i++)
+      scenes[i] = queue->scenes[(queue->head + i) % queue->size];
+
+   FREE(queue->scenes);
+   queue->scenes = scenes;
+   queue->size *= 2;
+   queue->head = 0;
+   queue->tail = count;
+
+   return true;
+}
+
+
 /** Remove first lp_scene from head of queue */
 struct lp_scene *
 lp_scene_dequeue(struct lp_scene_queue *queue, bool wait)
@@ -110,7 +145,7 @@ lp_scene_dequeue(struct lp_scene_queue *queue, bool wait)
       }
    }
 
-   struct lp_scene *scene = queue->scenes[queue->head++ % SCENE_QUEUE_SIZE];
+   struct lp_scene *scene = queue->scenes[queue->head++ % queue->size];
 
    cnd_signal(&queue->change);
    mtx_unlock(&queue->mutex);
@@ -125,11 +160,17 @@ lp_scene_enqueue(struct lp_scene_queue *queue, struct lp_scene *scene)
 {
    mtx_lock(&queue->mutex);
 
-   /* Wait for free space. */
-   while (queue->tail - queue->head >= SCENE_QUEUE_SIZE)
+   /* The number of scenes in flight is bounded by the contexts' scene
+    * memory budget, so grow rather than block.  Only wait for free space
+    * if that fails.
+    */
+   if (queue->tail - queue->head >= queue->size)
+      lp_scene_queue_grow(queue);
+
+   while (queue->tail - queue->head >= queue->size)
       cnd_wait(&queue->change, &queue->mutex);
 
-   queue->scenes[queue->tail++ % SCENE_QUEUE_SIZE] = scene;
+   queue->scenes[queue->tail++ % queue->size] = scene;
 
    cnd_signal(&queue->change);
    mtx_unlock(&queue->mutex);
@@ -39,6 +39,7 @@
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_nir.h"
 #include "util/disk_cache.h"
+#include "util/hash_table.h"
 #include "util/hex.h"
 #include "util/os_misc.h"
 #include "util/os_time.h"
@@ -54,6 +55,7 @@
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
 #include "lp_flush.h"
+#include "lp_state_fs.h"
 
 #include "frontend/sw_winsys.h"
 
@@ -85,6 +87,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "cs", DEBUG_CS, NULL },
    { "accurate_a0", DEBUG_ACCURATE_A0 },
    { "mesh", DEBUG_MESH },
+   { "raster_order", DEBUG_RASTER_ORDER, "rasterize bins in raster order instead of by cost" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -100,6 +103,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_tiled_tex",   PERF_NO_TILED_TEX, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -899,6 +904,7 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    assert(texture->dt);
 
    if (texture->dt) {
+      _pipe = threaded_context_unwrap_sync(_pipe);
       if (_pipe)
          llvmpipe_flush_resource(_pipe, resource, 0, true, true,
                                  false, "frontbuffer");
@@ -931,6 +937,13 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 
    mtx_destroy(&screen->rast_mutex);
    mtx_destroy(&screen->cs_mutex);
+   mtx_destroy(&screen->cs_variant_mutex);
+   if (screen->async_fs_compile)
+      util_queue_destroy(&screen->fs_compile_queue);
+   _mesa_hash_table_destroy(screen->fs_variants, NULL);
+   mtx_destroy(&screen->fs_variant_mutex);
+   slab_destroy_parent(&screen->transfer_pool);
+   util_idalloc_mt_fini(&screen->buffer_ids);
    FREE(screen);
 }
 
@@ -961,6 +974,30 @@ llvmpipe_fence_finish(struct pipe_screen *screen,
 {
    struct lp_fence *f = (struct lp_fence *) fence_handle;
 
+   /* Fences of the threaded context need their flush to have run first. */
+   if (!util_queue_fence_is_signalled(&f->ready)) {
+      const int64_t abs_timeout = os_time_get_absolute_timeout(timeout);
+
+      if (f->tc_token && ctx)
+         threaded_context_flush(ctx, f->tc_token, timeout == 0);
+
+      if (!timeout)
+         return false;
+
+      if (timeout == OS_TIMEOUT_INFINITE) {
+         util_queue_fence_wait(&f->ready);
+      } else {
+         if (!util_queue_fence_wait_timeout(&f->ready, abs_timeout))
+            return false;
+
+         const int64_t now = os_time_get_nano();
+         timeout = abs_timeout > now ? abs_timeout - now : 0;
+      }
+   }
+
+   if (f->flushed)
+      f = f->flushed;
+
    if (!timeout)
       return lp_fence_signalled(f);
 
@@ -1165,6 +1202,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS",
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
+   screen->parallel_binning = debug_get_bool_option("LP_PARALLEL_BINNING",
+                                                    false);
 
 #ifdef HAVE_LINUX_UDMABUF_H
    screen->udmabuf_fd = open("/dev/udmabuf", O_RDWR);
@@ -1176,9 +1215,26 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 
    list_inithead(&screen->ctx_list);
    (void) mtx_init(&screen->ctx_mutex, mtx_plain);
+   slab_create_parent(&screen->transfer_pool,
+                      sizeof(struct llvmpipe_transfer), 64);
+   util_idalloc_mt_init_tc(&screen->buffer_ids);
    (void) mtx_init(&screen->cs_mutex, mtx_plain);
+   (void) mtx_init(&screen->cs_variant_mutex, mtx_plain);
+   (void) mtx_init(&screen->fs_variant_mutex, mtx_plain);
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
+   screen->fs_variants = _mesa_hash_table_create(NULL, lp_fs_variant_key_hash,
+                                                 lp_fs_variant_key_equal);
+
+   screen->async_fs_compile = debug_get_bool_option("LP_ASYNC_COMPILE", false);
+   if (screen->async_fs_compile &&
+       !util_queue_init(&screen->fs_compile_queue, "lpfs", 64,
+                        MAX2(util_get_cpu_caps()->nr_cpus / 4, 1),
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                        UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY |
+                        UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY, NULL))
+      screen->async_fs_compile = false;
+
    (void) mtx_init(&screen->late_mutex, mtx_plain);
 
    return &screen->base;
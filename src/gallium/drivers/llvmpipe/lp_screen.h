@@ -36,13 +36,17 @@
 
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
+#include "util/u_idalloc.h"
+#include "util/u_queue.h"
 #include "util/u_thread.h"
 #include "util/list.h"
+#include "util/slab.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
 
 struct sw_winsys;
 struct lp_cs_tpool;
+struct hash_table;
 
 struct llvmpipe_screen
 {
@@ -62,7 +66,26 @@ struct llvmpipe_screen
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
+   /* Protects the compute/task/mesh shader variant lists, which are shared
+    * by all contexts the shader is bound in.
+    */
+   mtx_t cs_variant_mutex;
+
+   /* Fragment shader variants of all contexts indexed by key, for contexts
+    * to share the compiled code.  Holds no references: a variant removes
+    * itself when destroyed.
+    */
+   mtx_t fs_variant_mutex;
+   struct hash_table *fs_variants;
+
+   /* With LP_ASYNC_COMPILE, fragment shader variants are compiled on
+    * this queue when the shader is bound.
+    */
+   bool async_fs_compile;
+   struct util_queue fs_compile_queue;
+
    bool allow_cl;
+   bool parallel_binning;
 
    mtx_t late_mutex;
    bool late_init_done;
@@ -70,6 +93,10 @@ struct llvmpipe_screen
    mtx_t ctx_mutex;
    struct list_head ctx_list;
 
+   /* For the transfers and buffer IDs of u_threaded_context. */
+   struct slab_parent_pool transfer_pool;
+   struct util_idalloc_mt buffer_ids;
+
    char renderer_string[100];
 
    struct disk_cache *disk_shader_cache;
@@ -55,6 +55,8 @@
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_jit.h"
+#include "lp_linear_kernels.h"
+#include "lp_perf.h"
 #include "frontend/sw_winsys.h"
 
 #include "draw/draw_context.h"
@@ -65,15 +67,42 @@ static bool
 try_update_scene_state(struct lp_setup_context *setup);
 
 
+/**
+ * Memory held by a scene until it has been rasterized.
+ */
+static unsigned
+lp_setup_scene_footprint(const struct lp_scene *scene)
+{
+   return sizeof(struct lp_scene) + scene->scene_size +
+          scene->num_alloced_tiles * sizeof(struct cmd_bin);
+}
+
+
 static unsigned
 lp_setup_wait_empty_scene(struct lp_setup_context *setup)
 {
-   /* just use the first scene if we run out */
-   if (setup->scenes[0]->fence) {
-      lp_fence_wait(setup->scenes[0]->fence);
-      lp_scene_end_rasterization(setup->scenes[0]);
+   /* wait for the scene which was queued first, it's done soonest */
+   unsigned oldest = 0;
+   for (unsigned i = 1; i < setup->num_active_scenes; i++) {
+      const struct lp_fence *fence = setup->scenes[i]->fence;
+      const struct lp_fence *oldest_fence = setup->scenes[oldest]->fence;
+      if (fence &&
+          (!oldest_fence || (int)(fence->id - oldest_fence->id) < 0))
+         oldest = i;
    }
-   return 0;
+
+   if (setup->scenes[oldest]->fence) {
+      if (LP_DEBUG & DEBUG_COUNTERS) {
+         int64_t wait_start = os_time_get();
+         lp_fence_wait(setup->scenes[oldest]->fence);
+         LP_COUNT(nr_scene_stalls);
+         LP_COUNT_ADD(scene_stall_time, os_time_get() - wait_start);
+      } else {
+         lp_fence_wait(setup->scenes[oldest]->fence);
+      }
+      lp_scene_end_rasterization(setup->scenes[oldest]);
+   }
+   return oldest;
 }
 
 
@@ -81,6 +110,7 @@ static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
    assert(setup->scene == NULL);
+   unsigned in_flight_size = 0;
    unsigned i;
 
    /* try and find a scene that isn't being used */
@@ -90,16 +120,35 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
             lp_scene_end_rasterization(setup->scenes[i]);
             break;
          }
+         in_flight_size += lp_setup_scene_footprint(setup->scenes[i]);
       } else {
          break;
       }
    }
 
-   if (setup->num_active_scenes + 1 > MAX_SCENES) {
-      i = lp_setup_wait_empty_scene(setup);
-   } else if (i == setup->num_active_scenes) {
-      /* allocate a new scene */
-      struct lp_scene *scene = lp_scene_create(setup);
+   if (i == setup->num_active_scenes) {
+      /* All scenes are busy.  Allocate a new one as long as the memory
+       * held by the busy ones stays within budget, otherwise block.
+       */
+      struct lp_scene *scene = NULL;
+
+      if (in_flight_size + sizeof(struct lp_scene) <=
+          MAX_SCENES_IN_FLIGHT_SIZE) {
+         if (setup->num_active_scenes == setup->max_scenes) {
+            struct lp_scene **scenes =
+               REALLOC(setup->scenes,
+                       setup->max_scenes * sizeof(*scenes),
+                       2 * setup->max_scenes * sizeof(*scenes));
+            if (scenes) {
+               setup->scenes = scenes;
+               setup->max_scenes *= 2;
+            }
+         }
+
+         if (setup->num_active_scenes < setup->max_scenes)
+            scene = lp_scene_create(setup);
+      }
+
       if (!scene) {
          /* block and reuse scenes */
          i = lp_setup_wait_empty_scene(setup);
@@ -181,6 +230,7 @@ lp_setup_reset(struct lp_setup_context *setup)
 
    /* no current bin */
    setup->scene = NULL;
+   setup->batch.num_tris = 0;
 
    /* Reset some state:
     */
@@ -325,6 +375,8 @@ set_scene_state(struct lp_setup_context *setup,
 {
    const unsigned old_state = setup->state;
 
+   lp_setup_flush_batch(setup);
+
    if (old_state == new_state)
       return true;
 
@@ -542,6 +594,8 @@ lp_setup_clear(struct lp_setup_context *setup,
                unsigned stencil,
                unsigned flags)
 {
+   lp_setup_flush_batch(setup);
+
    /*
     * Note any of these (max 9) clears could fail (but at most there should
     * be just one failure!). This avoids doing the previous succeeded
@@ -580,6 +634,8 @@ lp_setup_bind_rasterizer(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    setup->ccw_is_frontface = rast->front_ccw;
    setup->cullmode = rast->cull_face;
    setup->triangle = first_triangle;
@@ -612,6 +668,8 @@ lp_setup_set_setup_variant(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    setup->setup.variant = variant;
 }
 
@@ -622,6 +680,8 @@ lp_setup_set_fs_variant(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %p\n", __func__, variant);
 
+   lp_setup_flush_batch(setup);
+
    setup->fs.current.variant = variant;
    setup->dirty |= LP_SETUP_NEW_FS;
 }
@@ -634,6 +694,8 @@ lp_setup_set_fs_constants(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %p\n", __func__, (void *) buffers);
 
+   lp_setup_flush_batch(setup);
+
    assert(num <= ARRAY_SIZE(setup->constants));
 
    unsigned i;
@@ -656,6 +718,8 @@ lp_setup_set_fs_ssbos(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %p\n", __func__, (void *) buffers);
 
+   lp_setup_flush_batch(setup);
+
    assert(num <= ARRAY_SIZE(setup->ssbos));
 
    unsigned i;
@@ -679,6 +743,8 @@ lp_setup_set_fs_images(struct lp_setup_context *setup,
 
    LP_DBG(DEBUG_SETUP, "%s %p\n", __func__, (void *) images);
 
+   lp_setup_flush_batch(setup);
+
    assert(num <= ARRAY_SIZE(setup->images));
 
    for (i = 0; i < num; ++i) {
@@ -706,6 +772,8 @@ lp_setup_set_alpha_ref_value(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %f\n", __func__, alpha_ref_value);
 
+   lp_setup_flush_batch(setup);
+
    if (setup->fs.current.jit_context.alpha_ref_value != alpha_ref_value) {
       setup->fs.current.jit_context.alpha_ref_value = alpha_ref_value;
       setup->dirty |= LP_SETUP_NEW_FS;
@@ -719,6 +787,8 @@ lp_setup_set_stencil_ref_values(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %d %d\n", __func__, refs[0], refs[1]);
 
+   lp_setup_flush_batch(setup);
+
    if (setup->fs.current.jit_context.stencil_ref_front != refs[0] ||
        setup->fs.current.jit_context.stencil_ref_back != refs[1]) {
       setup->fs.current.jit_context.stencil_ref_front = refs[0];
@@ -734,6 +804,8 @@ lp_setup_set_blend_color(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    assert(blend_color);
 
    if (memcmp(&setup->blend_color.current,
@@ -750,6 +822,8 @@ lp_setup_set_scissors(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    assert(scissors);
 
    for (unsigned i = 0; i < PIPE_MAX_VIEWPORTS; ++i) {
@@ -766,6 +840,8 @@ void
 lp_setup_set_sample_mask(struct lp_setup_context *setup,
                          uint32_t sample_mask)
 {
+   lp_setup_flush_batch(setup);
+
    if (setup->fs.current.jit_context.sample_mask != sample_mask) {
       setup->fs.current.jit_context.sample_mask = sample_mask;
       setup->dirty |= LP_SETUP_NEW_FS;
@@ -777,6 +853,8 @@ void
 lp_setup_set_rasterizer_discard(struct lp_setup_context *setup,
                                 bool rasterizer_discard)
 {
+   lp_setup_flush_batch(setup);
+
    if (setup->rasterizer_discard != rasterizer_discard) {
       setup->rasterizer_discard = rasterizer_discard;
       setup->line = first_line;
@@ -791,6 +869,8 @@ void
 lp_setup_set_vertex_info(struct lp_setup_context *setup,
                          struct vertex_info *vertex_info)
 {
+   lp_setup_flush_batch(setup);
+
    /* XXX: just silently holding onto the pointer:
     */
    setup->vertex_info = vertex_info;
@@ -801,17 +881,26 @@ void
 lp_setup_set_linear_mode(struct lp_setup_context *setup,
                          bool mode)
 {
-   /* The linear rasterizer requires sse2 both at compile and runtime,
-    * in particular for the code in lp_rast_linear_fallback.c.  This
-    * is more than ten-year-old technology, so it's a reasonable
-    * baseline.
+   lp_setup_flush_batch(setup);
+
+   /* The linear rasterizer only pays off with the vector row kernels of
+    * lp_linear_kernels.c, so require sse2 or neon both at compile and
+    * runtime.  Both are more than ten-year-old technology, so it's a
+    * reasonable baseline.
     */
 #if DETECT_ARCH_SSE
-   setup->permit_linear_rasterizer = (mode &&
-                                      util_get_cpu_caps()->has_sse2);
+   mode = mode && util_get_cpu_caps()->has_sse2;
+#elif defined(LP_LINEAR_KERNELS_NEON)
+   mode = mode && (DETECT_ARCH_AARCH64 || util_get_cpu_caps()->has_neon);
 #else
-   setup->permit_linear_rasterizer = false;
+   mode = false;
 #endif
+
+   if (setup->permit_linear_rasterizer != mode) {
+      setup->permit_linear_rasterizer = mode;
+      /* lp_setup_choose_triangle() depends on this */
+      setup->triangle = first_triangle;
+   }
 }
 
 
@@ -827,6 +916,8 @@ lp_setup_set_viewports(struct lp_setup_context *setup,
 
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    assert(num_viewports <= PIPE_MAX_VIEWPORTS);
    assert(viewports);
 
@@ -879,6 +970,8 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    assert(num <= PIPE_MAX_SHADER_SAMPLER_VIEWS);
 
    const unsigned max_tex_num = MAX2(num, setup->fs.current_tex_num);
@@ -923,6 +1016,8 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_batch(setup);
+
    assert(num <= PIPE_MAX_SAMPLERS);
 
    for (unsigned i = 0; i < PIPE_MAX_SAMPLERS; i++) {
@@ -973,6 +1068,29 @@ lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
 }
 
 
+/**
+ * Make every scene that is being binned or rasterized hold a reference to
+ * the resource, so that it outlives them.
+ * Return false if out of memory.
+ */
+bool
+lp_setup_reference_in_flight(struct lp_setup_context *setup,
+                             struct pipe_resource *resource)
+{
+   bool ok = true;
+
+   for (unsigned i = 0; i < setup->num_active_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene == setup->scene ||
+          (scene->fence && !lp_fence_signalled(scene->fence)))
+         ok &= lp_scene_add_resource_reference(scene, resource, true, false);
+   }
+
+   return ok;
+}
+
+
 /**
  * Called by vbuf code when we're about to draw something.
  *
@@ -1211,7 +1329,10 @@ lp_setup_update_state(struct lp_setup_context *setup,
     */
    {
       struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+
       if (lp->dirty) {
+         /* Bin anything still batched with the state it was drawn with. */
+         lp_setup_flush_batch(setup);
          llvmpipe_update_derived(lp);
       }
 
@@ -1314,7 +1435,9 @@ lp_setup_destroy(struct lp_setup_context *setup)
    }
 
    LP_DBG(DEBUG_SETUP, "number of scenes used: %d\n", setup->num_active_scenes);
+   lp_setup_destroy_batch(setup);
    slab_destroy(&setup->scene_slab);
+   FREE(setup->scenes);
 
    FREE(setup);
 }
@@ -1347,6 +1470,7 @@ lp_setup_create(struct pipe_context *pipe,
    setup->pipe = pipe;
 
    setup->num_threads = screen->num_threads;
+   setup->batch.enabled = screen->parallel_binning && setup->num_threads > 1;
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1358,6 +1482,12 @@ lp_setup_create(struct pipe_context *pipe,
    slab_create(&setup->scene_slab,
                sizeof(struct lp_scene),
                INITIAL_SCENES);
+   setup->scenes = CALLOC(INITIAL_SCENES, sizeof(*setup->scenes));
+   if (!setup->scenes) {
+      goto no_scenes;
+   }
+   setup->max_scenes = INITIAL_SCENES;
+
    /* create just one scene for starting point */
    setup->scenes[0] = lp_scene_create(setup);
    if (!setup->scenes[0]) {
@@ -1378,11 +1508,8 @@ lp_setup_create(struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (unsigned i = 0; i < MAX_SCENES; i++) {
-      if (setup->scenes[i]) {
-         lp_scene_destroy(setup->scenes[i]);
-      }
-   }
+   FREE(setup->scenes);
+   slab_destroy(&setup->scene_slab);
 
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
@@ -1532,6 +1659,25 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 }
 
 
+/**
+ * As above, but for binning batched triangles, which must use the state
+ * they were captured with even if the context has changed since.
+ */
+bool
+lp_setup_restart_scene(struct lp_setup_context *setup)
+{
+   assert(setup->state == SETUP_ACTIVE);
+
+   if (!set_scene_state(setup, SETUP_FLUSHED, __func__))
+      return false;
+
+   if (!set_scene_state(setup, SETUP_ACTIVE, __func__))
+      return false;
+
+   return setup->scene != NULL;
+}
+
+
 void
 lp_setup_add_scissor_planes(const struct u_rect *scissor,
                             struct lp_rast_plane *plane_s,
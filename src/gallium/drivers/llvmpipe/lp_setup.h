@@ -130,6 +130,10 @@ unsigned
 lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture);
 
+bool
+lp_setup_reference_in_flight(struct lp_setup_context *setup,
+                             struct pipe_resource *resource);
+
 void
 lp_setup_set_sample_mask(struct lp_setup_context *setup,
                          uint32_t sample_mask);
@@ -55,9 +55,15 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
+/** Number of scenes the scene pool starts out with room for */
 #define INITIAL_SCENES 4
-#define MAX_SCENES 64
+
+/**
+ * Max memory held by the scenes of one context which are queued for or
+ * being rasterized.  Binning of a new scene only blocks once this is
+ * exceeded, so many small scenes can be in flight at once.
+ */
+#define MAX_SCENES_IN_FLIGHT_SIZE (8 * LP_SCENE_MAX_SIZE)
 
 
 
@@ -93,7 +99,8 @@ struct lp_setup_context
 
    struct slab_mempool scene_slab;
    int num_active_scenes;
-   struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
+   int max_scenes;                       /**< size of the scenes array */
+   struct lp_scene **scenes;             /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
@@ -194,6 +201,18 @@ struct lp_setup_context
            const float (*v3)[4],
            const float (*v4)[4],
            const float (*v5)[4]);
+
+   /**
+    * Triangles waiting to be binned in parallel, see lp_setup_parallel.c.
+    */
+   struct {
+      bool enabled;
+      unsigned stride;        /**< bytes per vertex */
+      unsigned num_tris;
+      unsigned max_tris;
+      uint8_t *verts;         /**< three vertices per triangle */
+      struct lp_scene *chunks[LP_MAX_THREADS];
+   } batch;
 };
 
 
@@ -242,8 +261,12 @@ lp_setup_destroy(struct lp_setup_context *setup);
 bool
 lp_setup_flush_and_restart(struct lp_setup_context *setup);
 
+bool
+lp_setup_restart_scene(struct lp_setup_context *setup);
+
 bool
 lp_setup_whole_tile(struct lp_setup_context *setup,
+                    struct lp_scene *scene,
                     const struct lp_rast_shader_inputs *inputs,
                     int tx, int ty, bool opaque);
 
@@ -293,6 +316,7 @@ lp_setup_analyse_triangles(struct lp_setup_context *setup,
 
 bool
 lp_setup_bin_triangle(struct lp_setup_context *setup,
+                      struct lp_scene *scene,
                       struct lp_rast_triangle *tri,
                       bool use_32bits,
                       bool opaque,
@@ -305,6 +329,36 @@ lp_setup_bin_rectangle(struct lp_setup_context *setup,
                        struct lp_rast_rectangle *rect,
                        bool opaque);
 
+bool
+lp_setup_triangle_to_scene(struct lp_setup_context *setup,
+                           struct lp_scene *scene,
+                           const float (*v0)[4],
+                           const float (*v1)[4],
+                           const float (*v2)[4]);
+
+void
+lp_setup_batch_triangle(struct lp_setup_context *setup,
+                        const float (*v0)[4],
+                        const float (*v1)[4],
+                        const float (*v2)[4]);
+
+void
+lp_setup_bin_batch(struct lp_setup_context *setup);
+
+void
+lp_setup_destroy_batch(struct lp_setup_context *setup);
+
+/**
+ * Bin any triangles still waiting in setup->batch.  Must be called before
+ * anything else is put into the scene or any setup state changes.
+ */
+static inline void
+lp_setup_flush_batch(struct lp_setup_context *setup)
+{
+   if (setup->batch.num_tris)
+      lp_setup_bin_batch(setup);
+}
+
 static inline bool
 lp_setup_zero_sample_mask(struct lp_setup_context *setup)
 {
@@ -0,0 +1,249 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Parallel binning of triangles.
+ *
+ * The draw module hands triangles to setup a few hundred at a time, far
+ * too few to be worth spreading over threads.  So instead of binning each
+ * triangle straight away, setup->triangle copies its vertices into
+ * setup->batch.  Anything which could change how the captured triangles
+ * get binned (state changes, clears, queries, other primitive types,
+ * flushes) first calls lp_setup_flush_batch(), which splits the batch
+ * into runs of consecutive triangles.  Each run is binned into a private
+ * chunk scene on the compute thread pool, then the chunks are appended to
+ * the current scene's bins in submission order, so the command order
+ * within every bin is exactly what serial binning would have produced.
+ */
+
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "draw/draw_vertex.h"
+#include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_screen.h"
+#include "lp_setup_context.h"
+#include "lp_perf.h"
+
+
+/** Bytes of vertex data captured before the batch is binned */
+#define LP_SETUP_BATCH_SIZE (512 * 1024)
+
+/** Don't bother handing fewer triangles than this to a thread */
+#define LP_SETUP_BATCH_MIN_TRIS 64
+
+/** Don't bin in parallel unless each chunk may use this much memory */
+#define LP_SETUP_BATCH_MIN_CHUNK_SIZE (4 * DATA_BLOCK_SIZE)
+
+
+struct lp_setup_bin_job {
+   struct lp_setup_context *setup;
+   const uint8_t *verts;
+   unsigned stride;
+   unsigned num_tris;
+   unsigned tris_per_chunk;
+
+   /** one past the last triangle completely binned by each chunk */
+   unsigned end[LP_MAX_THREADS];
+};
+
+
+typedef const float (*const_float4_ptr)[4];
+
+
+static inline const_float4_ptr
+batch_vert(const uint8_t *verts, unsigned stride, unsigned tri, unsigned i)
+{
+   return (const_float4_ptr)(verts + (tri * 3 + i) * stride);
+}
+
+
+static void
+bin_chunk(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lp_setup_bin_job *job = data;
+   struct lp_scene *chunk = job->setup->batch.chunks[iter_idx];
+   const unsigned start = iter_idx * job->tris_per_chunk;
+   const unsigned end = MIN2(start + job->tris_per_chunk, job->num_tris);
+   unsigned i;
+
+   for (i = start; i < end; i++) {
+      if (!lp_setup_triangle_to_scene(job->setup, chunk,
+                                      batch_vert(job->verts, job->stride, i, 0),
+                                      batch_vert(job->verts, job->stride, i, 1),
+                                      batch_vert(job->verts, job->stride, i, 2)))
+         break;
+   }
+
+   job->end[iter_idx] = i;
+}
+
+
+/**
+ * Bin the first triangles of the batch in parallel.
+ * \return number of triangles binned into the current scene
+ */
+static unsigned
+bin_batch_parallel(struct lp_setup_context *setup, unsigned num_tris)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   struct lp_scene *scene = setup->scene;
+   unsigned num_chunks = MIN2(num_tris / LP_SETUP_BATCH_MIN_TRIS,
+                              screen->num_threads);
+
+   if (num_chunks < 2)
+      return 0;
+
+   /* Split what is left of the scene's memory budget between the chunks.
+    * Triangles which don't fit are binned serially afterwards, restarting
+    * the scene as usual.
+    */
+   const unsigned chunk_size =
+      (LP_SCENE_MAX_SIZE - MIN2(scene->scene_size, LP_SCENE_MAX_SIZE)) /
+      num_chunks;
+   if (chunk_size < LP_SETUP_BATCH_MIN_CHUNK_SIZE)
+      return 0;
+
+   unsigned c;
+   for (c = 0; c < num_chunks; c++) {
+      if (!setup->batch.chunks[c])
+         setup->batch.chunks[c] = lp_scene_create(setup);
+      if (!setup->batch.chunks[c] ||
+          !lp_scene_begin_chunk(setup->batch.chunks[c], scene, chunk_size))
+         break;
+   }
+
+   if (c < num_chunks) {
+      while (c--)
+         lp_scene_discard_chunk(setup->batch.chunks[c]);
+      return 0;
+   }
+
+   struct lp_setup_bin_job job = {
+      .setup = setup,
+      .verts = setup->batch.verts,
+      .stride = setup->batch.stride,
+      .num_tris = num_tris,
+      .tris_per_chunk = DIV_ROUND_UP(num_tris, num_chunks),
+   };
+   struct lp_cs_tpool_task *task;
+
+   mtx_lock(&screen->cs_mutex);
+   task = lp_cs_tpool_queue_task(screen->cs_tpool, bin_chunk, &job, num_chunks);
+   mtx_unlock(&screen->cs_mutex);
+
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+
+   /* Merge in order, stopping after the first chunk which ran out of
+    * memory.  Whatever it binned of its last triangle has been disabled,
+    * so that triangle is simply binned again.
+    */
+   unsigned binned = 0;
+   for (c = 0; c < num_chunks; c++) {
+      lp_scene_merge_chunk(scene, setup->batch.chunks[c]);
+      binned = job.end[c];
+      if (binned < MIN2((c + 1) * job.tris_per_chunk, num_tris)) {
+         c++;
+         break;
+      }
+   }
+
+   for (; c < num_chunks; c++)
+      lp_scene_discard_chunk(setup->batch.chunks[c]);
+
+   LP_COUNT_ADD(nr_parallel_binned_tris, binned);
+
+   return binned;
+}
+
+
+/**
+ * Bin all triangles captured so far into the current scene.
+ */
+void
+lp_setup_bin_batch(struct lp_setup_context *setup)
+{
+   const unsigned num_tris = setup->batch.num_tris;
+   const unsigned stride = setup->batch.stride;
+   const uint8_t *verts = setup->batch.verts;
+
+   assert(setup->scene);
+   assert(setup->state == SETUP_ACTIVE);
+
+   /* Restarting the scene below flushes the batch again. */
+   setup->batch.num_tris = 0;
+
+   unsigned i = bin_batch_parallel(setup, num_tris);
+
+   for (; i < num_tris; i++) {
+      const float (*v0)[4] = batch_vert(verts, stride, i, 0);
+      const float (*v1)[4] = batch_vert(verts, stride, i, 1);
+      const float (*v2)[4] = batch_vert(verts, stride, i, 2);
+
+      if (!lp_setup_triangle_to_scene(setup, setup->scene, v0, v1, v2)) {
+         if (!lp_setup_restart_scene(setup))
+            return;
+
+         lp_setup_triangle_to_scene(setup, setup->scene, v0, v1, v2);
+      }
+   }
+}
+
+
+/**
+ * setup->triangle when parallel binning is enabled: just copy the
+ * vertices into the batch.
+ */
+void
+lp_setup_batch_triangle(struct lp_setup_context *setup,
+                        const float (*v0)[4],
+                        const float (*v1)[4],
+                        const float (*v2)[4])
+{
+   struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
+   const unsigned stride = setup->vertex_info->size * sizeof(float);
+
+   if (lp_context->active_statistics_queries) {
+      lp_context->pipeline_statistics.c_primitives++;
+   }
+
+   if (stride != setup->batch.stride ||
+       setup->batch.num_tris == setup->batch.max_tris) {
+      lp_setup_flush_batch(setup);
+
+      if (stride != setup->batch.stride) {
+         if (!setup->batch.verts)
+            setup->batch.verts = align_malloc(LP_SETUP_BATCH_SIZE, 16);
+         setup->batch.stride = stride;
+         setup->batch.max_tris = setup->batch.verts ?
+            LP_SETUP_BATCH_SIZE / (3 * stride) : 0;
+      }
+
+      if (!setup->batch.max_tris) {
+         if (!lp_setup_triangle_to_scene(setup, setup->scene, v0, v1, v2)) {
+            if (lp_setup_restart_scene(setup))
+               lp_setup_triangle_to_scene(setup, setup->scene, v0, v1, v2);
+         }
+         return;
+      }
+   }
+
+   uint8_t *dst = setup->batch.verts + setup->batch.num_tris * 3 * stride;
+   memcpy(dst, v0, stride);
+   memcpy(dst + stride, v1, stride);
+   memcpy(dst + 2 * stride, v2, stride);
+   setup->batch.num_tris++;
+}
+
+
+void
+lp_setup_destroy_batch(struct lp_setup_context *setup)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(setup->batch.chunks); i++) {
+      if (setup->batch.chunks[i])
+         lp_scene_destroy(setup->batch.chunks[i]);
+   }
+
+   align_free(setup->batch.verts);
+}
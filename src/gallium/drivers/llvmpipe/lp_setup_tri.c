@@ -273,14 +273,13 @@ check_opaque(const struct lp_setup_context *setup,
  */
 static bool
 do_triangle_ccw(struct lp_setup_context *setup,
+                struct lp_scene *scene,
                 struct fixed_position *position,
                 const float (*v0)[4],
                 const float (*v1)[4],
                 const float (*v2)[4],
                 bool frontfacing)
 {
-   struct lp_scene *scene = setup->scene;
-
    const float (*pv)[4];
    if (setup->flatshade_first) {
       pv = v0;
@@ -744,7 +743,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
                                   s_planes, setup->multisample);
    }
 
-   return lp_setup_bin_triangle(setup, tri, use_32bits,
+   return lp_setup_bin_triangle(setup, scene, tri, use_32bits,
                                 check_opaque(setup, v0, v1, v2),
                                 &bbox, nr_planes, viewport_index);
 }
@@ -779,6 +778,7 @@ floor_pot(uint32_t n)
 
 bool
 lp_setup_bin_triangle(struct lp_setup_context *setup,
+                      struct lp_scene *scene,
                       struct lp_rast_triangle *tri,
                       bool use_32bits,
                       bool opaque,
@@ -786,7 +786,6 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       int nr_planes,
                       unsigned viewport_index)
 {
-   struct lp_scene *scene = setup->scene;
    unsigned cmd;
 
    /* What is the largest power-of-two boundary this triangle crosses:
@@ -970,7 +969,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                /* triangle covers the whole tile- shade whole tile */
                LP_COUNT(nr_fully_covered_64);
                in = true;
-               if (!lp_setup_whole_tile(setup, &tri->inputs, x, y, opaque))
+               if (!lp_setup_whole_tile(setup, scene, &tri->inputs,
+                                        x, y, opaque))
                   goto fail;
             }
 
@@ -997,36 +997,6 @@ fail:
 }
 
 
-/**
- * Try to draw the triangle, restart the scene on failure.
- */
-static inline void
-retry_triangle_ccw(struct lp_setup_context *setup,
-                   struct fixed_position *position,
-                   const float (*v0)[4],
-                   const float (*v1)[4],
-                   const float (*v2)[4],
-                   bool front)
-{
-   if (0)
-      lp_setup_print_triangle(setup, v0, v1, v2);
-
-   if (lp_setup_zero_sample_mask(setup)) {
-      if (0) debug_printf("zero sample mask\n");
-      LP_COUNT(nr_culled_tris);
-      return;
-   }
-
-   if (!do_triangle_ccw(setup, position, v0, v1, v2, front)) {
-      if (!lp_setup_flush_and_restart(setup))
-         return;
-
-      if (!do_triangle_ccw(setup, position, v0, v1, v2, front))
-         return;
-   }
-}
-
-
 /**
  * Calculate fixed position data for a triangle
  * It is unfortunate we need to do that here (as we need area
@@ -1147,55 +1117,109 @@ rotate_fixed_position_12(struct fixed_position* position)
 }
 
 
+/* Windings culled by triangle_to_scene() */
+#define CULL_CCW (1 << 0)
+#define CULL_CW  (1 << 1)
+
+
 /**
- * Draw triangle if it's CW, cull otherwise.
+ * Cull and bin a triangle into the given scene.
+ * \param cull  CULL_x flags, usually a constant so that this is specialized
+ * \return false if the scene ran out of memory
  */
-static void
-triangle_cw(struct lp_setup_context *setup,
-            const float (*v0)[4],
-            const float (*v1)[4],
-            const float (*v2)[4])
+static inline bool
+triangle_to_scene(struct lp_setup_context *setup,
+                  struct lp_scene *scene,
+                  unsigned cull,
+                  const float (*v0)[4],
+                  const float (*v1)[4],
+                  const float (*v2)[4])
 {
    alignas(16) struct fixed_position position;
+
+   int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
+
+   if (0) {
+      assert(!util_is_inf_or_nan(v0[0][0]));
+      assert(!util_is_inf_or_nan(v0[0][1]));
+      assert(!util_is_inf_or_nan(v1[0][0]));
+      assert(!util_is_inf_or_nan(v1[0][1]));
+      assert(!util_is_inf_or_nan(v2[0][0]));
+      assert(!util_is_inf_or_nan(v2[0][1]));
+   }
+
+   if (area_sign == 0 || (cull & (area_sign > 0 ? CULL_CCW : CULL_CW)))
+      return true;
+
+   if (0)
+      lp_setup_print_triangle(setup, v0, v1, v2);
+
+   if (lp_setup_zero_sample_mask(setup)) {
+      if (0) debug_printf("zero sample mask\n");
+      LP_COUNT(nr_culled_tris);
+      return true;
+   }
+
+   if (area_sign > 0) {
+      return do_triangle_ccw(setup, scene, &position, v0, v1, v2,
+                             setup->ccw_is_frontface);
+   } else if (setup->flatshade_first) {
+      rotate_fixed_position_12(&position);
+      return do_triangle_ccw(setup, scene, &position, v0, v2, v1,
+                             !setup->ccw_is_frontface);
+   } else {
+      rotate_fixed_position_01(&position);
+      return do_triangle_ccw(setup, scene, &position, v1, v0, v2,
+                             !setup->ccw_is_frontface);
+   }
+}
+
+
+/**
+ * Draw the triangle into the current scene, restart the scene on failure.
+ */
+static inline void
+retry_triangle(struct lp_setup_context *setup,
+               unsigned cull,
+               const float (*v0)[4],
+               const float (*v1)[4],
+               const float (*v2)[4])
+{
    struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
 
    if (lp_context->active_statistics_queries) {
       lp_context->pipeline_statistics.c_primitives++;
    }
 
-   int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
+   if (!triangle_to_scene(setup, setup->scene, cull, v0, v1, v2)) {
+      if (!lp_setup_flush_and_restart(setup))
+         return;
 
-   if (area_sign < 0) {
-      if (setup->flatshade_first) {
-         rotate_fixed_position_12(&position);
-         retry_triangle_ccw(setup, &position, v0, v2, v1,
-                            !setup->ccw_is_frontface);
-      } else {
-         rotate_fixed_position_01(&position);
-         retry_triangle_ccw(setup, &position, v1, v0, v2,
-                            !setup->ccw_is_frontface);
-      }
+      triangle_to_scene(setup, setup->scene, cull, v0, v1, v2);
    }
 }
 
 
+/**
+ * Draw triangle if it's CW, cull otherwise.
+ */
+static void
+triangle_cw(struct lp_setup_context *setup,
+            const float (*v0)[4],
+            const float (*v1)[4],
+            const float (*v2)[4])
+{
+   retry_triangle(setup, CULL_CCW, v0, v1, v2);
+}
+
+
 static void
 triangle_ccw(struct lp_setup_context *setup,
              const float (*v0)[4],
              const float (*v1)[4],
              const float (*v2)[4])
 {
-   alignas(16) struct fixed_position position;
-   struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
-
-   if (lp_context->active_statistics_queries) {
-      lp_context->pipeline_statistics.c_primitives++;
-   }
-
-   int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
-
-   if (area_sign > 0)
-      retry_triangle_ccw(setup, &position, v0, v1, v2, setup->ccw_is_frontface);
+   retry_triangle(setup, CULL_CW, v0, v1, v2);
 }
 
 
@@ -1208,38 +1232,7 @@ triangle_both(struct lp_setup_context *setup,
               const float (*v1)[4],
               const float (*v2)[4])
 {
-   alignas(16) struct fixed_position position;
-   struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
-
-   if (lp_context->active_statistics_queries) {
-      lp_context->pipeline_statistics.c_primitives++;
-   }
-
-   int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
-
-   if (0) {
-      assert(!util_is_inf_or_nan(v0[0][0]));
-      assert(!util_is_inf_or_nan(v0[0][1]));
-      assert(!util_is_inf_or_nan(v1[0][0]));
-      assert(!util_is_inf_or_nan(v1[0][1]));
-      assert(!util_is_inf_or_nan(v2[0][0]));
-      assert(!util_is_inf_or_nan(v2[0][1]));
-   }
-
-   if (area_sign > 0) {
-      retry_triangle_ccw(setup, &position, v0, v1, v2,
-                         setup->ccw_is_frontface);
-   } else if (area_sign < 0) {
-      if (setup->flatshade_first) {
-         rotate_fixed_position_12(&position);
-         retry_triangle_ccw(setup, &position, v0, v2, v1,
-                            !setup->ccw_is_frontface);
-      } else {
-         rotate_fixed_position_01(&position);
-         retry_triangle_ccw(setup, &position, v1, v0, v2,
-                            !setup->ccw_is_frontface);
-      }
-   }
+   retry_triangle(setup, 0, v0, v1, v2);
 }
 
 
@@ -1252,6 +1245,30 @@ triangle_noop(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Cull and bin a triangle into the given scene, which may be a chunk
+ * being binned on another thread (see lp_setup_parallel.c), so this
+ * must not touch anything but the scene and must not restart it.
+ * \return false if the scene ran out of memory
+ */
+bool
+lp_setup_triangle_to_scene(struct lp_setup_context *setup,
+                           struct lp_scene *scene,
+                           const float (*v0)[4],
+                           const float (*v1)[4],
+                           const float (*v2)[4])
+{
+   unsigned cull = 0;
+
+   if (setup->cullmode & PIPE_FACE_FRONT)
+      cull |= setup->ccw_is_frontface ? CULL_CCW : CULL_CW;
+   if (setup->cullmode & PIPE_FACE_BACK)
+      cull |= setup->ccw_is_frontface ? CULL_CW : CULL_CCW;
+
+   return triangle_to_scene(setup, scene, cull, v0, v1, v2);
+}
+
+
 void
 lp_setup_choose_triangle(struct lp_setup_context *setup)
 {
@@ -1271,6 +1288,12 @@ lp_setup_choose_triangle(struct lp_setup_context *setup)
       break;
    default:
       setup->triangle = triangle_noop;
-      break;
+      return;
    }
+
+   /* The linear rasterizer's rectangles are binned directly, so keep the
+    * triangles around them in order by binning those directly too.
+    */
+   if (setup->batch.enabled && !setup->permit_linear_rasterizer)
+      setup->triangle = lp_setup_batch_triangle;
 }
@@ -42,6 +42,7 @@
 #include "draw/draw_vertex.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_prim.h"
 #include "lp_state_fs.h"
 #include "lp_perf.h"
 
@@ -134,7 +135,12 @@ lp_setup_set_primitive(struct vbuf_render *vbr, enum mesa_prim prim)
 static void
 lp_setup_set_view_index(struct vbuf_render *vbr, unsigned view_index)
 {
-   lp_setup_context(vbr)->view_index = view_index;
+   struct lp_setup_context *setup = lp_setup_context(vbr);
+
+   if (setup->view_index != view_index) {
+      lp_setup_flush_batch(setup);
+      setup->view_index = view_index;
+   }
 }
 
 
@@ -182,6 +188,10 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
    if (!lp_setup_update_state(setup, true))
       return;
 
+   /* Only triangles are batched, keep everything else in order. */
+   if (u_reduced_prim(setup->prim) != MESA_PRIM_TRIANGLES)
+      lp_setup_flush_batch(setup);
+
    const bool uses_constant_interp =
       setup->setup.variant->key.uses_constant_interp;
 
@@ -390,6 +400,10 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    if (!lp_setup_update_state(setup, true))
       return;
 
+   /* Only triangles are batched, keep everything else in order. */
+   if (u_reduced_prim(setup->prim) != MESA_PRIM_TRIANGLES)
+      lp_setup_flush_batch(setup);
+
    const bool uses_constant_interp =
       setup->setup.variant->key.uses_constant_interp;
 
@@ -87,22 +87,30 @@ struct llvmpipe_context;
 
 
 
+struct lp_vertex_shader {
+   struct draw_vertex_shader *dvs;
+   struct lp_shader_sample_ops sample_ops;
+};
+
 struct lp_geometry_shader {
    bool no_tokens;
    struct pipe_stream_output_info stream_output;
    struct draw_geometry_shader *dgs;
+   struct lp_shader_sample_ops sample_ops;
 };
 
 struct lp_tess_ctrl_shader {
    bool no_tokens;
    struct pipe_stream_output_info stream_output;
    struct draw_tess_ctrl_shader *dtcs;
+   struct lp_shader_sample_ops sample_ops;
 };
 
 struct lp_tess_eval_shader {
    bool no_tokens;
    struct pipe_stream_output_info stream_output;
    struct draw_tess_eval_shader *dtes;
+   struct lp_shader_sample_ops sample_ops;
 };
 
 
@@ -125,6 +133,10 @@ llvmpipe_set_framebuffer_state(struct pipe_context *,
 void
 llvmpipe_update_fs(struct llvmpipe_context *lp);
 
+void
+llvmpipe_drop_fs_compile_jobs(struct llvmpipe_context *lp,
+                              struct lp_fragment_shader *shader);
+
 void 
 llvmpipe_update_setup(struct llvmpipe_context *lp);
 
@@ -211,6 +223,10 @@ void
 llvmpipe_cleanup_stage_sampling(struct llvmpipe_context *ctx,
                                 enum pipe_shader_type stage);
 
+void
+llvmpipe_sampler_static_texture_state(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view);
+
 void
 llvmpipe_prepare_vertex_images(struct llvmpipe_context *lp,
                                unsigned num,
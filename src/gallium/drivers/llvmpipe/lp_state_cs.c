@@ -944,9 +944,10 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
    shader->req_local_mem += nir->info.shared_size;
    shader->zero_initialize_shared_memory = nir->info.zero_initialize_shared_memory;
 
-   llvmpipe_register_shader(pipe, &shader->base);
+   llvmpipe_gather_sample_ops(&shader->base, &shader->sample_ops);
 
    list_inithead(&shader->variants.list);
+   simple_mtx_init(&shader->compile_lock, mtx_plain);
 
    int nr_samplers = BITSET_LAST_BIT(nir->info.samplers_used);
    int nr_sampler_views = BITSET_LAST_BIT(nir->info.textures_used);
@@ -967,6 +968,8 @@ llvmpipe_bind_compute_state(struct pipe_context *pipe,
       return;
 
    llvmpipe->cs = (struct lp_compute_shader *)cs;
+   if (llvmpipe->cs)
+      llvmpipe_register_sample_ops(llvmpipe, &llvmpipe->cs->sample_ops);
    llvmpipe->cs_dirty |= LP_CSNEW_CS;
 }
 
@@ -987,12 +990,14 @@ llvmpipe_get_compute_state_info(struct pipe_context *pipe, void *cs,
 
 /**
  * Remove shader variant from two lists: the shader's variant list
- * and the context's variant list.
+ * and the owning context's variant list.
+ * Must be called with the screen's cs_variant_mutex held.
  */
 static void
-llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
-                                  struct lp_compute_shader_variant *variant)
+llvmpipe_remove_cs_shader_variant(struct lp_compute_shader_variant *variant)
 {
+   struct llvmpipe_context *lp = variant->lp;
+
    if ((LP_DEBUG & DEBUG_CS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del cs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
@@ -1017,13 +1022,65 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
 }
 
 
+/**
+ * Delete the variants of a shader which is going away.
+ *
+ * Variants of other contexts can't be freed from this thread, as their
+ * owner may be compiling in the same LLVM context meanwhile. They are
+ * handed over to the owner, which frees them with
+ * llvmpipe_free_retired_cs_variants().
+ * Must be called with the screen's cs_variant_mutex held.
+ */
+static void
+llvmpipe_delete_cs_shader_variants(struct llvmpipe_context *lp,
+                                   struct lp_compute_shader *shader)
+{
+   struct lp_cs_variant_list_item *li, *next;
+
+   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
+      struct lp_compute_shader_variant *variant = li->base;
+      struct llvmpipe_context *owner = variant->lp;
+
+      if (owner == lp) {
+         llvmpipe_remove_cs_shader_variant(variant);
+         continue;
+      }
+
+      list_del(&variant->list_item_local.list);
+      variant->shader = NULL;
+
+      list_move_to(&variant->list_item_global.list,
+                   &owner->cs_variants_retired.list);
+      owner->nr_cs_variants--;
+      owner->nr_cs_instrs -= variant->nr_instrs;
+   }
+}
+
+
+/**
+ * Free the variants other contexts retired on behalf of this one.
+ * Must be called with the screen's cs_variant_mutex held.
+ */
+static void
+llvmpipe_free_retired_cs_variants(struct llvmpipe_context *lp)
+{
+   struct lp_cs_variant_list_item *li, *next;
+
+   LIST_FOR_EACH_ENTRY_SAFE(li, next, &lp->cs_variants_retired.list, list) {
+      list_del(&li->list);
+      gallivm_destroy(li->base->gallivm);
+      FREE(li->base);
+   }
+}
+
+
 static void
 llvmpipe_delete_compute_state(struct pipe_context *pipe,
                               void *cs)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_compute_shader *shader = cs;
-   struct lp_cs_variant_list_item *li, *next;
 
    if (llvmpipe->cs == cs)
       llvmpipe->cs = NULL;
@@ -1031,10 +1088,10 @@ llvmpipe_delete_compute_state(struct pipe_context *pipe,
       pipe_resource_reference(&shader->global_buffers[i], NULL);
    FREE(shader->global_buffers);
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
-   }
+   mtx_lock(&screen->cs_variant_mutex);
+   llvmpipe_delete_cs_shader_variants(llvmpipe, shader);
+   mtx_unlock(&screen->cs_variant_mutex);
+   simple_mtx_destroy(&shader->compile_lock);
    ralloc_free(shader->base.ir.nir);
    FREE(shader);
 }
@@ -1080,16 +1137,16 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if (BITSET_TEST(nir->info.textures_used, i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[sh_type][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[sh_type][i]);
          }
       }
    } else {
       key->nr_sampler_views = key->nr_samplers;
       for (unsigned i = 0; i < key->nr_sampler_views; ++i) {
          if (BITSET_TEST(nir->info.samplers_used, i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
-                                            lp->sampler_views[sh_type][i]);
+            llvmpipe_sampler_static_texture_state(&cs_sampler[i].texture_state,
+                                                  lp->sampler_views[sh_type][i]);
          }
       }
    }
@@ -1154,6 +1211,7 @@ dump_cs_variant_key(const struct lp_compute_shader_variant_key *key)
                    texture->pot_width,
                    texture->pot_height,
                    texture->pot_depth);
+      debug_printf("  .tiled = %u\n", texture->tiled);
    }
    struct lp_image_static_state *images = lp_cs_variant_key_images(key);
    for (i = 0; i < key->nr_images; ++i) {
@@ -1229,6 +1287,7 @@ generate_variant(struct llvmpipe_context *lp,
             shname, shader->no, shader->variants_created);
 
    variant->shader = shader;
+   variant->lp = lp;
    memcpy(&variant->key, key, shader->variant_key_size);
 
    unsigned char ir_sha1_cache_key[20];
@@ -1298,14 +1357,20 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
                            struct lp_compute_shader *shader)
 {
    char store[LP_CS_MAX_VARIANT_KEY_SIZE];
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_compute_shader_variant_key *key =
       make_variant_key(lp, shader, sh_type, store);
    struct lp_compute_shader_variant *variant = NULL;
    struct lp_cs_variant_list_item *li;
 
-   /* Search the variants for one which matches the key */
+   mtx_lock(&screen->cs_variant_mutex);
+
+   llvmpipe_free_retired_cs_variants(lp);
+
+   /* Search this context's variants for one which matches the key */
    LIST_FOR_EACH_ENTRY(li, &shader->variants.list, list) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
+      if (li->base->lp == lp &&
+          memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
          variant = li->base;
          break;
       }
@@ -1317,6 +1382,7 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
        */
       list_move_to(&variant->list_item_global.list,
                    &lp->cs_variants_list.list);
+      mtx_unlock(&screen->cs_variant_mutex);
    } else {
       /* variant not found, create it now */
 
@@ -1360,16 +1426,21 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
                                    struct lp_cs_variant_list_item, list);
             assert(item);
             assert(item->base);
-            llvmpipe_remove_cs_shader_variant(lp, item->base);
+            llvmpipe_remove_cs_shader_variant(item->base);
          }
       }
 
+      mtx_unlock(&screen->cs_variant_mutex);
+
       /*
-       * Generate the new variant.
+       * Generate the new variant.  Other contexts can keep looking up
+       * their variants meanwhile.
        */
       int64_t t0, t1, dt;
       t0 = os_time_get();
+      simple_mtx_lock(&shader->compile_lock);
       variant = generate_variant(lp, shader, sh_type, key);
+      simple_mtx_unlock(&shader->compile_lock);
       t1 = os_time_get();
       dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
@@ -1377,16 +1448,37 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
 
       /* Put the new variant into the list */
       if (variant) {
+         mtx_lock(&screen->cs_variant_mutex);
          list_add(&variant->list_item_local.list, &shader->variants.list);
          list_add(&variant->list_item_global.list, &lp->cs_variants_list.list);
          lp->nr_cs_variants++;
          lp->nr_cs_instrs += variant->nr_instrs;
          shader->variants_cached++;
+         mtx_unlock(&screen->cs_variant_mutex);
       }
    }
    return variant;
 }
 
+/**
+ * Delete the variants compiled by a context that is going away, their code
+ * lives in the context's LLVM context.
+ */
+void
+lp_delete_cs_variants(struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_cs_variant_list_item *li, *next;
+
+   mtx_lock(&screen->cs_variant_mutex);
+   LIST_FOR_EACH_ENTRY_SAFE(li, next, &lp->cs_variants_list.list, list) {
+      llvmpipe_remove_cs_shader_variant(li->base);
+   }
+   llvmpipe_free_retired_cs_variants(lp);
+   mtx_unlock(&screen->cs_variant_mutex);
+}
+
+
 static void
 llvmpipe_update_cs(struct llvmpipe_context *lp)
 {
@@ -1576,6 +1668,14 @@ update_csctx_ssbo(struct llvmpipe_context *llvmpipe,
 static void
 llvmpipe_cs_update_derived(struct llvmpipe_context *llvmpipe, const void *input)
 {
+   struct llvmpipe_screen *lp_screen = llvmpipe_screen(llvmpipe->pipe.screen);
+
+   /* Check for updated textures, their layout might have changed. */
+   if (llvmpipe->cs_tex_timestamp != lp_screen->timestamp) {
+      llvmpipe->cs_tex_timestamp = lp_screen->timestamp;
+      llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+   }
+
    if (llvmpipe->cs_dirty & LP_CSNEW_CONSTANTS) {
       lp_csctx_set_cs_constants(llvmpipe->csctx,
                                 ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_COMPUTE]),
@@ -1862,7 +1962,7 @@ llvmpipe_create_ts_state(struct pipe_context *pipe,
    if (!shader)
       return NULL;
 
-   llvmpipe_register_shader(pipe, templ);
+   llvmpipe_gather_sample_ops(templ, &shader->sample_ops);
 
    shader->no = task_no++;
    shader->base.type = templ->type;
@@ -1870,6 +1970,7 @@ llvmpipe_create_ts_state(struct pipe_context *pipe,
    shader->base.ir.nir = templ->ir.nir;
    shader->req_local_mem += ((struct nir_shader *)shader->base.ir.nir)->info.shared_size;
    list_inithead(&shader->variants.list);
+   simple_mtx_init(&shader->compile_lock, mtx_plain);
 
    struct nir_shader *nir = shader->base.ir.nir;
    int nr_samplers = BITSET_LAST_BIT(nir->info.samplers_used);
@@ -1889,6 +1990,8 @@ llvmpipe_bind_ts_state(struct pipe_context *pipe, void *_task)
       return;
 
    llvmpipe->tss = (struct lp_compute_shader *)_task;
+   if (llvmpipe->tss)
+      llvmpipe_register_sample_ops(llvmpipe, &llvmpipe->tss->sample_ops);
    llvmpipe->dirty |= LP_NEW_TASK;
 }
 
@@ -1896,13 +1999,13 @@ static void
 llvmpipe_delete_ts_state(struct pipe_context *pipe, void *_task)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_compute_shader *shader = _task;
-   struct lp_cs_variant_list_item *li, *next;
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
-   }
+   mtx_lock(&screen->cs_variant_mutex);
+   llvmpipe_delete_cs_shader_variants(llvmpipe, shader);
+   mtx_unlock(&screen->cs_variant_mutex);
+   simple_mtx_destroy(&shader->compile_lock);
    ralloc_free(shader->base.ir.nir);
    FREE(shader);
 }
@@ -1933,7 +2036,7 @@ llvmpipe_create_ms_state(struct pipe_context *pipe,
    if (!shader)
       return NULL;
 
-   llvmpipe_register_shader(pipe, templ);
+   llvmpipe_gather_sample_ops(templ, &shader->sample_ops);
 
    shader->no = mesh_no++;
    shader->base.type = templ->type;
@@ -1941,9 +2044,11 @@ llvmpipe_create_ms_state(struct pipe_context *pipe,
    shader->base.ir.nir = templ->ir.nir;
    shader->req_local_mem += ((struct nir_shader *)shader->base.ir.nir)->info.shared_size;
    list_inithead(&shader->variants.list);
+   simple_mtx_init(&shader->compile_lock, mtx_plain);
 
    shader->draw_mesh_data = draw_create_mesh_shader(llvmpipe->draw, templ);
    if (shader->draw_mesh_data == NULL) {
+      simple_mtx_destroy(&shader->compile_lock);
       FREE(shader);
       return NULL;
    }
@@ -1966,6 +2071,8 @@ llvmpipe_bind_ms_state(struct pipe_context *pipe, void *_mesh)
       return;
 
    llvmpipe->mhs = (struct lp_compute_shader *)_mesh;
+   if (llvmpipe->mhs)
+      llvmpipe_register_sample_ops(llvmpipe, &llvmpipe->mhs->sample_ops);
 
    draw_bind_mesh_shader(llvmpipe->draw, _mesh ? llvmpipe->mhs->draw_mesh_data : NULL);
    llvmpipe->dirty |= LP_NEW_MESH;
@@ -1976,13 +2083,13 @@ static void
 llvmpipe_delete_ms_state(struct pipe_context *pipe, void *_mesh)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_compute_shader *shader = _mesh;
-   struct lp_cs_variant_list_item *li, *next;
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
-   }
+   mtx_lock(&screen->cs_variant_mutex);
+   llvmpipe_delete_cs_shader_variants(llvmpipe, shader);
+   mtx_unlock(&screen->cs_variant_mutex);
+   simple_mtx_destroy(&shader->compile_lock);
 
    draw_delete_mesh_shader(llvmpipe->draw, shader->draw_mesh_data);
    ralloc_free(shader->base.ir.nir);
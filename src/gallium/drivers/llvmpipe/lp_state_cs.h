@@ -26,6 +26,7 @@
 #ifndef LP_STATE_CS_H
 #define LP_STATE_CS_H
 
+#include "util/simple_mtx.h"
 #include "util/u_thread.h"
 #include "pipe/p_state.h"
 
@@ -100,6 +101,11 @@ struct lp_compute_shader_variant
 
    struct lp_compute_shader *shader;
 
+   /* The context that compiled this variant.  Variants are only ever used
+    * by the context that owns them and live on that context's LRU list.
+    */
+   struct llvmpipe_context *lp;
+
    /* For debugging/profiling purposes */
    unsigned no;
 
@@ -112,7 +118,13 @@ struct lp_compute_shader {
 
    struct lp_cs_variant_list_item variants;
 
+   /* Serializes variant compiles, which rewrite the NIR's SSA indices, when
+    * the shader is used by several contexts.
+    */
+   simple_mtx_t compile_lock;
+
    struct draw_mesh_shader *draw_mesh_data;
+   struct lp_shader_sample_ops sample_ops;
    uint32_t req_local_mem;
 
    /* For debugging/profiling purposes */
@@ -163,4 +175,7 @@ struct lp_cs_context {
 struct lp_cs_context *lp_csctx_create(struct pipe_context *pipe);
 void lp_csctx_destroy(struct lp_cs_context *csctx);
 
+struct llvmpipe_context;
+void lp_delete_cs_variants(struct llvmpipe_context *lp);
+
 #endif
@@ -107,6 +107,7 @@
 
 #include "lp_screen.h"
 #include "compiler/nir/nir_serialize.h"
+#include "util/hash_table.h"
 #include "util/mesa-sha1.h"
 
 
@@ -3092,15 +3093,14 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
+                  struct nir_shader *nir,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
    assert(partial_mask == RAST_WHOLE ||
           partial_mask == RAST_EDGE_TEST);
 
-   struct nir_shader *nir = shader->base.ir.nir;
    struct gallivm_state *gallivm = variant->gallivm;
    struct lp_fragment_shader_variant_key *key = &variant->key;
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
@@ -3637,6 +3637,7 @@ dump_fs_variant_key(struct lp_fragment_shader_variant_key *key)
                    texture->pot_width,
                    texture->pot_height,
                    texture->pot_depth);
+      debug_printf("  .tiled = %u\n", texture->tiled);
    }
    struct lp_image_static_state *images = lp_fs_variant_key_images(key);
    for (unsigned i = 0; i < key->nr_images; ++i) {
@@ -3685,6 +3686,8 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
    debug_printf("variant->potentially_opaque = %u\n", variant->potentially_opaque);
+   debug_printf("variant->hiz_cull = %u\n", variant->hiz_cull);
+   debug_printf("variant->hiz_full_write = %u\n", variant->hiz_full_write);
    debug_printf("variant->blit = %u\n", variant->blit);
    debug_printf("shader->kind = %s\n", lp_debug_fs_kind(variant->shader->kind));
    debug_printf("\n");
@@ -3695,35 +3698,50 @@ static void
 lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
                        unsigned char ir_sha1_cache_key[20])
 {
-   struct blob blob = { 0 };
-   unsigned ir_size;
-   void *ir_binary;
+   /* The key already includes the hash of the NIR. */
+   _mesa_sha1_compute(&variant->key, variant->shader->variant_key_size,
+                      ir_sha1_cache_key);
+}
 
-   blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
-   ir_binary = blob.data;
-   ir_size = blob.size;
 
-   struct mesa_sha1 ctx;
-   _mesa_sha1_init(&ctx);
-   _mesa_sha1_update(&ctx, &variant->key, variant->shader->variant_key_size);
-   _mesa_sha1_update(&ctx, ir_binary, ir_size);
-   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+static inline size_t
+fs_variant_key_size(const struct lp_fragment_shader_variant_key *key)
+{
+   return lp_fs_variant_key_size(MAX2(key->nr_samplers, key->nr_sampler_views),
+                                 key->nr_images);
+}
 
-   blob_finish(&blob);
+
+uint32_t
+lp_fs_variant_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, fs_variant_key_size(key));
+}
+
+
+bool
+lp_fs_variant_key_equal(const void *a, const void *b)
+{
+   const size_t size = fs_variant_key_size(a);
+   return size == fs_variant_key_size(b) && memcmp(a, b, size) == 0;
 }
 
 
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * Doesn't use the context, so that it can run on the screen's compile
+ * queue.  'nir' is the shader's NIR, or a copy of it on the queue, as
+ * compiling modifies it.
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
+generate_variant(struct llvmpipe_screen *screen,
                  struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+                 struct nir_shader *nir,
+                 const struct lp_fragment_shader_variant_key *key,
+                 uint32_t hash)
 {
-   struct nir_shader *nir = shader->base.ir.nir;
    struct lp_fragment_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
@@ -3731,16 +3749,30 @@ generate_variant(struct llvmpipe_context *lp,
 
    memset(variant, 0, sizeof(*variant));
 
+#ifdef USE_GLOBAL_LLVM_CONTEXT
+   variant->context = LLVMGetGlobalContext();
+#else
+   variant->context = LLVMContextCreate();
+#endif
+   if (!variant->context) {
+      FREE(variant);
+      return NULL;
+   }
+
+#if LLVM_VERSION_MAJOR == 15
+   LLVMContextSetOpaquePointers(variant->context, false);
+#endif
+
    pipe_reference_init(&variant->reference, 1);
-   lp_fs_reference(lp, &variant->shader, shader);
 
    memcpy(&variant->key, key, shader->variant_key_size);
+   variant->hash = hash;
+   variant->shader = shader;
 
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_cached_code cached = { 0 };
    unsigned char ir_sha1_cache_key[20];
    bool needs_caching = false;
-   if (shader->base.ir.nir) {
+   if (nir) {
       lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
 
       lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
@@ -3748,18 +3780,24 @@ generate_variant(struct llvmpipe_context *lp,
          needs_caching = true;
    }
 
+   /* Variants may be compiled on the compile queue and the context's
+    * thread at the same time.
+    */
+   variant->no = p_atomic_inc_return(&shader->variants_created) - 1;
+
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
+            shader->no, variant->no);
+   variant->gallivm = gallivm_create(module_name, variant->context, &cached);
    if (!variant->gallivm) {
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+      LLVMContextDispose(variant->context);
+#endif
       FREE(variant);
       return NULL;
    }
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
+   pipe_reference(NULL, &shader->reference);
 
    /*
     * Determine whether we are touching all channels in the color buffer.
@@ -3810,6 +3848,40 @@ generate_variant(struct llvmpipe_context *lp,
          shader->info.cbuf[0][3].file != TGSI_FILE_NULL
          ? true : false;
 
+   /* Hierarchical Z.  Fragments which are known to fail the depth test can
+    * only be skipped if they have no other effect, and the depth bounds are
+    * only lowered (or raised) by primitives which write every pixel they
+    * cover.
+    */
+   const bool shader_z =
+      nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_DEPTH);
+   const bool hiz_func = key->depth.func == PIPE_FUNC_LESS ||
+                         key->depth.func == PIPE_FUNC_LEQUAL ||
+                         key->depth.func == PIPE_FUNC_GREATER ||
+                         key->depth.func == PIPE_FUNC_GEQUAL;
+
+   variant->hiz_cull =
+         key->depth.enabled &&
+         hiz_func &&
+         !shader_z &&
+         !key->stencil[0].enabled &&
+         (!nir->info.writes_memory || nir->info.fs.early_fragment_tests);
+
+   variant->hiz_writes_z = key->depth.enabled && key->depth.writemask;
+   variant->hiz_shader_z = variant->hiz_writes_z && shader_z;
+
+   variant->hiz_full_write =
+         variant->hiz_writes_z &&
+         (hiz_func || key->depth.func == PIPE_FUNC_ALWAYS) &&
+         !shader_z &&
+         !key->stencil[0].enabled &&
+         !key->alpha.enabled &&
+         !key->multisample &&
+         !key->blend.alpha_to_coverage &&
+         !nir->info.fs.uses_discard &&
+         !nir->info.fs.uses_demote &&
+         !(nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_SAMPLE_MASK));
+
    /* We only care about opaque blits for now */
    if (variant->opaque &&
        (shader->kind == LP_FS_KIND_BLIT_RGBA ||
@@ -3831,6 +3903,7 @@ generate_variant(struct llvmpipe_context *lp,
       }
 
       if (target == PIPE_TEXTURE_2D &&
+          !samp0->texture_state.tiled &&
           min_img_filter == PIPE_TEX_FILTER_NEAREST &&
           mag_img_filter == PIPE_TEX_FILTER_NEAREST &&
           min_mip_filter == PIPE_TEX_MIPFILTER_NONE &&
@@ -3870,12 +3943,12 @@ generate_variant(struct llvmpipe_context *lp,
    lp_jit_init_types(variant);
 
    if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+      generate_fragment(shader, nir, variant, RAST_EDGE_TEST);
 
    if (variant->jit_function[RAST_WHOLE] == NULL) {
       if (variant->opaque) {
          /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+         generate_fragment(shader, nir, variant, RAST_WHOLE);
       }
    }
 
@@ -3899,7 +3972,7 @@ generate_variant(struct llvmpipe_context *lp,
          if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
              shader->kind == LP_FS_KIND_BLIT_RGB1 ||
              shader->kind == LP_FS_KIND_LLVM_LINEAR) {
-            llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
+            llvmpipe_fs_variant_linear_llvm(shader, nir, variant);
          }
       }
    } else {
@@ -3965,9 +4038,15 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    if (!shader)
       return NULL;
 
+   shader->variants = _mesa_hash_table_create(NULL, lp_fs_variant_key_hash,
+                                              lp_fs_variant_key_equal);
+   if (!shader->variants) {
+      FREE(shader);
+      return NULL;
+   }
+
    pipe_reference_init(&shader->reference, 1);
    shader->no = fs_no++;
-   list_inithead(&shader->variants.list);
 
    shader->base.type = PIPE_SHADER_IR_NIR;
 
@@ -3985,10 +4064,11 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    nir_tgsi_scan_shader(nir, &shader->info.base, true);
    shader->info.num_texs = shader->info.base.opcode_count[TGSI_OPCODE_TEX];
 
-   llvmpipe_register_shader(pipe, &shader->base);
+   llvmpipe_gather_sample_ops(&shader->base, &shader->sample_ops);
 
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
+      _mesa_hash_table_destroy(shader->variants, NULL);
       FREE(shader);
       return NULL;
    }
@@ -4054,10 +4134,23 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
 
    llvmpipe_fs_analyse_nir(shader);
 
+   /* Variant keys include this, for variants to be shared by all the
+    * shaders with the same code, across contexts.
+    */
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, nir, true);
+   _mesa_sha1_compute(blob.data, blob.size, shader->ir_sha1);
+   blob_finish(&blob);
+
    return shader;
 }
 
 
+static void
+queue_fs_variant(struct llvmpipe_context *lp);
+
+
 static void
 llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
 {
@@ -4066,6 +4159,9 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
    if (llvmpipe->fs == lp_fs)
       return;
 
+   if (lp_fs)
+      llvmpipe_register_sample_ops(llvmpipe, &lp_fs->sample_ops);
+
    draw_bind_fragment_shader(llvmpipe->draw,
                              (lp_fs ? lp_fs->draw_data : NULL));
 
@@ -4074,34 +4170,46 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
    /* invalidate the setup link, NEW_FS will make it update */
    lp_setup_set_fs_variant(llvmpipe->setup, NULL);
    llvmpipe->dirty |= LP_NEW_FS;
+
+   queue_fs_variant(llvmpipe);
 }
 
 
 /**
- * Remove shader variant from two lists: the shader's variant list
- * and the context's variant list.
+ * Remove a context's link to a shader variant from the shader's variant
+ * table and the context's variant list, and drop its reference.
  */
 static void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
-                               struct lp_fragment_shader_variant *variant)
+                               struct lp_fs_variant_link *link)
 {
+   struct lp_fragment_shader *shader = link->shader;
+   struct lp_fragment_shader_variant *variant = link->list_item_global.base;
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
-                   variant->shader->no, variant->no,
-                   variant->shader->variants_created,
-                   variant->shader->variants_cached,
+                   shader->no, variant->no,
+                   shader->variants_created,
+                   shader->variants_cached,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
-   /* remove from shader's list */
-   list_del(&variant->list_item_local.list);
-   variant->shader->variants_cached--;
+   /* remove from shader's table */
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(shader->variants, variant->hash,
+                                         &variant->key);
+   assert(entry && entry->data == link);
+   _mesa_hash_table_remove(shader->variants, entry);
+   shader->variants_cached--;
 
    /* remove from context's list */
-   list_del(&variant->list_item_global.list);
+   list_del(&link->list_item_global.list);
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
+
+   FREE(link);
+   lp_fs_variant_reference(lp, &variant, NULL);
 }
 
 
@@ -4109,7 +4217,23 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   /* A context which found the variant while its last reference was going
+    * away may have replaced it with a new one already.
+    */
+   mtx_lock(&screen->fs_variant_mutex);
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(screen->fs_variants, variant->hash,
+                                         &variant->key);
+   if (entry && entry->data == variant)
+      _mesa_hash_table_remove(screen->fs_variants, entry);
+   mtx_unlock(&screen->fs_variant_mutex);
+
    gallivm_destroy(variant->gallivm);
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+   LLVMContextDispose(variant->context);
+#endif
    lp_fs_reference(lp, &variant->shader, NULL);
    FREE(variant);
 }
@@ -4124,6 +4248,7 @@ llvmpipe_destroy_fs(struct llvmpipe_context *llvmpipe,
 
    ralloc_free(shader->base.ir.nir);
    assert(shader->variants_cached == 0);
+   _mesa_hash_table_destroy(shader->variants, NULL);
    FREE(shader);
 }
 
@@ -4133,14 +4258,14 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_fragment_shader *shader = fs;
-   struct lp_fs_variant_list_item *li, *next;
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      struct lp_fragment_shader_variant *variant;
-      variant = li->base;
-      llvmpipe_remove_shader_variant(llvmpipe, li->base);
-      lp_fs_variant_reference(llvmpipe, &variant, NULL);
+   llvmpipe_drop_fs_compile_jobs(llvmpipe, shader);
+
+   /* Delete this context's links to the variants, the variants themselves
+    * go away with their last reference.
+    */
+   hash_table_foreach(shader->variants, entry) {
+      llvmpipe_remove_shader_variant(llvmpipe, entry->data);
    }
 
    lp_fs_reference(llvmpipe, &shader, NULL);
@@ -4291,6 +4416,7 @@ llvmpipe_set_shader_images(struct pipe_context *pipe,
 
       if (image && image->resource) {
          bool read_only = !(image->access & PIPE_IMAGE_ACCESS_WRITE);
+         llvmpipe_resource_untile(pipe, image->resource);
          llvmpipe_flush_resource(pipe, image->resource, 0, read_only, false,
                                  false, "image");
       }
@@ -4361,7 +4487,8 @@ force_dst_alpha_one(enum pipe_blendfactor factor, bool clamped_zero)
 static struct lp_fragment_shader_variant_key *
 make_variant_key(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
-                 char *store)
+                 char *store,
+                 uint32_t *hash)
 {
    struct lp_fragment_shader_variant_key *key =
       (struct lp_fragment_shader_variant_key *)store;
@@ -4577,16 +4704,16 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if (BITSET_TEST(nir->info.textures_used, i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                          lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    } else {
       key->nr_sampler_views = key->nr_samplers;
       for (unsigned i = 0; i < key->nr_sampler_views; ++i) {
          if (BITSET_TEST(nir->info.samplers_used, i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                 lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                          lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -4611,10 +4738,251 @@ make_variant_key(struct llvmpipe_context *lp,
       samp0->sampler_state.mag_img_filter = PIPE_TEX_FILTER_NEAREST;
    }
 
+   memcpy(key->ir_sha1, shader->ir_sha1, sizeof key->ir_sha1);
+
+   assert(fs_variant_key_size(key) == shader->variant_key_size);
+   *hash = _mesa_hash_data(key, shader->variant_key_size);
+
    return key;
 }
 
 
+/**
+ * Look for a variant another context or shader has compiled already.
+ * Returns a new reference.
+ */
+static struct lp_fragment_shader_variant *
+find_shared_variant(struct llvmpipe_screen *screen,
+                    const struct lp_fragment_shader_variant_key *key,
+                    uint32_t hash)
+{
+   struct lp_fragment_shader_variant *variant = NULL;
+
+   mtx_lock(&screen->fs_variant_mutex);
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(screen->fs_variants, hash, key);
+   if (entry) {
+      /* Don't revive a variant whose last reference is being dropped, it
+       * is about to remove itself from the table.
+       */
+      struct lp_fragment_shader_variant *found = entry->data;
+      int32_t count = p_atomic_read(&found->reference.count);
+      while (count > 0) {
+         int32_t old = p_atomic_cmpxchg(&found->reference.count,
+                                        count, count + 1);
+         if (old == count) {
+            variant = found;
+            break;
+         }
+         count = old;
+      }
+   }
+
+   mtx_unlock(&screen->fs_variant_mutex);
+
+   return variant;
+}
+
+
+/**
+ * A variant compiled on the screen's compile queue ahead of the draw which
+ * needs it.  Owned by the context which queued it.
+ */
+struct lp_fs_compile_job {
+   struct list_head link;
+   struct util_queue_fence ready;
+
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader *shader;
+   /* Private copy of the NIR, freed by the job */
+   struct nir_shader *nir;
+   /* The result, NULL if compiling failed */
+   struct lp_fragment_shader_variant *variant;
+
+   uint32_t hash;
+   struct lp_fragment_shader_variant_key key; /* must be last */
+};
+
+
+static void
+fs_compile_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct llvmpipe_screen *screen = job->screen;
+
+   job->variant = generate_variant(screen, job->shader, job->nir,
+                                   &job->key, job->hash);
+   ralloc_free(job->nir);
+   job->nir = NULL;
+
+   /* Let other contexts find it, as for variants compiled by draws */
+   if (job->variant) {
+      mtx_lock(&screen->fs_variant_mutex);
+      _mesa_hash_table_insert_pre_hashed(screen->fs_variants, job->hash,
+                                         &job->variant->key, job->variant);
+      mtx_unlock(&screen->fs_variant_mutex);
+   }
+}
+
+
+static struct lp_fs_compile_job *
+find_compile_job(struct llvmpipe_context *lp,
+                 const struct lp_fragment_shader_variant_key *key)
+{
+   list_for_each_entry(struct lp_fs_compile_job, job,
+                       &lp->fs_compile_jobs, link) {
+      if (lp_fs_variant_key_equal(&job->key, key))
+         return job;
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Free a job which is done or was dropped from the queue.
+ */
+static void
+free_compile_job(struct llvmpipe_context *lp, struct lp_fs_compile_job *job)
+{
+   assert(util_queue_fence_is_signalled(&job->ready));
+
+   list_del(&job->link);
+   lp_fs_variant_reference(lp, &job->variant, NULL);
+   ralloc_free(job->nir);
+   util_queue_fence_destroy(&job->ready);
+   lp_fs_reference(lp, &job->shader, NULL);
+   FREE(job);
+}
+
+
+/**
+ * Drop the compile jobs of a shader, or all of them if shader is NULL,
+ * waiting for those which are running.
+ */
+void
+llvmpipe_drop_fs_compile_jobs(struct llvmpipe_context *lp,
+                              struct lp_fragment_shader *shader)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   list_for_each_entry_safe(struct lp_fs_compile_job, job,
+                            &lp->fs_compile_jobs, link) {
+      if (shader && job->shader != shader)
+         continue;
+
+      util_queue_drop_job(&screen->fs_compile_queue, &job->ready);
+      free_compile_job(lp, job);
+   }
+}
+
+
+/**
+ * With LP_ASYNC_COMPILE, start compiling the variant the bound fragment
+ * shader needs with the current state, so that the draw which uses it
+ * finds it compiled, or at least being compiled.
+ *
+ * There is no variant which works with any key to draw with meanwhile, as
+ * blend, depth and format state are baked into the code.
+ */
+static void
+queue_fs_variant(struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader *shader = lp->fs;
+
+   /* make_variant_key() needs these */
+   if (!screen->async_fs_compile || !shader ||
+       !lp->rasterizer || !lp->blend || !lp->depth_stencil)
+      return;
+
+   char store[LP_FS_MAX_VARIANT_KEY_SIZE];
+   uint32_t hash;
+   const struct lp_fragment_shader_variant_key *key =
+      make_variant_key(lp, shader, store, &hash);
+
+   if (_mesa_hash_table_search_pre_hashed(shader->variants, hash, key) ||
+       find_compile_job(lp, key))
+      return;
+
+   mtx_lock(&screen->fs_variant_mutex);
+   const bool shared =
+      _mesa_hash_table_search_pre_hashed(screen->fs_variants, hash, key);
+   mtx_unlock(&screen->fs_variant_mutex);
+   if (shared)
+      return;
+
+   struct lp_fs_compile_job *job =
+      MALLOC(sizeof *job + shader->variant_key_size - sizeof job->key);
+   if (!job)
+      return;
+
+   memset(job, 0, sizeof *job);
+   util_queue_fence_init(&job->ready);
+   job->screen = screen;
+   lp_fs_reference(lp, &job->shader, shader);
+   /* Compiling modifies the NIR, while the context keeps using it */
+   job->nir = nir_shader_clone(NULL, shader->base.ir.nir);
+   job->hash = hash;
+   memcpy(&job->key, key, shader->variant_key_size);
+   list_addtail(&job->link, &lp->fs_compile_jobs);
+
+   util_queue_add_job(&screen->fs_compile_queue, job, &job->ready,
+                      fs_compile_job_execute, NULL, 0);
+}
+
+
+/**
+ * Put a variant into the shader's table and the context's list, taking
+ * over the reference.
+ */
+static void
+insert_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader *shader,
+               struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_variant_link *link = MALLOC_STRUCT(lp_fs_variant_link);
+   if (!link) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return;
+   }
+
+   link->list_item_global.base = variant;
+   link->shader = shader;
+   _mesa_hash_table_insert_pre_hashed(shader->variants, variant->hash,
+                                      &variant->key, link);
+   list_add(&link->list_item_global.list, &lp->fs_variants_list.list);
+   lp->nr_fs_variants++;
+   lp->nr_fs_instrs += variant->nr_instrs;
+   shader->variants_cached++;
+}
+
+
+/**
+ * Keep the variants which compile jobs have finished.
+ */
+static void
+collect_compile_jobs(struct llvmpipe_context *lp)
+{
+   list_for_each_entry_safe(struct lp_fs_compile_job, job,
+                            &lp->fs_compile_jobs, link) {
+      if (!util_queue_fence_is_signalled(&job->ready))
+         continue;
+
+      struct lp_fragment_shader_variant *variant = job->variant;
+      if (variant &&
+          !_mesa_hash_table_search_pre_hashed(job->shader->variants,
+                                              variant->hash, &variant->key)) {
+         job->variant = NULL;
+         insert_variant(lp, job->shader, variant);
+      }
+
+      free_compile_job(lp, job);
+   }
+}
+
+
 /**
  * Update fragment shader state.  This is called just prior to drawing
  * something when some fragment-related state has changed.
@@ -4624,25 +4992,28 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 {
    struct lp_fragment_shader *shader = lp->fs;
 
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    char store[LP_FS_MAX_VARIANT_KEY_SIZE];
+   uint32_t hash;
    const struct lp_fragment_shader_variant_key *key =
-      make_variant_key(lp, shader, store);
+      make_variant_key(lp, shader, store, &hash);
+
+   collect_compile_jobs(lp);
 
    struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
    /* Search the variants for one which matches the key */
-   LIST_FOR_EACH_ENTRY(li, &shader->variants.list, list) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-   }
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(shader->variants, hash, key);
+
+   if (entry) {
+      struct lp_fs_variant_link *link = entry->data;
+      variant = link->list_item_global.base;
+      LP_COUNT(nr_fs_variant_hits);
 
-   if (variant) {
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
-      list_move_to(&variant->list_item_global.list, &lp->fs_variants_list.list);
+      list_move_to(&link->list_item_global.list, &lp->fs_variants_list.list);
    } else {
       /* variant not found, create it now */
 
@@ -4680,38 +5051,62 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
               i < variants_to_cull ||
                  lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS;
               i++) {
-            struct lp_fs_variant_list_item *item;
+            struct lp_fs_variant_link *link;
             if (list_is_empty(&lp->fs_variants_list.list)) {
                break;
             }
-            item = list_last_entry(&lp->fs_variants_list.list,
-                                   struct lp_fs_variant_list_item, list);
-            assert(item);
-            assert(item->base);
-            llvmpipe_remove_shader_variant(lp, item->base);
-            struct lp_fragment_shader_variant *variant = item->base;
-            lp_fs_variant_reference(lp, &variant, NULL);
+            link = list_last_entry(&lp->fs_variants_list.list,
+                                   struct lp_fs_variant_link,
+                                   list_item_global.list);
+            assert(link);
+            assert(link->list_item_global.base);
+            llvmpipe_remove_shader_variant(lp, link);
          }
       }
 
-      /*
-       * Generate the new variant.
+      /* Wait for the compile queue if it is compiling the variant, else
+       * look for it in the other contexts.
        */
-      int64_t t0 = os_time_get();
-      variant = generate_variant(lp, shader, key);
-      int64_t t1 = os_time_get();
-      int64_t dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
-      LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
-
-      /* Put the new variant into the list */
+      struct lp_fs_compile_job *job = find_compile_job(lp, key);
+      if (job) {
+         util_queue_fence_wait(&job->ready);
+         variant = job->variant;
+         job->variant = NULL;
+         free_compile_job(lp, job);
+      }
+
+      if (!variant)
+         variant = find_shared_variant(screen, key, hash);
+
       if (variant) {
-         list_add(&variant->list_item_local.list, &shader->variants.list);
-         list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
-         lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
-         shader->variants_cached++;
+         LP_COUNT(nr_fs_variant_shared_hits);
+      } else {
+         /*
+          * Generate the new variant.
+          */
+         int64_t t0 = os_time_get();
+         variant = generate_variant(screen, shader, shader->base.ir.nir,
+                                    key, hash);
+         int64_t t1 = os_time_get();
+         int64_t dt = t1 - t0;
+         LP_COUNT_ADD(llvm_compile_time, dt);
+         LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+         LP_COUNT(nr_fs_variant_misses);
+
+         /* Let other contexts find it.  If one compiled the same variant
+          * meanwhile, it stays in use but is no longer shared.
+          */
+         if (variant) {
+            mtx_lock(&screen->fs_variant_mutex);
+            _mesa_hash_table_insert_pre_hashed(screen->fs_variants, hash,
+                                               &variant->key, variant);
+            mtx_unlock(&screen->fs_variant_mutex);
+         }
       }
+
+      /* Put the new variant into the table and list */
+      if (variant)
+         insert_variant(lp, shader, variant);
    }
 
    /* Bind this variant */
@@ -39,8 +39,11 @@
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
 #include "lp_jit.h"
+#include "lp_texture_handle.h"
 
+struct hash_table;
 struct lp_fragment_shader;
+struct nir_shader;
 
 
 /** Indexes into jit_function[] array */
@@ -95,6 +98,9 @@ struct lp_fragment_shader_variant_key
    uint8_t zsbuf_nr_samples;
    uint8_t coverage_samples;
    uint8_t min_samples;
+
+   /* Identifies the shader code, so that keys are unique across shaders. */
+   unsigned char ir_sha1[20];
    /* followed by variable number of samplers + images */
 };
 
@@ -111,6 +117,12 @@ lp_fs_variant_key_size(unsigned nr_samplers, unsigned nr_images)
            nr_images * sizeof(struct lp_image_static_state));
 }
 
+uint32_t
+lp_fs_variant_key_hash(const void *key);
+
+bool
+lp_fs_variant_key_equal(const void *a, const void *b);
+
 static inline struct lp_sampler_static_state *
 lp_fs_variant_key_samplers(const struct lp_fragment_shader_variant_key *key)
 {
@@ -141,6 +153,20 @@ struct lp_fs_variant_list_item
 };
 
 
+/**
+ * A context's reference to a variant.  Variants are shared by all the
+ * contexts of a screen, but each context evicts the ones it uses on its own.
+ */
+struct lp_fs_variant_link
+{
+   /** In the context's LRU list */
+   struct lp_fs_variant_list_item list_item_global;
+
+   /** The shader whose variant table holds this link */
+   struct lp_fragment_shader *shader;
+};
+
+
 struct lp_fragment_shader_variant
 {
    /*
@@ -151,6 +177,14 @@ struct lp_fragment_shader_variant
    unsigned opaque:1;
    unsigned blit:1;
    unsigned linear_input_mask:16;
+
+   /*
+    * Hierarchical Z, see struct lp_rast_hiz.
+    */
+   unsigned hiz_cull:1;        /**< may skip fragments failing the depth test */
+   unsigned hiz_writes_z:1;    /**< writes the depth buffer */
+   unsigned hiz_shader_z:1;    /**< ... with the depth output of the shader */
+   unsigned hiz_full_write:1;  /**< ... for every covered pixel */
    struct pipe_reference reference;
 
    struct gallivm_state *gallivm;
@@ -185,9 +219,16 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
-   struct lp_fs_variant_list_item list_item_global, list_item_local;
+   /* The code may outlive the context that compiled it, so the variant
+    * has an LLVM context of its own.
+    */
+   LLVMContextRef context;
+
    struct lp_fragment_shader *shader;
 
+   /* lp_fs_variant_key_hash() of the key */
+   uint32_t hash;
+
    /* For debugging/profiling purposes */
    unsigned no;
 
@@ -203,14 +244,18 @@ struct lp_fragment_shader
 
    struct pipe_reference reference;
    struct lp_tgsi_info info;
+   struct lp_shader_sample_ops sample_ops;
 
    /* Analysis results */
    enum lp_fs_kind kind;
 
-   struct lp_fs_variant_list_item variants;
+   /* This context's variants, lp_fs_variant_links indexed by key */
+   struct hash_table *variants;
 
    struct draw_fragment_shader *draw_data;
 
+   unsigned char ir_sha1[20];
+
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
    unsigned no;
@@ -232,8 +277,8 @@ void
 llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant);
 
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
-                                struct lp_fragment_shader *shader,
+llvmpipe_fs_variant_linear_llvm(struct lp_fragment_shader *shader,
+                                struct nir_shader *nir,
                                 struct lp_fragment_shader_variant *variant);
 
 void
@@ -41,11 +41,6 @@
 #include "lp_linear_priv.h"
 
 
-#if DETECT_ARCH_SSE
-
-#include <emmintrin.h>
-
-
 struct nearest_sampler {
    alignas(16) uint32_t out[64];
 
@@ -82,7 +77,7 @@ struct shader {
    alignas(16) uint32_t out0[64];
    const uint32_t *src0;
    const uint32_t *src1;
-   __m128i const0;
+   const struct lp_linear_kernels *kernels;
    int width;                   /* rounded up to multiple of 4 */
 };
 
@@ -103,11 +98,13 @@ blend_premul(struct color_blend *blend)
    const uint32_t *src = blend->src;  /* aligned */
    uint32_t *dst = (uint32_t *)blend->color;      /* unaligned */
    const int width = blend->width;
-   int i;
-   union { __m128i m128; uint ui[4]; } dstreg;
 
    blend->color += blend->stride;
 
+#if DETECT_ARCH_SSE
+   union { __m128i m128; uint ui[4]; } dstreg;
+   int i;
+
    for (i = 0; i + 3 < width; i += 4) {
       __m128i tmp;
       tmp = _mm_loadu_si128((const __m128i *)&dst[i]);  /* UNALIGNED READ */
@@ -126,6 +123,16 @@ blend_premul(struct color_blend *blend)
       for (; i < width; i++)
          dst[i] = dstreg.ui[i&3];
    }
+#else
+   for (int i = 0; i < width; i++) {
+      const uint8_t *s = (const uint8_t *)&src[i];
+      uint8_t *d = (uint8_t *)&dst[i];
+
+      /* Same arithmetic as util_sse2_blend_premul_4(). */
+      for (unsigned c = 0; c < 4; c++)
+         d[c] = MIN2(s[c] + d[c] - ((d[c] * s[3]) >> 8), 255);
+   }
+#endif
 }
 
 
@@ -315,17 +322,7 @@ init_nearest_sampler(struct nearest_sampler *samp,
 static const uint32_t *
 shade_rgb1(struct shader *shader)
 {
-   const __m128i rgb1 = _mm_set1_epi32(0xff000000);
-   const uint32_t *src0 = shader->src0;
-   uint32_t *dst = shader->out0;
-   int width = shader->width;
-   int i;
-
-   for (i = 0; i + 3 < width; i += 4) {
-      __m128i s = *(const __m128i *)&src0[i];
-      *(__m128i *)&dst[i] = _mm_or_si128(s, rgb1);
-   }
-
+   shader->kernels->blit_rgb1_row(shader->out0, shader->src0, shader->width);
    return shader->out0;
 }
 
@@ -335,6 +332,7 @@ init_shader(struct shader *shader,
            int x, int y, int width, int height)
 {
    shader->width = align(width, 4);
+   shader->kernels = lp_linear_get_kernels();
 }
 
 
@@ -405,6 +403,7 @@ blit_rgb1_blit(const struct lp_rast_state *state,
 {
    const struct lp_jit_resources *resources = &state->jit_resources;
    const struct lp_jit_texture *texture = &resources->textures[0];
+   const struct lp_linear_kernels *kernels = lp_linear_get_kernels();
    const uint8_t *src;
    unsigned src_stride;
    int src_x, src_y;
@@ -435,13 +434,7 @@ blit_rgb1_blit(const struct lp_rast_state *state,
       return false;
 
    for (y = 0; y < height; y++) {
-      const uint32_t *src_row = (const uint32_t *)src;
-      uint32_t *dst_row = (uint32_t *)color;
-
-      for (x = 0; x < width; x++) {
-         *dst_row++ = *src_row++ | 0xff000000;
-      }
-
+      kernels->blit_rgb1_row((uint32_t *)color, (const uint32_t *)src, width);
       color += stride;
       src += src_stride;
    }
@@ -650,7 +643,7 @@ llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
 
    struct lp_sampler_static_state *samp0 =
       lp_fs_variant_key_sampler_idx(&variant->key, 0);
-   if (!samp0)
+   if (!samp0 || samp0->texture_state.tiled)
       return;
 
    enum pipe_format tex_format = samp0->texture_state.format;
@@ -660,8 +653,7 @@ llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
       if (variant->opaque) {
          variant->jit_linear_blit = blit_rgba_blit;
          variant->jit_linear = blit_rgba;
-      } else if (is_one_inv_src_alpha_blend(variant) &&
-                 util_get_cpu_caps()->has_sse2) {
+      } else if (is_one_inv_src_alpha_blend(variant)) {
          variant->jit_linear = blit_rgba_blend_premul;
       }
       return;
@@ -682,11 +674,3 @@ llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
       return;
    }
 }
-#else
-void
-llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
-{
-   /* don't bother if there is no SSE */
-}
-#endif
-
@@ -42,8 +42,6 @@ static void *
 llvmpipe_create_gs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
 {
-   llvmpipe_register_shader(pipe, templ);
-
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_geometry_shader *state;
 
@@ -51,6 +49,8 @@ llvmpipe_create_gs_state(struct pipe_context *pipe,
    if (!state)
       goto no_state;
 
+   llvmpipe_gather_sample_ops(templ, &state->sample_ops);
+
    /* debug */
    if (LP_DEBUG & DEBUG_TGSI && templ->type == PIPE_SHADER_IR_TGSI) {
       debug_printf("llvmpipe: Create geometry shader %p:\n", (void *)state);
@@ -86,6 +86,8 @@ llvmpipe_bind_gs_state(struct pipe_context *pipe, void *gs)
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
 
    llvmpipe->gs = (struct lp_geometry_shader *)gs;
+   if (llvmpipe->gs)
+      llvmpipe_register_sample_ops(llvmpipe, &llvmpipe->gs->sample_ops);
 
    draw_bind_geometry_shader(llvmpipe->draw,
                              (llvmpipe->gs ? llvmpipe->gs->dgs : NULL));
@@ -125,6 +125,35 @@ llvmpipe_bind_sampler_states(struct pipe_context *pipe,
 }
 
 
+/**
+ * Whether a texture sampled through this view must be in the linear layout.
+ *
+ * Only the shaders compiled by llvmpipe itself know about tiled textures,
+ * draw expects linear ones. Views reinterpreting the texels with a
+ * different size would need another tiling.
+ */
+static bool
+sampler_view_needs_linear(enum pipe_shader_type shader,
+                          const struct pipe_sampler_view *view)
+{
+   const struct util_format_description *desc =
+      util_format_description(view->format);
+
+   switch (shader) {
+   case PIPE_SHADER_FRAGMENT:
+   case PIPE_SHADER_COMPUTE:
+   case PIPE_SHADER_TASK:
+   case PIPE_SHADER_MESH:
+      break;
+   default:
+      return true;
+   }
+
+   return desc->block.width != 1 || desc->block.height != 1 ||
+          desc->block.bits != util_format_get_blocksizebits(view->texture->format);
+}
+
+
 static void
 llvmpipe_set_sampler_views(struct pipe_context *pipe,
                            enum pipe_shader_type shader,
@@ -161,8 +190,11 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
                       "context\n", i);
       }
 
-      if (view)
+      if (view) {
+         if (sampler_view_needs_linear(shader, view))
+            llvmpipe_resource_untile(pipe, view->texture);
          llvmpipe_flush_resource(pipe, view->texture, 0, true, false, false, "sampler_view");
+      }
 
       if (take_ownership) {
          pipe_sampler_view_reference(&llvmpipe->sampler_views[shader][start + i],
@@ -462,6 +494,21 @@ llvmpipe_cleanup_stage_sampling(struct llvmpipe_context *ctx,
 }
 
 
+/**
+ * lp_sampler_static_texture_state() plus the texture layout, which only
+ * llvmpipe knows about.
+ */
+void
+llvmpipe_sampler_static_texture_state(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && view->texture && view->target != PIPE_BUFFER)
+      state->tiled = llvmpipe_resource_const(view->texture)->tiled;
+}
+
+
 static void
 prepare_shader_images(struct llvmpipe_context *lp,
                       unsigned num,
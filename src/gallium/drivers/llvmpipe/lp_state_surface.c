@@ -36,6 +36,7 @@
 #include "lp_scene.h"
 #include "lp_state.h"
 #include "lp_setup.h"
+#include "lp_texture.h"
 
 #include "draw/draw_context.h"
 
@@ -76,6 +77,12 @@ llvmpipe_set_framebuffer_state(struct pipe_context *pipe,
             debug_printf("Illegal setting of fb state with cbuf %d created in "
                           "another context\n", i);
          }
+
+         /* The rasterizer only renders to linear textures. This is not done
+          * when creating the surface, as that may run on another thread.
+          */
+         if (fb->cbufs[i])
+            llvmpipe_resource_untile(pipe, fb->cbufs[i]->texture);
       }
 
       util_copy_framebuffer_state(&lp->framebuffer, fb);
@@ -40,8 +40,6 @@ static void *
 llvmpipe_create_tcs_state(struct pipe_context *pipe,
                           const struct pipe_shader_state *templ)
 {
-   llvmpipe_register_shader(pipe, templ);
-
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_tess_ctrl_shader *state;
 
@@ -49,6 +47,8 @@ llvmpipe_create_tcs_state(struct pipe_context *pipe,
    if (!state)
       goto no_state;
 
+   llvmpipe_gather_sample_ops(templ, &state->sample_ops);
+
    /* debug */
    if (LP_DEBUG & DEBUG_TGSI && templ->type == PIPE_SHADER_IR_TGSI) {
       debug_printf("llvmpipe: Create tess ctrl shader %p:\n", (void *)state);
@@ -81,6 +81,8 @@ llvmpipe_bind_tcs_state(struct pipe_context *pipe, void *tcs)
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
 
    llvmpipe->tcs = (struct lp_tess_ctrl_shader *)tcs;
+   if (llvmpipe->tcs)
+      llvmpipe_register_sample_ops(llvmpipe, &llvmpipe->tcs->sample_ops);
 
    draw_bind_tess_ctrl_shader(llvmpipe->draw,
                               (llvmpipe->tcs ? llvmpipe->tcs->dtcs : NULL));
@@ -110,8 +112,6 @@ static void *
 llvmpipe_create_tes_state(struct pipe_context *pipe,
                           const struct pipe_shader_state *templ)
 {
-   llvmpipe_register_shader(pipe, templ);
-
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_tess_eval_shader *state;
 
@@ -119,6 +119,8 @@ llvmpipe_create_tes_state(struct pipe_context *pipe,
    if (!state)
       goto no_state;
 
+   llvmpipe_gather_sample_ops(templ, &state->sample_ops);
+
    /* debug */
    if (LP_DEBUG & DEBUG_TGSI) {
       debug_printf("llvmpipe: Create tess eval shader %p:\n", (void *)state);
@@ -151,6 +153,8 @@ llvmpipe_bind_tes_state(struct pipe_context *pipe, void *tes)
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
 
    llvmpipe->tes = (struct lp_tess_eval_shader *)tes;
+   if (llvmpipe->tes)
+      llvmpipe_register_sample_ops(llvmpipe, &llvmpipe->tes->sample_ops);
 
    draw_bind_tess_eval_shader(llvmpipe->draw,
                               (llvmpipe->tes ? llvmpipe->tes->dtes : NULL));
@@ -42,13 +42,18 @@ static void *
 llvmpipe_create_vs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
 {
-   llvmpipe_register_shader(pipe, templ);
-
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
-   struct draw_vertex_shader *vs;
+   struct lp_vertex_shader *vs;
 
-   vs = draw_create_vertex_shader(llvmpipe->draw, templ);
-   if (!vs) {
+   vs = CALLOC_STRUCT(lp_vertex_shader);
+   if (!vs)
+      return NULL;
+
+   llvmpipe_gather_sample_ops(templ, &vs->sample_ops);
+
+   vs->dvs = draw_create_vertex_shader(llvmpipe->draw, templ);
+   if (!vs->dvs) {
+      FREE(vs);
       return NULL;
    }
 
@@ -65,12 +70,15 @@ static void
 llvmpipe_bind_vs_state(struct pipe_context *pipe, void *_vs)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
-   struct draw_vertex_shader *vs = (struct draw_vertex_shader *)_vs;
+   struct lp_vertex_shader *vs = (struct lp_vertex_shader *)_vs;
 
    if (llvmpipe->vs == vs)
       return;
 
-   draw_bind_vertex_shader(llvmpipe->draw, vs);
+   if (vs)
+      llvmpipe_register_sample_ops(llvmpipe, &vs->sample_ops);
+
+   draw_bind_vertex_shader(llvmpipe->draw, vs ? vs->dvs : NULL);
 
    llvmpipe->vs = vs;
 
@@ -82,9 +90,10 @@ static void
 llvmpipe_delete_vs_state(struct pipe_context *pipe, void *_vs)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
-   struct draw_vertex_shader *vs = (struct draw_vertex_shader *)_vs;
+   struct lp_vertex_shader *vs = (struct lp_vertex_shader *)_vs;
 
-   draw_delete_vertex_shader(llvmpipe->draw, vs);
+   draw_delete_vertex_shader(llvmpipe->draw, vs->dvs);
+   FREE(vs);
 }
 
 
@@ -0,0 +1,247 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Test for compute shaders shared by contexts running on several threads,
+ * as lavapipe's compute queues do.
+ *
+ * Every round, one context creates a shader which the other contexts
+ * dispatch at the same time, each compiling its own variant. Then that
+ * context deletes the shader, retiring the other contexts' variants, while
+ * they compile and dispatch the next one. Checks the results of every
+ * dispatch.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "c11/threads.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "sw/null/null_sw_winsys.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define NUM_WORKERS 3
+#define NUM_ROUNDS 4
+#define BLOCK_SIZE 64
+#define NUM_BLOCKS 16
+#define NUM_VALUES (BLOCK_SIZE * NUM_BLOCKS)
+
+
+/* BUFFER[0][i] = i + CONST[0][0].x */
+static const char cs_text[] =
+   "COMP\n"
+   "PROPERTY CS_FIXED_BLOCK_WIDTH 64\n"
+   "PROPERTY CS_FIXED_BLOCK_HEIGHT 1\n"
+   "PROPERTY CS_FIXED_BLOCK_DEPTH 1\n"
+   "DCL SV[0], THREAD_ID\n"
+   "DCL SV[1], BLOCK_ID\n"
+   "DCL BUFFER[0]\n"
+   "DCL CONST[0][0]\n"
+   "DCL TEMP[0..1]\n"
+   "IMM[0] UINT32 { 64, 4, 0, 0}\n"
+   "UMAD TEMP[0].x, SV[1].xxxx, IMM[0].xxxx, SV[0].xxxx\n"
+   "UMUL TEMP[1].x, TEMP[0].xxxx, IMM[0].yyyy\n"
+   "UADD TEMP[0].x, TEMP[0].xxxx, CONST[0][0].xxxx\n"
+   "STORE BUFFER[0].x, TEMP[1].xxxx, TEMP[0].xxxx\n"
+   "END\n";
+
+
+struct worker {
+   struct pipe_context *ctx;
+   struct pipe_resource *buffer;
+   void *cs;
+   unsigned base;
+   bool success;
+};
+
+
+static void *
+create_cs(struct pipe_context *ctx)
+{
+   struct tgsi_token tokens[256];
+
+   if (!tgsi_text_translate(cs_text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   struct pipe_compute_state state = {
+      .ir_type = PIPE_SHADER_IR_TGSI,
+      .prog = tokens,
+   };
+
+   return ctx->create_compute_state(ctx, &state);
+}
+
+
+static bool
+dispatch_and_check(struct pipe_context *ctx, struct pipe_resource *buffer,
+                   void *cs, unsigned base)
+{
+   const uint32_t constants[4] = { base };
+   struct pipe_constant_buffer cb = {
+      .buffer_size = sizeof(constants),
+      .user_buffer = constants,
+   };
+   struct pipe_shader_buffer sb = {
+      .buffer = buffer,
+      .buffer_size = NUM_VALUES * sizeof(uint32_t),
+   };
+   struct pipe_grid_info info = {
+      .work_dim = 1,
+      .block = { BLOCK_SIZE, 1, 1 },
+      .grid = { NUM_BLOCKS, 1, 1 },
+   };
+   uint32_t values[NUM_VALUES];
+
+   ctx->bind_compute_state(ctx, cs);
+   ctx->set_constant_buffer(ctx, PIPE_SHADER_COMPUTE, 0, false, &cb);
+   ctx->set_shader_buffers(ctx, PIPE_SHADER_COMPUTE, 0, 1, &sb, 1);
+   ctx->launch_grid(ctx, &info);
+   ctx->bind_compute_state(ctx, NULL);
+
+   pipe_buffer_read(ctx, buffer, 0, sizeof(values), values);
+
+   for (unsigned i = 0; i < NUM_VALUES; i++) {
+      if (values[i] != base + i) {
+         fprintf(stderr, "value %u is %u, expected %u\n",
+                 i, values[i], base + i);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+static int
+worker_func(void *data)
+{
+   struct worker *w = data;
+
+   w->success &= dispatch_and_check(w->ctx, w->buffer, w->cs, w->base);
+   return 0;
+}
+
+
+/**
+ * Have every worker dispatch cs once, while the main context deletes
+ * old_cs if set.
+ */
+static bool
+run_workers(struct pipe_context *ctx, struct worker *workers,
+            void *cs, void *old_cs, unsigned round)
+{
+   thrd_t threads[NUM_WORKERS];
+   bool success = true;
+
+   for (unsigned i = 0; i < NUM_WORKERS; i++) {
+      workers[i].cs = cs;
+      workers[i].base = (round * NUM_WORKERS + i) * NUM_VALUES;
+      if (thrd_create(&threads[i], worker_func, &workers[i]) != thrd_success)
+         return false;
+   }
+
+   if (old_cs)
+      ctx->delete_compute_state(ctx, old_cs);
+
+   for (unsigned i = 0; i < NUM_WORKERS; i++) {
+      thrd_join(threads[i], NULL);
+      success &= workers[i].success;
+   }
+
+   return success;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "rounds\n");
+
+   fflush(fp);
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   struct pipe_screen *screen = llvmpipe_create_screen(null_sw_create());
+   struct pipe_context *ctx;
+   struct worker workers[NUM_WORKERS];
+   void *cs = NULL;
+   bool success = true;
+
+   if (!screen)
+      return false;
+
+   ctx = screen->context_create(screen, NULL, 0);
+   for (unsigned i = 0; i < NUM_WORKERS; i++) {
+      workers[i].ctx = screen->context_create(screen, NULL, 0);
+      workers[i].buffer = pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER,
+                                             PIPE_USAGE_DEFAULT,
+                                             NUM_VALUES * sizeof(uint32_t));
+      workers[i].success = true;
+   }
+
+   for (unsigned round = 0; round < NUM_ROUNDS && success; round++) {
+      void *old_cs = cs;
+
+      cs = create_cs(ctx);
+      if (!cs) {
+         success = false;
+         break;
+      }
+
+      /* The first dispatch of each worker compiles its variant of cs,
+       * concurrently with the deletion of the previous shader.
+       */
+      success &= run_workers(ctx, workers, cs, old_cs, round);
+      success &= dispatch_and_check(ctx, workers[0].buffer, cs, round);
+
+      if (verbose >= 1)
+         printf("round %u: %s\n", round, success ? "pass" : "fail");
+   }
+
+   if (cs)
+      ctx->delete_compute_state(ctx, cs);
+
+   for (unsigned i = 0; i < NUM_WORKERS; i++) {
+      pipe_resource_reference(&workers[i].buffer, NULL);
+      workers[i].ctx->destroy(workers[i].ctx);
+   }
+   ctx->destroy(ctx);
+   screen->destroy(screen);
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\n", success ? "pass" : "fail", NUM_ROUNDS);
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
@@ -0,0 +1,223 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Microbenchmark for the compute thread pool.
+ *
+ * Dispatches workloads whose iterations have skewed cost and reports how
+ * busy the pool's threads were kept, i.e. the time spent in iterations
+ * divided by wall time times the number of threads.  Also checks that
+ * every iteration ran exactly once.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+#include "util/u_thread.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+#define NUM_ITERS 4096
+#define NUM_DISPATCHES 8
+
+
+enum skew {
+   SKEW_NONE,     /* all iterations cost the same */
+   SKEW_RAMP,     /* cost grows with the iteration index */
+   SKEW_TAIL,     /* the last 1/16th of the iterations cost 64x more */
+};
+
+static const char *skew_names[] = {
+   "uniform",
+   "ramp",
+   "tail",
+};
+
+
+struct tpool_test_job {
+   enum skew skew;
+   unsigned num_iters;
+   unsigned *hits;
+   int64_t busy_ns;
+};
+
+
+static unsigned
+iter_cost(const struct tpool_test_job *job, unsigned iter)
+{
+   switch (job->skew) {
+   case SKEW_RAMP:
+      return 1 + iter * 64 / job->num_iters;
+   case SKEW_TAIL:
+      return iter >= job->num_iters - job->num_iters / 16 ? 64 : 1;
+   default:
+      return 1;
+   }
+}
+
+
+static void
+tpool_test_work(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct tpool_test_job *job = data;
+   const int64_t start = os_time_get_nano();
+   volatile uint32_t x = iter_idx;
+
+   for (unsigned i = 0; i < iter_cost(job, iter_idx) * 200; i++)
+      x = x * 1664525u + 1013904223u;
+
+   p_atomic_inc(&job->hits[iter_idx]);
+   p_atomic_add(&job->busy_ns, os_time_get_nano() - start);
+}
+
+
+static void
+tpool_dispatch(struct lp_cs_tpool *pool, struct tpool_test_job *job)
+{
+   for (unsigned d = 0; d < NUM_DISPATCHES; d++) {
+      struct lp_cs_tpool_task *task =
+         lp_cs_tpool_queue_task(pool, tpool_test_work, job, job->num_iters);
+      lp_cs_tpool_wait_for_task(pool, &task);
+   }
+}
+
+
+struct tpool_test_thread {
+   struct lp_cs_tpool *pool;
+   struct tpool_test_job *job;
+};
+
+
+static int
+tpool_dispatch_thread(void *data)
+{
+   struct tpool_test_thread *thread = data;
+   tpool_dispatch(thread->pool, thread->job);
+   return 0;
+}
+
+
+/**
+ * Run the given skew from 'num_contexts' application threads at once.
+ */
+static bool
+test_tpool(unsigned verbose, FILE *fp, struct lp_cs_tpool *pool,
+           enum skew skew, unsigned num_contexts)
+{
+   struct tpool_test_job jobs[2];
+   struct tpool_test_thread threads[2];
+   thrd_t handles[2];
+   bool success = true;
+
+   assert(num_contexts <= ARRAY_SIZE(jobs));
+
+   for (unsigned c = 0; c < num_contexts; c++) {
+      jobs[c].skew = skew;
+      jobs[c].num_iters = NUM_ITERS;
+      jobs[c].hits = CALLOC(NUM_ITERS, sizeof(unsigned));
+      jobs[c].busy_ns = 0;
+      threads[c].pool = pool;
+      threads[c].job = &jobs[c];
+   }
+
+   const int64_t start = os_time_get_nano();
+
+   for (unsigned c = 1; c < num_contexts; c++)
+      u_thread_create(&handles[c], tpool_dispatch_thread, &threads[c]);
+
+   tpool_dispatch(pool, &jobs[0]);
+
+   for (unsigned c = 1; c < num_contexts; c++)
+      thrd_join(handles[c], NULL);
+
+   const int64_t wall_ns = os_time_get_nano() - start;
+
+   int64_t busy_ns = 0;
+   for (unsigned c = 0; c < num_contexts; c++) {
+      for (unsigned i = 0; i < NUM_ITERS; i++) {
+         if (jobs[c].hits[i] != NUM_DISPATCHES) {
+            if (success)
+               fprintf(stderr, "%s: iteration %u ran %u times, expected %u\n",
+                       skew_names[skew], i, jobs[c].hits[i], NUM_DISPATCHES);
+            success = false;
+         }
+      }
+      busy_ns += jobs[c].busy_ns;
+      FREE(jobs[c].hits);
+   }
+
+   const double utilization =
+      100.0 * busy_ns / ((double)wall_ns * MAX2(pool->num_threads, 1));
+
+   printf("%-8s x%u: %8.2f ms, utilization %5.1f%% of %u threads\n",
+          skew_names[skew], num_contexts, wall_ns / 1000000.0,
+          utilization, pool->num_threads);
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\t%u\t%f\t%f\n", success ? "pass" : "fail",
+              skew_names[skew], num_contexts, wall_ns / 1000000.0,
+              utilization);
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "skew\t"
+           "contexts\t"
+           "ms\t"
+           "utilization\n");
+
+   fflush(fp);
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   const unsigned num_threads =
+      CLAMP(util_get_cpu_caps()->nr_cpus, 2, LP_MAX_THREADS);
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(num_threads);
+   bool success = true;
+
+   if (!pool)
+      return false;
+
+   for (unsigned skew = SKEW_NONE; skew <= SKEW_TAIL; skew++) {
+      for (unsigned contexts = 1; contexts <= 2; contexts++)
+         success &= test_tpool(verbose, fp, pool, skew, contexts);
+   }
+
+   lp_cs_tpool_destroy(pool);
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
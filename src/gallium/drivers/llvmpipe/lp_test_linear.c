@@ -0,0 +1,223 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Tests for the row kernels of the linear path.
+ *
+ * Checks that every kernel implementation supported by the CPU gives the
+ * same results as the portable C kernels, then compares how many pixels
+ * per second each of them produces.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+
+#include "lp_linear_kernels.h"
+#include "lp_test.h"
+
+
+#define ROW_WIDTH 64
+#define TEX_SIZE 128
+#define NUM_TESTS 256
+#define BENCH_ROWS (1 << 16)
+
+
+struct row_test {
+   int16_t a0[8];
+   int16_t dadx[8];
+   int weight;
+   int s, t, dsdx, dtdx;
+   int width;
+};
+
+
+static unsigned
+get_kernels(const struct lp_linear_kernels **kernels)
+{
+   unsigned n = 0;
+
+   kernels[n++] = &lp_linear_kernels_c;
+#if DETECT_ARCH_SSE
+   kernels[n++] = &lp_linear_kernels_sse2;
+   if (util_get_cpu_caps()->has_avx2)
+      kernels[n++] = &lp_linear_kernels_avx2;
+#endif
+#ifdef LP_LINEAR_KERNELS_NEON
+   if (DETECT_ARCH_AARCH64 || util_get_cpu_caps()->has_neon)
+      kernels[n++] = &lp_linear_kernels_neon;
+#endif
+
+   return n;
+}
+
+
+/**
+ * Random parameters which keep every bilinear footprint of a row inside
+ * the texture.
+ */
+static void
+random_row_test(struct row_test *test)
+{
+   for (unsigned i = 0; i < 8; i++) {
+      test->a0[i] = rand();
+      test->dadx[i] = rand() % 512 - 256;
+   }
+
+   test->weight = rand() & 0xff;
+   test->s = ((32 + rand() % 32) << 16) | (rand() & 0xffff);
+   test->t = ((32 + rand() % 32) << 16) | (rand() & 0xffff);
+   test->dsdx = rand() % (1 << 16) - (1 << 15);
+   test->dtdx = rand() % (1 << 16) - (1 << 15);
+   test->width = 4 * (1 + rand() % (ROW_WIDTH / 4));
+}
+
+
+static void
+run_kernel(const struct lp_linear_kernels *kernels, unsigned func,
+           const struct row_test *test, const uint32_t *texels,
+           uint32_t *row)
+{
+   switch (func) {
+   case 0:
+      kernels->interp_row(row, test->a0, test->dadx, test->width);
+      break;
+   case 1:
+      kernels->lerp_rows(row, texels, texels + TEX_SIZE, test->weight,
+                         test->width);
+      break;
+   case 2:
+      kernels->fetch_linear_row(row, texels, TEX_SIZE, test->s, test->t,
+                                test->dsdx, test->dtdx, test->width);
+      break;
+   default:
+      kernels->blit_rgb1_row(row, texels + test->s % TEX_SIZE,
+                             test->width - test->t % 4);
+      break;
+   }
+}
+
+
+static const char *func_names[] = {
+   "interp_row",
+   "lerp_rows",
+   "fetch_linear_row",
+   "blit_rgb1_row",
+};
+
+
+static bool
+test_kernels(unsigned verbose, FILE *fp,
+             const struct lp_linear_kernels *kernels, unsigned func,
+             const uint32_t *texels)
+{
+   alignas(32) uint32_t ref[ROW_WIDTH];
+   alignas(32) uint32_t res[ROW_WIDTH];
+   bool success = true;
+
+   srand(func);
+
+   for (unsigned n = 0; n < NUM_TESTS && success; n++) {
+      struct row_test test;
+
+      random_row_test(&test);
+
+      memset(ref, 0, sizeof ref);
+      memset(res, 0, sizeof res);
+
+      run_kernel(&lp_linear_kernels_c, func, &test, texels, ref);
+      run_kernel(kernels, func, &test, texels, res);
+
+      for (int i = 0; i < ROW_WIDTH; i++) {
+         if (res[i] != ref[i]) {
+            fprintf(stderr, "%s %s: pixel %d of %d is %08x, expected %08x\n",
+                    kernels->name, func_names[func], i, test.width,
+                    res[i], ref[i]);
+            success = false;
+            break;
+         }
+      }
+   }
+
+   /* Time full rows, which is what the rasterizer mostly asks for. */
+   struct row_test test;
+   random_row_test(&test);
+   test.width = ROW_WIDTH;
+   test.t &= ~3;
+
+   const int64_t start = os_time_get_nano();
+   for (unsigned n = 0; n < BENCH_ROWS; n++)
+      run_kernel(kernels, func, &test, texels, res);
+   const int64_t elapsed = os_time_get_nano() - start;
+
+   if (verbose >= 1 || !success)
+      printf("%-5s %-16s %8.2f Mpixel/s\n", kernels->name, func_names[func],
+             (double)BENCH_ROWS * ROW_WIDTH * 1000.0 / MAX2(elapsed, 1));
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\t%s\t%f\n", success ? "pass" : "fail",
+              kernels->name, func_names[func], elapsed / 1000000.0);
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "kernels\t"
+           "function\t"
+           "time_ms\n");
+
+   fflush(fp);
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   const struct lp_linear_kernels *kernels[4];
+   const unsigned num_kernels = get_kernels(kernels);
+   uint32_t *texels = MALLOC(TEX_SIZE * TEX_SIZE * sizeof(uint32_t));
+   bool success = true;
+
+   if (!texels)
+      return false;
+
+   for (unsigned i = 0; i < TEX_SIZE * TEX_SIZE; i++)
+      texels[i] = i * 2654435761u;
+
+   for (unsigned func = 0; func < ARRAY_SIZE(func_names); func++) {
+      for (unsigned k = 0; k < num_kernels; k++)
+         success &= test_kernels(verbose, fp, kernels[k], func, texels);
+   }
+
+   FREE(texels);
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
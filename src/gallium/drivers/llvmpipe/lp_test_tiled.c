@@ -0,0 +1,413 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Tests for the tiled texture layout.
+ *
+ * Checks that the texel offsets generated by lp_build_sample_offset() match
+ * llvmpipe_tiled_offset(), which is what transfers and untiling use, and
+ * that the tiled layout maps the texels of an image one to one.
+ *
+ * With -s, compares instead how fast the code generated by
+ * lp_build_sample_offset() fetches 2x2 texel footprints from a large RGBA8
+ * texture in the linear and the tiled layout, for a few access patterns.
+ * This is run by "meson test --benchmark lp_test_tiled_bench".
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_memory.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_sample.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_texture.h"
+#include "lp_test.h"
+
+
+#define WIDTH 40
+#define HEIGHT 32
+
+#define BENCH_SIZE 2048
+#define BENCH_SAMPLES (1 << 20)
+
+
+typedef void (*test_offset_t)(int32_t *offset, const int32_t *x,
+                              const int32_t *y, const int32_t *stride);
+
+typedef void (*fetch_quad_t)(uint32_t *sum, const uint8_t *texels,
+                             const int32_t *x, const int32_t *y,
+                             const int32_t *stride);
+
+
+static const enum pipe_format formats[] = {
+   PIPE_FORMAT_R8_UNORM,
+   PIPE_FORMAT_R8G8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_R16G16B16A16_UNORM,
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+};
+
+
+static LLVMValueRef
+add_offset_test(struct gallivm_state *gallivm, const char *name,
+                const struct util_format_description *format_desc,
+                bool tiled)
+{
+   struct lp_type type = lp_type_int_vec(32, 128);
+   LLVMContextRef context = gallivm->context;
+   LLVMTypeRef vi32t = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef args[4] = {
+      LLVMPointerType(vi32t, 0), LLVMPointerType(vi32t, 0),
+      LLVMPointerType(vi32t, 0), LLVMPointerType(vi32t, 0),
+   };
+   LLVMValueRef func =
+      LLVMAddFunction(gallivm->module, name,
+                      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                       args, ARRAY_SIZE(args), 0));
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   struct lp_build_context bld;
+   LLVMValueRef x, y, stride, offset, i, j;
+
+   lp_build_context_init(&bld, gallivm, type);
+
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   x = LLVMBuildLoad2(builder, vi32t, LLVMGetParam(func, 1), "");
+   y = LLVMBuildLoad2(builder, vi32t, LLVMGetParam(func, 2), "");
+   stride = LLVMBuildLoad2(builder, vi32t, LLVMGetParam(func, 3), "");
+
+   lp_build_sample_offset(&bld, format_desc, tiled, x, y, NULL, stride, NULL,
+                          &offset, &i, &j);
+
+   LLVMBuildStore(builder, offset, LLVMGetParam(func, 0));
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+UTIL_ALIGN_STACK
+static bool
+test_offsets(unsigned verbose, FILE *fp, enum pipe_format format, bool tiled)
+{
+   const struct util_format_description *format_desc =
+      util_format_description(format);
+   const unsigned texel_bytes = format_desc->block.bits / 8;
+   const unsigned row_stride = WIDTH * texel_bytes;
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   LLVMValueRef func;
+   test_offset_t offset_func;
+   bool success = true;
+
+   context = LLVMContextCreate();
+#if LLVM_VERSION_MAJOR == 15
+   LLVMContextSetOpaquePointers(context, false);
+#endif
+   gallivm = gallivm_create("test_module", context, NULL);
+
+   func = add_offset_test(gallivm, "test_offset", format_desc, tiled);
+
+   gallivm_compile_module(gallivm);
+
+   offset_func = (test_offset_t) gallivm_jit_function(gallivm, func);
+
+   gallivm_free_ir(gallivm);
+
+   uint8_t *seen = CALLOC(row_stride * HEIGHT, 1);
+
+   for (unsigned y = 0; y < HEIGHT && success; y++) {
+      for (unsigned x = 0; x < WIDTH && success; x += 4) {
+         alignas(16) int32_t xs[4], ys[4], strides[4], offsets[4];
+
+         for (unsigned k = 0; k < 4; k++) {
+            xs[k] = x + k;
+            ys[k] = y;
+            strides[k] = row_stride;
+         }
+
+         offset_func(offsets, xs, ys, strides);
+
+         for (unsigned k = 0; k < 4; k++) {
+            const uint64_t expected = tiled ?
+               llvmpipe_tiled_offset(x + k, y, row_stride, texel_bytes) :
+               (uint64_t)y * row_stride + (x + k) * texel_bytes;
+
+            if ((uint64_t)offsets[k] != expected) {
+               fprintf(stderr, "%s %s: offset of (%u, %u) is %d, expected %" PRIu64 "\n",
+                       format_desc->short_name, tiled ? "tiled" : "linear",
+                       x + k, y, offsets[k], expected);
+               success = false;
+            } else if (expected % texel_bytes ||
+                       expected >= row_stride * HEIGHT ||
+                       seen[expected]) {
+               fprintf(stderr, "%s %s: offset of (%u, %u) is not unique\n",
+                       format_desc->short_name, tiled ? "tiled" : "linear",
+                       x + k, y);
+               success = false;
+            } else {
+               seen[expected] = 1;
+            }
+         }
+      }
+   }
+
+   FREE(seen);
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\t%s\toffsets\t\t\n", success ? "pass" : "fail",
+              format_desc->short_name, tiled ? "tiled" : "linear");
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+struct access_pattern {
+   const char *name;
+   float angle;   /* rotation of the texture, in degrees */
+   float scale;   /* texels per pixel */
+};
+
+static const struct access_pattern patterns[] = {
+   { "aligned",    0.0f, 1.0f },
+   { "rotated30", 30.0f, 1.0f },
+   { "rotated90", 90.0f, 1.0f },
+   { "minified",   0.0f, 2.0f },
+   { "minrot45",  45.0f, 2.0f },
+};
+
+
+/**
+ * Build a function which fetches the four RGBA8 texels at the given
+ * coordinates and adds them to *sum.
+ */
+static LLVMValueRef
+add_fetch_quad(struct gallivm_state *gallivm, bool tiled)
+{
+   const struct util_format_description *format_desc =
+      util_format_description(PIPE_FORMAT_R8G8B8A8_UNORM);
+   struct lp_type type = lp_type_int_vec(32, 128);
+   LLVMContextRef context = gallivm->context;
+   LLVMTypeRef i8t = LLVMInt8TypeInContext(context);
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef vi32t = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef args[5] = {
+      LLVMPointerType(i32t, 0), LLVMPointerType(i8t, 0),
+      LLVMPointerType(vi32t, 0), LLVMPointerType(vi32t, 0),
+      LLVMPointerType(vi32t, 0),
+   };
+   LLVMValueRef func =
+      LLVMAddFunction(gallivm->module, "fetch_quad",
+                      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                       args, ARRAY_SIZE(args), 0));
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   struct lp_build_context bld;
+   LLVMValueRef x, y, stride, offset, i, j, sum;
+
+   lp_build_context_init(&bld, gallivm, type);
+
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   x = LLVMBuildLoad2(builder, vi32t, LLVMGetParam(func, 2), "");
+   y = LLVMBuildLoad2(builder, vi32t, LLVMGetParam(func, 3), "");
+   stride = LLVMBuildLoad2(builder, vi32t, LLVMGetParam(func, 4), "");
+
+   lp_build_sample_offset(&bld, format_desc, tiled, x, y, NULL, stride, NULL,
+                          &offset, &i, &j);
+
+   sum = LLVMBuildLoad2(builder, i32t, LLVMGetParam(func, 0), "");
+   for (unsigned k = 0; k < 4; k++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, k);
+      LLVMValueRef texel_offset =
+         LLVMBuildExtractElement(builder, offset, index, "");
+      LLVMValueRef ptr = LLVMBuildGEP2(builder, i8t, LLVMGetParam(func, 1),
+                                       &texel_offset, 1, "");
+
+      ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(i32t, 0), "");
+      sum = LLVMBuildAdd(builder, sum, LLVMBuildLoad2(builder, i32t, ptr, ""),
+                         "");
+   }
+   LLVMBuildStore(builder, sum, LLVMGetParam(func, 0));
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/**
+ * Fetch the 2x2 footprints of bilinear filtering along screen space rows of
+ * a texture mapped with the given rotation and scale, like the rasterizer
+ * would, and return the time it took.
+ */
+static int64_t
+bench_fetch(fetch_quad_t fetch_quad, const uint8_t *texels,
+            const struct access_pattern *pattern, uint32_t *sum)
+{
+   const float rad = pattern->angle * (float)M_PI / 180.0f;
+   const float dsdx = cosf(rad) * pattern->scale;
+   const float dtdx = sinf(rad) * pattern->scale;
+   const unsigned row_length = 256;
+   alignas(16) int32_t xs[4], ys[4], strides[4];
+
+   for (unsigned k = 0; k < 4; k++)
+      strides[k] = BENCH_SIZE * 4;
+
+   const int64_t start = os_time_get_nano();
+
+   for (unsigned n = 0; n < BENCH_SAMPLES; n += row_length) {
+      const unsigned row = n / row_length;
+      /* Rows of a 256 pixel wide rectangle, one after the other. */
+      const float s0 = BENCH_SIZE / 2 - dtdx * row;
+      const float t0 = BENCH_SIZE / 2 + dsdx * row;
+
+      for (unsigned i = 0; i < row_length; i++) {
+         /* Wrap around, keeping the footprint inside the texture. */
+         const int s = MIN2((int)(s0 + dsdx * i) & (BENCH_SIZE - 1),
+                            BENCH_SIZE - 2);
+         const int t = MIN2((int)(t0 + dtdx * i) & (BENCH_SIZE - 1),
+                            BENCH_SIZE - 2);
+
+         for (unsigned k = 0; k < 4; k++) {
+            xs[k] = s + (k & 1);
+            ys[k] = t + (k >> 1);
+         }
+
+         fetch_quad(sum, texels, xs, ys, strides);
+      }
+   }
+
+   return os_time_get_nano() - start;
+}
+
+
+UTIL_ALIGN_STACK
+static bool
+bench_layouts(unsigned verbose, FILE *fp)
+{
+   const size_t num_texels = (size_t)BENCH_SIZE * BENCH_SIZE;
+   uint32_t *texels = MALLOC(num_texels * sizeof(uint32_t));
+   LLVMContextRef context[2];
+   struct gallivm_state *gallivm[2];
+   fetch_quad_t fetch_quad[2];
+   uint32_t sum = 0;
+
+   if (!texels)
+      return false;
+
+   for (size_t i = 0; i < num_texels; i++)
+      texels[i] = i * 2654435761u;
+
+   /* Index 0 is the linear layout, 1 the tiled one. */
+   for (unsigned tiled = 0; tiled < 2; tiled++) {
+      context[tiled] = LLVMContextCreate();
+#if LLVM_VERSION_MAJOR == 15
+      LLVMContextSetOpaquePointers(context[tiled], false);
+#endif
+      gallivm[tiled] = gallivm_create("bench_module", context[tiled], NULL);
+
+      LLVMValueRef func = add_fetch_quad(gallivm[tiled], tiled);
+
+      gallivm_compile_module(gallivm[tiled]);
+
+      fetch_quad[tiled] =
+         (fetch_quad_t) gallivm_jit_function(gallivm[tiled], func);
+
+      gallivm_free_ir(gallivm[tiled]);
+   }
+
+   for (unsigned p = 0; p < ARRAY_SIZE(patterns); p++) {
+      const int64_t linear_ns = bench_fetch(fetch_quad[0],
+                                            (const uint8_t *)texels,
+                                            &patterns[p], &sum);
+      const int64_t tiled_ns = bench_fetch(fetch_quad[1],
+                                           (const uint8_t *)texels,
+                                           &patterns[p], &sum);
+
+      printf("%-10s linear %8.2f Mfetch/s, tiled %8.2f Mfetch/s\n",
+             patterns[p].name,
+             4.0 * BENCH_SAMPLES * 1000.0 / linear_ns,
+             4.0 * BENCH_SAMPLES * 1000.0 / tiled_ns);
+
+      if (fp) {
+         fprintf(fp, "pass\tR8G8B8A8_UNORM\t%s\tbench\t%f\t%f\n",
+                 patterns[p].name, linear_ns / 1000000.0,
+                 tiled_ns / 1000000.0);
+         fflush(fp);
+      }
+   }
+
+   if (verbose >= 1)
+      printf("checksum %08x\n", sum);
+
+   for (unsigned tiled = 0; tiled < 2; tiled++) {
+      gallivm_destroy(gallivm[tiled]);
+      LLVMContextDispose(context[tiled]);
+   }
+
+   FREE(texels);
+
+   return true;
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "format\t"
+           "case\t"
+           "test\t"
+           "linear_ms\t"
+           "tiled_ms\n");
+
+   fflush(fp);
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   bool success = true;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(formats); i++) {
+      success &= test_offsets(verbose, fp, formats[i], false);
+      success &= test_offsets(verbose, fp, formats[i], true);
+   }
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return bench_layouts(verbose, fp);
+}
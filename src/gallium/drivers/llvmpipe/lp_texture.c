@@ -35,6 +35,8 @@
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
 
+#include "draw/draw_context.h"
+
 #include "util/simple_mtx.h"
 #include "util/u_inlines.h"
 #include "util/u_cpu_detect.h"
@@ -44,6 +46,7 @@
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
@@ -88,7 +91,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                         struct llvmpipe_resource *lpr,
                         bool allocate)
 {
-   struct pipe_resource *pt = &lpr->base;
+   struct pipe_resource *pt = &lpr->base.b;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
    unsigned depth = pt->depth0;
@@ -111,7 +114,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
     * for the virgl driver when host uses llvmpipe, causing Qemu and crosvm to
     * bail out on the KVM error.
     */
-   if (lpr->base.flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
+   if (lpr->base.b.flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
       os_get_page_size(&mip_align);
 
    assert(LP_MAX_TEXTURE_2D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
@@ -135,7 +138,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
          align_x = align_y = 1;
       } else {
          align_x = LP_RASTER_BLOCK_SIZE;
-         if (llvmpipe_resource_is_1d(&lpr->base))
+         if (llvmpipe_resource_is_1d(&lpr->base.b))
             align_y = 1;
          else
             align_y = LP_RASTER_BLOCK_SIZE;
@@ -156,16 +159,16 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       lpr->img_stride[level] = (uint64_t)lpr->row_stride[level] * nblocksy;
 
       /* Number of 3D image slices, cube faces or texture array layers */
-      if (lpr->base.target == PIPE_TEXTURE_CUBE) {
+      if (lpr->base.b.target == PIPE_TEXTURE_CUBE) {
          assert(layers == 6);
       }
 
-      if (lpr->base.target == PIPE_TEXTURE_3D)
+      if (lpr->base.b.target == PIPE_TEXTURE_3D)
          num_slices = depth;
-      else if (lpr->base.target == PIPE_TEXTURE_1D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_2D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_CUBE ||
-               lpr->base.target == PIPE_TEXTURE_CUBE_ARRAY)
+      else if (lpr->base.b.target == PIPE_TEXTURE_1D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE_ARRAY)
          num_slices = layers;
       else
          num_slices = 1;
@@ -204,6 +207,48 @@ fail:
 }
 
 
+/**
+ * Whether a texture gets the tiled layout.
+ *
+ * Only textures which are likely to be only sampled from are tiled, as
+ * the rasterizer, the linear paths and draw expect linear textures. These
+ * are demoted by llvmpipe_resource_untile() when they are used otherwise.
+ */
+static bool
+llvmpipe_texture_can_tile(const struct pipe_resource *pt)
+{
+   const unsigned block_size = util_format_get_blocksize(pt->format);
+
+   if (LP_PERF & PERF_NO_TILED_TEX)
+      return false;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      break;
+   default:
+      return false;
+   }
+
+   if (!(pt->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (pt->bind & ~(PIPE_BIND_SAMPLER_VIEW | PIPE_BIND_RENDER_TARGET)))
+      return false;
+
+   if (pt->flags & (PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                    PIPE_RESOURCE_FLAG_MAP_COHERENT |
+                    PIPE_RESOURCE_FLAG_SPARSE))
+      return false;
+
+   return pt->nr_samples <= 1 &&
+          !util_format_is_compressed(pt->format) &&
+          !util_format_is_depth_or_stencil(pt->format) &&
+          util_is_power_of_two_nonzero(block_size) && block_size <= 16;
+}
+
+
 /**
  * Check the size of the texture specified by 'res'.
  * \return TRUE if OK, FALSE if too large.
@@ -214,7 +259,7 @@ llvmpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct llvmpipe_resource lpr;
    memset(&lpr, 0, sizeof(lpr));
-   lpr.base = *res;
+   lpr.base.b = *res;
    if (!llvmpipe_texture_layout(llvmpipe_screen(screen), &lpr, false))
       return false;
 
@@ -232,12 +277,12 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size to
     * avoid tile clipping.
     */
-   const unsigned width = MAX2(1, align(lpr->base.width0, TILE_SIZE));
-   const unsigned height = MAX2(1, align(lpr->base.height0, TILE_SIZE));
+   const unsigned width = MAX2(1, align(lpr->base.b.width0, TILE_SIZE));
+   const unsigned height = MAX2(1, align(lpr->base.b.height0, TILE_SIZE));
 
    lpr->dt = winsys->displaytarget_create(winsys,
-                                          lpr->base.bind,
-                                          lpr->base.format,
+                                          lpr->base.b.bind,
+                                          lpr->base.b.format,
                                           width, height,
                                           64,
                                           map_front_private,
@@ -247,6 +292,21 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
 }
 
 
+/**
+ * Buffers get an ID for u_threaded_context to track where they're bound,
+ * which it needs to ask llvmpipe_is_resource_busy() about them.
+ */
+static void
+llvmpipe_threaded_resource_init(struct llvmpipe_resource *lpr)
+{
+   threaded_resource_init(&lpr->base.b, false);
+
+   if (lpr->base.b.target == PIPE_BUFFER)
+      lpr->base.buffer_id_unique =
+         util_idalloc_mt_alloc(&lpr->screen->buffer_ids);
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create_all(struct pipe_screen *_screen,
                              const struct pipe_resource *templat,
@@ -258,19 +318,19 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    if (!lpr)
       return NULL;
 
-   lpr->base = *templat;
+   lpr->base.b = *templat;
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
 
 #ifdef HAVE_LINUX_UDMABUF_H
    lpr->dmabuf_alloc = NULL;
 #endif
 
-   /* assert(lpr->base.bind); */
+   /* assert(lpr->base.b.bind); */
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
-      if (lpr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
+      if (lpr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
                             PIPE_BIND_SCANOUT |
                             PIPE_BIND_SHARED)) {
          /* displayable surface */
@@ -280,6 +340,7 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
          /* texture map */
          if (!llvmpipe_texture_layout(screen, lpr, alloc_backing))
             goto fail;
+         lpr->tiled = alloc_backing && llvmpipe_texture_can_tile(templat);
       }
    } else {
       /* other data (vertex buffer, const buffer, etc) */
@@ -319,6 +380,7 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    }
 
    lpr->id = id_counter++;
+   llvmpipe_threaded_resource_init(lpr);
 
 #if MESA_DEBUG
    simple_mtx_lock(&resource_list_mutex);
@@ -326,7 +388,7 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    simple_mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
  fail:
    FREE(lpr);
@@ -378,6 +440,7 @@ llvmpipe_resource_create_unbacked(struct pipe_screen *_screen,
       return pt;
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
    lpr->backable = true;
+   lpr->base.is_shared = true;
    *size_required = lpr->size_required;
    return pt;
 }
@@ -426,13 +489,13 @@ llvmpipe_resource_from_memobj(struct pipe_screen *pscreen,
    struct llvmpipe_screen *screen = llvmpipe_screen(pscreen);
    struct llvmpipe_memory_object *lpmo = llvmpipe_memory_object(memobj);
    struct llvmpipe_resource *lpr = CALLOC_STRUCT(llvmpipe_resource);
-   lpr->base = *templat;
+   lpr->base.b = *templat;
 
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
       /* texture map */
       if (!llvmpipe_texture_layout(screen, lpr, false))
          goto fail;
@@ -468,6 +531,8 @@ llvmpipe_resource_from_memobj(struct pipe_screen *pscreen,
    }
    lpr->id = id_counter++;
    lpr->imported_memory = true;
+   llvmpipe_threaded_resource_init(lpr);
+   lpr->base.is_shared = true;
 
 #if MESA_DEBUG
    simple_mtx_lock(&resource_list_mutex);
@@ -475,7 +540,7 @@ llvmpipe_resource_from_memobj(struct pipe_screen *pscreen,
    simple_mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 fail:
    free(lpr);
@@ -489,7 +554,7 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    struct llvmpipe_screen *screen = llvmpipe_screen(pscreen);
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
 
-   if (!lpr->backable && !lpr->user_ptr) {
+   if (!lpr->backable && !lpr->user_ptr && !lpr->storage) {
       if (lpr->dt) {
          /* display target */
          struct sw_winsys *winsys = screen->winsys;
@@ -501,6 +566,7 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
                align_free(lpr->tex_data);
             lpr->tex_data = NULL;
          }
+         align_free(lpr->retired_tex_data);
       } else if (lpr->data) {
          if (!lpr->imported_memory)
             align_free(lpr->data);
@@ -519,6 +585,10 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    simple_mtx_unlock(&resource_list_mutex);
 #endif
 
+   pipe_resource_reference(&lpr->storage, NULL);
+   if (lpr->base.buffer_id_unique)
+      util_idalloc_mt_free(&screen->buffer_ids, lpr->base.buffer_id_unique);
+   threaded_resource_deinit(pt);
    FREE(lpr);
 }
 
@@ -636,19 +706,19 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
       goto no_lpr;
    }
 
-   lpr->base = *template;
+   lpr->base.b = *template;
    lpr->screen = screen;
    lpr->dt_format = whandle->format;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = _screen;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = _screen;
 
    /*
     * Looks like unaligned displaytargets work just fine,
     * at least sampler/render ones.
     */
 #if 0
-   assert(lpr->base.width0 == width);
-   assert(lpr->base.height0 == height);
+   assert(lpr->base.b.width0 == width);
+   assert(lpr->base.b.height0 == height);
 #endif
 
    unsigned nblocksy = util_format_get_nblocksy(template->format, align(template->height0, LP_RASTER_BLOCK_SIZE));
@@ -691,7 +761,7 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
          whandle->size = lpr->size_required;
       }
 
-      assert(llvmpipe_resource_is_texture(&lpr->base));
+      assert(llvmpipe_resource_is_texture(&lpr->base.b));
       lpr->tex_data = data;
    } else {
       whandle->size = lpr->size_required;
@@ -702,6 +772,8 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
 
    lpr->id = id_counter++;
    lpr->dmabuf = true;
+   llvmpipe_threaded_resource_init(lpr);
+   lpr->base.is_shared = true;
 
 #if MESA_DEBUG
    simple_mtx_lock(&resource_list_mutex);
@@ -709,7 +781,7 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
    simple_mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 no_dt:
    FREE(lpr);
@@ -729,6 +801,12 @@ llvmpipe_resource_get_handle(struct pipe_screen *_screen,
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
 
+   /* The backing may be replaced below, sync with the driver thread. */
+   struct pipe_context *pipe = threaded_context_unwrap_sync(ctx);
+
+   /* Handles are always for linear images. */
+   llvmpipe_resource_untile(pipe, pt);
+
    whandle->stride = lpr->row_stride[0];
 #ifdef HAVE_LINUX_UDMABUF_H
    whandle->modifier = DRM_FORMAT_MOD_LINEAR;
@@ -747,7 +825,9 @@ llvmpipe_resource_get_handle(struct pipe_screen *_screen,
             if (lpr->data)
                memcpy(lpr->dmabuf_alloc->data, lpr->data, lpr->size_required);
          }
-         if (!lpr->imported_memory)
+         if (lpr->storage)
+            pipe_resource_reference(&lpr->storage, NULL);
+         else if (!lpr->imported_memory)
             align_free(is_tex ? lpr->tex_data : lpr->data);
          if (is_tex)
             lpr->tex_data = lpr->dmabuf_alloc->data;
@@ -755,6 +835,7 @@ llvmpipe_resource_get_handle(struct pipe_screen *_screen,
             lpr->data = lpr->dmabuf_alloc->data;
          /* reuse lavapipe codepath to handle destruction */
          lpr->backable = true;
+         lpr->base.is_shared = true;
       }
       whandle->handle = lpr->dmabuf_alloc->dmabuf_fd;
       return true;
@@ -786,12 +867,12 @@ llvmpipe_resource_from_user_memory(struct pipe_screen *_screen,
       return NULL;
    }
 
-   lpr->base = *resource;
+   lpr->base.b = *resource;
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = _screen;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = _screen;
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
       if (!llvmpipe_texture_layout(screen, lpr, false))
          goto fail;
 
@@ -799,18 +880,138 @@ llvmpipe_resource_from_user_memory(struct pipe_screen *_screen,
    } else
       lpr->data = user_memory;
    lpr->user_ptr = true;
+   llvmpipe_threaded_resource_init(lpr);
+   lpr->base.is_user_ptr = true;
+   util_range_add(&lpr->base.b, &lpr->base.valid_buffer_range,
+                  0, resource->width0);
 #if MESA_DEBUG
    simple_mtx_lock(&resource_list_mutex);
    list_addtail(&lpr->list, &resource_list.list);
    simple_mtx_unlock(&resource_list_mutex);
 #endif
-   return &lpr->base;
+   return &lpr->base.b;
 fail:
    FREE(lpr);
    return NULL;
 }
 
 
+/**
+ * Copy a box of texels between a tiled image and a linear buffer.
+ */
+static void
+llvmpipe_copy_tiled_box(uint8_t *tiled, unsigned row_stride,
+                        uint8_t *linear, unsigned linear_stride,
+                        unsigned x0, unsigned y0,
+                        unsigned width, unsigned height,
+                        unsigned texel_bytes, bool to_tiled)
+{
+   for (unsigned y = 0; y < height; y++) {
+      uint8_t *row = linear + (uint64_t)y * linear_stride;
+      unsigned x = 0;
+
+      while (x < width) {
+         /* Texels 2n and 2n + 1 of a row are next to each other. */
+         const unsigned n = ((x0 + x) & 1) == 0 && x + 1 < width ? 2 : 1;
+         uint8_t *texel = tiled + llvmpipe_tiled_offset(x0 + x, y0 + y,
+                                                        row_stride,
+                                                        texel_bytes);
+         if (to_tiled)
+            memcpy(texel, row + x * texel_bytes, n * texel_bytes);
+         else
+            memcpy(row + x * texel_bytes, texel, n * texel_bytes);
+         x += n;
+      }
+   }
+}
+
+
+/**
+ * Convert a tiled texture to the linear layout.
+ *
+ * Called before the texture is used in a way which requires the linear
+ * layout, like rendering to it. The texture stays linear afterwards.
+ *
+ * The linear image is written to new storage. Scenes of other contexts may
+ * still sample from the tiled one, and they can't be waited for from this
+ * thread, so it is kept until the texture is destroyed unless this is the
+ * only context. Without a context, as for handles queried by the
+ * frontends, it is always kept.
+ */
+void
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+
+   if (!resource || !lpr->tiled)
+      return;
+
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   bool other_users = true;
+
+   if (pipe) {
+      llvmpipe_flush_resource(pipe, resource, 0,
+                              false, /* read_only */
+                              true, /* cpu_access */
+                              false, /* do_not_block */
+                              __func__);
+
+      mtx_lock(&screen->ctx_mutex);
+      other_users = !list_is_singular(&screen->ctx_list);
+      mtx_unlock(&screen->ctx_mutex);
+   }
+
+   /* As in llvmpipe_texture_layout(), tiled textures are never persistent. */
+   const uint64_t alignment = MAX2(64, util_get_cpu_caps()->cacheline);
+   uint8_t *tiled = lpr->tex_data;
+   uint8_t *linear = align_malloc(lpr->size_required, alignment);
+   if (!linear)
+      return;
+
+   const unsigned texel_bytes = util_format_get_blocksize(resource->format);
+
+   for (unsigned level = 0; level <= resource->last_level; level++) {
+      const unsigned width = align(u_minify(resource->width0, level),
+                                   LP_RASTER_BLOCK_SIZE);
+      const unsigned height = align(u_minify(resource->height0, level),
+                                    LP_RASTER_BLOCK_SIZE);
+
+      for (unsigned slice = 0; slice < resource->array_size; slice++) {
+         const uint64_t offset =
+            llvmpipe_get_texture_image_address(lpr, slice, level) - tiled;
+
+         llvmpipe_copy_tiled_box(tiled + offset, lpr->row_stride[level],
+                                 linear + offset, lpr->row_stride[level],
+                                 0, 0, width, height, texel_bytes, false);
+      }
+   }
+
+   lpr->tex_data = linear;
+   if (other_users) {
+      assert(!lpr->retired_tex_data);
+      lpr->retired_tex_data = tiled;
+   } else {
+      align_free(tiled);
+   }
+
+   lpr->tiled = false;
+
+   /* Shaders sampling from the texture need to be rebuilt. Other contexts
+    * notice through the timestamp.
+    */
+   screen->timestamp++;
+   if (pipe) {
+      struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+      llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW |
+                         LP_NEW_TASK_SAMPLER_VIEW |
+                         LP_NEW_MESH_SAMPLER_VIEW;
+      llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+   }
+}
+
+
 void *
 llvmpipe_transfer_map_ms(struct pipe_context *pipe,
                          struct pipe_resource *resource,
@@ -852,8 +1053,12 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       }
    }
 
-   /* Check if we're mapping a current constant buffer */
+   /* Check if we're mapping a current constant buffer.  Threaded
+    * unsynchronized maps come from the application thread and must not touch
+    * the context; the data they write isn't in use yet anyway.
+    */
    if ((usage & PIPE_MAP_WRITE) &&
+       !(usage & TC_TRANSFER_MAP_THREADED_UNSYNC) &&
        (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
       unsigned i;
       for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
@@ -865,10 +1070,14 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       }
    }
 
+   /* Direct maps must see the actual layout. */
+   if (lpr->tiled && (usage & PIPE_MAP_DIRECTLY))
+      llvmpipe_resource_untile(pipe, resource);
+
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
-   pt = &lpt->base;
+   pt = &lpt->base.b;
    pipe_resource_reference(&pt->resource, resource);
    pt->box = *box;
    pt->level = level;
@@ -901,7 +1110,7 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       printf("transfer map tex %u  mode %s\n", lpr->id, mode);
    }
 
-   format = lpr->base.format;
+   format = lpr->base.b.format;
 
    map = llvmpipe_resource_map(resource, level, box->z, tex_usage);
 
@@ -915,6 +1124,36 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       screen->timestamp++;
    }
 
+   if (lpr->tiled) {
+      /* Hand out a linear copy of the box, written back on unmap. */
+      const unsigned texel_bytes = util_format_get_blocksize(format);
+
+      pt->stride = box->width * texel_bytes;
+      pt->layer_stride = (uint64_t)pt->stride * box->height;
+
+      lpt->staging = MALLOC(pt->layer_stride * box->depth);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_MAP_DISCARD_RANGE |
+                     PIPE_MAP_DISCARD_WHOLE_RESOURCE))) {
+         for (unsigned z = 0; z < box->depth; z++) {
+            llvmpipe_copy_tiled_box(map + z * lpr->img_stride[level],
+                                    lpr->row_stride[level],
+                                    (uint8_t *)lpt->staging + z * pt->layer_stride,
+                                    pt->stride, box->x, box->y,
+                                    box->width, box->height,
+                                    texel_bytes, false);
+         }
+      }
+
+      return lpt->staging;
+   }
+
    map +=
       box->y / util_format_get_blockheight(format) * pt->stride +
       box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
@@ -941,8 +1180,41 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
+   if (lpt->staging) {
+      if (transfer->usage & PIPE_MAP_WRITE) {
+         struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+         const struct pipe_box *box = &transfer->box;
+         const unsigned level = transfer->level;
+         const enum pipe_format format = transfer->resource->format;
+         uint8_t *map = llvmpipe_resource_map(transfer->resource, level,
+                                              box->z, LP_TEX_USAGE_READ_WRITE);
+
+         for (unsigned z = 0; z < box->depth; z++) {
+            uint8_t *image = map + z * lpr->img_stride[level];
+            uint8_t *src = (uint8_t *)lpt->staging + z * transfer->layer_stride;
+
+            /* The texture might have been demoted while mapped. */
+            if (lpr->tiled) {
+               llvmpipe_copy_tiled_box(image, lpr->row_stride[level],
+                                       src, transfer->stride,
+                                       box->x, box->y,
+                                       box->width, box->height,
+                                       util_format_get_blocksize(format),
+                                       true);
+            } else {
+               util_copy_rect(image, format, lpr->row_stride[level],
+                              box->x, box->y, box->width, box->height,
+                              src, transfer->stride, 0, 0);
+            }
+         }
+      }
+      FREE(lpt->staging);
+   }
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
@@ -1019,20 +1291,24 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
       return NULL;
 
    buffer->screen = llvmpipe_screen(screen);
-   pipe_reference_init(&buffer->base.reference, 1);
-   buffer->base.screen = screen;
-   buffer->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   buffer->base.bind = bind_flags;
-   buffer->base.usage = PIPE_USAGE_IMMUTABLE;
-   buffer->base.flags = 0;
-   buffer->base.width0 = bytes;
-   buffer->base.height0 = 1;
-   buffer->base.depth0 = 1;
-   buffer->base.array_size = 1;
+   pipe_reference_init(&buffer->base.b.reference, 1);
+   buffer->base.b.screen = screen;
+   buffer->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   buffer->base.b.bind = bind_flags;
+   buffer->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   buffer->base.b.flags = 0;
+   buffer->base.b.width0 = bytes;
+   buffer->base.b.height0 = 1;
+   buffer->base.b.depth0 = 1;
+   buffer->base.b.array_size = 1;
    buffer->user_ptr = true;
    buffer->data = ptr;
+   llvmpipe_threaded_resource_init(buffer);
+   buffer->base.is_user_ptr = true;
+   util_range_add(&buffer->base.b, &buffer->base.valid_buffer_range,
+                  0, bytes);
 
-   return &buffer->base;
+   return &buffer->base.b;
 }
 
 
@@ -1055,7 +1331,7 @@ uint8_t *
 llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level)
 {
-   assert(llvmpipe_resource_is_texture(&lpr->base));
+   assert(llvmpipe_resource_is_texture(&lpr->base.b));
 
    unsigned offset = lpr->mip_offsets[level];
 
@@ -1300,7 +1576,7 @@ llvmpipe_resource_bind_backing(struct pipe_screen *pscreen,
    if (!lpr->backable)
       return false;
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
       if (lpr->size_required > LP_MAX_TEXTURE_SIZE)
          return false;
 
@@ -1313,12 +1589,12 @@ llvmpipe_resource_bind_backing(struct pipe_screen *pscreen,
             /* Round up the surface size to a multiple of the tile size to
              * avoid tile clipping.
              */
-            const unsigned width = MAX2(1, align(lpr->base.width0, TILE_SIZE));
-            const unsigned height = MAX2(1, align(lpr->base.height0, TILE_SIZE));
+            const unsigned width = MAX2(1, align(lpr->base.b.width0, TILE_SIZE));
+            const unsigned height = MAX2(1, align(lpr->base.b.height0, TILE_SIZE));
 
             lpr->dt = winsys->displaytarget_create_mapped(winsys,
-                                                          lpr->base.bind,
-                                                          lpr->base.format,
+                                                          lpr->base.b.bind,
+                                                          lpr->base.b.format,
                                                           width, height,
                                                           lpr->row_stride[0],
                                                           lpr->tex_data);
@@ -1357,11 +1633,11 @@ llvmpipe_print_resources(void)
    debug_printf("LLVMPIPE: current resources:\n");
    simple_mtx_lock(&resource_list_mutex);
    LIST_FOR_EACH_ENTRY(lpr, &resource_list.list, list) {
-      unsigned size = llvmpipe_resource_size(&lpr->base);
+      unsigned size = llvmpipe_resource_size(&lpr->base.b);
       debug_printf("resource %u at %p, size %ux%ux%u: %u bytes, refcount %u\n",
                    lpr->id, (void *) lpr,
-                   lpr->base.width0, lpr->base.height0, lpr->base.depth0,
-                   size, lpr->base.reference.count);
+                   lpr->base.b.width0, lpr->base.b.height0, lpr->base.b.depth0,
+                   size, lpr->base.b.reference.count);
       total += size;
       n++;
    }
@@ -1518,6 +1794,161 @@ llvmpipe_init_screen_resource_funcs(struct pipe_screen *screen)
 }
 
 
+/**
+ * Point everything bound to a buffer at its new storage.  Most data pointers
+ * are looked up again when the state is validated, only the draw module keeps
+ * the ones of the vertex processing stages around.
+ */
+static void
+llvmpipe_rebind_buffer(struct llvmpipe_context *llvmpipe,
+                       struct pipe_resource *buffer)
+{
+   const uint8_t *data = llvmpipe_resource_data(buffer);
+
+   for (enum pipe_shader_type sh = 0; sh < PIPE_SHADER_MESH_TYPES; sh++) {
+      const bool draw_stage = sh == PIPE_SHADER_VERTEX ||
+                              sh == PIPE_SHADER_GEOMETRY ||
+                              sh == PIPE_SHADER_TESS_CTRL ||
+                              sh == PIPE_SHADER_TESS_EVAL;
+
+      for (unsigned i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         const struct pipe_constant_buffer *cb = &llvmpipe->constants[sh][i];
+         if (cb->buffer != buffer)
+            continue;
+         if (draw_stage)
+            draw_set_mapped_constant_buffer(llvmpipe->draw, sh, i,
+                                            data + cb->buffer_offset,
+                                            cb->buffer_size);
+      }
+
+      for (unsigned i = 0; i < ARRAY_SIZE(llvmpipe->ssbos[sh]); i++) {
+         const struct pipe_shader_buffer *sb = &llvmpipe->ssbos[sh][i];
+         if (sb->buffer != buffer)
+            continue;
+         if (draw_stage)
+            draw_set_mapped_shader_buffer(llvmpipe->draw, sh, i,
+                                          data + sb->buffer_offset,
+                                          sb->buffer_size);
+      }
+   }
+
+   for (int i = 0; i < llvmpipe->num_so_targets; i++) {
+      if (llvmpipe->so_targets[i] &&
+          llvmpipe->so_targets[i]->target.buffer == buffer)
+         llvmpipe->so_targets[i]->mapping = (void *)data;
+   }
+
+   /* Constants, shader buffers, images and buffer textures of the other
+    * stages.
+    */
+   llvmpipe->dirty |= LP_NEW_FS_CONSTANTS | LP_NEW_FS_SSBOS |
+                      LP_NEW_FS_IMAGES | LP_NEW_SAMPLER_VIEW |
+                      LP_NEW_TASK_CONSTANTS | LP_NEW_TASK_SSBOS |
+                      LP_NEW_TASK_IMAGES | LP_NEW_TASK_SAMPLER_VIEW |
+                      LP_NEW_MESH_CONSTANTS | LP_NEW_MESH_SSBOS |
+                      LP_NEW_MESH_IMAGES | LP_NEW_MESH_SAMPLER_VIEW;
+   llvmpipe->cs_dirty |= LP_CSNEW_CONSTANTS | LP_CSNEW_SSBOS |
+                         LP_CSNEW_IMAGES | LP_CSNEW_SAMPLER_VIEW;
+}
+
+
+/**
+ * Hand the storage of a buffer over to a new buffer object, which the scenes
+ * still using it hold on to, and which frees it once they're done.
+ */
+static void
+llvmpipe_retire_buffer_storage(struct llvmpipe_context *llvmpipe,
+                               struct llvmpipe_resource *lpr)
+{
+   struct llvmpipe_resource *old = CALLOC_STRUCT(llvmpipe_resource);
+   if (!old) {
+      llvmpipe_finish(&llvmpipe->pipe, __func__);
+      if (lpr->storage)
+         pipe_resource_reference(&lpr->storage, NULL);
+      else
+         align_free(lpr->data);
+      lpr->data = NULL;
+      return;
+   }
+
+   old->base.b = lpr->base.b;
+   pipe_reference_init(&old->base.b.reference, 1);
+   old->screen = lpr->screen;
+   old->row_stride[0] = lpr->row_stride[0];
+   old->size_required = lpr->size_required;
+   old->data = lpr->data;
+   old->storage = lpr->storage;
+   old->id = id_counter++;
+   threaded_resource_init(&old->base.b, false);
+
+#if MESA_DEBUG
+   simple_mtx_lock(&resource_list_mutex);
+   list_addtail(&old->list, &resource_list.list);
+   simple_mtx_unlock(&resource_list_mutex);
+#endif
+
+   lpr->data = NULL;
+   lpr->storage = NULL;
+
+   struct pipe_resource *pt = &old->base.b;
+   if (!lp_setup_reference_in_flight(llvmpipe->setup, pt))
+      llvmpipe_finish(&llvmpipe->pipe, __func__);
+   pipe_resource_reference(&pt, NULL);
+}
+
+
+/**
+ * u_threaded_context callback: make dst use the storage of src, which was
+ * freshly allocated to invalidate dst without waiting for the scenes using
+ * it.  Both keep sharing it, as mappings of dst go to src from now on.
+ */
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src,
+                                unsigned num_rebinds,
+                                uint32_t rebind_mask,
+                                uint32_t delete_buffer_id)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_resource *lp_dst = llvmpipe_resource(dst);
+   struct llvmpipe_resource *lp_src = llvmpipe_resource(src);
+
+   assert(!lp_dst->user_ptr && !lp_dst->imported_memory && !lp_dst->backable);
+   assert(lp_dst->size_required == lp_src->size_required);
+
+   llvmpipe_retire_buffer_storage(llvmpipe, lp_dst);
+
+   lp_dst->data = lp_src->data;
+   pipe_resource_reference(&lp_dst->storage,
+                           (struct pipe_resource *)llvmpipe_resource_storage(src));
+
+   llvmpipe_rebind_buffer(llvmpipe, dst);
+
+   util_idalloc_mt_free(&llvmpipe_screen(pipe->screen)->buffer_ids,
+                        delete_buffer_id);
+}
+
+
+/**
+ * u_threaded_context callback: is the buffer still used by a scene?
+ *
+ * Scenes drop their references when they are recycled rather than right
+ * after rasterization, so this errs on the busy side.  That only costs
+ * an unnecessary reallocation on invalidation.
+ */
+bool
+llvmpipe_is_resource_busy(struct pipe_screen *screen,
+                          struct pipe_resource *resource,
+                          unsigned usage)
+{
+   const struct llvmpipe_resource *storage =
+      llvmpipe_resource_const(llvmpipe_resource_storage(resource));
+
+   return p_atomic_read(&storage->scene_refs) != 0;
+}
+
+
 void
 llvmpipe_init_context_resource_funcs(struct pipe_context *pipe)
 {
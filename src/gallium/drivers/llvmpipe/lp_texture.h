@@ -31,6 +31,7 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 #if MESA_DEBUG
 #include "util/list.h"
@@ -75,7 +76,7 @@ struct llvmpipe_memory_fd_alloc {
  */
 struct llvmpipe_resource
 {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    /** an extra screen pointer to avoid crashing in driver trace */
    struct llvmpipe_screen *screen;
@@ -106,6 +107,20 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * Buffer owning 'data' after u_threaded_context replaced the storage of
+    * this one, NULL if this resource owns it.
+    */
+   struct pipe_resource *storage;
+
+   /**
+    * Number of scenes holding a reference to this resource, updated
+    * atomically.  Scenes using a buffer through a replaced storage also
+    * reference the storage owner, so a buffer is idle when the count of
+    * its storage owner is zero.
+    */
+   unsigned scene_refs;
+
    bool user_ptr;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
@@ -121,6 +136,17 @@ struct llvmpipe_resource
    bool backable;
    bool imported_memory;
    bool dmabuf;
+   /**
+    * Texels are stored in 4x4 micro-tiles, see llvmpipe_tiled_offset().
+    * Only set for textures which are only sampled from, demoted back to the
+    * linear layout by llvmpipe_resource_untile().
+    */
+   bool tiled;
+   /**
+    * Tiled storage replaced by llvmpipe_resource_untile() while scenes of
+    * other contexts could still be sampling from it.
+    */
+   void *retired_tex_data;
 #if MESA_DEBUG
    struct list_head list;
 #endif
@@ -129,7 +155,9 @@ struct llvmpipe_resource
 
 struct llvmpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
+   /** linear copy of the mapped box of a tiled texture */
+   void *staging;
 };
 
 
@@ -156,6 +184,17 @@ llvmpipe_resource_const(const struct pipe_resource *pt)
 }
 
 
+/**
+ * The resource whose storage backs the given one.
+ */
+static inline const struct pipe_resource *
+llvmpipe_resource_storage(const struct pipe_resource *pt)
+{
+   const struct llvmpipe_resource *lpr = llvmpipe_resource_const(pt);
+   return lpr->storage ? lpr->storage : pt;
+}
+
+
 static inline struct llvmpipe_transfer *
 llvmpipe_transfer(struct pipe_transfer *pt)
 {
@@ -173,6 +212,19 @@ llvmpipe_memory_object(struct pipe_memory_object *pt)
 void llvmpipe_init_screen_resource_funcs(struct pipe_screen *screen);
 void llvmpipe_init_context_resource_funcs(struct pipe_context *pipe);
 
+bool
+llvmpipe_is_resource_busy(struct pipe_screen *screen,
+                          struct pipe_resource *resource,
+                          unsigned usage);
+
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src,
+                                unsigned num_rebinds,
+                                uint32_t rebind_mask,
+                                uint32_t delete_buffer_id);
+
 
 static inline bool
 llvmpipe_resource_is_texture(const struct pipe_resource *resource)
@@ -246,6 +298,29 @@ llvmpipe_sample_stride(struct pipe_resource *resource)
 }
 
 
+/**
+ * Byte offset of texel (x, y) within an image of a tiled texture.
+ *
+ * The image is made of rows of 4x4 texel micro-tiles, the texels of a
+ * micro-tile are stored in morton order. Width and height are padded to
+ * multiples of 4 as for linear textures, so the row stride is the same.
+ * This must match lp_build_sample_tiled_partial_offset().
+ */
+static inline uint64_t
+llvmpipe_tiled_offset(unsigned x, unsigned y, unsigned row_stride,
+                      unsigned texel_bytes)
+{
+   return (uint64_t)(y & ~3) * row_stride +
+          ((x & ~3) * 4 + (x & 1) + ((y & 1) << 1) +
+           ((x & 2) << 1) + ((y & 2) << 2)) * texel_bytes;
+}
+
+
+void
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
+
 void *
 llvmpipe_resource_map(struct pipe_resource *resource,
                       unsigned level,
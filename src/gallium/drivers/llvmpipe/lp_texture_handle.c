@@ -57,6 +57,9 @@ llvmpipe_create_texture_handle(struct pipe_context *pctx, struct pipe_sampler_vi
 
    if (view) {
       struct lp_static_texture_state state;
+
+      /* Handles can outlive the layout of the texture, keep it linear. */
+      llvmpipe_resource_untile(pctx, view->texture);
       lp_sampler_static_texture_state(&state, view);
 
       /* Trade a bit of performance for potentially less sampler/texture combinations. */
@@ -112,6 +115,7 @@ llvmpipe_create_image_handle(struct pipe_context *pctx, const struct pipe_image_
    struct lp_texture_handle *handle = calloc(1, sizeof(struct lp_texture_handle));
 
    struct lp_static_texture_state state;
+   llvmpipe_resource_untile(pctx, view->resource);
    lp_sampler_static_texture_state_image(&state, view);
 
    /* Trade a bit of performance for potentially less sampler/texture combinations. */
@@ -921,15 +925,15 @@ register_image_op(struct llvmpipe_context *ctx, uint32_t op)
 }
 
 static bool
-register_instr(nir_builder *b, nir_instr *instr, void *data)
+gather_instr(nir_builder *b, nir_instr *instr, void *data)
 {
-   struct llvmpipe_context *ctx = data;
+   struct lp_shader_sample_ops *ops = data;
 
    if (instr->type == nir_instr_type_tex) {
       nir_tex_instr *tex = nir_instr_as_tex(instr);
       uint32_t sample_key = lp_build_nir_sample_key(b->shader->info.stage, tex);
 
-      register_sample_key(ctx, sample_key);
+      BITSET_SET(ops->sample_keys, sample_key);
    } else if (instr->type == nir_instr_type_intrinsic) {
       nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
 
@@ -949,17 +953,43 @@ register_instr(nir_builder *b, nir_instr *instr, void *data)
           nir_intrinsic_image_dim(intrin) == GLSL_SAMPLER_DIM_SUBPASS_MS)
          op += LP_TOTAL_IMAGE_OP_COUNT / 2;
 
-      register_image_op(ctx, op);
+      BITSET_SET(ops->image_ops, op);
    }
 
    return false;
 }
 
+/**
+ * Collect the sample keys and image ops of a shader.  This only reads the
+ * shader, so it is safe from the application thread of a threaded context.
+ */
 void
-llvmpipe_register_shader(struct pipe_context *ctx, const struct pipe_shader_state *shader)
+llvmpipe_gather_sample_ops(const struct pipe_shader_state *shader,
+                           struct lp_shader_sample_ops *ops)
 {
+   memset(ops, 0, sizeof(*ops));
+
    if (shader->type == PIPE_SHADER_IR_NIR)
-      nir_shader_instructions_pass(shader->ir.nir, register_instr, nir_metadata_all, ctx);
+      nir_shader_instructions_pass(shader->ir.nir, gather_instr, nir_metadata_all, ops);
+}
+
+/**
+ * Make sure the sample functions a shader needs exist for every texture
+ * handle of the context.  This changes the sampler matrix and compiles in
+ * the context's LLVMContext, so it is called when the shader is bound,
+ * on the driver thread.
+ */
+void
+llvmpipe_register_sample_ops(struct llvmpipe_context *ctx,
+                             const struct lp_shader_sample_ops *ops)
+{
+   unsigned i;
+
+   BITSET_FOREACH_SET(i, ops->sample_keys, LP_SAMPLE_KEY_COUNT)
+      register_sample_key(ctx, i);
+
+   BITSET_FOREACH_SET(i, ops->image_ops, LP_TOTAL_IMAGE_OP_COUNT)
+      register_image_op(ctx, i);
 }
 
 void
@@ -981,8 +1011,12 @@ llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_
       ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, OS_TIMEOUT_INFINITE);
 
    /* All work is finished, it's safe to move cache entries into the table.
-    * The key is the intended address of the sample function.
+    * The key is the intended address of the sample function.  Work from
+    * other contexts using this context's handles may still be adding
+    * entries, so keep holding the lock.
     */
+   simple_mtx_lock(&matrix->lock);
    hash_table_foreach_remove(matrix->cache, entry)
       *(void **)entry->key = entry->data;
+   simple_mtx_unlock(&matrix->lock);
 }
@@ -33,6 +33,15 @@
 
 #define LP_SAMPLE_KEY_COUNT (1 << 11)
 
+struct llvmpipe_context;
+struct pipe_shader_state;
+
+/* Sample keys and image ops used by a shader. */
+struct lp_shader_sample_ops {
+   BITSET_DECLARE(sample_keys, LP_SAMPLE_KEY_COUNT);
+   BITSET_DECLARE(image_ops, LP_TOTAL_IMAGE_OP_COUNT);
+};
+
 struct lp_sampler_matrix {
    struct lp_texture_functions **textures;
    struct lp_static_sampler_state *samplers;
@@ -58,7 +67,11 @@ void llvmpipe_init_sampler_matrix(struct llvmpipe_context *ctx);
 
 void llvmpipe_sampler_matrix_destroy(struct llvmpipe_context *ctx);
 
-void llvmpipe_register_shader(struct pipe_context *ctx, const struct pipe_shader_state *shader);
+void llvmpipe_gather_sample_ops(const struct pipe_shader_state *shader,
+                                struct lp_shader_sample_ops *ops);
+
+void llvmpipe_register_sample_ops(struct llvmpipe_context *ctx,
+                                  const struct lp_shader_sample_ops *ops);
 
 void llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_fence_handle **fence);
 
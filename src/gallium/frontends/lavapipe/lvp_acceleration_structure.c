@@ -8,12 +8,26 @@
 
 #include "util/format/format_utils.h"
 #include "util/half_float.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_screen.h"
 
 static_assert(sizeof(struct lvp_bvh_triangle_node) % 8 == 0, "lvp_bvh_triangle_node is not padded");
 static_assert(sizeof(struct lvp_bvh_aabb_node) % 8 == 0, "lvp_bvh_aabb_node is not padded");
 static_assert(sizeof(struct lvp_bvh_instance_node) % 8 == 0, "lvp_bvh_instance_node is not padded");
 static_assert(sizeof(struct lvp_bvh_box_node) % 8 == 0, "lvp_bvh_box_node is not padded");
 
+/* Every box node has four children, except for those with only two or three
+ * leaves below them, so there are at most (2 * leaf_count - 1) / 3.
+ */
+static uint32_t
+lvp_bvh_max_box_nodes(uint32_t leaf_count)
+{
+   return leaf_count > 1 ? ((uint64_t)leaf_count * 2 - 1) / 3 : 1;
+}
+
 VKAPI_ATTR void VKAPI_CALL
 lvp_GetAccelerationStructureBuildSizesKHR(
    VkDevice _device, VkAccelerationStructureBuildTypeKHR buildType,
@@ -27,7 +41,7 @@ lvp_GetAccelerationStructureBuildSizesKHR(
    for (uint32_t i = 0; i < pBuildInfo->geometryCount; i++)
       leaf_count += pMaxPrimitiveCounts[i];
 
-   uint32_t internal_count = MAX2(leaf_count, 2) - 1;
+   uint32_t internal_count = lvp_bvh_max_box_nodes(leaf_count);
 
    VkGeometryTypeKHR geometry_type = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
    if (pBuildInfo->geometryCount) {
@@ -140,164 +154,599 @@ lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR fl
    return ret;
 }
 
-struct lvp_build_internal_ctx {
+/* Ranges of at most this many primitives are binned by one thread. */
+#define LVP_BVH_BUILD_CHUNK_SIZE 4096
+
+/* Don't hand subtrees smaller than this to other threads. */
+#define LVP_BVH_BUILD_MIN_TASK_SIZE 1024
+
+#define LVP_BVH_SAH_MAX_BINS 32
+
+struct lvp_bvh_build_prim {
+   lvp_aabb bounds;
+   float centroid[3];
+   uint32_t node_id;
+};
+
+/* A range of ctx->prims which becomes one child of a box node. */
+struct lvp_bvh_build_range {
+   uint32_t first;
+   uint32_t count;
+   lvp_aabb bounds;
+};
+
+/* A subtree which is built on the thread pool. */
+struct lvp_bvh_build_task {
+   struct lvp_bvh_box_node *parent;
+   uint32_t child;
+   uint32_t depth;
+   struct lvp_bvh_build_range range;
+};
+
+struct lvp_bvh_build_ctx {
    uint8_t *dst;
-   uint32_t dst_offset;
+   uint32_t node_count;
+
+   struct lvp_bvh_build_prim *prims;
+   uint32_t prim_count;
 
-   void *leaf_nodes;
    uint32_t leaf_nodes_offset;
    uint32_t leaf_node_type;
    uint32_t leaf_node_size;
+
+   /* Number of SAH bins per axis, 0 to always split at the object median. */
+   uint32_t sah_bins;
+
+   /* Subtrees with at most this many primitives are added to tasks instead
+    * of being built right away, 0 while running the tasks.
+    */
+   uint32_t task_size;
+   struct util_dynarray tasks;
 };
 
-static uint32_t
-lvp_build_internal_node(struct lvp_build_internal_ctx *ctx, uint32_t first_leaf, uint32_t last_leaf)
+static void
+lvp_aabb_init_empty(lvp_aabb *aabb)
 {
-   uint32_t dst_offset = ctx->dst_offset;
-   ctx->dst_offset += sizeof(struct lvp_bvh_box_node);
-
-   uint32_t node_id = dst_offset | lvp_bvh_node_internal;
+   aabb->min.x = INFINITY;
+   aabb->min.y = INFINITY;
+   aabb->min.z = INFINITY;
+   aabb->max.x = -INFINITY;
+   aabb->max.y = -INFINITY;
+   aabb->max.z = -INFINITY;
+}
 
-   struct lvp_bvh_box_node *node = (void *)(ctx->dst + dst_offset);
+/* fminf/fmaxf skip the NaN bounds of inactive AABBs. */
+static void
+lvp_aabb_extend(lvp_aabb *aabb, const lvp_aabb *other)
+{
+   aabb->min.x = fminf(aabb->min.x, other->min.x);
+   aabb->min.y = fminf(aabb->min.y, other->min.y);
+   aabb->min.z = fminf(aabb->min.z, other->min.z);
+   aabb->max.x = fmaxf(aabb->max.x, other->max.x);
+   aabb->max.y = fmaxf(aabb->max.y, other->max.y);
+   aabb->max.z = fmaxf(aabb->max.z, other->max.z);
+}
 
-   uint32_t split = (first_leaf + last_leaf) / 2;
+/* Half the surface area, which is all the SAH needs. */
+static float
+lvp_aabb_area(const lvp_aabb *aabb)
+{
+   float x = aabb->max.x - aabb->min.x;
+   float y = aabb->max.y - aabb->min.y;
+   float z = aabb->max.z - aabb->min.z;
+   if (!(x >= 0.0f && y >= 0.0f && z >= 0.0f))
+      return 0.0f;
 
-   if (first_leaf < split)
-      node->children[0] = lvp_build_internal_node(ctx, first_leaf, split);
-   else
-      node->children[0] =
-         (ctx->leaf_nodes_offset + (first_leaf * ctx->leaf_node_size)) | ctx->leaf_node_type;
+   return x * y + y * z + z * x;
+}
 
-   if (first_leaf < last_leaf) {
-      if (split + 1 < last_leaf)
-         node->children[1] = lvp_build_internal_node(ctx, split + 1, last_leaf);
-      else
-         node->children[1] =
-            (ctx->leaf_nodes_offset + (last_leaf * ctx->leaf_node_size)) | ctx->leaf_node_type;
-   } else {
-      node->children[1] = LVP_BVH_INVALID_NODE;
+static void
+lvp_bvh_init_empty_node(struct lvp_bvh_box_node *node)
+{
+   for (uint32_t i = 0; i < 4; i++) {
+      node->min_x[i] = INFINITY;
+      node->min_y[i] = INFINITY;
+      node->min_z[i] = INFINITY;
+      node->max_x[i] = -INFINITY;
+      node->max_y[i] = -INFINITY;
+      node->max_z[i] = -INFINITY;
+      node->children[i] = LVP_BVH_INVALID_NODE;
    }
+}
 
-   for (uint32_t i = 0; i < 2; i++) {
-      struct lvp_aabb *aabb = &node->bounds[i];
+static void
+lvp_leaf_bounds(uint8_t *bvh, uint32_t node_id, lvp_aabb *aabb)
+{
+   void *node = bvh + (node_id & ~3u);
 
-      if (node->children[i] == LVP_BVH_INVALID_NODE) {
-         aabb->min.x = INFINITY;
-         aabb->min.y = INFINITY;
-         aabb->min.z = INFINITY;
-         aabb->max.x = -INFINITY;
-         aabb->max.y = -INFINITY;
-         aabb->max.z = -INFINITY;
-         continue;
+   switch (node_id & 3u) {
+   case lvp_bvh_node_triangle: {
+      struct lvp_bvh_triangle_node *triangle = node;
+
+      aabb->min.x = MIN3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
+      aabb->min.y = MIN3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
+      aabb->min.z = MIN3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+
+      aabb->max.x = MAX3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
+      aabb->max.y = MAX3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
+      aabb->max.z = MAX3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+
+      break;
+   }
+   case lvp_bvh_node_instance: {
+      struct lvp_bvh_instance_node *instance = node;
+      struct lvp_bvh_header *instance_header = (void *)(uintptr_t)instance->bvh_ptr;
+
+      float bounds[2][3];
+
+      float header_bounds[2][3];
+      memcpy(header_bounds, &instance_header->bounds, sizeof(struct lvp_aabb));
+
+      for (unsigned j = 0; j < 3; ++j) {
+         bounds[0][j] = instance->otw_matrix.values[j][3];
+         bounds[1][j] = instance->otw_matrix.values[j][3];
+         for (unsigned k = 0; k < 3; ++k) {
+            bounds[0][j] += MIN2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
+                                 instance->otw_matrix.values[j][k] * header_bounds[1][k]);
+            bounds[1][j] += MAX2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
+                                 instance->otw_matrix.values[j][k] * header_bounds[1][k]);
+         }
       }
 
-      uint32_t child_offset = node->children[i] & (~3u);
-      uint32_t child_type = node->children[i] & 3u;
-      void *child_node = (void *)(ctx->dst + child_offset);
+      memcpy(aabb, bounds, sizeof(struct lvp_aabb));
 
-      switch (child_type) {
-      case lvp_bvh_node_triangle: {
-         struct lvp_bvh_triangle_node *triangle = child_node;
+      break;
+   }
+   case lvp_bvh_node_aabb: {
+      struct lvp_bvh_aabb_node *aabb_node = node;
 
-         aabb->min.x = MIN3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
-         aabb->min.y = MIN3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
-         aabb->min.z = MIN3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+      memcpy(aabb, &aabb_node->bounds, sizeof(struct lvp_aabb));
 
-         aabb->max.x = MAX3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
-         aabb->max.y = MAX3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
-         aabb->max.z = MAX3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+      break;
+   }
+   default:
+      unreachable("Invalid node type");
+   }
+}
 
-         break;
+static void
+lvp_bvh_init_prims(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lvp_bvh_build_ctx *ctx = data;
+   uint32_t first = iter_idx * LVP_BVH_BUILD_CHUNK_SIZE;
+   uint32_t end = MIN2(first + LVP_BVH_BUILD_CHUNK_SIZE, ctx->prim_count);
+
+   for (uint32_t i = first; i < end; i++) {
+      struct lvp_bvh_build_prim *prim = &ctx->prims[i];
+
+      prim->node_id = (ctx->leaf_nodes_offset + i * ctx->leaf_node_size) | ctx->leaf_node_type;
+      lvp_leaf_bounds(ctx->dst, prim->node_id, &prim->bounds);
+
+      /* Inactive AABBs have NaN bounds, keep them out of the binning. */
+      prim->centroid[0] = (prim->bounds.min.x + prim->bounds.max.x) * 0.5f;
+      prim->centroid[1] = (prim->bounds.min.y + prim->bounds.max.y) * 0.5f;
+      prim->centroid[2] = (prim->bounds.min.z + prim->bounds.max.z) * 0.5f;
+      for (unsigned j = 0; j < 3; j++) {
+         if (isnan(prim->centroid[j]))
+            prim->centroid[j] = 0.0f;
       }
-      case lvp_bvh_node_internal: {
-         struct lvp_bvh_box_node *box = child_node;
+   }
+}
 
-         aabb->min.x = MIN2(box->bounds[0].min.x, box->bounds[1].min.x);
-         aabb->min.y = MIN2(box->bounds[0].min.y, box->bounds[1].min.y);
-         aabb->min.z = MIN2(box->bounds[0].min.z, box->bounds[1].min.z);
+static void
+lvp_bvh_swap_prims(struct lvp_bvh_build_prim *prims, uint32_t i, uint32_t j)
+{
+   struct lvp_bvh_build_prim tmp = prims[i];
+   prims[i] = prims[j];
+   prims[j] = tmp;
+}
 
-         aabb->max.x = MAX2(box->bounds[0].max.x, box->bounds[1].max.x);
-         aabb->max.y = MAX2(box->bounds[0].max.y, box->bounds[1].max.y);
-         aabb->max.z = MAX2(box->bounds[0].max.z, box->bounds[1].max.z);
+/* Partially sorts prims so that the k-th one is in place along the axis. */
+static void
+lvp_bvh_select(struct lvp_bvh_build_prim *prims, uint32_t count, uint32_t k, unsigned axis)
+{
+   int64_t lo = 0;
+   int64_t hi = count - 1;
+
+   while (lo < hi) {
+      float pivot = prims[lo + (hi - lo) / 2].centroid[axis];
+      int64_t i = lo;
+      int64_t j = hi;
+
+      while (i <= j) {
+         while (prims[i].centroid[axis] < pivot)
+            i++;
+         while (prims[j].centroid[axis] > pivot)
+            j--;
+         if (i <= j) {
+            lvp_bvh_swap_prims(prims, i, j);
+            i++;
+            j--;
+         }
+      }
 
+      if (k <= j)
+         hi = j;
+      else if (k >= i)
+         lo = i;
+      else
          break;
+   }
+}
+
+static uint32_t
+lvp_bvh_sah_bin(float centroid, float min, float scale, uint32_t bins)
+{
+   return MIN2((uint32_t)((centroid - min) * scale), bins - 1);
+}
+
+/* Binned SAH split. Returns the number of primitives moved to the left, or
+ * 0 if the centroids could not be separated.
+ */
+static uint32_t
+lvp_bvh_split_sah(const struct lvp_bvh_build_ctx *ctx, struct lvp_bvh_build_prim *prims,
+                  uint32_t count, const float *centroid_min, const float *centroid_max)
+{
+   const uint32_t bins = ctx->sah_bins;
+   float best_cost = INFINITY;
+   int best_axis = -1;
+   uint32_t best_split = 0;
+
+   for (unsigned axis = 0; axis < 3; axis++) {
+      float extent = centroid_max[axis] - centroid_min[axis];
+      if (!(extent > 0.0f))
+         continue;
+
+      float scale = bins / extent;
+
+      lvp_aabb bin_bounds[LVP_BVH_SAH_MAX_BINS];
+      uint32_t bin_counts[LVP_BVH_SAH_MAX_BINS] = {0};
+      for (uint32_t i = 0; i < bins; i++)
+         lvp_aabb_init_empty(&bin_bounds[i]);
+
+      for (uint32_t i = 0; i < count; i++) {
+         uint32_t bin = lvp_bvh_sah_bin(prims[i].centroid[axis], centroid_min[axis], scale, bins);
+         lvp_aabb_extend(&bin_bounds[bin], &prims[i].bounds);
+         bin_counts[bin]++;
       }
-      case lvp_bvh_node_instance: {
-         struct lvp_bvh_instance_node *instance = child_node;
-         struct lvp_bvh_header *instance_header = (void *)(uintptr_t)instance->bvh_ptr;
-
-         float bounds[2][3];
-
-         float header_bounds[2][3];
-         memcpy(header_bounds, &instance_header->bounds, sizeof(struct lvp_aabb));
-
-         for (unsigned j = 0; j < 3; ++j) {
-            bounds[0][j] = instance->otw_matrix.values[j][3];
-            bounds[1][j] = instance->otw_matrix.values[j][3];
-            for (unsigned k = 0; k < 3; ++k) {
-               bounds[0][j] += MIN2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
-                                    instance->otw_matrix.values[j][k] * header_bounds[1][k]);
-               bounds[1][j] += MAX2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
-                                    instance->otw_matrix.values[j][k] * header_bounds[1][k]);
-            }
-         }
 
-         memcpy(aabb, bounds, sizeof(struct lvp_aabb));
+      float right_area[LVP_BVH_SAH_MAX_BINS];
+      uint32_t right_count[LVP_BVH_SAH_MAX_BINS];
+      lvp_aabb bounds;
+      uint32_t n = 0;
+
+      lvp_aabb_init_empty(&bounds);
+      for (uint32_t i = bins - 1; i > 0; i--) {
+         lvp_aabb_extend(&bounds, &bin_bounds[i]);
+         n += bin_counts[i];
+         right_area[i] = lvp_aabb_area(&bounds);
+         right_count[i] = n;
+      }
 
-         break;
+      lvp_aabb_init_empty(&bounds);
+      n = 0;
+      for (uint32_t i = 0; i < bins - 1; i++) {
+         lvp_aabb_extend(&bounds, &bin_bounds[i]);
+         n += bin_counts[i];
+         if (!n || !right_count[i + 1])
+            continue;
+
+         float cost = lvp_aabb_area(&bounds) * n + right_area[i + 1] * right_count[i + 1];
+         if (cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_split = i + 1;
+         }
       }
-      case lvp_bvh_node_aabb: {
-         struct lvp_bvh_aabb_node *aabb_node = child_node;
+   }
 
-         memcpy(aabb, &aabb_node->bounds, sizeof(struct lvp_aabb));
+   if (best_axis < 0)
+      return 0;
 
-         break;
+   float scale = bins / (centroid_max[best_axis] - centroid_min[best_axis]);
+   uint32_t left = 0;
+   for (uint32_t i = 0; i < count; i++) {
+      if (lvp_bvh_sah_bin(prims[i].centroid[best_axis], centroid_min[best_axis], scale, bins) <
+          best_split) {
+         lvp_bvh_swap_prims(prims, i, left);
+         left++;
       }
-      default:
-         unreachable("Invalid node type");
+   }
+
+   return left;
+}
+
+static void
+lvp_bvh_range_bounds(const struct lvp_bvh_build_ctx *ctx, struct lvp_bvh_build_range *range)
+{
+   lvp_aabb_init_empty(&range->bounds);
+   for (uint32_t i = 0; i < range->count; i++)
+      lvp_aabb_extend(&range->bounds, &ctx->prims[range->first + i].bounds);
+}
+
+static void
+lvp_bvh_split(const struct lvp_bvh_build_ctx *ctx, struct lvp_bvh_build_range *range,
+              bool median, struct lvp_bvh_build_range *right)
+{
+   struct lvp_bvh_build_prim *prims = ctx->prims + range->first;
+
+   float centroid_min[3] = {INFINITY, INFINITY, INFINITY};
+   float centroid_max[3] = {-INFINITY, -INFINITY, -INFINITY};
+   for (uint32_t i = 0; i < range->count; i++) {
+      for (unsigned j = 0; j < 3; j++) {
+         centroid_min[j] = MIN2(centroid_min[j], prims[i].centroid[j]);
+         centroid_max[j] = MAX2(centroid_max[j], prims[i].centroid[j]);
       }
    }
 
-   return node_id;
+   unsigned axis = 0;
+   for (unsigned j = 1; j < 3; j++) {
+      if (centroid_max[j] - centroid_min[j] > centroid_max[axis] - centroid_min[axis])
+         axis = j;
+   }
+
+   uint32_t left_count = 0;
+   if (!median)
+      left_count = lvp_bvh_split_sah(ctx, prims, range->count, centroid_min, centroid_max);
+
+   if (!left_count) {
+      left_count = range->count / 2;
+      if (centroid_max[axis] > centroid_min[axis])
+         lvp_bvh_select(prims, range->count, left_count, axis);
+   }
+
+   right->first = range->first + left_count;
+   right->count = range->count - left_count;
+   range->count = left_count;
+
+   lvp_bvh_range_bounds(ctx, range);
+   lvp_bvh_range_bounds(ctx, right);
 }
 
-void
-lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *info,
-                                 const VkAccelerationStructureBuildRangeInfoKHR *ranges)
+/* Levels of box nodes needed for count leaves when always splitting at the median. */
+static uint32_t
+lvp_bvh_median_levels(uint32_t count)
 {
-   VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, info->dstAccelerationStructure);
-   void *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+   return (util_logbase2_ceil(count) + 1) / 2;
+}
 
-   memset(dst, 0, accel_struct->size);
+static uint32_t
+lvp_bvh_build_node(struct lvp_bvh_build_ctx *ctx, const struct lvp_bvh_build_range *range,
+                   uint32_t depth)
+{
+   uint32_t dst_offset = LVP_BVH_ROOT_NODE_OFFSET +
+                         (p_atomic_inc_return(&ctx->node_count) - 1) *
+                         sizeof(struct lvp_bvh_box_node);
+   struct lvp_bvh_box_node *node = (void *)(ctx->dst + dst_offset);
 
-   struct lvp_bvh_header *header = dst;
-   header->instance_count = 0;
+   /* Fall back to median splits where the SAH could exceed the maximum depth,
+    * each of those takes a quarter of the primitives off.
+    */
+   bool median = !ctx->sah_bins || depth + lvp_bvh_median_levels(range->count) >= LVP_BVH_MAX_DEPTH;
+
+   /* Keep splitting the largest child until there are four. */
+   struct lvp_bvh_build_range children[4];
+   uint32_t child_count = 1;
+   children[0] = *range;
+   while (child_count < 4) {
+      int largest = -1;
+      float largest_size = -1.0f;
+      for (uint32_t i = 0; i < child_count; i++) {
+         if (children[i].count < 2)
+            continue;
+
+         float size = median ? children[i].count : lvp_aabb_area(&children[i].bounds);
+         if (size > largest_size) {
+            largest = i;
+            largest_size = size;
+         }
+      }
 
-   struct lvp_bvh_box_node *root = (void *)((uint8_t *)dst + sizeof(struct lvp_bvh_header));
+      if (largest < 0)
+         break;
 
-   uint32_t leaf_count = 0;
-   for (unsigned i = 0; i < info->geometryCount; i++)
-      leaf_count += ranges[i].primitiveCount;
+      lvp_bvh_split(ctx, &children[largest], median, &children[child_count]);
+      child_count++;
+   }
 
-   if (!leaf_count) {
-      for (uint32_t i = 0; i < 2; i++) {
-         root->bounds[i].min.x = INFINITY;
-         root->bounds[i].min.y = INFINITY;
-         root->bounds[i].min.z = INFINITY;
-         root->bounds[i].max.x = -INFINITY;
-         root->bounds[i].max.y = -INFINITY;
-         root->bounds[i].max.z = -INFINITY;
+   for (uint32_t i = 0; i < 4; i++) {
+      lvp_aabb bounds;
+      uint32_t child = LVP_BVH_INVALID_NODE;
+
+      if (i >= child_count) {
+         lvp_aabb_init_empty(&bounds);
+      } else if (children[i].count == 1) {
+         bounds = ctx->prims[children[i].first].bounds;
+         child = ctx->prims[children[i].first].node_id;
+      } else if (children[i].count <= ctx->task_size) {
+         bounds = children[i].bounds;
+
+         struct lvp_bvh_build_task task = {
+            .parent = node,
+            .child = i,
+            .depth = depth + 1,
+            .range = children[i],
+         };
+         util_dynarray_append(&ctx->tasks, struct lvp_bvh_build_task, task);
+      } else {
+         bounds = children[i].bounds;
+         child = lvp_bvh_build_node(ctx, &children[i], depth + 1);
       }
+
+      node->min_x[i] = bounds.min.x;
+      node->min_y[i] = bounds.min.y;
+      node->min_z[i] = bounds.min.z;
+      node->max_x[i] = bounds.max.x;
+      node->max_y[i] = bounds.max.y;
+      node->max_z[i] = bounds.max.z;
+      node->children[i] = child;
+   }
+
+   return dst_offset | lvp_bvh_node_internal;
+}
+
+static void
+lvp_bvh_build_task(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lvp_bvh_build_ctx *ctx = data;
+   struct lvp_bvh_build_task *task =
+      util_dynarray_element(&ctx->tasks, struct lvp_bvh_build_task, iter_idx);
+
+   task->parent->children[task->child] = lvp_bvh_build_node(ctx, &task->range, task->depth);
+}
+
+static void
+lvp_bvh_run(struct lvp_device *device, lp_cs_tpool_task_func func, void *data,
+            uint32_t iter_count)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(device->pscreen);
+
+   if (iter_count < 2 || !screen->cs_tpool) {
+      for (uint32_t i = 0; i < iter_count; i++)
+         func(data, i, NULL);
       return;
    }
 
-   uint32_t internal_count = MAX2(leaf_count, 2) - 1;
+   struct lp_cs_tpool_task *task;
 
-   uint32_t primitive_index = 0;
+   mtx_lock(&screen->cs_mutex);
+   task = lp_cs_tpool_queue_task(screen->cs_tpool, func, data, iter_count);
+   mtx_unlock(&screen->cs_mutex);
 
-   header->leaf_nodes_offset =
-      sizeof(struct lvp_bvh_header) + sizeof(struct lvp_bvh_box_node) * internal_count;
-   void *leaf_nodes = (void *)((uint8_t *)dst + header->leaf_nodes_offset);
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+}
+
+struct lvp_bvh_refit_ctx {
+   uint8_t *dst;
+   uint32_t node_count;
+
+   uint32_t *parents;
+   /* Number of box node children already refit. */
+   uint32_t *refit_children;
+};
+
+static uint32_t
+lvp_bvh_node_index(uint32_t node_id)
+{
+   return ((node_id & ~3u) - LVP_BVH_ROOT_NODE_OFFSET) / sizeof(struct lvp_bvh_box_node);
+}
+
+static struct lvp_bvh_box_node *
+lvp_bvh_box_node(uint8_t *bvh, uint32_t index)
+{
+   return (void *)(bvh + LVP_BVH_ROOT_NODE_OFFSET + index * sizeof(struct lvp_bvh_box_node));
+}
+
+static uint32_t
+lvp_bvh_box_children(const struct lvp_bvh_box_node *node)
+{
+   uint32_t count = 0;
+   for (uint32_t i = 0; i < 4; i++) {
+      if (node->children[i] != LVP_BVH_INVALID_NODE &&
+          (node->children[i] & 3u) == lvp_bvh_node_internal)
+         count++;
+   }
+   return count;
+}
+
+static void
+lvp_bvh_box_bounds(const struct lvp_bvh_box_node *node, lvp_aabb *aabb)
+{
+   lvp_aabb_init_empty(aabb);
+   for (uint32_t i = 0; i < 4; i++) {
+      lvp_aabb child = {
+         .min = {node->min_x[i], node->min_y[i], node->min_z[i]},
+         .max = {node->max_x[i], node->max_y[i], node->max_z[i]},
+      };
+      lvp_aabb_extend(aabb, &child);
+   }
+}
+
+static void
+lvp_bvh_refit_node(struct lvp_bvh_refit_ctx *ctx, struct lvp_bvh_box_node *node)
+{
+   for (uint32_t i = 0; i < 4; i++) {
+      if (node->children[i] == LVP_BVH_INVALID_NODE)
+         continue;
+
+      lvp_aabb bounds;
+      if ((node->children[i] & 3u) == lvp_bvh_node_internal)
+         lvp_bvh_box_bounds((void *)(ctx->dst + (node->children[i] & ~3u)), &bounds);
+      else
+         lvp_leaf_bounds(ctx->dst, node->children[i], &bounds);
+
+      node->min_x[i] = bounds.min.x;
+      node->min_y[i] = bounds.min.y;
+      node->min_z[i] = bounds.min.z;
+      node->max_x[i] = bounds.max.x;
+      node->max_y[i] = bounds.max.y;
+      node->max_z[i] = bounds.max.z;
+   }
+}
+
+static void
+lvp_bvh_find_parents(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lvp_bvh_refit_ctx *ctx = data;
+   uint32_t first = iter_idx * LVP_BVH_BUILD_CHUNK_SIZE;
+   uint32_t end = MIN2(first + LVP_BVH_BUILD_CHUNK_SIZE, ctx->node_count);
+
+   for (uint32_t i = first; i < end; i++) {
+      struct lvp_bvh_box_node *node = lvp_bvh_box_node(ctx->dst, i);
+      for (uint32_t j = 0; j < 4; j++) {
+         if (node->children[j] != LVP_BVH_INVALID_NODE &&
+             (node->children[j] & 3u) == lvp_bvh_node_internal)
+            ctx->parents[lvp_bvh_node_index(node->children[j])] = i;
+      }
+   }
+}
+
+/* Refits the nodes above the leaves, then walks up the tree. Whichever
+ * thread refits the last box node child of a parent goes on to refit the
+ * parent.
+ */
+static void
+lvp_bvh_refit(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lvp_bvh_refit_ctx *ctx = data;
+   uint32_t first = iter_idx * LVP_BVH_BUILD_CHUNK_SIZE;
+   uint32_t end = MIN2(first + LVP_BVH_BUILD_CHUNK_SIZE, ctx->node_count);
+
+   for (uint32_t i = first; i < end; i++) {
+      struct lvp_bvh_box_node *node = lvp_bvh_box_node(ctx->dst, i);
+      if (lvp_bvh_box_children(node))
+         continue;
+
+      lvp_bvh_refit_node(ctx, node);
+
+      for (uint32_t parent = ctx->parents[i]; parent != LVP_BVH_INVALID_NODE;
+           parent = ctx->parents[parent]) {
+         node = lvp_bvh_box_node(ctx->dst, parent);
+         if (p_atomic_inc_return(&ctx->refit_children[parent]) < lvp_bvh_box_children(node))
+            break;
+
+         lvp_bvh_refit_node(ctx, node);
+      }
+   }
+}
+
+static uint32_t
+lvp_bvh_build_sah_bins(VkBuildAccelerationStructureFlagsKHR flags)
+{
+   if (flags & VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR)
+      return LVP_BVH_SAH_MAX_BINS;
+   if (flags & VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR)
+      return 0;
+   return 8;
+}
+
+/* Returns the number of leaf nodes written. */
+static uint32_t
+lvp_write_leaf_nodes(const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                     const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+                     struct lvp_bvh_header *header, void *leaf_nodes)
+{
+   uint32_t primitive_index = 0;
 
    for (unsigned i = 0; i < info->geometryCount; i++) {
       const VkAccelerationStructureGeometryKHR *geom =
@@ -556,14 +1005,96 @@ lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *in
       }
    }
 
-   leaf_count = primitive_index;
+   return primitive_index;
+}
+
+/* Keeps the topology of the source BVH and only recomputes the leaves and
+ * the bounds of the box nodes.
+ */
+static void
+lvp_update_acceleration_structure(struct lvp_device *device,
+                                  VkAccelerationStructureBuildGeometryInfoKHR *info,
+                                  const VkAccelerationStructureBuildRangeInfoKHR *ranges)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, src_struct, info->srcAccelerationStructure);
+   VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, info->dstAccelerationStructure);
+   void *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(src_struct);
+   void *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
 
-   struct lvp_build_internal_ctx internal_ctx = {
+   if (src != dst)
+      memcpy(dst, src, MIN2(src_struct->size, accel_struct->size));
+
+   struct lvp_bvh_header *header = dst;
+   header->instance_count = 0;
+
+   lvp_write_leaf_nodes(info, ranges, header, (uint8_t *)dst + header->leaf_nodes_offset);
+
+   struct lvp_bvh_refit_ctx ctx = {
       .dst = dst,
-      .dst_offset = sizeof(struct lvp_bvh_header),
+      .node_count = header->box_node_count,
+   };
+
+   if (!ctx.node_count)
+      return;
+
+   ctx.parents = malloc(ctx.node_count * sizeof(uint32_t));
+   ctx.refit_children = calloc(ctx.node_count, sizeof(uint32_t));
+   if (ctx.parents && ctx.refit_children) {
+      uint32_t chunk_count = DIV_ROUND_UP(ctx.node_count, LVP_BVH_BUILD_CHUNK_SIZE);
+
+      ctx.parents[0] = LVP_BVH_INVALID_NODE;
+      lvp_bvh_run(device, lvp_bvh_find_parents, &ctx, chunk_count);
+      lvp_bvh_run(device, lvp_bvh_refit, &ctx, chunk_count);
+
+      lvp_bvh_box_bounds(lvp_bvh_box_node(ctx.dst, 0), &header->bounds);
+   }
+
+   free(ctx.parents);
+   free(ctx.refit_children);
+}
 
-      .leaf_nodes = leaf_nodes,
+void
+lvp_build_acceleration_structure(struct lvp_device *device,
+                                 VkAccelerationStructureBuildGeometryInfoKHR *info,
+                                 const VkAccelerationStructureBuildRangeInfoKHR *ranges)
+{
+   if (info->mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR) {
+      lvp_update_acceleration_structure(device, info, ranges);
+      return;
+   }
+
+   VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, info->dstAccelerationStructure);
+   void *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+
+   memset(dst, 0, accel_struct->size);
+
+   struct lvp_bvh_header *header = dst;
+   header->instance_count = 0;
+
+   struct lvp_bvh_box_node *root = (void *)((uint8_t *)dst + sizeof(struct lvp_bvh_header));
+
+   uint32_t leaf_count = 0;
+   for (unsigned i = 0; i < info->geometryCount; i++)
+      leaf_count += ranges[i].primitiveCount;
+
+   if (!leaf_count) {
+      lvp_bvh_init_empty_node(root);
+      return;
+   }
+
+   uint32_t internal_count = lvp_bvh_max_box_nodes(leaf_count);
+
+   header->leaf_nodes_offset =
+      sizeof(struct lvp_bvh_header) + sizeof(struct lvp_bvh_box_node) * internal_count;
+   void *leaf_nodes = (void *)((uint8_t *)dst + header->leaf_nodes_offset);
+
+   leaf_count = lvp_write_leaf_nodes(info, ranges, header, leaf_nodes);
+
+   struct lvp_bvh_build_ctx ctx = {
+      .dst = dst,
+      .prim_count = leaf_count,
       .leaf_nodes_offset = header->leaf_nodes_offset,
+      .sah_bins = lvp_bvh_build_sah_bins(info->flags),
    };
 
    VkGeometryTypeKHR geometry_type = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
@@ -576,36 +1107,56 @@ lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *in
 
    switch (geometry_type) {
    case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
-      internal_ctx.leaf_node_type = lvp_bvh_node_triangle;
-      internal_ctx.leaf_node_size = sizeof(struct lvp_bvh_triangle_node);
+      ctx.leaf_node_type = lvp_bvh_node_triangle;
+      ctx.leaf_node_size = sizeof(struct lvp_bvh_triangle_node);
       break;
    case VK_GEOMETRY_TYPE_AABBS_KHR:
-      internal_ctx.leaf_node_type = lvp_bvh_node_aabb;
-      internal_ctx.leaf_node_size = sizeof(struct lvp_bvh_aabb_node);
+      ctx.leaf_node_type = lvp_bvh_node_aabb;
+      ctx.leaf_node_size = sizeof(struct lvp_bvh_aabb_node);
       break;
    case VK_GEOMETRY_TYPE_INSTANCES_KHR:
-      internal_ctx.leaf_node_type = lvp_bvh_node_instance;
-      internal_ctx.leaf_node_size = sizeof(struct lvp_bvh_instance_node);
+      ctx.leaf_node_type = lvp_bvh_node_instance;
+      ctx.leaf_node_size = sizeof(struct lvp_bvh_instance_node);
       break;
    default:
       unreachable("Unknown VkGeometryTypeKHR");
    }
 
-   if (leaf_count) {
-      lvp_build_internal_node(&internal_ctx, 0, leaf_count - 1);
-   } else {
-      root->children[0] = LVP_BVH_INVALID_NODE;
-      root->children[1] = LVP_BVH_INVALID_NODE;
+   ctx.prims = leaf_count ? malloc(leaf_count * sizeof(struct lvp_bvh_build_prim)) : NULL;
+   if (!ctx.prims) {
+      lvp_bvh_init_empty_node(root);
+      lvp_aabb_init_empty(&header->bounds);
+      goto done;
    }
 
-   header->bounds.min.x = MIN2(root->bounds[0].min.x, root->bounds[1].min.x);
-   header->bounds.min.y = MIN2(root->bounds[0].min.y, root->bounds[1].min.y);
-   header->bounds.min.z = MIN2(root->bounds[0].min.z, root->bounds[1].min.z);
+   lvp_bvh_run(device, lvp_bvh_init_prims, &ctx,
+               DIV_ROUND_UP(leaf_count, LVP_BVH_BUILD_CHUNK_SIZE));
+
+   struct lvp_bvh_build_range range = {
+      .first = 0,
+      .count = leaf_count,
+   };
+   lvp_bvh_range_bounds(&ctx, &range);
+   header->bounds = range.bounds;
+
+   /* Build the top of the tree here and the subtrees below it on the thread pool. */
+   uint32_t num_threads = llvmpipe_screen(device->pscreen)->num_threads;
+   if (num_threads && leaf_count > LVP_BVH_BUILD_MIN_TASK_SIZE)
+      ctx.task_size = MAX2(leaf_count / (num_threads * 4), LVP_BVH_BUILD_MIN_TASK_SIZE);
+   util_dynarray_init(&ctx.tasks, NULL);
+
+   lvp_bvh_build_node(&ctx, &range, 0);
+
+   ctx.task_size = 0;
+   lvp_bvh_run(device, lvp_bvh_build_task, &ctx,
+               util_dynarray_num_elements(&ctx.tasks, struct lvp_bvh_build_task));
+
+   header->box_node_count = ctx.node_count;
 
-   header->bounds.max.x = MAX2(root->bounds[0].max.x, root->bounds[1].max.x);
-   header->bounds.max.y = MAX2(root->bounds[0].max.y, root->bounds[1].max.y);
-   header->bounds.max.z = MAX2(root->bounds[0].max.z, root->bounds[1].max.z);
+   util_dynarray_fini(&ctx.tasks);
+   free(ctx.prims);
 
+done:
    header->serialization_size = sizeof(struct lvp_accel_struct_serialization_header) +
                                 sizeof(uint64_t) * header->instance_count + accel_struct->size;
 }
@@ -72,9 +72,17 @@ struct lvp_bvh_instance_node {
    lvp_mat3x4 otw_matrix;
 };
 
+/* Bounds are stored per component, so that the slab test for all four
+ * children can be done with vec4 operations.
+ */
 struct lvp_bvh_box_node {
-   lvp_aabb bounds[2];
-   uint32_t children[2];
+   float min_x[4];
+   float min_y[4];
+   float min_z[4];
+   float max_x[4];
+   float max_y[4];
+   float max_z[4];
+   uint32_t children[4];
 };
 
 struct lvp_bvh_header {
@@ -84,7 +92,8 @@ struct lvp_bvh_header {
    uint32_t instance_count;
    uint32_t leaf_nodes_offset;
 
-   uint32_t padding;
+   /* Box nodes are allocated in order, parents before their children. */
+   uint32_t box_node_count;
 };
 
 struct lvp_accel_struct_serialization_header {
@@ -101,8 +110,17 @@ struct lvp_accel_struct_serialization_header {
 #define LVP_BVH_ROOT_NODE        (LVP_BVH_ROOT_NODE_OFFSET | lvp_bvh_node_internal)
 #define LVP_BVH_INVALID_NODE     0xFFFFFFFF
 
+/* Maximum number of box nodes between the root and a leaf. */
+#define LVP_BVH_MAX_DEPTH 16
+
+/* Traversal pushes at most 3 children per box node, for a top level and a
+ * bottom level BVH.
+ */
+#define LVP_BVH_STACK_SIZE (2 * 3 * LVP_BVH_MAX_DEPTH)
+
 void
-lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *info,
+lvp_build_acceleration_structure(struct lvp_device *device,
+                                 VkAccelerationStructureBuildGeometryInfoKHR *info,
                                  const VkAccelerationStructureBuildRangeInfoKHR *ranges);
 
 #endif
@@ -1417,6 +1417,15 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
       };
    }
+
+   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+      p->queueFamilyProperties = (VkQueueFamilyProperties) {
+         .queueFlags = VK_QUEUE_COMPUTE_BIT,
+         .queueCount = LVP_MAX_COMPUTE_QUEUES,
+         .timestampValidBits = 64,
+         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
+      };
+   }
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceMemoryProperties(
@@ -1550,48 +1559,63 @@ lvp_queue_submit(struct vk_queue *vk_queue,
    return VK_SUCCESS;
 }
 
+static void
+lvp_queue_finish(struct lvp_queue *queue)
+{
+   if (queue->vk.driver_submit)
+      vk_queue_finish(&queue->vk);
+
+   destroy_pipelines(queue);
+   simple_mtx_destroy(&queue->lock);
+   util_dynarray_fini(&queue->pipeline_destroys);
+
+   if (queue->last_fence)
+      queue->device->pscreen->fence_reference(queue->device->pscreen, &queue->last_fence, NULL);
+
+   u_upload_destroy(queue->uploader);
+   cso_destroy_context(queue->cso);
+   queue->ctx->destroy(queue->ctx);
+}
+
+/**
+ * A NULL create_info only sets up the pipe context, for the graphics queue
+ * of a device created without it.
+ */
 static VkResult
 lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
                const VkDeviceQueueCreateInfo *create_info,
                uint32_t index_in_family)
 {
-   VkResult result = vk_queue_init(&queue->vk, &device->vk, create_info,
-                                   index_in_family);
-   if (result != VK_SUCCESS)
-      return result;
-
-   result = vk_queue_enable_submit_thread(&queue->vk);
-   if (result != VK_SUCCESS) {
-      vk_queue_finish(&queue->vk);
-      return result;
-   }
-
    queue->device = device;
 
    queue->ctx = device->pscreen->context_create(device->pscreen, NULL, PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
+   if (!queue->ctx)
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
    queue->cso = cso_create_context(queue->ctx, CSO_NO_VBUF);
    queue->uploader = u_upload_create(queue->ctx, 1024 * 1024, PIPE_BIND_CONSTANT_BUFFER, PIPE_USAGE_STREAM, 0);
 
-   queue->vk.driver_submit = lvp_queue_submit;
-
    simple_mtx_init(&queue->lock, mtx_plain);
    util_dynarray_init(&queue->pipeline_destroys, NULL);
 
-   return VK_SUCCESS;
-}
+   if (!create_info)
+      return VK_SUCCESS;
 
-static void
-lvp_queue_finish(struct lvp_queue *queue)
-{
-   vk_queue_finish(&queue->vk);
+   VkResult result = vk_queue_init(&queue->vk, &device->vk, create_info,
+                                   index_in_family);
+   if (result != VK_SUCCESS) {
+      lvp_queue_finish(queue);
+      return result;
+   }
 
-   destroy_pipelines(queue);
-   simple_mtx_destroy(&queue->lock);
-   util_dynarray_fini(&queue->pipeline_destroys);
+   queue->vk.driver_submit = lvp_queue_submit;
 
-   u_upload_destroy(queue->uploader);
-   cso_destroy_context(queue->cso);
-   queue->ctx->destroy(queue->ctx);
+   result = vk_queue_enable_submit_thread(&queue->vk);
+   if (result != VK_SUCCESS) {
+      lvp_queue_finish(queue);
+      return result;
+   }
+
+   return VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
@@ -1606,14 +1630,31 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
 
+   const VkDeviceQueueCreateInfo *graphics_queue_info = NULL;
+   const VkDeviceQueueCreateInfo *compute_queue_info = NULL;
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *queue_info = &pCreateInfo->pQueueCreateInfos[i];
+      if (queue_info->queueFamilyIndex == LVP_QUEUE_FAMILY_GRAPHICS) {
+         assert(queue_info->queueCount == 1);
+         graphics_queue_info = queue_info;
+      } else {
+         assert(queue_info->queueFamilyIndex == LVP_QUEUE_FAMILY_COMPUTE);
+         assert(queue_info->queueCount <= LVP_MAX_COMPUTE_QUEUES);
+         compute_queue_info = queue_info;
+      }
+   }
+   uint32_t compute_queue_count = compute_queue_info ? compute_queue_info->queueCount : 0;
+
    size_t state_size = lvp_get_rendering_state_size();
    device = vk_zalloc2(&physical_device->vk.instance->alloc, pAllocator,
-                       sizeof(*device) + state_size, 8,
+                       sizeof(*device) + state_size * (1 + compute_queue_count), 8,
                        VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
    if (!device)
       return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
    device->queue.state = device + 1;
+   for (uint32_t i = 0; i < compute_queue_count; i++)
+      device->compute_queues[i].state = (uint8_t *)(device + 1) + state_size * (i + 1);
    device->poison_mem = debug_get_bool_option("LVP_POISON_MEMORY", false);
    device->print_cmds = debug_get_bool_option("LVP_CMD_DEBUG", false);
 
@@ -1640,15 +1681,24 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   result = lvp_queue_init(device, &device->queue, graphics_queue_info, 0);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, device);
       return result;
    }
 
+   for (uint32_t i = 0; i < compute_queue_count; i++) {
+      result = lvp_queue_init(device, &device->compute_queues[i], compute_queue_info, i);
+      if (result != VK_SUCCESS) {
+         while (device->compute_queue_count)
+            lvp_queue_finish(&device->compute_queues[--device->compute_queue_count]);
+         lvp_queue_finish(&device->queue);
+         vk_free(&device->vk.alloc, device);
+         return result;
+      }
+      device->compute_queue_count++;
+   }
+
    nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
    struct pipe_shader_state shstate = {0};
    shstate.type = PIPE_SHADER_IR_NIR;
@@ -1682,6 +1732,9 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
+   for (uint32_t i = 0; i < device->compute_queue_count; i++)
+      lvp_queue_finish(&device->compute_queues[i]);
+
    util_dynarray_foreach(&device->bda_texture_handles, struct lp_texture_handle *, handle)
       device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)*handle);
 
@@ -1697,8 +1750,6 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 
    device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
 
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
@@ -83,6 +83,7 @@ struct rendering_state {
    struct lvp_device *device; //for uniform inlining only
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
+   bool is_device_queue;
 
    bool blend_dirty;
    bool rs_dirty;
@@ -297,6 +298,14 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
    struct lvp_shader *shader = state->shaders[stage];
    if (!shader || !shader->inlines.can_inline)
       return;
+   /* Inlined variants are compiled on the device queue's context, the other
+    * queues can't touch it while executing so they use the generic shader.
+    */
+   if (!state->is_device_queue) {
+      assert(sh == MESA_SHADER_COMPUTE);
+      state->pctx->bind_compute_state(state->pctx, shader->shader_cso);
+      return;
+   }
    struct lvp_inline_variant v;
    v.mask = shader->inlines.can_inline;
    /* these buffers have already been flushed in llvmpipe, so they're safe to read */
@@ -1123,7 +1132,11 @@ static void handle_pipeline(struct vk_cmd_queue_entry *cmd,
                             struct rendering_state *state)
 {
    LVP_FROM_HANDLE(lvp_pipeline, pipeline, cmd->u.bind_pipeline.pipeline);
-   pipeline->used = true;
+   /* Compute queues are done with their pipelines when the submission
+    * returns, only the device queue needs lvp_DestroyPipeline to defer.
+    */
+   if (state->is_device_queue)
+      pipeline->used = true;
    if (pipeline->type == LVP_PIPELINE_COMPUTE) {
       handle_compute_pipeline(cmd, state);
    } else if (pipeline->type == LVP_PIPELINE_RAY_TRACING) {
@@ -4470,7 +4483,7 @@ handle_build_acceleration_structures(struct vk_cmd_queue_entry *cmd, struct rend
    struct vk_cmd_build_acceleration_structures_khr *build = &cmd->u.build_acceleration_structures_khr;
 
    for (uint32_t i = 0; i < build->info_count; i++)
-      lvp_build_acceleration_structure(&build->infos[i], build->pp_build_range_infos[i]);
+      lvp_build_acceleration_structure(state->device, &build->infos[i], build->pp_build_range_infos[i]);
 }
 
 static void
@@ -5204,6 +5217,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    state->device = device;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
+   state->is_device_queue = queue == &device->queue;
    state->blend_dirty = true;
    state->dsa_dirty = true;
    state->rs_dirty = true;
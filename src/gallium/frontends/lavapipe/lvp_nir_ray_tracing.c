@@ -57,86 +57,100 @@ lvp_load_vertex_position(nir_builder *b, nir_def *instance_addr, nir_def *primit
    return nir_build_load_global(b, 3, 32, nir_iadd(b, bvh_addr, nir_u2u64(b, offset)));
 }
 
+static void
+lvp_build_sort_children(nir_builder *b, nir_def **distances, nir_def **children,
+                        unsigned i, unsigned j)
+{
+   nir_def *swap = nir_flt(b, distances[j], distances[i]);
+
+   nir_def *distance = distances[i];
+   distances[i] = nir_bcsel(b, swap, distances[j], distance);
+   distances[j] = nir_bcsel(b, swap, distance, distances[j]);
+
+   nir_def *child = children[i];
+   children[i] = nir_bcsel(b, swap, children[j], child);
+   children[j] = nir_bcsel(b, swap, child, children[j]);
+}
+
+/* Tests the ray against all four children of a box node at once and returns
+ * the children which were hit, nearest first, followed by
+ * LVP_BVH_INVALID_NODE.
+ */
 static nir_def *
 lvp_build_intersect_ray_box(nir_builder *b, nir_def *node_addr, nir_def *ray_tmax,
                             nir_def *origin, nir_def *dir, nir_def *inv_dir)
 {
-   const struct glsl_type *vec2_type = glsl_vector_type(GLSL_TYPE_FLOAT, 2);
-   const struct glsl_type *uvec2_type = glsl_vector_type(GLSL_TYPE_UINT, 2);
-
-   nir_variable *distances =
-      nir_variable_create(b->shader, nir_var_shader_temp, vec2_type, "distances");
-   nir_store_var(b, distances, nir_imm_vec2(b, INFINITY, INFINITY), 0xf);
-
-   nir_variable *child_indices =
-      nir_variable_create(b->shader, nir_var_shader_temp, uvec2_type, "child_indices");
-   nir_store_var(b, child_indices, nir_imm_ivec2(b, 0xffffffffu, 0xffffffffu), 0xf);
+   const uint32_t coord_offsets[2][3] = {
+      {
+         offsetof(struct lvp_bvh_box_node, min_x),
+         offsetof(struct lvp_bvh_box_node, min_y),
+         offsetof(struct lvp_bvh_box_node, min_z),
+      },
+      {
+         offsetof(struct lvp_bvh_box_node, max_x),
+         offsetof(struct lvp_bvh_box_node, max_y),
+         offsetof(struct lvp_bvh_box_node, max_z),
+      },
+   };
 
    inv_dir = nir_bcsel(b, nir_feq_imm(b, dir, 0), nir_imm_float(b, FLT_MAX), inv_dir);
 
-   for (int i = 0; i < 2; i++) {
-      const uint32_t child_offset = offsetof(struct lvp_bvh_box_node, children[i]);
-      const uint32_t coord_offsets[2] = {
-         offsetof(struct lvp_bvh_box_node, bounds[i].min.x),
-         offsetof(struct lvp_bvh_box_node, bounds[i].max.x),
-      };
-
-      nir_def *child_index =
-         nir_build_load_global(b, 1, 32, nir_iadd_imm(b, node_addr, child_offset));
+   nir_def *child_indices = nir_build_load_global(
+      b, 4, 32, nir_iadd_imm(b, node_addr, offsetof(struct lvp_bvh_box_node, children)));
 
+   nir_def *tmin = NULL;
+   nir_def *tmax = NULL;
+   nir_def *min_x = NULL;
+   for (unsigned i = 0; i < 3; i++) {
       nir_def *node_coords[2] = {
-         nir_build_load_global(b, 3, 32, nir_iadd_imm(b, node_addr, coord_offsets[0])),
-         nir_build_load_global(b, 3, 32, nir_iadd_imm(b, node_addr, coord_offsets[1])),
+         nir_build_load_global(b, 4, 32, nir_iadd_imm(b, node_addr, coord_offsets[0][i])),
+         nir_build_load_global(b, 4, 32, nir_iadd_imm(b, node_addr, coord_offsets[1][i])),
       };
 
-      /* If x of the aabb min is NaN, then this is an inactive aabb.
-       * We don't need to care about any other components being NaN as that is UB.
-       * https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/chap36.html#VkAabbPositionsKHR
-       */
-      nir_def *min_x = nir_channel(b, node_coords[0], 0);
-      nir_def *min_x_is_not_nan =
-         nir_inot(b, nir_fneu(b, min_x, min_x)); /* NaN != NaN -> true */
-
-      nir_def *bound0 = nir_fmul(b, nir_fsub(b, node_coords[0], origin), inv_dir);
-      nir_def *bound1 = nir_fmul(b, nir_fsub(b, node_coords[1], origin), inv_dir);
-
-      nir_def *tmin =
-         nir_fmax(b,
-                  nir_fmax(b, nir_fmin(b, nir_channel(b, bound0, 0), nir_channel(b, bound1, 0)),
-                           nir_fmin(b, nir_channel(b, bound0, 1), nir_channel(b, bound1, 1))),
-                  nir_fmin(b, nir_channel(b, bound0, 2), nir_channel(b, bound1, 2)));
-
-      nir_def *tmax =
-         nir_fmin(b,
-                  nir_fmin(b, nir_fmax(b, nir_channel(b, bound0, 0), nir_channel(b, bound1, 0)),
-                           nir_fmax(b, nir_channel(b, bound0, 1), nir_channel(b, bound1, 1))),
-                  nir_fmax(b, nir_channel(b, bound0, 2), nir_channel(b, bound1, 2)));
-
-      nir_push_if(b,
-                  nir_iand(b, min_x_is_not_nan,
-                           nir_iand(b, nir_fge(b, tmax, nir_fmax(b, nir_imm_float(b, 0.0f), tmin)),
-                                    nir_flt(b, tmin, ray_tmax))));
-      {
-         nir_def *new_child_indices[2] = {child_index, child_index};
-         nir_store_var(b, child_indices, nir_vec(b, new_child_indices, 2), 1u << i);
+      if (i == 0)
+         min_x = node_coords[0];
 
-         nir_def *new_distances[2] = {tmin, tmin};
-         nir_store_var(b, distances, nir_vec(b, new_distances, 2), 1u << i);
-      }
-      nir_pop_if(b, NULL);
+      nir_def *axis_origin = nir_replicate(b, nir_channel(b, origin, i), 4);
+      nir_def *axis_inv_dir = nir_replicate(b, nir_channel(b, inv_dir, i), 4);
+
+      nir_def *bound0 = nir_fmul(b, nir_fsub(b, node_coords[0], axis_origin), axis_inv_dir);
+      nir_def *bound1 = nir_fmul(b, nir_fsub(b, node_coords[1], axis_origin), axis_inv_dir);
+
+      nir_def *axis_tmin = nir_fmin(b, bound0, bound1);
+      nir_def *axis_tmax = nir_fmax(b, bound0, bound1);
+
+      tmin = tmin ? nir_fmax(b, tmin, axis_tmin) : axis_tmin;
+      tmax = tmax ? nir_fmin(b, tmax, axis_tmax) : axis_tmax;
    }
 
-   nir_def *ssa_distances = nir_load_var(b, distances);
-   nir_def *ssa_indices = nir_load_var(b, child_indices);
-   nir_push_if(b, nir_flt(b, nir_channel(b, ssa_distances, 1), nir_channel(b, ssa_distances, 0)));
-   {
-      nir_store_var(b, child_indices,
-                    nir_vec2(b, nir_channel(b, ssa_indices, 0), nir_channel(b, ssa_indices, 1)),
-                    0b11);
+   /* If x of the aabb min is NaN, then this is an inactive aabb.
+    * We don't need to care about any other components being NaN as that is UB.
+    * https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/chap36.html#VkAabbPositionsKHR
+    */
+   nir_def *min_x_is_not_nan = nir_inot(b, nir_fneu(b, min_x, min_x)); /* NaN != NaN -> true */
+
+   nir_def *hit =
+      nir_iand(b, nir_iand(b, min_x_is_not_nan, nir_ine_imm(b, child_indices, LVP_BVH_INVALID_NODE)),
+               nir_iand(b, nir_fge(b, tmax, nir_fmax(b, nir_imm_float(b, 0.0f), tmin)),
+                        nir_flt(b, tmin, nir_replicate(b, ray_tmax, 4))));
+
+   nir_def *distances[4];
+   nir_def *children[4];
+   for (unsigned i = 0; i < 4; i++) {
+      nir_def *child_hit = nir_channel(b, hit, i);
+      distances[i] = nir_bcsel(b, child_hit, nir_channel(b, tmin, i), nir_imm_float(b, INFINITY));
+      children[i] = nir_bcsel(b, child_hit, nir_channel(b, child_indices, i),
+                              nir_imm_int(b, LVP_BVH_INVALID_NODE));
    }
-   nir_pop_if(b, NULL);
 
-   return nir_load_var(b, child_indices);
+   /* Sorting network for four elements. */
+   lvp_build_sort_children(b, distances, children, 0, 1);
+   lvp_build_sort_children(b, distances, children, 2, 3);
+   lvp_build_sort_children(b, distances, children, 0, 2);
+   lvp_build_sort_children(b, distances, children, 1, 3);
+   lvp_build_sort_children(b, distances, children, 1, 2);
+
+   return nir_vec(b, children, 4);
 }
 
 static nir_def *
@@ -497,11 +511,14 @@ lvp_build_ray_traversal(nir_builder *b, const struct lvp_ray_traversal_args *arg
 
             nir_store_deref(b, args->vars.current_node, nir_channel(b, result, 0), 0x1);
 
-            nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, 1), LVP_BVH_INVALID_NODE));
-            {
-               lvp_build_push_stack(b, args, nir_channel(b, result, 1));
+            /* Push the farthest child first, so the nearer ones are visited first. */
+            for (unsigned i = 3; i > 0; i--) {
+               nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, i), LVP_BVH_INVALID_NODE));
+               {
+                  lvp_build_push_stack(b, args, nir_channel(b, result, i));
+               }
+               nir_pop_if(b, NULL);
             }
-            nir_pop_if(b, NULL);
          }
          nir_pop_if(b, NULL);
       }
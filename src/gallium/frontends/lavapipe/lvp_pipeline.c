@@ -223,50 +223,52 @@ lvp_nir_fixup_indirect_tex(nir_shader *shader)
 static void
 optimize(nir_shader *nir)
 {
+   struct set *skip = _mesa_pointer_set_create(NULL);
    bool progress = false;
    do {
       progress = false;
 
-      NIR_PASS(progress, nir, nir_lower_flrp, 32|64, true);
-      NIR_PASS(progress, nir, nir_split_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_vars_to_ssa);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_flrp, 32|64, true);
+      NIR_LOOP_PASS(progress, skip, nir, nir_split_array_vars, nir_var_function_temp);
+      NIR_LOOP_PASS(progress, skip, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_deref);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_vars_to_ssa);
 
-      NIR_PASS(progress, nir, nir_opt_copy_prop_vars);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_copy_prop_vars);
 
-      NIR_PASS(progress, nir, nir_copy_prop);
-      NIR_PASS(progress, nir, nir_opt_dce);
-      NIR_PASS(progress, nir, nir_opt_peephole_select, 8, true, true);
+      NIR_LOOP_PASS(progress, skip, nir, nir_copy_prop);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_dce);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_peephole_select, 8, true, true);
 
-      NIR_PASS(progress, nir, nir_opt_algebraic);
-      NIR_PASS(progress, nir, nir_opt_constant_folding);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_algebraic);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_constant_folding);
 
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_remove_phis);
       bool loop = false;
-      NIR_PASS(loop, nir, nir_opt_loop);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(loop, skip, nir, nir_opt_loop);
       progress |= loop;
       if (loop) {
          /* If nir_opt_loop makes progress, then we need to clean
           * things up if we want any hope of nir_opt_if or nir_opt_loop_unroll
           * to make progress.
           */
-         NIR_PASS(progress, nir, nir_copy_prop);
-         NIR_PASS(progress, nir, nir_opt_dce);
-         NIR_PASS(progress, nir, nir_opt_remove_phis);
+         NIR_LOOP_PASS(progress, skip, nir, nir_copy_prop);
+         NIR_LOOP_PASS(progress, skip, nir, nir_opt_dce);
+         NIR_LOOP_PASS(progress, skip, nir, nir_opt_remove_phis);
       }
-      NIR_PASS(progress, nir, nir_opt_if, nir_opt_if_optimize_phi_true_false);
-      NIR_PASS(progress, nir, nir_opt_dead_cf);
-      NIR_PASS(progress, nir, nir_opt_conditional_discard);
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
-      NIR_PASS(progress, nir, nir_opt_cse);
-      NIR_PASS(progress, nir, nir_opt_undef);
-
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_alu_to_scalar, NULL, NULL);
-      NIR_PASS(progress, nir, nir_opt_loop_unroll);
-      NIR_PASS(progress, nir, lvp_nir_fixup_indirect_tex);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_if, nir_opt_if_optimize_phi_true_false);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_dead_cf);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_conditional_discard);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_remove_phis);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_cse);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_undef);
+
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_deref);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_alu_to_scalar, NULL, NULL);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_loop_unroll);
+      NIR_LOOP_PASS(progress, skip, nir, lvp_nir_fixup_indirect_tex);
    } while (progress);
+   _mesa_set_destroy(skip, NULL);
 }
 
 void
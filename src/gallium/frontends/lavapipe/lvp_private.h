@@ -101,6 +101,10 @@ extern "C" {
 #define MAX_DGC_STREAMS 16
 #define MAX_DGC_TOKENS 16
 
+#define LVP_QUEUE_FAMILY_GRAPHICS 0
+#define LVP_QUEUE_FAMILY_COMPUTE  1
+#define LVP_MAX_COMPUTE_QUEUES    4
+
 #ifdef _WIN32
 #define lvp_printflike(a, b)
 #else
@@ -198,7 +202,14 @@ struct lvp_pipeline_cache {
 struct lvp_device {
    struct vk_device vk;
 
+   /* The graphics queue.  Its context is also the one CSOs, sampler views
+    * and texture/image handles are created on, under its lock, so it exists
+    * even when the application doesn't ask for the queue.
+    */
    struct lvp_queue queue;
+   /* Compute-only queues executing concurrently with the graphics queue. */
+   struct lvp_queue compute_queues[LVP_MAX_COMPUTE_QUEUES];
+   uint32_t compute_queue_count;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
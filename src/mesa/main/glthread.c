@@ -218,8 +218,12 @@ _mesa_glthread_init(struct gl_context *ctx)
        !screen->get_param(screen, PIPE_CAP_ALLOW_MAPPED_BUFFERS_DURING_EXECUTION))
       return;
 
+   /* Batches are only reused after their fence signals, so the queue never
+    * fills up and the lock-free ring fits.  It saves a mutex and condition
+    * variable round trip per batch.
+    */
    if (!util_queue_init(&glthread->queue, "gl", MARSHAL_MAX_BATCHES - 2,
-                        1, 0, NULL)) {
+                        1, UTIL_QUEUE_INIT_LOCKLESS, NULL)) {
       return;
    }
 
@@ -309,6 +309,14 @@ disk_cache_destroy(struct disk_cache *cache)
       printf("disk shader cache:  hits = %u, misses = %u\n",
              cache->stats.hits,
              cache->stats.misses);
+
+      if (cache->type == DISK_CACHE_DATABASE && cache->stats.db_batches) {
+         printf("disk shader cache:  database writes = %u, "
+                "average batch size = %.1f\n",
+                cache->stats.db_batches,
+                (double)cache->stats.db_batched_items /
+                cache->stats.db_batches);
+      }
    }
 
    if (cache && util_queue_is_initialized(&cache->cache_queue)) {
@@ -322,7 +330,7 @@ disk_cache_destroy(struct disk_cache *cache)
          foz_destroy(&cache->foz_db);
 
       if (cache->type == DISK_CACHE_DATABASE)
-         mesa_cache_db_multipart_close(&cache->cache_db);
+         disk_cache_db_close(cache);
 
       disk_cache_destroy_mmap(cache);
    }
@@ -363,6 +371,7 @@ create_put_job(struct disk_cache *cache, const cache_key key,
 
    if (dc_job) {
       dc_job->cache = cache;
+      dc_job->db_put_queued = false;
       memcpy(dc_job->key, key, sizeof(cache_key));
       if (take_ownership) {
          dc_job->data = data;
@@ -407,6 +416,7 @@ destroy_put_job(void *job, void *gdata, int thread_index)
 {
    if (job) {
       struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
+      disk_cache_db_put_done(dc_job);
       free(dc_job->cache_item_metadata.keys);
       free(job);
    }
@@ -554,6 +564,8 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 
    if (dc_job) {
       util_queue_fence_init(&dc_job->fence);
+      if (cache->type == DISK_CACHE_DATABASE && !cache->blob_put_cb)
+         disk_cache_db_put_queued(dc_job);
       util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
                          cache_put, destroy_put_job, dc_job->size);
    }
@@ -574,6 +586,8 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
 
    if (dc_job) {
       util_queue_fence_init(&dc_job->fence);
+      if (cache->type == DISK_CACHE_DATABASE && !cache->blob_put_cb)
+         disk_cache_db_put_queued(dc_job);
       util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
                          cache_put, destroy_put_job_nocopy, dc_job->size);
    }
@@ -1176,28 +1176,180 @@ disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
    return uncompressed_data;
 }
 
+/* Upper bound for the number of items written with one database lock. */
+#define DB_BATCH_MAX_ITEMS 64
+
+/* How long the writer waits for already queued put jobs to join the batch. */
+#define DB_BATCH_WINDOW_NS (1 * 1000 * 1000)
+
+struct db_batch_item {
+   cache_key key;
+   struct blob blob;
+};
+
+static void
+db_batch_write(struct disk_cache *cache, struct db_batch_item *items,
+               unsigned num_items)
+{
+   struct mesa_cache_db_write_entry entries[DB_BATCH_MAX_ITEMS];
+
+   for (unsigned i = 0; i < num_items; i++) {
+      entries[i].cache_key_160bit = items[i].key;
+      entries[i].blob = items[i].blob.data;
+      entries[i].blob_size = items[i].blob.size;
+   }
+
+   mesa_cache_db_multipart_entries_write(&cache->cache_db, entries, num_items);
+
+   for (unsigned i = 0; i < num_items; i++)
+      blob_finish(&items[i].blob);
+
+   if (unlikely(cache->stats.enabled)) {
+      p_atomic_inc(&cache->stats.db_batches);
+      p_atomic_add(&cache->stats.db_batched_items, num_items);
+   }
+}
+
+/* Should the writer wait for more items before writing the batch? Only if
+ * there are put jobs that can make progress on other queue threads. The
+ * writer's own job stays counted until its cleanup runs, so it is skipped.
+ */
+static bool
+db_batch_should_wait(struct disk_cache *cache)
+{
+   return cache->db_batch.num_queued_puts > 1 &&
+          util_dynarray_num_elements(&cache->db_batch.items,
+                                     struct db_batch_item) < DB_BATCH_MAX_ITEMS &&
+          p_atomic_read(&cache->cache_queue.num_threads) > 1;
+}
+
+void
+disk_cache_db_put_queued(struct disk_cache_put_job *dc_job)
+{
+   struct disk_cache *cache = dc_job->cache;
+
+   mtx_lock(&cache->db_batch.lock);
+   cache->db_batch.num_queued_puts++;
+   mtx_unlock(&cache->db_batch.lock);
+
+   dc_job->db_put_queued = true;
+}
+
+/* Called from the job cleanup, which also runs for jobs that are dropped
+ * without being executed.
+ */
+void
+disk_cache_db_put_done(struct disk_cache_put_job *dc_job)
+{
+   struct disk_cache *cache = dc_job->cache;
+
+   if (!dc_job->db_put_queued)
+      return;
+
+   mtx_lock(&cache->db_batch.lock);
+   assert(cache->db_batch.num_queued_puts);
+   cache->db_batch.num_queued_puts--;
+   cnd_signal(&cache->db_batch.cond);
+   mtx_unlock(&cache->db_batch.lock);
+}
+
+/* Put jobs add their item to a shared batch. The first one to find no
+ * writer becomes the writer: it waits a bit for the put jobs that are
+ * already queued, then writes the whole batch with a single database lock,
+ * and repeats until the batch is empty. Because the writer is still a
+ * running job, util_queue_finish() waits for the written batch.
+ */
 bool
 disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job)
 {
-   struct blob cache_blob;
-   blob_init(&cache_blob);
+   struct disk_cache *cache = dc_job->cache;
+   struct db_batch_item item;
+   bool success;
 
-   if (!create_cache_item_header_and_blob(dc_job, &cache_blob))
-      return false;
+   memcpy(item.key, dc_job->key, sizeof(cache_key));
+   blob_init(&item.blob);
+   success = create_cache_item_header_and_blob(dc_job, &item.blob);
 
-   bool r = mesa_cache_db_multipart_entry_write(&dc_job->cache->cache_db,
-                                                dc_job->key, cache_blob.data,
-                                                cache_blob.size);
+   mtx_lock(&cache->db_batch.lock);
 
-   blob_finish(&cache_blob);
-   return r;
+   if (success) {
+      util_dynarray_append(&cache->db_batch.items, struct db_batch_item, item);
+   } else {
+      blob_finish(&item.blob);
+   }
+   cnd_signal(&cache->db_batch.cond);
+
+   if (cache->db_batch.writing) {
+      mtx_unlock(&cache->db_batch.lock);
+      return success;
+   }
+
+   cache->db_batch.writing = true;
+
+   while (util_dynarray_num_elements(&cache->db_batch.items,
+                                     struct db_batch_item)) {
+      int64_t deadline = os_time_get_nano() + DB_BATCH_WINDOW_NS;
+      int64_t now;
+
+      while (db_batch_should_wait(cache) &&
+             (now = os_time_get_nano()) < deadline) {
+         struct timespec ts;
+
+         timespec_get(&ts, TIME_UTC);
+         ts.tv_nsec += deadline - now;
+         if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+         }
+         cnd_timedwait(&cache->db_batch.cond, &cache->db_batch.lock, &ts);
+      }
+
+      struct db_batch_item batch[DB_BATCH_MAX_ITEMS];
+      unsigned num_left =
+         util_dynarray_num_elements(&cache->db_batch.items,
+                                    struct db_batch_item);
+      unsigned num_items = MIN2(num_left, DB_BATCH_MAX_ITEMS);
+
+      num_left -= num_items;
+      memcpy(batch, util_dynarray_element(&cache->db_batch.items,
+                                          struct db_batch_item, num_left),
+             num_items * sizeof(*batch));
+      cache->db_batch.items.size = num_left * sizeof(struct db_batch_item);
+      mtx_unlock(&cache->db_batch.lock);
+
+      db_batch_write(cache, batch, num_items);
+
+      mtx_lock(&cache->db_batch.lock);
+   }
+
+   cache->db_batch.writing = false;
+   mtx_unlock(&cache->db_batch.lock);
+
+   return success;
 }
 
 bool
 disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache)
 {
+   mtx_init(&cache->db_batch.lock, mtx_plain);
+   cnd_init(&cache->db_batch.cond);
+   util_dynarray_init(&cache->db_batch.items, NULL);
+
    return mesa_cache_db_multipart_open(&cache->cache_db, cache->path);
 }
+
+void
+disk_cache_db_close(struct disk_cache *cache)
+{
+   assert(!util_dynarray_num_elements(&cache->db_batch.items,
+                                      struct db_batch_item));
+
+   mesa_cache_db_multipart_close(&cache->cache_db);
+
+   util_dynarray_fini(&cache->db_batch.items);
+   cnd_destroy(&cache->db_batch.cond);
+   mtx_destroy(&cache->db_batch.lock);
+}
 #endif
 
 #endif /* ENABLE_SHADER_CACHE */
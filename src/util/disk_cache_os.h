@@ -35,6 +35,7 @@
 #include "util/fossilize_db.h"
 #include "util/mesa_cache_db.h"
 #include "util/mesa_cache_db_multipart.h"
+#include "util/u_dynarray.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -100,8 +101,21 @@ struct disk_cache {
       bool enabled;
       unsigned hits;
       unsigned misses;
+      unsigned db_batches;
+      unsigned db_batched_items;
    } stats;
 
+   /* Items waiting to be written to the database in one batch, see
+    * disk_cache_db_write_item_to_disk().
+    */
+   struct {
+      mtx_t lock;
+      cnd_t cond;
+      struct util_dynarray items;
+      unsigned num_queued_puts; /* put jobs that haven't been cleaned up yet */
+      bool writing;
+   } db_batch;
+
    /* Internal RO FOZ cache for combined use of RO and RW caches. */
    struct disk_cache *foz_ro_cache;
 };
@@ -125,6 +139,9 @@ struct disk_cache_put_job {
    size_t size;
 
    struct cache_item_metadata cache_item_metadata;
+
+   /* Counted in db_batch.num_queued_puts until the job is cleaned up. */
+   bool db_put_queued;
 };
 
 char *
@@ -175,12 +192,21 @@ void *
 disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
                         size_t *size);
 
+void
+disk_cache_db_put_queued(struct disk_cache_put_job *dc_job);
+
+void
+disk_cache_db_put_done(struct disk_cache_put_job *dc_job);
+
 bool
 disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job);
 
 bool
 disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache);
 
+void
+disk_cache_db_close(struct disk_cache *cache);
+
 #ifdef __cplusplus
 }
 #endif
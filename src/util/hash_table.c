@@ -45,6 +45,8 @@
 #include <assert.h>
 
 #include "hash_table.h"
+#include "bitscan.h"
+#include "detect_arch.h"
 #include "ralloc.h"
 #include "macros.h"
 #include "u_memory.h"
@@ -54,6 +56,12 @@
 #define XXH_INLINE_ALL
 #include "xxhash.h"
 
+#if DETECT_ARCH_SSE
+#include <emmintrin.h>
+#elif DETECT_ARCH_AARCH64
+#include <arm_neon.h>
+#endif
+
 /**
  * Magic number that gets stored outside of the struct hash_table.
  *
@@ -145,6 +153,296 @@ entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
    return entry->key != NULL && entry->key != ht->deleted_key;
 }
 
+/*
+ * The SIMD-probed layout.
+ *
+ * The size of the table is a power of two, divided in groups of
+ * SWISS_GROUP_SIZE entries.  Each entry has a control byte, which is either
+ * SWISS_EMPTY, SWISS_DELETED or the low 7 bits of the hash of its key.  A
+ * lookup compares the control bytes of a whole group with those 7 bits at
+ * once, and only compares the keys of the entries which match.  Groups are
+ * probed quadratically, until one with an empty entry is found.
+ *
+ * Entries are still struct hash_entry, with deleted entries holding
+ * deleted_key, so that iterating works the same on both layouts.
+ */
+#define SWISS_GROUP_SIZE 16
+#define SWISS_EMPTY      0x80
+#define SWISS_DELETED    0xfe
+
+/* 16 << 27 entries is the largest power of two under 2^32. */
+#define SWISS_MAX_SIZE_INDEX 27
+
+#if DETECT_ARCH_SSE
+
+static inline unsigned
+swiss_match(const uint8_t *ctrl, uint8_t value)
+{
+   __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+}
+
+/* Empty and deleted entries are the only ones with the top bit set. */
+static inline unsigned
+swiss_match_available(const uint8_t *ctrl)
+{
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#elif DETECT_ARCH_AARCH64
+
+static inline unsigned
+swiss_movemask(uint8x16_t mask)
+{
+   static const uint8_t bits[16] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+   };
+
+   mask = vandq_u8(mask, vld1q_u8(bits));
+   return vaddv_u8(vget_low_u8(mask)) | (vaddv_u8(vget_high_u8(mask)) << 8);
+}
+
+static inline unsigned
+swiss_match(const uint8_t *ctrl, uint8_t value)
+{
+   return swiss_movemask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value)));
+}
+
+static inline unsigned
+swiss_match_available(const uint8_t *ctrl)
+{
+   return swiss_movemask(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl))));
+}
+
+#else
+
+static inline unsigned
+swiss_match(const uint8_t *ctrl, uint8_t value)
+{
+   unsigned mask = 0;
+
+   for (unsigned i = 0; i < SWISS_GROUP_SIZE; i++)
+      mask |= (unsigned)(ctrl[i] == value) << i;
+
+   return mask;
+}
+
+static inline unsigned
+swiss_match_available(const uint8_t *ctrl)
+{
+   unsigned mask = 0;
+
+   for (unsigned i = 0; i < SWISS_GROUP_SIZE; i++)
+      mask |= (unsigned)(ctrl[i] >> 7) << i;
+
+   return mask;
+}
+
+#endif
+
+static inline uint8_t
+swiss_h2(uint32_t hash)
+{
+   return hash & 0x7f;
+}
+
+/* The first group to probe.  The hash is scrambled first, as the pointer
+ * hash for instance has few significant bits.
+ */
+static inline uint32_t
+swiss_first_group(const struct hash_table *ht, uint32_t hash)
+{
+   uint32_t num_groups = ht->size / SWISS_GROUP_SIZE;
+   return ((uint64_t)(hash * 0x9e3779b9u) * num_groups) >> 32;
+}
+
+static bool
+swiss_alloc(struct hash_table *ht, void *mem_ctx, unsigned size_index)
+{
+   uint32_t size = SWISS_GROUP_SIZE << size_index;
+   struct hash_entry *table = rzalloc_array(mem_ctx, struct hash_entry, size);
+   uint8_t *ctrl = ralloc_array(mem_ctx, uint8_t, size);
+
+   if (table == NULL || ctrl == NULL) {
+      ralloc_free(table);
+      ralloc_free(ctrl);
+      return false;
+   }
+
+   memset(ctrl, SWISS_EMPTY, size);
+
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->size_index = size_index;
+   ht->size = size;
+   ht->rehash = 0;
+   ht->size_magic = 0;
+   ht->rehash_magic = 0;
+   /* Keep at least one empty entry per 8, so that probing stays short. */
+   ht->max_entries = size - size / 8;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+
+   return true;
+}
+
+static struct hash_entry *
+swiss_search(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   const uint32_t group_mask = ht->size / SWISS_GROUP_SIZE - 1;
+   const uint8_t h2 = swiss_h2(hash);
+   uint32_t group = swiss_first_group(ht, hash);
+
+   for (uint32_t i = 1; i <= group_mask + 1; i++) {
+      const uint32_t base = group * SWISS_GROUP_SIZE;
+      const uint8_t *ctrl = ht->ctrl + base;
+      unsigned match = swiss_match(ctrl, h2);
+
+      while (match) {
+         struct hash_entry *entry = ht->table + base + u_bit_scan(&match);
+
+         /* hash_table_foreach_remove() clears keys behind our back. */
+         if (entry->hash == hash && entry->key != NULL &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (swiss_match(ctrl, SWISS_EMPTY))
+         return NULL;
+
+      group = (group + i) & group_mask;
+   }
+
+   return NULL;
+}
+
+static void
+swiss_insert_rehash(struct hash_table *ht, uint32_t hash,
+                    const void *key, void *data)
+{
+   const uint32_t group_mask = ht->size / SWISS_GROUP_SIZE - 1;
+   uint32_t group = swiss_first_group(ht, hash);
+
+   for (uint32_t i = 1; ; i++) {
+      const uint32_t base = group * SWISS_GROUP_SIZE;
+      unsigned available = swiss_match_available(ht->ctrl + base);
+
+      if (likely(available)) {
+         const uint32_t slot = base + ffs(available) - 1;
+         struct hash_entry *entry = ht->table + slot;
+
+         ht->ctrl[slot] = swiss_h2(hash);
+         entry->hash = hash;
+         entry->key = key;
+         entry->data = data;
+         return;
+      }
+
+      group = (group + i) & group_mask;
+   }
+}
+
+static void
+swiss_rehash(struct hash_table *ht, unsigned new_size_index)
+{
+   struct hash_table old_ht;
+
+   if (new_size_index > SWISS_MAX_SIZE_INDEX)
+      return;
+
+   old_ht = *ht;
+
+   if (!swiss_alloc(ht, ralloc_parent(old_ht.table), new_size_index)) {
+      *ht = old_ht;
+      return;
+   }
+
+   hash_table_foreach(&old_ht, entry) {
+      swiss_insert_rehash(ht, entry->hash, entry->key, entry->data);
+   }
+
+   ht->entries = old_ht.entries;
+
+   ralloc_free(old_ht.table);
+   ralloc_free(old_ht.ctrl);
+}
+
+static struct hash_entry *
+swiss_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   const uint32_t group_mask = ht->size / SWISS_GROUP_SIZE - 1;
+   const uint8_t h2 = swiss_h2(hash);
+   uint32_t group = swiss_first_group(ht, hash);
+   uint32_t available_slot = UINT32_MAX;
+
+   for (uint32_t i = 1; i <= group_mask + 1; i++) {
+      const uint32_t base = group * SWISS_GROUP_SIZE;
+      const uint8_t *ctrl = ht->ctrl + base;
+      unsigned match = swiss_match(ctrl, h2);
+
+      /* Replace the entry of a matching key, like hash_table_get_entry(). */
+      while (match) {
+         struct hash_entry *entry = ht->table + base + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry->key != NULL &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      /* Stash the first available entry we find */
+      if (available_slot == UINT32_MAX) {
+         unsigned available = swiss_match_available(ctrl);
+         if (available)
+            available_slot = base + ffs(available) - 1;
+      }
+
+      if (swiss_match(ctrl, SWISS_EMPTY))
+         break;
+
+      group = (group + i) & group_mask;
+   }
+
+   if (available_slot == UINT32_MAX) {
+      /* Every entry is taken, which can only happen when
+       * hash_table_foreach_remove() left cleared keys in the table.  A
+       * rehash drops them.
+       */
+      const struct hash_entry *old_table = ht->table;
+      swiss_rehash(ht, ht->size_index);
+      if (ht->table == old_table)
+         return NULL;
+      return swiss_get_entry(ht, hash, key);
+   }
+
+   if (ht->ctrl[available_slot] == SWISS_DELETED)
+      ht->deleted_entries--;
+   ht->ctrl[available_slot] = h2;
+   ht->table[available_slot].hash = hash;
+   ht->entries++;
+   return ht->table + available_slot;
+}
+
+static void
+swiss_remove(struct hash_table *ht, struct hash_entry *entry)
+{
+   const uint32_t slot = entry - ht->table;
+   const uint32_t base = slot & ~(SWISS_GROUP_SIZE - 1);
+
+   /* If the group still has an empty entry, no lookup ever went past it,
+    * so the entry can be made empty again instead of leaving a tombstone.
+    */
+   if (swiss_match(ht->ctrl + base, SWISS_EMPTY)) {
+      ht->ctrl[slot] = SWISS_EMPTY;
+      entry->key = NULL;
+   } else {
+      ht->ctrl[slot] = SWISS_DELETED;
+      entry->key = ht->deleted_key;
+      ht->deleted_entries++;
+   }
+
+   ht->entries--;
+}
+
 bool
 _mesa_hash_table_init(struct hash_table *ht,
                       void *mem_ctx,
@@ -161,6 +459,7 @@ _mesa_hash_table_init(struct hash_table *ht,
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
    ht->table = rzalloc_array(mem_ctx, struct hash_entry, ht->size);
+   ht->ctrl = NULL;
    ht->entries = 0;
    ht->deleted_entries = 0;
    ht->deleted_key = &deleted_key_value;
@@ -168,6 +467,20 @@ _mesa_hash_table_init(struct hash_table *ht,
    return ht->table != NULL;
 }
 
+bool
+_mesa_hash_table_init_swiss(struct hash_table *ht,
+                            void *mem_ctx,
+                            uint32_t (*key_hash_function)(const void *key),
+                            bool (*key_equals_function)(const void *a,
+                                                        const void *b))
+{
+   ht->key_hash_function = key_hash_function;
+   ht->key_equals_function = key_equals_function;
+   ht->deleted_key = &deleted_key_value;
+
+   return swiss_alloc(ht, mem_ctx, 0);
+}
+
 struct hash_table *
 _mesa_hash_table_create(void *mem_ctx,
                         uint32_t (*key_hash_function)(const void *key),
@@ -191,6 +504,27 @@ _mesa_hash_table_create(void *mem_ctx,
    return ht;
 }
 
+struct hash_table *
+_mesa_hash_table_create_swiss(void *mem_ctx,
+                              uint32_t (*key_hash_function)(const void *key),
+                              bool (*key_equals_function)(const void *a,
+                                                          const void *b))
+{
+   struct hash_table *ht;
+
+   ht = ralloc(mem_ctx, struct hash_table);
+   if (ht == NULL)
+      return NULL;
+
+   if (!_mesa_hash_table_init_swiss(ht, ht, key_hash_function,
+                                    key_equals_function)) {
+      ralloc_free(ht);
+      return NULL;
+   }
+
+   return ht;
+}
+
 static uint32_t
 key_u32_hash(const void *key)
 {
@@ -230,6 +564,16 @@ _mesa_hash_table_clone(struct hash_table *src, void *dst_mem_ctx)
 
    memcpy(ht->table, src->table, ht->size * sizeof(struct hash_entry));
 
+   if (src->ctrl) {
+      ht->ctrl = ralloc_array(ht, uint8_t, ht->size);
+      if (ht->ctrl == NULL) {
+         ralloc_free(ht);
+         return NULL;
+      }
+
+      memcpy(ht->ctrl, src->ctrl, ht->size);
+   }
+
    return ht;
 }
 
@@ -257,7 +601,9 @@ _mesa_hash_table_destroy(struct hash_table *ht,
 static void
 hash_table_clear_fast(struct hash_table *ht)
 {
-   memset(ht->table, 0, sizeof(struct hash_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct hash_entry) * ht->size);
+   if (ht->ctrl)
+      memset(ht->ctrl, SWISS_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -283,6 +629,8 @@ _mesa_hash_table_clear(struct hash_table *ht,
 
          entry->key = NULL;
       }
+      if (ht->ctrl)
+         memset(ht->ctrl, SWISS_EMPTY, ht->size);
       ht->entries = 0;
       ht->deleted_entries = 0;
    } else
@@ -310,6 +658,9 @@ hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(ht, key));
 
+   if (ht->ctrl)
+      return swiss_search(ht, hash, key);
+
    uint32_t size = ht->size;
    uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
    uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
@@ -397,6 +748,11 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
       return;
    }
 
+   if (ht->ctrl) {
+      swiss_rehash(ht, new_size_index);
+      return;
+   }
+
    if (new_size_index >= ARRAY_SIZE(hash_sizes))
       return;
 
@@ -439,6 +795,9 @@ hash_table_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
       _mesa_hash_table_rehash(ht, ht->size_index);
    }
 
+   if (ht->ctrl)
+      return swiss_get_entry(ht, hash, key);
+
    uint32_t size = ht->size;
    uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
    uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
@@ -538,6 +897,11 @@ _mesa_hash_table_remove(struct hash_table *ht,
    if (!entry)
       return;
 
+   if (ht->ctrl) {
+      swiss_remove(ht, entry);
+      return;
+   }
+
    entry->key = ht->deleted_key;
    ht->entries--;
    ht->deleted_entries++;
@@ -735,12 +1099,29 @@ _mesa_pointer_hash_table_create(void *mem_ctx)
                                   _mesa_key_pointer_equal);
 }
 
+struct hash_table *
+_mesa_pointer_hash_table_create_swiss(void *mem_ctx)
+{
+   return _mesa_hash_table_create_swiss(mem_ctx, _mesa_hash_pointer,
+                                        _mesa_key_pointer_equal);
+}
+
 
 bool
 _mesa_hash_table_reserve(struct hash_table *ht, unsigned size)
 {
    if (size < ht->max_entries)
       return true;
+   if (ht->ctrl) {
+      for (unsigned i = ht->size_index + 1; i <= SWISS_MAX_SIZE_INDEX; i++) {
+         uint32_t entries = SWISS_GROUP_SIZE << i;
+         if (entries - entries / 8 >= size) {
+            swiss_rehash(ht, i);
+            break;
+         }
+      }
+      return ht->max_entries >= size;
+   }
    for (unsigned i = ht->size_index + 1; i < ARRAY_SIZE(hash_sizes); i++) {
       if (hash_sizes[i].max_entries >= size) {
          _mesa_hash_table_rehash(ht, i);
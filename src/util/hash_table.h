@@ -45,6 +45,10 @@ struct hash_entry {
 
 struct hash_table {
    struct hash_entry *table;
+   /* Control bytes of tables using the SIMD-probed layout, NULL for tables
+    * using double hashing.
+    */
+   uint8_t *ctrl;
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
@@ -71,6 +75,24 @@ _mesa_hash_table_init(struct hash_table *ht,
                       bool (*key_equals_function)(const void *a,
                                                   const void *b));
 
+/* Variants using a Swiss table layout: entries are found by comparing a
+ * group of 16 control bytes at once, in a power of two sized table.  This
+ * has fewer cache misses than the default double hashing on large tables.
+ * The rest of the API works the same on both kinds of tables.
+ */
+struct hash_table *
+_mesa_hash_table_create_swiss(void *mem_ctx,
+                              uint32_t (*key_hash_function)(const void *key),
+                              bool (*key_equals_function)(const void *a,
+                                                          const void *b));
+
+bool
+_mesa_hash_table_init_swiss(struct hash_table *ht,
+                            void *mem_ctx,
+                            uint32_t (*key_hash_function)(const void *key),
+                            bool (*key_equals_function)(const void *a,
+                                                        const void *b));
+
 struct hash_table *
 _mesa_hash_table_create_u32_keys(void *mem_ctx);
 
@@ -130,6 +152,9 @@ bool _mesa_key_pointer_equal(const void *a, const void *b);
 struct hash_table *
 _mesa_pointer_hash_table_create(void *mem_ctx);
 
+struct hash_table *
+_mesa_pointer_hash_table_create_swiss(void *mem_ctx);
+
 bool
 _mesa_hash_table_reserve(struct hash_table *ht, unsigned size);
 /**
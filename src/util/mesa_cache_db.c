@@ -755,9 +755,9 @@ fail:
 }
 
 static bool
-mesa_cache_db_has_space_locked(struct mesa_cache_db *db, size_t blob_size)
+mesa_cache_db_has_space_locked(struct mesa_cache_db *db, size_t file_size)
 {
-   return ftell(db->cache.file) + blob_file_size(blob_size) -
+   return ftell(db->cache.file) + file_size -
           sizeof(struct mesa_db_file_header) <= db->max_cache_size;
 }
 
@@ -767,18 +767,51 @@ mesa_cache_db_eviction_size(struct mesa_cache_db *db)
    return db->max_cache_size / 2 - sizeof(struct mesa_db_file_header);
 }
 
-bool
-mesa_cache_db_entry_write(struct mesa_cache_db *db,
-                          const uint8_t *cache_key_160bit,
-                          const void *blob, size_t blob_size)
+struct mesa_db_pending_write {
+   const struct mesa_cache_db_write_entry *entry;
+   struct mesa_index_db_hash_entry *hash_entry;
+   uint64_t hash;
+};
+
+static bool
+mesa_db_batch_has_hash(struct mesa_db_pending_write *writes,
+                       unsigned num_writes, uint64_t hash)
+{
+   for (unsigned i = 0; i < num_writes; i++) {
+      if (writes[i].hash == hash)
+         return true;
+   }
+   return false;
+}
+
+/* Append all the entries with a single lock and index update. Entries that
+ * are already in the database are skipped.
+ *
+ * Returns the number of written entries.
+ */
+unsigned
+mesa_cache_db_entries_write(struct mesa_cache_db *db,
+                            const struct mesa_cache_db_write_entry *entries,
+                            unsigned num_entries)
 {
-   uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
-   struct mesa_index_db_hash_entry *hash_entry = NULL;
    struct mesa_cache_db_file_entry cache_entry;
    struct mesa_index_db_file_entry index_entry;
+   struct mesa_db_pending_write *writes;
+   uint64_t cache_offset, index_offset, access_time;
+   unsigned num_writes = 0, i;
+   size_t batch_size = 0;
 
-   if (!mesa_db_lock(db))
-      return false;
+   for (i = 0; i < num_entries; i++)
+      batch_size += blob_file_size(entries[i].blob_size);
+
+   writes = calloc(num_entries, sizeof(*writes));
+   if (!writes)
+      return 0;
+
+   if (!mesa_db_lock(db)) {
+      free(writes);
+      return 0;
+   }
 
    if (!db->alive)
       goto fail;
@@ -789,8 +822,8 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    if (!mesa_db_seek_end(db->cache.file))
       goto fail_fatal;
 
-   if (!mesa_cache_db_has_space_locked(db, blob_size)) {
-      if (!mesa_db_compact(db, MAX2(blob_size, mesa_cache_db_eviction_size(db)),
+   if (!mesa_cache_db_has_space_locked(db, batch_size)) {
+      if (!mesa_db_compact(db, MAX2(batch_size, mesa_cache_db_eviction_size(db)),
                            NULL))
          goto fail_fatal;
    } else {
@@ -798,59 +831,100 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
          goto fail_fatal;
    }
 
-   hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
-   if (hash_entry) {
-      hash_entry = NULL;
-      goto fail;
-   }
-
    if (!mesa_db_seek_end(db->cache.file) ||
        !mesa_db_seek_end(db->index.file))
       goto fail_fatal;
 
-   memcpy(cache_entry.key, cache_key_160bit, sizeof(cache_entry.key));
-   cache_entry.crc = util_hash_crc32(blob, blob_size);
-   cache_entry.size = blob_size;
+   cache_offset = ftell(db->cache.file);
+   index_offset = ftell(db->index.file);
+   access_time = os_time_get_nano();
 
-   index_entry.hash = hash;
-   index_entry.size = blob_size;
-   index_entry.last_access_time = os_time_get_nano();
-   index_entry.cache_db_file_offset = ftell(db->cache.file);
+   for (i = 0; i < num_entries; i++) {
+      uint64_t hash = to_mesa_cache_db_hash(entries[i].cache_key_160bit);
+      struct mesa_index_db_hash_entry *hash_entry;
 
-   hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
-   if (!hash_entry)
-      goto fail;
+      if (_mesa_hash_table_u64_search(db->index_db, hash) ||
+          mesa_db_batch_has_hash(writes, num_writes, hash))
+         continue;
 
-   hash_entry->cache_db_file_offset = index_entry.cache_db_file_offset;
-   hash_entry->index_db_file_offset = ftell(db->index.file);
-   hash_entry->last_access_time = index_entry.last_access_time;
-   hash_entry->size = index_entry.size;
+      hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
+      if (!hash_entry)
+         goto fail;
 
-   if (!mesa_db_write(db->cache.file, &cache_entry) ||
-       !mesa_db_write_data(db->cache.file, blob, blob_size) ||
-       !mesa_db_write(db->index.file, &index_entry))
-      goto fail_fatal;
+      hash_entry->cache_db_file_offset = cache_offset;
+      hash_entry->index_db_file_offset = index_offset;
+      hash_entry->last_access_time = access_time;
+      hash_entry->size = entries[i].blob_size;
+
+      writes[num_writes].entry = &entries[i];
+      writes[num_writes].hash_entry = hash_entry;
+      writes[num_writes].hash = hash;
+      num_writes++;
+
+      cache_offset += blob_file_size(entries[i].blob_size);
+      index_offset += sizeof(index_entry);
+   }
+
+   for (i = 0; i < num_writes; i++) {
+      const struct mesa_cache_db_write_entry *entry = writes[i].entry;
+
+      memcpy(cache_entry.key, entry->cache_key_160bit, sizeof(cache_entry.key));
+      cache_entry.crc = util_hash_crc32(entry->blob, entry->blob_size);
+      cache_entry.size = entry->blob_size;
+
+      if (!mesa_db_write(db->cache.file, &cache_entry) ||
+          !mesa_db_write_data(db->cache.file, entry->blob, entry->blob_size))
+         goto fail_fatal;
+   }
+
+   for (i = 0; i < num_writes; i++) {
+      index_entry.hash = writes[i].hash;
+      index_entry.size = writes[i].hash_entry->size;
+      index_entry.last_access_time = access_time;
+      index_entry.cache_db_file_offset = writes[i].hash_entry->cache_db_file_offset;
+
+      if (!mesa_db_write(db->index.file, &index_entry))
+         goto fail_fatal;
+   }
 
    fflush(db->cache.file);
    fflush(db->index.file);
 
    db->index.offset = ftell(db->index.file);
 
-   _mesa_hash_table_u64_insert(db->index_db, hash, hash_entry);
+   for (i = 0; i < num_writes; i++)
+      _mesa_hash_table_u64_insert(db->index_db, writes[i].hash,
+                                  writes[i].hash_entry);
 
    mesa_db_unlock(db);
+   free(writes);
 
-   return true;
+   return num_writes;
 
 fail_fatal:
    mesa_db_zap(db);
 fail:
    mesa_db_unlock(db);
 
-   if (hash_entry)
-      ralloc_free(hash_entry);
+   for (i = 0; i < num_writes; i++)
+      ralloc_free(writes[i].hash_entry);
+   free(writes);
 
-   return false;
+   return 0;
+}
+
+bool
+mesa_cache_db_entry_write(struct mesa_cache_db *db,
+                          const uint8_t *cache_key_160bit,
+                          const void *blob, size_t blob_size)
+{
+   const struct mesa_cache_db_write_entry entry = {
+      .cache_key_160bit = cache_key_160bit,
+      .blob = blob,
+      .blob_size = blob_size,
+   };
+
+   return mesa_cache_db_entries_write(db, &entry, 1) == 1;
 }
 
 bool
@@ -911,7 +985,7 @@ mesa_cache_db_has_space(struct mesa_cache_db *db, size_t blob_size)
    if (!mesa_db_seek_end(db->cache.file))
       goto fail_fatal;
 
-   has_space = mesa_cache_db_has_space_locked(db, blob_size);
+   has_space = mesa_cache_db_has_space_locked(db, blob_file_size(blob_size));
 
    mesa_db_unlock(db);
 
@@ -39,6 +39,12 @@ struct mesa_cache_db {
    bool alive;
 };
 
+struct mesa_cache_db_write_entry {
+   const uint8_t *cache_key_160bit;
+   const void *blob;
+   size_t blob_size;
+};
+
 #if DETECT_OS_WINDOWS == 0
 bool
 mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path);
@@ -63,6 +69,11 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
                           const void *blob, size_t blob_size);
 
+unsigned
+mesa_cache_db_entries_write(struct mesa_cache_db *db,
+                            const struct mesa_cache_db_write_entry *entries,
+                            unsigned num_entries);
+
 bool
 mesa_cache_db_entry_remove(struct mesa_cache_db *db,
                            const uint8_t *cache_key_160bit);
@@ -115,6 +126,14 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    return false;
 }
 
+static inline unsigned
+mesa_cache_db_entries_write(struct mesa_cache_db *db,
+                            const struct mesa_cache_db_write_entry *entries,
+                            unsigned num_entries)
+{
+   return 0;
+}
+
 static inline bool
 mesa_cache_db_entry_remove(struct mesa_cache_db *db,
                            const uint8_t *cache_key_160bit)
@@ -120,19 +120,31 @@ mesa_cache_db_multipart_select_victim_part(struct mesa_cache_db_multipart *db)
    return victim;
 }
 
-bool
-mesa_cache_db_multipart_entry_write(struct mesa_cache_db_multipart *db,
-                                    const uint8_t *cache_key_160bit,
-                                    const void *blob, size_t blob_size)
+unsigned
+mesa_cache_db_multipart_entries_write(struct mesa_cache_db_multipart *db,
+                                      const struct mesa_cache_db_write_entry *entries,
+                                      unsigned num_entries)
 {
    unsigned last_written_part = db->last_written_part;
+   size_t batch_size = 0;
    int wpart = -1;
 
+   if (!num_entries)
+      return 0;
+
+   /* The whole batch goes into one part, with a single lock and index
+    * update. Size it as one blob, so that it can be passed to
+    * mesa_cache_db_has_space().
+    */
+   for (unsigned int i = 0; i < num_entries; i++)
+      batch_size += entries[i].blob_size;
+   batch_size += (num_entries - 1) * mesa_cache_db_file_entry_size();
+
    for (unsigned int i = 0; i < db->num_parts; i++) {
       unsigned int part = (last_written_part + i) % db->num_parts;
 
       /* Note that each DB part has own locking. */
-      if (mesa_cache_db_has_space(&db->parts[part], blob_size)) {
+      if (mesa_cache_db_has_space(&db->parts[part], batch_size)) {
          wpart = part;
          break;
       }
@@ -147,8 +159,21 @@ mesa_cache_db_multipart_entry_write(struct mesa_cache_db_multipart *db,
 
    db->last_written_part = wpart;
 
-   return mesa_cache_db_entry_write(&db->parts[wpart], cache_key_160bit,
-                                    blob, blob_size);
+   return mesa_cache_db_entries_write(&db->parts[wpart], entries, num_entries);
+}
+
+bool
+mesa_cache_db_multipart_entry_write(struct mesa_cache_db_multipart *db,
+                                    const uint8_t *cache_key_160bit,
+                                    const void *blob, size_t blob_size)
+{
+   const struct mesa_cache_db_write_entry entry = {
+      .cache_key_160bit = cache_key_160bit,
+      .blob = blob,
+      .blob_size = blob_size,
+   };
+
+   return mesa_cache_db_multipart_entries_write(db, &entry, 1) == 1;
 }
 
 void
@@ -37,6 +37,11 @@ mesa_cache_db_multipart_entry_write(struct mesa_cache_db_multipart *db,
                                     const uint8_t *cache_key_160bit,
                                     const void *blob, size_t blob_size);
 
+unsigned
+mesa_cache_db_multipart_entries_write(struct mesa_cache_db_multipart *db,
+                                      const struct mesa_cache_db_write_entry *entries,
+                                      unsigned num_entries);
+
 void
 mesa_cache_db_multipart_entry_remove(struct mesa_cache_db_multipart *db,
                                      const uint8_t *cache_key_160bit);
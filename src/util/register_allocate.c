@@ -74,6 +74,7 @@
 #include <stdlib.h>
 
 #include "blob.h"
+#include "hash_table.h"
 #include "ralloc.h"
 #include "util/bitset.h"
 #include "util/u_dynarray.h"
@@ -491,23 +492,57 @@ static bool
 ra_test_adjacency_bit(struct ra_graph *g, unsigned n1, unsigned n2)
 {
    uint64_t index = ra_get_adjacency_bit_index(n1, n2);
+   if (g->adjacency_set)
+      return _mesa_hash_table_u64_search(g->adjacency_set, index) != NULL;
+
    return BITSET_TEST(g->adjacency, index);
 }
 
 static void
 ra_set_adjacency_bit(struct ra_graph *g, unsigned n1, unsigned n2)
 {
-   unsigned index = ra_get_adjacency_bit_index(n1, n2);
+   uint64_t index = ra_get_adjacency_bit_index(n1, n2);
+   if (g->adjacency_set) {
+      /* The set only needs a non-NULL value to tell present keys apart. */
+      _mesa_hash_table_u64_insert(g->adjacency_set, index, g);
+      return;
+   }
+
    BITSET_SET(g->adjacency, index);
 }
 
 static void
 ra_clear_adjacency_bit(struct ra_graph *g, unsigned n1, unsigned n2)
 {
-   unsigned index = ra_get_adjacency_bit_index(n1, n2);
+   uint64_t index = ra_get_adjacency_bit_index(n1, n2);
+   if (g->adjacency_set) {
+      _mesa_hash_table_u64_remove(g->adjacency_set, index);
+      return;
+   }
+
    BITSET_CLEAR(g->adjacency, index);
 }
 
+/**
+ * Moves the adjacency of the first \p count nodes from the bit matrix to an
+ * edge set, which is rebuilt from the adjacency lists.
+ */
+static void
+ra_make_adjacency_sparse(struct ra_graph *g, unsigned int count)
+{
+   g->adjacency_set = _mesa_hash_table_u64_create(g);
+
+   for (unsigned n1 = 0; n1 < count; n1++) {
+      util_dynarray_foreach(&g->nodes[n1].adjacency_list, unsigned int, n2p) {
+         if (*n2p < n1)
+            ra_set_adjacency_bit(g, n1, *n2p);
+      }
+   }
+
+   ralloc_free(g->adjacency);
+   g->adjacency = NULL;
+}
+
 static void
 ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
@@ -546,9 +581,19 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
    assert(g->alloc % BITSET_WORDBITS == 0);
    alloc = align(alloc, BITSET_WORDBITS);
    g->nodes = rerzalloc(g, g->nodes, struct ra_node, g->alloc, alloc);
-   g->adjacency = rerzalloc(g, g->adjacency, BITSET_WORD,
-                            BITSET_WORDS(ra_get_num_adjacency_bits(g->alloc)),
-                            BITSET_WORDS(ra_get_num_adjacency_bits(alloc)));
+
+   /* Once the graph is large enough, stop growing the bit matrix.  The
+    * edge set doesn't depend on the number of nodes, so nodes added after
+    * spilling don't have to copy the whole adjacency around any more.
+    */
+   if (alloc >= RA_SPARSE_ADJACENCY_MIN_NODES) {
+      if (!g->adjacency_set)
+         ra_make_adjacency_sparse(g, g->alloc);
+   } else {
+      g->adjacency = rerzalloc(g, g->adjacency, BITSET_WORD,
+                               BITSET_WORDS(ra_get_num_adjacency_bits(g->alloc)),
+                               BITSET_WORDS(ra_get_num_adjacency_bits(alloc)));
+   }
 
    /* Initialize new nodes. */
    for (unsigned i = g->alloc; i < alloc; i++) {
@@ -38,6 +38,15 @@ extern "C" {
 #define class klass
 #endif
 
+struct hash_table_u64;
+
+/**
+ * Graphs with at least this many nodes track interference in a hash table of
+ * edges instead of a triangular bit matrix, which takes O(n^2) memory and
+ * has to be reallocated every time the graph grows.
+ */
+#define RA_SPARSE_ADJACENCY_MIN_NODES 8192
+
 struct ra_reg {
    BITSET_WORD *conflicts;
    struct util_dynarray conflict_list;
@@ -130,7 +139,18 @@ struct ra_graph {
     * the variables that need register allocation.
     */
    struct ra_node *nodes;
+
+   /** @{
+    *
+    * Adjacency of each pair of nodes, indexed by ra_get_adjacency_bit_index().
+    * Small graphs use the bit matrix, graphs of at least
+    * RA_SPARSE_ADJACENCY_MIN_NODES nodes use the edge set, and only one of
+    * them is non-NULL.
+    */
    BITSET_WORD *adjacency;
+   struct hash_table_u64 *adjacency_set;
+   /** @} */
+
    unsigned int count; /**< count of nodes. */
 
    unsigned int alloc; /**< count of nodes allocated. */
@@ -547,6 +547,56 @@ test_put_and_get_between_instances(const char *driver_id)
    disk_cache_destroy(cache2);
 }
 
+static void
+test_put_many_and_get(const char *driver_id)
+{
+   const unsigned num_items = 500;
+   uint8_t key[20];
+   char blob[32];
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_SHADER_CACHE_MAX_SIZE", "1M", 1);
+
+   struct disk_cache *cache = disk_cache_create("test_put_many", driver_id, 0);
+
+   /* Count the database writes, without printing the stats on destroy. */
+   cache->stats.enabled = true;
+
+   /* A burst of puts, the database backend writes them in batches. */
+   for (unsigned i = 0; i < num_items; i++) {
+      memset(blob, 0, sizeof(blob));
+      snprintf(blob, sizeof(blob), "item %u", i);
+      disk_cache_compute_key(cache, blob, sizeof(blob), key);
+      disk_cache_put(cache, key, blob, sizeof(blob), NULL);
+   }
+
+   /* disk_cache_put() hands things off to a thread so wait for it. */
+   disk_cache_wait_for_idle(cache);
+
+   cache->stats.enabled = false;
+   EXPECT_EQ(cache->stats.db_batched_items, num_items);
+   EXPECT_GT(cache->stats.db_batches, 0u);
+   EXPECT_LT(cache->stats.db_batches, num_items / 2)
+      << "puts were not batched into fewer database writes";
+
+   for (unsigned i = 0; i < num_items; i++) {
+      memset(blob, 0, sizeof(blob));
+      snprintf(blob, sizeof(blob), "item %u", i);
+      disk_cache_compute_key(cache, blob, sizeof(blob), key);
+      result = (char *) disk_cache_get(cache, key, &size);
+      EXPECT_STREQ(result, blob) << "disk_cache_get of item " << i;
+      EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get of item " << i << " (size)";
+      free(result);
+   }
+
+   disk_cache_destroy(cache);
+}
+
 static void
 test_put_and_get_between_instances_with_eviction(const char *driver_id)
 {
@@ -793,6 +843,8 @@ TEST_F(Cache, Database)
 
    test_put_and_get_between_instances_with_eviction(driver_id);
 
+   test_put_many_and_get(driver_id);
+
    setenv("MESA_DISK_CACHE_DATABASE", "false", 1);
    unsetenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS");
 
@@ -0,0 +1,161 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Compares insert, lookup and delete times of double hashing tables and
+ * Swiss tables, for pointer and string keys and a few table sizes.
+ *
+ * Run with "meson test --benchmark hash_table_bench", or directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "util/hash_table.h"
+#include "util/os_time.h"
+
+#define ROUNDS 4
+
+typedef struct hash_table *(*create_func)(void *mem_ctx,
+                                          uint32_t (*hash)(const void *key),
+                                          bool (*equals)(const void *a,
+                                                         const void *b));
+
+struct layout {
+   const char *name;
+   create_func create;
+};
+
+static const struct layout layouts[] = {
+   { "double", _mesa_hash_table_create },
+   { "swiss", _mesa_hash_table_create_swiss },
+};
+
+static const unsigned sizes[] = { 64, 4096, 262144 };
+
+struct bench_result {
+   double insert, hit, miss, remove;
+};
+
+static void
+shuffle(const void **keys, unsigned count)
+{
+   for (unsigned i = count - 1; i > 0; i--) {
+      unsigned j = rand() % (i + 1);
+      const void *tmp = keys[i];
+      keys[i] = keys[j];
+      keys[j] = tmp;
+   }
+}
+
+static double
+ns_per_op(int64_t start, unsigned ops)
+{
+   return (double)(os_time_get_nano() - start) / ops;
+}
+
+/* keys holds count keys to insert, followed by count keys which are never
+ * inserted.
+ */
+static struct bench_result
+bench(const struct layout *layout, uint32_t (*hash)(const void *key),
+      bool (*equals)(const void *a, const void *b),
+      const void **keys, unsigned count)
+{
+   struct bench_result res = { 0 };
+   unsigned found = 0;
+   int64_t start;
+
+   for (unsigned r = 0; r < ROUNDS; r++) {
+      struct hash_table *ht = layout->create(NULL, hash, equals);
+
+      start = os_time_get_nano();
+      for (unsigned i = 0; i < count; i++)
+         _mesa_hash_table_insert(ht, keys[i], NULL);
+      res.insert += ns_per_op(start, count);
+
+      start = os_time_get_nano();
+      for (unsigned i = 0; i < count; i++)
+         found += _mesa_hash_table_search(ht, keys[i]) != NULL;
+      res.hit += ns_per_op(start, count);
+
+      start = os_time_get_nano();
+      for (unsigned i = 0; i < count; i++)
+         found += _mesa_hash_table_search(ht, keys[count + i]) != NULL;
+      res.miss += ns_per_op(start, count);
+
+      start = os_time_get_nano();
+      for (unsigned i = 0; i < count; i++)
+         _mesa_hash_table_remove_key(ht, keys[i]);
+      res.remove += ns_per_op(start, count);
+
+      _mesa_hash_table_destroy(ht, NULL);
+   }
+
+   if (found != ROUNDS * count)
+      fprintf(stderr, "%s: found %u keys, expected %u\n",
+              layout->name, found, ROUNDS * count);
+
+   res.insert /= ROUNDS;
+   res.hit /= ROUNDS;
+   res.miss /= ROUNDS;
+   res.remove /= ROUNDS;
+   return res;
+}
+
+static void
+bench_keys(const char *key_type, uint32_t (*hash)(const void *key),
+           bool (*equals)(const void *a, const void *b),
+           const void **keys, unsigned count)
+{
+   for (unsigned l = 0; l < ARRAY_SIZE(layouts); l++) {
+      struct bench_result res = bench(&layouts[l], hash, equals, keys, count);
+
+      printf("%-8s %-7s %7u %9.1f %9.1f %9.1f %9.1f\n",
+             key_type, layouts[l].name, count,
+             res.insert, res.hit, res.miss, res.remove);
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   const unsigned max_count = sizes[ARRAY_SIZE(sizes) - 1];
+   const void **keys = malloc(2 * max_count * sizeof(*keys));
+   char *pointers = malloc(2 * max_count * 16);
+   char (*strings)[24] = malloc(2 * max_count * sizeof(*strings));
+
+   (void) argc;
+   (void) argv;
+
+   printf("%-8s %-7s %7s %9s %9s %9s %9s  (ns/op)\n",
+          "keys", "layout", "entries", "insert", "hit", "miss", "delete");
+
+   for (unsigned s = 0; s < ARRAY_SIZE(sizes); s++) {
+      const unsigned count = sizes[s];
+
+      srand(s);
+
+      /* Pointers to 16 byte objects, like most keys in the compiler. */
+      for (unsigned i = 0; i < 2 * count; i++)
+         keys[i] = pointers + i * 16;
+      shuffle(keys, 2 * count);
+      bench_keys("pointer", _mesa_hash_pointer, _mesa_key_pointer_equal,
+                 keys, count);
+
+      /* Identifier-like strings. */
+      for (unsigned i = 0; i < 2 * count; i++) {
+         snprintf(strings[i], sizeof(strings[i]), "gl_var_%u_%x", i, rand());
+         keys[i] = strings[i];
+      }
+      shuffle(keys, 2 * count);
+      bench_keys("string", _mesa_hash_string, _mesa_key_string_equal,
+                 keys, count);
+   }
+
+   free(strings);
+   free(pointers);
+   free(keys);
+
+   return 0;
+}
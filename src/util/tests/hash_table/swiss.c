@@ -0,0 +1,179 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Runs the same random sequence of operations on a double hashing table and
+ * on a Swiss table, and checks that both always hold the same entries.
+ */
+
+#undef NDEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "util/hash_table.h"
+
+#define NUM_KEYS 4000
+#define NUM_OPS 200000
+
+static void *make_key(uint32_t i)
+{
+   return (void *)(uintptr_t)(16 + i * 8);
+}
+
+/* A weak hash, so that many keys share control bytes and groups. */
+static uint32_t weak_hash(const void *key)
+{
+   return ((uintptr_t)key >> 3) & 0x3ff;
+}
+
+static void
+check_same(struct hash_table *ref, struct hash_table *ht)
+{
+   unsigned count = 0;
+
+   assert(ref->entries == ht->entries);
+
+   hash_table_foreach(ht, entry) {
+      struct hash_entry *ref_entry = _mesa_hash_table_search(ref, entry->key);
+      assert(ref_entry);
+      assert(ref_entry->data == entry->data);
+      count++;
+   }
+
+   assert(count == ht->entries);
+}
+
+static void
+run_ops(uint32_t (*hash)(const void *key))
+{
+   struct hash_table *ref = _mesa_hash_table_create(NULL, hash,
+                                                    _mesa_key_pointer_equal);
+   struct hash_table *ht = _mesa_hash_table_create_swiss(NULL, hash,
+                                                         _mesa_key_pointer_equal);
+
+   srand(42);
+
+   for (unsigned n = 0; n < NUM_OPS; n++) {
+      /* Grow the key range over time, so that the table both grows and
+       * sees lots of deletions.
+       */
+      const uint32_t range = 16 + (uint64_t)n * NUM_KEYS / NUM_OPS;
+      void *key = make_key(rand() % range);
+      void *data = (void *)(uintptr_t)rand();
+      struct hash_entry *ref_entry, *entry;
+
+      switch (rand() % 4) {
+      case 0:
+      case 1:
+         _mesa_hash_table_insert(ref, key, data);
+         entry = _mesa_hash_table_insert(ht, key, data);
+         assert(entry && entry->key == key && entry->data == data);
+         break;
+      case 2:
+         _mesa_hash_table_remove_key(ref, key);
+         _mesa_hash_table_remove_key(ht, key);
+         assert(!_mesa_hash_table_search(ht, key));
+         break;
+      default:
+         ref_entry = _mesa_hash_table_search(ref, key);
+         entry = _mesa_hash_table_search(ht, key);
+         assert(!ref_entry == !entry);
+         assert(!entry || entry->data == ref_entry->data);
+         break;
+      }
+
+      assert(ref->entries == ht->entries);
+
+      if (n % 10000 == 0)
+         check_same(ref, ht);
+   }
+
+   check_same(ref, ht);
+
+   /* Clones are independent copies. */
+   struct hash_table *clone = _mesa_hash_table_clone(ht, NULL);
+   check_same(ref, clone);
+   _mesa_hash_table_clear(clone, NULL);
+   assert(_mesa_hash_table_next_entry(clone, NULL) == NULL);
+   check_same(ref, ht);
+   _mesa_hash_table_destroy(clone, NULL);
+
+   /* hash_table_foreach_remove() leaves the control bytes behind, the table
+    * must still be usable afterwards.
+    */
+   struct hash_table *fresh = _mesa_hash_table_create_swiss(NULL, hash,
+                                                            _mesa_key_pointer_equal);
+   for (uint32_t i = 0; i < NUM_KEYS; i++)
+      _mesa_hash_table_insert(fresh, make_key(i), NULL);
+   hash_table_foreach_remove(fresh, entry) {
+      assert(entry->key);
+   }
+
+   for (uint32_t i = NUM_KEYS; i < 3 * NUM_KEYS; i++) {
+      void *key = make_key(i);
+      assert(!_mesa_hash_table_search(fresh, key));
+      _mesa_hash_table_insert(fresh, key, key);
+   }
+   assert(fresh->entries == 2 * NUM_KEYS);
+   for (uint32_t i = 0; i < 3 * NUM_KEYS; i++) {
+      struct hash_entry *entry = _mesa_hash_table_search(fresh, make_key(i));
+      assert(i < NUM_KEYS ? !entry : entry && entry->data == make_key(i));
+   }
+   _mesa_hash_table_destroy(fresh, NULL);
+
+   assert(_mesa_hash_table_reserve(ht, NUM_KEYS * 4));
+   assert(ht->max_entries >= NUM_KEYS * 4);
+   check_same(ref, ht);
+
+   assert(_mesa_hash_table_random_entry(ht, NULL));
+
+   _mesa_hash_table_destroy(ref, NULL);
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+static void
+string_keys(void)
+{
+   struct hash_table *ht = _mesa_hash_table_create_swiss(NULL,
+                                                         _mesa_hash_string,
+                                                         _mesa_key_string_equal);
+   char (*keys)[16] = malloc(NUM_KEYS * sizeof(*keys));
+   char str[16];
+
+   for (uint32_t i = 0; i < NUM_KEYS; i++) {
+      snprintf(keys[i], sizeof(keys[i]), "key%u", i);
+      _mesa_hash_table_insert(ht, keys[i], keys[i]);
+   }
+
+   for (uint32_t i = 0; i < NUM_KEYS; i++) {
+      snprintf(str, sizeof(str), "key%u", i);
+      struct hash_entry *entry = _mesa_hash_table_search(ht, str);
+      assert(entry && entry->data == keys[i]);
+      if (i % 2)
+         _mesa_hash_table_remove(ht, entry);
+   }
+
+   assert(ht->entries == NUM_KEYS / 2);
+
+   for (uint32_t i = 0; i < NUM_KEYS; i++) {
+      snprintf(str, sizeof(str), "key%u", i);
+      assert(!_mesa_hash_table_search(ht, str) == (i % 2));
+   }
+
+   _mesa_hash_table_destroy(ht, NULL);
+   free(keys);
+}
+
+int
+main(int argc, char **argv)
+{
+   (void) argc;
+   (void) argv;
+
+   run_ops(_mesa_hash_pointer);
+   run_ops(weak_hash);
+   string_keys();
+
+   return 0;
+}
@@ -279,3 +279,74 @@ TEST_F(ra_test, serialization_roundtrip)
    blob_finish(&blob);
 }
 
+
+static void
+check_band_allocation(struct ra_graph *g, unsigned count)
+{
+   for (unsigned n = 0; n < count; n++) {
+      const unsigned reg = ra_get_node_reg(g, n);
+      ASSERT_NE(reg, NO_REG);
+
+      util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned int, n2p)
+         ASSERT_NE(reg, ra_get_node_reg(g, *n2p));
+   }
+}
+
+TEST_F(ra_test, sparse_adjacency)
+{
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, 4, true);
+   struct ra_class *c = ra_alloc_reg_class(regs);
+   for (unsigned i = 0; i < 4; i++)
+      ra_class_add_reg(c, i);
+   ra_set_finalize(regs, NULL);
+
+   /* Start small, with each node interfering with the two before it. */
+   struct ra_graph *g = ra_alloc_interference_graph(regs, 64);
+   for (unsigned n = 0; n < 64; n++) {
+      ra_set_node_class(g, n, c);
+      for (unsigned d = 1; d <= 2 && d <= n; d++)
+         ra_add_node_interference(g, n, n - d);
+   }
+   ASSERT_TRUE(g->adjacency);
+   ASSERT_FALSE(g->adjacency_set);
+
+   /* Grow it past the threshold the way spilling does, one node at a time. */
+   const unsigned count = RA_SPARSE_ADJACENCY_MIN_NODES + 100;
+   while (g->count < count) {
+      const unsigned n = ra_add_node(g, c);
+      for (unsigned d = 1; d <= 2; d++)
+         ra_add_node_interference(g, n, n - d);
+   }
+   ASSERT_FALSE(g->adjacency);
+   ASSERT_TRUE(g->adjacency_set);
+
+   /* Edges from before the switch are still known, so none get added twice. */
+   for (unsigned n = 2; n < count; n++) {
+      ra_add_node_interference(g, n, n - 1);
+      ra_add_node_interference(g, n - 2, n);
+   }
+   for (unsigned n = 2; n < count - 2; n++)
+      ASSERT_EQ(util_dynarray_num_elements(&g->nodes[n].adjacency_list,
+                                           unsigned int), 4);
+
+   ASSERT_TRUE(ra_allocate(g));
+   check_band_allocation(g, count);
+
+   /* Rebuild the interference of one node, like after spilling it. */
+   const unsigned n = count / 2;
+   ra_reset_node_interference(g, n);
+   ASSERT_EQ(util_dynarray_num_elements(&g->nodes[n].adjacency_list,
+                                        unsigned int), 0);
+   ASSERT_EQ(util_dynarray_num_elements(&g->nodes[n - 1].adjacency_list,
+                                        unsigned int), 3);
+
+   ra_add_node_interference(g, n, 0);
+   ra_add_node_interference(g, n, count - 1);
+   ASSERT_EQ(util_dynarray_num_elements(&g->nodes[n].adjacency_list,
+                                        unsigned int), 2);
+
+   ASSERT_TRUE(ra_allocate(g));
+   check_band_allocation(g, count);
+
+   ralloc_free(g);
+}
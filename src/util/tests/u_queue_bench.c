@@ -0,0 +1,116 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Reports the throughput of tiny jobs added from several threads at once,
+ * with and without UTIL_QUEUE_INIT_LOCKLESS.
+ *
+ * Run with "meson test --benchmark u_queue_bench", or directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define NUM_PRODUCERS 4
+#define NUM_WORKERS 4
+#define JOBS_PER_PRODUCER 100000
+#define ROUNDS 2
+
+struct producer {
+   struct util_queue *queue;
+   struct util_queue_fence *fences;
+   unsigned executed;
+};
+
+static void
+count_execute(void *data, void *gdata, int thread_index)
+{
+   p_atomic_inc((unsigned *)data);
+}
+
+static int
+producer_func(void *data)
+{
+   struct producer *p = (struct producer *)data;
+
+   for (unsigned i = 0; i < JOBS_PER_PRODUCER; i++) {
+      util_queue_fence_init(&p->fences[i]);
+      util_queue_add_job(p->queue, &p->executed, &p->fences[i],
+                         count_execute, NULL, 0);
+   }
+   return 0;
+}
+
+/* Returns the jobs executed per second, or 0 on failure. */
+static double
+run(unsigned flags)
+{
+   struct util_queue queue;
+   struct producer producers[NUM_PRODUCERS];
+   thrd_t threads[NUM_PRODUCERS];
+   bool ok = true;
+
+   if (!util_queue_init(&queue, "bench", 32, NUM_WORKERS, flags, NULL))
+      return 0;
+
+   for (unsigned i = 0; i < NUM_PRODUCERS; i++) {
+      producers[i].queue = &queue;
+      producers[i].fences = (struct util_queue_fence *)
+         calloc(JOBS_PER_PRODUCER, sizeof(struct util_queue_fence));
+      producers[i].executed = 0;
+   }
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < NUM_PRODUCERS; i++)
+      thrd_create(&threads[i], producer_func, &producers[i]);
+   for (unsigned i = 0; i < NUM_PRODUCERS; i++)
+      thrd_join(threads[i], NULL);
+   util_queue_finish(&queue);
+
+   int64_t elapsed = os_time_get_nano() - start;
+
+   for (unsigned i = 0; i < NUM_PRODUCERS; i++) {
+      ok &= producers[i].executed == JOBS_PER_PRODUCER;
+      for (unsigned j = 0; j < JOBS_PER_PRODUCER; j++)
+         util_queue_fence_destroy(&producers[i].fences[j]);
+      free(producers[i].fences);
+   }
+   util_queue_destroy(&queue);
+
+   return ok ? NUM_PRODUCERS * JOBS_PER_PRODUCER * 1e9 / elapsed : 0;
+}
+
+int
+main(void)
+{
+   static const struct {
+      const char *name;
+      unsigned flags;
+   } modes[] = {
+      { "locked", 0 },
+      { "lockless", UTIL_QUEUE_INIT_LOCKLESS },
+   };
+
+   for (unsigned m = 0; m < ARRAY_SIZE(modes); m++) {
+      for (unsigned round = 0; round < ROUNDS; round++) {
+         double jobs_per_s = run(modes[m].flags);
+
+         if (jobs_per_s == 0) {
+            fprintf(stderr, "%s: queue failed\n", modes[m].name);
+            return 1;
+         }
+         printf("%s: %u producers, %u threads: %.2f Mjobs/s\n",
+                modes[m].name, NUM_PRODUCERS, NUM_WORKERS,
+                jobs_per_s / 1e6);
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Testing u_queue.h, with and without UTIL_QUEUE_INIT_LOCKLESS.
+ */
+
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define NUM_PRODUCERS 4
+#define NUM_WORKERS 4
+#define JOBS_PER_PRODUCER 20000
+
+struct counter_job {
+   struct util_queue_fence fence;
+   unsigned *executed;
+   unsigned *cleaned_up;
+};
+
+static void
+counter_execute(void *data, void *gdata, int thread_index)
+{
+   struct counter_job *job = (struct counter_job *)data;
+   p_atomic_inc(job->executed);
+}
+
+static void
+counter_cleanup(void *data, void *gdata, int thread_index)
+{
+   struct counter_job *job = (struct counter_job *)data;
+   p_atomic_inc(job->cleaned_up);
+}
+
+struct producer {
+   struct util_queue *queue;
+   struct counter_job *jobs;
+   unsigned num_jobs;
+   unsigned executed;
+   unsigned cleaned_up;
+};
+
+static int
+producer_func(void *data)
+{
+   struct producer *p = (struct producer *)data;
+
+   for (unsigned i = 0; i < p->num_jobs; i++) {
+      struct counter_job *job = &p->jobs[i];
+
+      util_queue_fence_init(&job->fence);
+      job->executed = &p->executed;
+      job->cleaned_up = &p->cleaned_up;
+      util_queue_add_job(p->queue, job, &job->fence, counter_execute,
+                         counter_cleanup, 0);
+   }
+   return 0;
+}
+
+class u_queue_test : public ::testing::TestWithParam<unsigned> {
+protected:
+   void SetUp() override
+   {
+      ASSERT_TRUE(util_queue_init(&queue, "test", 32, NUM_WORKERS, GetParam(),
+                                  NULL));
+   }
+
+   void TearDown() override
+   {
+      util_queue_destroy(&queue);
+   }
+
+   /* Add jobs from NUM_PRODUCERS threads at once, return the time it took to
+    * add and execute all of them.
+    */
+   int64_t run_producers(unsigned jobs_per_producer)
+   {
+      struct producer producers[NUM_PRODUCERS];
+      thrd_t threads[NUM_PRODUCERS];
+
+      for (unsigned i = 0; i < NUM_PRODUCERS; i++) {
+         producers[i].queue = &queue;
+         producers[i].jobs = (struct counter_job *)
+            calloc(jobs_per_producer, sizeof(struct counter_job));
+         producers[i].num_jobs = jobs_per_producer;
+         producers[i].executed = 0;
+         producers[i].cleaned_up = 0;
+      }
+
+      int64_t start = os_time_get_nano();
+
+      for (unsigned i = 0; i < NUM_PRODUCERS; i++)
+         thrd_create(&threads[i], producer_func, &producers[i]);
+      for (unsigned i = 0; i < NUM_PRODUCERS; i++)
+         thrd_join(threads[i], NULL);
+
+      for (unsigned i = 0; i < NUM_PRODUCERS; i++) {
+         for (unsigned j = 0; j < jobs_per_producer; j++)
+            util_queue_fence_wait(&producers[i].jobs[j].fence);
+      }
+      util_queue_finish(&queue);
+
+      int64_t elapsed = os_time_get_nano() - start;
+
+      for (unsigned i = 0; i < NUM_PRODUCERS; i++) {
+         EXPECT_EQ(producers[i].executed, jobs_per_producer);
+         EXPECT_EQ(producers[i].cleaned_up, jobs_per_producer);
+         for (unsigned j = 0; j < jobs_per_producer; j++)
+            util_queue_fence_destroy(&producers[i].jobs[j].fence);
+         free(producers[i].jobs);
+      }
+
+      return elapsed;
+   }
+
+   struct util_queue queue;
+};
+
+TEST_P(u_queue_test, multiple_producers)
+{
+   run_producers(JOBS_PER_PRODUCER);
+}
+
+TEST_P(u_queue_test, finish)
+{
+   unsigned executed = 0, cleaned_up = 0;
+   struct counter_job jobs[256];
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      jobs[i].executed = &executed;
+      jobs[i].cleaned_up = &cleaned_up;
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, counter_execute,
+                         NULL, 0);
+   }
+
+   util_queue_finish(&queue);
+   EXPECT_EQ(executed, ARRAY_SIZE(jobs));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      EXPECT_TRUE(util_queue_fence_is_signalled(&jobs[i].fence));
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
+struct blocking_job {
+   struct util_queue_fence fence;
+   struct util_queue_fence started;
+   struct util_queue_fence release;
+};
+
+static void
+blocking_execute(void *data, void *gdata, int thread_index)
+{
+   struct blocking_job *job = (struct blocking_job *)data;
+
+   util_queue_fence_signal(&job->started);
+   util_queue_fence_wait(&job->release);
+}
+
+TEST_P(u_queue_test, drop_job)
+{
+   struct blocking_job blockers[NUM_WORKERS];
+   struct counter_job dropped, kept;
+   unsigned executed = 0, cleaned_up = 0;
+
+   /* Occupy all threads, so that the next jobs stay queued. */
+   util_queue_adjust_num_threads(&queue, NUM_WORKERS, false);
+   for (unsigned i = 0; i < queue.num_threads; i++) {
+      util_queue_fence_init(&blockers[i].fence);
+      util_queue_fence_init(&blockers[i].started);
+      util_queue_fence_init(&blockers[i].release);
+      util_queue_fence_reset(&blockers[i].started);
+      util_queue_fence_reset(&blockers[i].release);
+      util_queue_add_job(&queue, &blockers[i], &blockers[i].fence,
+                         blocking_execute, NULL, 0);
+   }
+   for (unsigned i = 0; i < queue.num_threads; i++)
+      util_queue_fence_wait(&blockers[i].started);
+
+   util_queue_fence_init(&dropped.fence);
+   dropped.executed = &executed;
+   dropped.cleaned_up = &cleaned_up;
+   util_queue_add_job(&queue, &dropped, &dropped.fence, counter_execute,
+                      counter_cleanup, 0);
+
+   util_queue_fence_init(&kept.fence);
+   kept.executed = &executed;
+   kept.cleaned_up = &cleaned_up;
+   util_queue_add_job(&queue, &kept, &kept.fence, counter_execute,
+                      counter_cleanup, 0);
+
+   util_queue_drop_job(&queue, &dropped.fence);
+   EXPECT_TRUE(util_queue_fence_is_signalled(&dropped.fence));
+   EXPECT_EQ(cleaned_up, 1u);
+
+   for (unsigned i = 0; i < queue.num_threads; i++)
+      util_queue_fence_signal(&blockers[i].release);
+
+   util_queue_fence_wait(&kept.fence);
+   util_queue_finish(&queue);
+   EXPECT_EQ(executed, 1u);
+   EXPECT_EQ(cleaned_up, 2u);
+
+   for (unsigned i = 0; i < queue.num_threads; i++) {
+      util_queue_fence_destroy(&blockers[i].fence);
+      util_queue_fence_destroy(&blockers[i].started);
+      util_queue_fence_destroy(&blockers[i].release);
+   }
+   util_queue_fence_destroy(&dropped.fence);
+   util_queue_fence_destroy(&kept.fence);
+}
+
+struct exit_blocking_job {
+   struct util_queue_fence fence;
+   struct util_queue_fence started;
+   struct util_queue *queue;
+};
+
+static void
+exit_blocking_execute(void *data, void *gdata, int thread_index)
+{
+   struct exit_blocking_job *job = (struct exit_blocking_job *)data;
+
+   util_queue_fence_signal(&job->started);
+   while (p_atomic_read(&job->queue->num_threads) != 0)
+      os_time_sleep(1000);
+}
+
+/* Jobs that are still queued when the queue is destroyed are never executed,
+ * but their fences must be signalled.
+ */
+TEST_P(u_queue_test, destroy_signals_fences)
+{
+   struct exit_blocking_job blocker;
+   struct counter_job jobs[16];
+   unsigned executed = 0, cleaned_up = 0;
+
+   /* The only thread is busy until util_queue_destroy starts. */
+   util_queue_destroy(&queue);
+   ASSERT_TRUE(util_queue_init(&queue, "test", 32, 1, GetParam(), NULL));
+
+   util_queue_fence_init(&blocker.fence);
+   util_queue_fence_init(&blocker.started);
+   util_queue_fence_reset(&blocker.started);
+   blocker.queue = &queue;
+   util_queue_add_job(&queue, &blocker, &blocker.fence, exit_blocking_execute,
+                      NULL, 0);
+   util_queue_fence_wait(&blocker.started);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      jobs[i].executed = &executed;
+      jobs[i].cleaned_up = &cleaned_up;
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, counter_execute,
+                         NULL, 0);
+   }
+
+   util_queue_destroy(&queue);
+
+   EXPECT_EQ(executed, 0u);
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      EXPECT_TRUE(util_queue_fence_is_signalled(&jobs[i].fence));
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+   util_queue_fence_destroy(&blocker.fence);
+   util_queue_fence_destroy(&blocker.started);
+
+   /* For TearDown. */
+   ASSERT_TRUE(util_queue_init(&queue, "test", 32, 1, GetParam(), NULL));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+   u_queue, u_queue_test,
+   ::testing::Values(0u, (unsigned)UTIL_QUEUE_INIT_LOCKLESS),
+   [](const ::testing::TestParamInfo<unsigned> &info) {
+      return std::string(info.param ? "lockless" : "locked");
+   });
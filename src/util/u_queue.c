@@ -29,6 +29,8 @@
 #include "c11/threads.h"
 #include "util/u_cpu_detect.h"
 #include "util/os_time.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
 #include "u_process.h"
@@ -46,6 +48,8 @@
 static void
 util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
                         bool locked);
+static void
+util_queue_finish_execute(void *data, void *gdata, int num_thread);
 
 /****************************************************************************
  * Wait for all queues to assert idle when exit() is called.
@@ -237,6 +241,299 @@ util_queue_fence_destroy(struct util_queue_fence *fence)
 }
 #endif
 
+/****************************************************************************
+ * Lock-free job ring (UTIL_QUEUE_INIT_LOCKLESS)
+ *
+ * This is a bounded multi-producer multi-consumer ring: each cell has a
+ * sequence number that tells producers and consumers whose turn it is, so
+ * the only shared writes are the two position counters. Idle threads sleep
+ * on wake_gen. They announce themselves in "sleepers" first, and producers
+ * only bump wake_gen and make a syscall when there's someone to wake.
+ *
+ * "sleepers" is always updated with a read-modify-write. These are totally
+ * ordered, so either a sleeping thread sees the published job (or the new
+ * num_threads), or the publishing thread sees the sleeper.
+ */
+
+#if UTIL_FUTEX_SUPPORTED
+
+struct util_queue_ring_cell {
+   uint32_t seq;   /* pos when free, pos + 1 when the job is published */
+   uint32_t claim; /* pos while the job can be run or dropped */
+   struct util_queue_job job;
+};
+
+struct util_queue_ring {
+   /* Producers, consumers and sleepers each get their own cache line. */
+   uint32_t enqueue_pos;
+   char pad0[CACHE_LINE_SIZE - sizeof(uint32_t)];
+   uint32_t dequeue_pos;
+   char pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+   uint32_t sleepers;
+   uint32_t wake_gen;
+   uint32_t space_waiters;
+   uint32_t space_gen;
+   uint32_t mask;
+   struct util_queue_ring_cell cells[];
+};
+
+static struct util_queue_ring *
+util_queue_ring_create(unsigned max_jobs)
+{
+   unsigned num_cells = util_next_power_of_two(MAX2(max_jobs, 2));
+   struct util_queue_ring *ring =
+      align_calloc(sizeof(*ring) + num_cells * sizeof(ring->cells[0]),
+                   CACHE_LINE_SIZE);
+   if (!ring)
+      return NULL;
+
+   ring->mask = num_cells - 1;
+   for (unsigned i = 0; i < num_cells; i++)
+      ring->cells[i].seq = i;
+
+   return ring;
+}
+
+static void
+util_queue_ring_destroy(struct util_queue_ring *ring)
+{
+   align_free(ring);
+}
+
+static bool
+util_queue_ring_push(struct util_queue_ring *ring,
+                     const struct util_queue_job *job)
+{
+   uint32_t pos = p_atomic_read_relaxed(&ring->enqueue_pos);
+
+   while (1) {
+      struct util_queue_ring_cell *cell = &ring->cells[pos & ring->mask];
+      int32_t diff = (int32_t)(p_atomic_read(&cell->seq) - pos);
+
+      if (diff == 0) {
+         uint32_t old = p_atomic_cmpxchg(&ring->enqueue_pos, pos, pos + 1);
+         if (old == pos) {
+            cell->job = *job;
+            cell->claim = pos;
+            p_atomic_set(&cell->seq, pos + 1);
+            return true;
+         }
+         pos = old;
+      } else if (diff < 0) {
+         /* The consumer of the previous lap hasn't freed the cell: full. */
+         return false;
+      } else {
+         pos = p_atomic_read_relaxed(&ring->enqueue_pos);
+      }
+   }
+}
+
+/* A popped job that was dropped is returned with job->job == NULL. */
+static bool
+util_queue_ring_pop(struct util_queue_ring *ring, struct util_queue_job *job)
+{
+   uint32_t pos = p_atomic_read_relaxed(&ring->dequeue_pos);
+
+   while (1) {
+      struct util_queue_ring_cell *cell = &ring->cells[pos & ring->mask];
+      int32_t diff = (int32_t)(p_atomic_read(&cell->seq) - (pos + 1));
+
+      if (diff == 0) {
+         uint32_t old = p_atomic_cmpxchg(&ring->dequeue_pos, pos, pos + 1);
+         if (old == pos) {
+            *job = cell->job;
+            if (p_atomic_cmpxchg(&cell->claim, pos, pos + 1) != pos)
+               job->job = NULL;
+            p_atomic_set(&cell->seq, pos + ring->mask + 1);
+
+            /* Producers waiting for space poll, so this can be lazy. */
+            if (p_atomic_read_relaxed(&ring->space_waiters)) {
+               p_atomic_inc(&ring->space_gen);
+               futex_wake(&ring->space_gen, 1);
+            }
+            return true;
+         }
+         pos = old;
+      } else if (diff < 0) {
+         /* Empty, or the next job isn't published yet. Its producer will
+          * wake us up when it is.
+          */
+         return false;
+      } else {
+         pos = p_atomic_read_relaxed(&ring->dequeue_pos);
+      }
+   }
+}
+
+static void
+util_queue_ring_wake(struct util_queue_ring *ring, int32_t count)
+{
+   if (p_atomic_add_return(&ring->sleepers, 0) > 0) {
+      p_atomic_inc(&ring->wake_gen);
+      futex_wake(&ring->wake_gen, count);
+   }
+}
+
+static void
+util_queue_ring_wait_for_space(struct util_queue_ring *ring)
+{
+   /* Consumers don't synchronize with us when checking space_waiters, so
+    * don't sleep for long.
+    */
+   int64_t abs_timeout = os_time_get_nano() + 1000000;
+   struct timespec ts = {
+      .tv_sec = abs_timeout / 1000000000,
+      .tv_nsec = abs_timeout % 1000000000,
+   };
+   uint32_t gen = p_atomic_read(&ring->space_gen);
+
+   p_atomic_inc(&ring->space_waiters);
+   futex_wait(&ring->space_gen, gen, &ts);
+   p_atomic_dec(&ring->space_waiters);
+}
+
+/* Signal the fences of all jobs that will never be executed. */
+static void
+util_queue_ring_drain(struct util_queue_ring *ring)
+{
+   struct util_queue_job job;
+
+   while (util_queue_ring_pop(ring, &job)) {
+      if (job.job && job.fence)
+         util_queue_fence_signal(job.fence);
+   }
+}
+
+/* Return false if the thread should terminate. */
+static bool
+util_queue_ring_get_job(struct util_queue *queue, unsigned thread_index,
+                        struct util_queue_job *job)
+{
+   struct util_queue_ring *ring = queue->ring;
+
+   while (thread_index < p_atomic_read(&queue->num_threads)) {
+      if (util_queue_ring_pop(ring, job))
+         return true;
+
+      uint32_t gen = p_atomic_read(&ring->wake_gen);
+      bool popped = false;
+
+      p_atomic_inc(&ring->sleepers);
+      if (thread_index < p_atomic_read(&queue->num_threads)) {
+         popped = util_queue_ring_pop(ring, job);
+         if (!popped)
+            futex_wait(&ring->wake_gen, gen, NULL);
+      }
+      p_atomic_dec(&ring->sleepers);
+
+      if (popped)
+         return true;
+   }
+   return false;
+}
+
+static void
+util_queue_ring_add_job(struct util_queue *queue,
+                        const struct util_queue_job *job,
+                        bool locked)
+{
+   struct util_queue_ring *ring = queue->ring;
+
+   /* Scale the number of threads up if there's already one job waiting. */
+   if (p_atomic_read_relaxed(&ring->enqueue_pos) !=
+       p_atomic_read_relaxed(&ring->dequeue_pos) &&
+       queue->create_threads_on_demand &&
+       job->execute != util_queue_finish_execute &&
+       p_atomic_read(&queue->num_threads) < queue->max_threads) {
+      if (!locked)
+         mtx_lock(&queue->lock);
+      if (queue->create_threads_on_demand && queue->num_threads &&
+          queue->num_threads < queue->max_threads)
+         util_queue_adjust_num_threads(queue, queue->num_threads + 1, true);
+      if (!locked)
+         mtx_unlock(&queue->lock);
+   }
+
+   while (!util_queue_ring_push(ring, job))
+      util_queue_ring_wait_for_space(ring);
+
+   util_queue_ring_wake(ring, 1);
+
+   /* If all threads were terminated while we were adding the job, nobody
+    * will execute it. util_queue_ring_wake is a full barrier, so either we
+    * see num_threads == 0 here, or util_queue_kill_threads sees our job.
+    */
+   if (p_atomic_read(&queue->num_threads) == 0)
+      util_queue_ring_drain(ring);
+}
+
+static bool
+util_queue_ring_drop_job(struct util_queue *queue,
+                         struct util_queue_fence *fence)
+{
+   struct util_queue_ring *ring = queue->ring;
+   uint32_t start = p_atomic_read(&ring->dequeue_pos);
+   uint32_t end = p_atomic_read(&ring->enqueue_pos);
+
+   for (uint32_t pos = start; pos != end; pos++) {
+      struct util_queue_ring_cell *cell = &ring->cells[pos & ring->mask];
+
+      if (p_atomic_read(&cell->seq) != pos + 1)
+         continue;
+
+      /* The copy is only valid if the claim below succeeds, because the
+       * cell can't be reused before the job is claimed.
+       */
+      struct util_queue_job job = cell->job;
+      if (job.fence != fence)
+         continue;
+
+      if (p_atomic_cmpxchg(&cell->claim, pos, pos + 1) != pos)
+         return false;
+
+      if (job.cleanup)
+         job.cleanup(job.job, job.global_data, -1);
+      return true;
+   }
+   return false;
+}
+
+#else
+
+static struct util_queue_ring *
+util_queue_ring_create(unsigned max_jobs)
+{
+   return NULL;
+}
+
+static void util_queue_ring_destroy(struct util_queue_ring *ring) {}
+static void util_queue_ring_wake(struct util_queue_ring *ring, int32_t count) {}
+static void util_queue_ring_drain(struct util_queue_ring *ring) {}
+
+static bool
+util_queue_ring_get_job(struct util_queue *queue, unsigned thread_index,
+                        struct util_queue_job *job)
+{
+   unreachable("no lock-free ring without futexes");
+}
+
+static void
+util_queue_ring_add_job(struct util_queue *queue,
+                        const struct util_queue_job *job,
+                        bool locked)
+{
+   unreachable("no lock-free ring without futexes");
+}
+
+static bool
+util_queue_ring_drop_job(struct util_queue *queue,
+                         struct util_queue_fence *fence)
+{
+   unreachable("no lock-free ring without futexes");
+}
+
+#endif
+
 /****************************************************************************
  * util_queue implementation
  */
@@ -279,6 +576,22 @@ util_queue_thread_func(void *input)
       u_thread_setname(name);
    }
 
+   if (queue->ring) {
+      struct util_queue_job job;
+
+      while (util_queue_ring_get_job(queue, thread_index, &job)) {
+         if (job.job) {
+            job.execute(job.job, job.global_data, thread_index);
+            if (job.fence)
+               util_queue_fence_signal(job.fence);
+            if (job.cleanup)
+               job.cleanup(job.job, job.global_data, thread_index);
+         }
+      }
+      /* Remaining jobs are signalled by util_queue_kill_threads. */
+      return 0;
+   }
+
    while (1) {
       struct util_queue_job job;
 
@@ -455,10 +768,18 @@ util_queue_init(struct util_queue *queue,
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
+   if (flags & UTIL_QUEUE_INIT_LOCKLESS) {
+      queue->ring = util_queue_ring_create(max_jobs);
+      if (!queue->ring && UTIL_FUTEX_SUPPORTED)
+         goto fail;
+   }
+
+   if (!queue->ring) {
+      queue->jobs = (struct util_queue_job*)
+                    calloc(max_jobs, sizeof(struct util_queue_job));
+      if (!queue->jobs)
+         goto fail;
+   }
 
    queue->threads = (thrd_t*) calloc(queue->max_threads, sizeof(thrd_t));
    if (!queue->threads)
@@ -484,11 +805,13 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
+   if (queue->jobs || queue->ring) {
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
       mtx_destroy(&queue->lock);
       free(queue->jobs);
+      if (queue->ring)
+         util_queue_ring_destroy(queue->ring);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -513,8 +836,10 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
    /* Setting num_threads is what causes the threads to terminate.
     * Then cnd_broadcast wakes them up and they will exit their function.
     */
-   queue->num_threads = keep_num_threads;
+   p_atomic_set(&queue->num_threads, keep_num_threads);
    cnd_broadcast(&queue->has_queued_cond);
+   if (queue->ring)
+      util_queue_ring_wake(queue->ring, INT32_MAX);
 
    /* Wait for threads to terminate. */
    if (keep_num_threads < old_num_threads) {
@@ -522,6 +847,9 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
       mtx_unlock(&queue->lock);
       for (unsigned i = keep_num_threads; i < old_num_threads; i++)
          thrd_join(queue->threads[i], NULL);
+      /* signal remaining jobs if all threads have been terminated */
+      if (queue->ring && keep_num_threads == 0)
+         util_queue_ring_drain(queue->ring);
       if (locked)
          mtx_lock(&queue->lock);
    } else {
@@ -551,6 +879,8 @@ util_queue_destroy(struct util_queue *queue)
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->lock);
    free(queue->jobs);
+   if (queue->ring)
+      util_queue_ring_destroy(queue->ring);
    free(queue->threads);
 }
 
@@ -565,6 +895,25 @@ util_queue_add_job_locked(struct util_queue *queue,
 {
    struct util_queue_job *ptr;
 
+   if (queue->ring) {
+      if (p_atomic_read(&queue->num_threads) == 0)
+         return;
+
+      if (fence)
+         util_queue_fence_reset(fence);
+
+      struct util_queue_job entry = {
+         .job = job,
+         .global_data = queue->global_data,
+         .job_size = job_size,
+         .fence = fence,
+         .execute = execute,
+         .cleanup = cleanup,
+      };
+      util_queue_ring_add_job(queue, &entry, locked);
+      return;
+   }
+
    if (!locked)
       mtx_lock(&queue->lock);
    if (queue->num_threads == 0) {
@@ -672,20 +1021,24 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
-   mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].fence == fence) {
-         if (queue->jobs[i].cleanup)
-            queue->jobs[i].cleanup(queue->jobs[i].job, queue->global_data, -1);
-
-         /* Just clear it. The threads will treat as a no-op job. */
-         memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
-         removed = true;
-         break;
+   if (queue->ring) {
+      removed = util_queue_ring_drop_job(queue, fence);
+   } else {
+      mtx_lock(&queue->lock);
+      for (unsigned i = queue->read_idx; i != queue->write_idx;
+           i = (i + 1) % queue->max_jobs) {
+         if (queue->jobs[i].fence == fence) {
+            if (queue->jobs[i].cleanup)
+               queue->jobs[i].cleanup(queue->jobs[i].job, queue->global_data, -1);
+
+            /* Just clear it. The threads will treat as a no-op job. */
+            memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
+            removed = true;
+            break;
+         }
       }
+      mtx_unlock(&queue->lock);
    }
-   mtx_unlock(&queue->lock);
 
    if (removed)
       util_queue_fence_signal(fence);
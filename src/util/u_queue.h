@@ -50,6 +50,16 @@ extern "C" {
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
 #define UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY  (1 << 2)
+/* Queue jobs in a lock-free ring instead of the mutex-protected one, so that
+ * many threads can add jobs at once without contending for the queue lock.
+ * Idle threads sleep on a futex, and adding a job only makes a syscall when
+ * some thread is asleep.
+ *
+ * The ring can't grow: UTIL_QUEUE_INIT_RESIZE_IF_FULL is ignored and
+ * util_queue_add_job waits for a free slot instead. This flag is also ignored
+ * where futexes aren't supported.
+ */
+#define UTIL_QUEUE_INIT_LOCKLESS                  (1 << 3)
 
 #if UTIL_FUTEX_SUPPORTED
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -219,6 +229,8 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+struct util_queue_ring;
+
 /* Put this into your context. */
 struct util_queue {
    char name[14]; /* 13 characters = the thread name without the index */
@@ -237,6 +249,11 @@ struct util_queue {
    struct util_queue_job *jobs;
    void *global_data;
 
+   /* If non-NULL, jobs are queued here and the fields above that describe
+    * the queued jobs are unused. (UTIL_QUEUE_INIT_LOCKLESS)
+    */
+   struct util_queue_ring *ring;
+
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
 };
@@ -0,0 +1,219 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+
+#include "util/os_time.h"
+#include "vk_cmd_queue.h"
+#include "vk_dispatch_table.h"
+
+#define NUM_DRAWS 100000
+
+struct counting_alloc {
+   VkAllocationCallbacks cb;
+   unsigned num_allocs;
+   unsigned num_live;
+};
+
+static VKAPI_ATTR void * VKAPI_CALL
+counting_alloc_func(void *user_data, size_t size, size_t align,
+                    VkSystemAllocationScope scope)
+{
+   struct counting_alloc *alloc = (struct counting_alloc *)user_data;
+   alloc->num_allocs++;
+   alloc->num_live++;
+   assert(align <= 16);
+   return malloc(size);
+}
+
+static VKAPI_ATTR void * VKAPI_CALL
+counting_realloc_func(void *user_data, void *ptr, size_t size, size_t align,
+                      VkSystemAllocationScope scope)
+{
+   unreachable("the command queue never reallocates");
+}
+
+static VKAPI_ATTR void VKAPI_CALL
+counting_free_func(void *user_data, void *ptr)
+{
+   struct counting_alloc *alloc = (struct counting_alloc *)user_data;
+   if (ptr) {
+      alloc->num_live--;
+      free(ptr);
+   }
+}
+
+struct replay_state {
+   unsigned num_draws;
+   unsigned num_binds;
+   bool ok;
+};
+
+static struct replay_state replay;
+
+static VKAPI_ATTR void VKAPI_CALL
+replay_CmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount,
+               uint32_t instanceCount, uint32_t firstVertex,
+               uint32_t firstInstance)
+{
+   replay.ok &= vertexCount == 3 && instanceCount == 1 &&
+                firstVertex == replay.num_draws && firstInstance == 0;
+   replay.num_draws++;
+}
+
+static VKAPI_ATTR void VKAPI_CALL
+replay_CmdBindVertexBuffers(VkCommandBuffer commandBuffer,
+                            uint32_t firstBinding, uint32_t bindingCount,
+                            const VkBuffer *pBuffers,
+                            const VkDeviceSize *pOffsets)
+{
+   replay.ok &= firstBinding == 0 && bindingCount == 2 &&
+                pOffsets[0] == replay.num_binds &&
+                pOffsets[1] == replay.num_binds * 2;
+   replay.num_binds++;
+}
+
+class vk_cmd_queue_test : public ::testing::Test {
+protected:
+   vk_cmd_queue_test()
+   {
+      alloc.cb.pUserData = &alloc;
+      alloc.cb.pfnAllocation = counting_alloc_func;
+      alloc.cb.pfnReallocation = counting_realloc_func;
+      alloc.cb.pfnFree = counting_free_func;
+      alloc.num_allocs = 0;
+      alloc.num_live = 0;
+
+      disp.CmdDraw = replay_CmdDraw;
+      disp.CmdBindVertexBuffers = replay_CmdBindVertexBuffers;
+
+      vk_cmd_queue_init(&queue, &alloc.cb);
+   }
+
+   ~vk_cmd_queue_test()
+   {
+      vk_cmd_queue_finish(&queue);
+      EXPECT_EQ(alloc.num_live, 0u);
+   }
+
+   void record(unsigned num_draws)
+   {
+      const VkBuffer buffers[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+
+      for (unsigned i = 0; i < num_draws; i++) {
+         const VkDeviceSize offsets[2] = { i, i * 2 };
+
+         ASSERT_EQ(vk_enqueue_cmd_bind_vertex_buffers(&queue, 0, 2, buffers,
+                                                      offsets), VK_SUCCESS);
+         ASSERT_EQ(vk_enqueue_cmd_draw(&queue, 3, 1, i, 0), VK_SUCCESS);
+      }
+   }
+
+   void execute(unsigned num_draws)
+   {
+      replay = {};
+      replay.ok = true;
+
+      vk_cmd_queue_execute(&queue, VK_NULL_HANDLE, &disp);
+
+      EXPECT_TRUE(replay.ok);
+      EXPECT_EQ(replay.num_draws, num_draws);
+      EXPECT_EQ(replay.num_binds, num_draws);
+   }
+
+   struct counting_alloc alloc;
+   struct vk_device_dispatch_table disp = {};
+   struct vk_cmd_queue queue;
+};
+
+TEST_F(vk_cmd_queue_test, record_execute)
+{
+   record(1000);
+   execute(1000);
+}
+
+/* Recording the same commands again after a reset must not touch the
+ * allocator.
+ */
+TEST_F(vk_cmd_queue_test, reset_reuses_memory)
+{
+   record(NUM_DRAWS);
+   const unsigned num_allocs = alloc.num_allocs;
+
+   for (unsigned i = 0; i < 3; i++) {
+      vk_cmd_queue_reset(&queue);
+      EXPECT_TRUE(list_is_empty(&queue.cmds));
+
+      record(NUM_DRAWS);
+      execute(NUM_DRAWS);
+      EXPECT_EQ(alloc.num_allocs, num_allocs);
+   }
+}
+
+/* Trimming a reset queue returns all of its memory, and the queue can be
+ * recorded into again.
+ */
+TEST_F(vk_cmd_queue_test, trim_releases_memory)
+{
+   record(NUM_DRAWS);
+   EXPECT_NE(alloc.num_live, 0u);
+
+   vk_cmd_queue_reset(&queue);
+   vk_cmd_queue_trim(&queue);
+   EXPECT_EQ(alloc.num_live, 0u);
+
+   record(1000);
+   execute(1000);
+}
+
+TEST_F(vk_cmd_queue_test, zalloc)
+{
+   uint8_t *small = (uint8_t *)vk_cmd_queue_zalloc(&queue, 3);
+   void *empty = vk_cmd_queue_zalloc(&queue, 0);
+   uint8_t *big = (uint8_t *)vk_cmd_queue_zalloc(&queue, 4 * 1024 * 1024);
+
+   ASSERT_NE(small, nullptr);
+   ASSERT_NE(empty, nullptr);
+   ASSERT_NE(big, nullptr);
+   EXPECT_NE(empty, (void *)small);
+   EXPECT_EQ((uintptr_t)small % 8, 0u);
+   EXPECT_EQ((uintptr_t)empty % 8, 0u);
+   EXPECT_EQ((uintptr_t)big % 8, 0u);
+
+   memset(big, 0xff, 4 * 1024 * 1024);
+   vk_cmd_queue_reset(&queue);
+
+   /* The big block is reused, and must come back zeroed. */
+   big = (uint8_t *)vk_cmd_queue_zalloc(&queue, 4 * 1024 * 1024);
+   for (unsigned i = 0; i < 4 * 1024 * 1024; i++) {
+      if (big[i] != 0) {
+         ADD_FAILURE() << "byte " << i << " is not zero";
+         break;
+      }
+   }
+}
+
+/* Not much of a test, reports how long recording, replaying and resetting
+ * a large command buffer take.
+ */
+TEST_F(vk_cmd_queue_test, benchmark)
+{
+   for (unsigned pass = 0; pass < 2; pass++) {
+      int64_t start = os_time_get_nano();
+      record(NUM_DRAWS);
+      int64_t recorded = os_time_get_nano();
+      execute(NUM_DRAWS);
+      int64_t executed = os_time_get_nano();
+      vk_cmd_queue_reset(&queue);
+      int64_t reset = os_time_get_nano();
+
+      printf("%s: record %.2f ms, execute %.2f ms, reset %.2f ms, "
+             "%u allocations\n",
+             pass ? "reused" : "fresh",
+             (recorded - start) / 1000000.0,
+             (executed - recorded) / 1000000.0,
+             (reset - executed) / 1000000.0,
+             alloc.num_allocs);
+   }
+}
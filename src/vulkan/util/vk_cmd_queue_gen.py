@@ -71,7 +71,11 @@ TEMPLATE_H = Template(COPYRIGHT + """\
 
 #pragma once
 
+#include <stdint.h>
+#include <string.h>
+
 #include "util/list.h"
+#include "util/macros.h"
 
 #define VK_PROTOTYPES
 #include <vulkan/vulkan_core.h>
@@ -84,10 +88,20 @@ extern "C" {
 #endif
 
 struct vk_device_dispatch_table;
+struct vk_cmd_queue_block;
 
 struct vk_cmd_queue {
    const VkAllocationCallbacks *alloc;
    struct list_head cmds;
+
+   /* Linear arena holding the recorded commands and everything they point
+    * to.  Blocks are kept across resets and only handed back to alloc by
+    * vk_cmd_queue_finish().
+    */
+   struct list_head blocks;
+   struct vk_cmd_queue_block *block;
+   uint8_t *next;
+   uint8_t *end;
 };
 
 enum vk_cmd_type {
@@ -176,27 +190,43 @@ struct vk_cmd_queue_entry {
 
 void vk_free_queue(struct vk_cmd_queue *queue);
 
-static inline void
-vk_cmd_queue_init(struct vk_cmd_queue *queue, VkAllocationCallbacks *alloc)
-{
-   queue->alloc = alloc;
-   list_inithead(&queue->cmds);
-}
+void *vk_cmd_queue_zalloc_block(struct vk_cmd_queue *queue, size_t size);
 
-static inline void
-vk_cmd_queue_reset(struct vk_cmd_queue *queue)
+/* Allocate zeroed, 8-byte aligned memory which lives until the queue is
+ * reset or finished.  There is no way to free it individually.
+ */
+static inline void *
+vk_cmd_queue_zalloc(struct vk_cmd_queue *queue, size_t size)
 {
-   vk_free_queue(queue);
-   list_inithead(&queue->cmds);
+   /* Zero-sized allocations still get a unique, non-NULL pointer. */
+   size = ALIGN_POT(MAX2(size, 1), (size_t)8);
+
+   if (unlikely((size_t)(queue->end - queue->next) < size))
+      return vk_cmd_queue_zalloc_block(queue, size);
+
+   void *ptr = queue->next;
+   queue->next += size;
+   memset(ptr, 0, size);
+   return ptr;
 }
 
 static inline void
-vk_cmd_queue_finish(struct vk_cmd_queue *queue)
+vk_cmd_queue_init(struct vk_cmd_queue *queue, VkAllocationCallbacks *alloc)
 {
-   vk_free_queue(queue);
+   queue->alloc = alloc;
    list_inithead(&queue->cmds);
+   list_inithead(&queue->blocks);
+   queue->block = NULL;
+   queue->next = NULL;
+   queue->end = NULL;
 }
 
+void vk_cmd_queue_reset(struct vk_cmd_queue *queue);
+
+void vk_cmd_queue_trim(struct vk_cmd_queue *queue);
+
+void vk_cmd_queue_finish(struct vk_cmd_queue *queue);
+
 void vk_cmd_queue_execute(struct vk_cmd_queue *queue,
                           VkCommandBuffer commandBuffer,
                           const struct vk_device_dispatch_table *disp);
@@ -251,37 +281,20 @@ size_t vk_cmd_queue_type_sizes[] = {
 };
 
 % for c in commands:
+% if c.name in manual_commands or c.name in no_enqueue_commands:
+<% continue %>
+% endif
 % if c.guard is not None:
 #ifdef ${c.guard}
 % endif
-static void
-vk_free_${to_underscore(c.name)}(struct vk_cmd_queue *queue,
-${' ' * len('vk_free_' + to_underscore(c.name) + '(')}\\
-struct vk_cmd_queue_entry *cmd)
-{
-   if (cmd->driver_free_cb)
-      cmd->driver_free_cb(queue, cmd);
-   else
-      vk_free(queue->alloc, cmd->driver_data);
-% for p in c.params[1:]:
-% if p.len:
-   vk_free(queue->alloc, (${remove_suffix(p.decl.replace("const", ""), p.name)})cmd->u.${to_struct_field_name(c.name)}.${to_field_name(p.name)});
-% elif '*' in p.decl:
-   ${get_struct_free(c, p, types)}
-% endif
-% endfor
-   vk_free(queue->alloc, cmd);
-}
-
-% if c.name not in manual_commands and c.name not in no_enqueue_commands:
 VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 % for p in c.params[1:]:
 , ${p.decl}
 % endfor
 )
 {
-   struct vk_cmd_queue_entry *cmd = vk_zalloc(queue->alloc, vk_cmd_queue_type_sizes[${to_enum_name(c.name)}], 8,
-                                              VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   struct vk_cmd_queue_entry *cmd =
+      vk_cmd_queue_zalloc(queue, vk_cmd_queue_type_sizes[${to_enum_name(c.name)}]);
    if (!cmd) return VK_ERROR_OUT_OF_HOST_MEMORY;
 
    cmd->type = ${to_enum_name(c.name)};
@@ -311,37 +324,112 @@ VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 
 % if need_error_handling:
 err:
-   if (cmd)
-      vk_free_${to_underscore(c.name)}(queue, cmd);
+   /* Whatever was allocated stays in the arena until the next reset. */
    return VK_ERROR_OUT_OF_HOST_MEMORY;
 % endif
 }
-% endif
 % if c.guard is not None:
 #endif // ${c.guard}
 % endif
 
 % endfor
 
-void
-vk_free_queue(struct vk_cmd_queue *queue)
+/* Minimum size of an arena block, later blocks grow up to the maximum. */
+#define VK_CMD_QUEUE_BLOCK_MIN_SIZE (16 * 1024)
+#define VK_CMD_QUEUE_BLOCK_MAX_SIZE (1024 * 1024)
+
+struct vk_cmd_queue_block {
+   struct list_head link;
+   size_t size;
+   alignas(8) uint8_t data[];
+};
+
+void *
+vk_cmd_queue_zalloc_block(struct vk_cmd_queue *queue, size_t size)
 {
-   struct vk_cmd_queue_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &queue->cmds, cmd_link) {
-      switch(cmd->type) {
-% for c in commands:
-% if c.guard is not None:
-#ifdef ${c.guard}
-% endif
-      case ${to_enum_name(c.name)}:
-         vk_free_${to_underscore(c.name)}(queue, cmd);
+   struct list_head *prev = queue->block ? &queue->block->link : &queue->blocks;
+   struct vk_cmd_queue_block *block = NULL;
+
+   /* Blocks after the current one are left over from before the last
+    * reset, use them first.  Any too small for this allocation are skipped
+    * for the rest of the recording.
+    */
+   for (struct list_head *l = prev->next; l != &queue->blocks; l = l->next) {
+      struct vk_cmd_queue_block *b = list_entry(l, struct vk_cmd_queue_block, link);
+      if (b->size >= size) {
+         block = b;
          break;
-% if c.guard is not None:
-#endif // ${c.guard}
-% endif
-% endfor
       }
    }
+
+   if (!block) {
+      size_t block_size = queue->block ?
+         MIN2(queue->block->size * 2, VK_CMD_QUEUE_BLOCK_MAX_SIZE) :
+         VK_CMD_QUEUE_BLOCK_MIN_SIZE;
+      block_size = MAX2(block_size, size);
+
+      block = vk_alloc(queue->alloc, sizeof(*block) + block_size, 8,
+                       VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (!block)
+         return NULL;
+
+      block->size = block_size;
+      list_add(&block->link, prev);
+   }
+
+   queue->block = block;
+   queue->next = block->data + size;
+   queue->end = block->data + block->size;
+
+   memset(block->data, 0, size);
+   return block->data;
+}
+
+void
+vk_free_queue(struct vk_cmd_queue *queue)
+{
+   /* The commands themselves live in the arena, only driver data needs
+    * to be released.
+    */
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      if (cmd->driver_free_cb)
+         cmd->driver_free_cb(queue, cmd);
+      else if (cmd->driver_data)
+         vk_free(queue->alloc, cmd->driver_data);
+   }
+}
+
+void
+vk_cmd_queue_reset(struct vk_cmd_queue *queue)
+{
+   vk_free_queue(queue);
+   list_inithead(&queue->cmds);
+
+   /* Rewind the arena, keeping its blocks for the next recording. */
+   queue->block = NULL;
+   queue->next = NULL;
+   queue->end = NULL;
+}
+
+/* Free the arena blocks of a reset queue, for when the application asks
+ * for the memory back.  The queue can still be recorded into afterwards.
+ */
+void
+vk_cmd_queue_trim(struct vk_cmd_queue *queue)
+{
+   assert(list_is_empty(&queue->cmds) && queue->block == NULL);
+
+   list_for_each_entry_safe(struct vk_cmd_queue_block, block,
+                            &queue->blocks, link)
+      vk_free(queue->alloc, block);
+   list_inithead(&queue->blocks);
+}
+
+void
+vk_cmd_queue_finish(struct vk_cmd_queue *queue)
+{
+   vk_cmd_queue_reset(queue);
+   vk_cmd_queue_trim(queue);
 }
 
 void
@@ -465,7 +553,7 @@ def get_array_copy(command, param):
         field_size = "1"
     else:
         field_size = "sizeof(*%s)" % field_name
-    allocation = "%s = vk_zalloc(queue->alloc, %s * (%s), 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, param.len, field_name)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s * (%s));\n   if (%s == NULL) goto err;\n" % (field_name, field_size, param.len, field_name)
     copy = "memcpy((void*)%s, %s, %s * (%s));" % (field_name, param.name, field_size, param.len)
     return "%s\n   %s" % (allocation, copy)
 
@@ -475,7 +563,7 @@ def get_array_member_copy(struct, src_name, member):
         field_size = "sizeof(*%s)" % (field_name)
     else:
         field_size = "sizeof(*%s) * %s->%s" % (field_name, struct, member.len)
-    allocation = "%s = vk_zalloc(queue->alloc, %s, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, field_name)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, field_name)
     copy = "memcpy((void*)%s, %s->%s, %s);" % (field_name, src_name, member.name, field_size)
     return "if (%s->%s) {\n   %s\n   %s\n}\n" % (src_name, member.name, allocation, copy)
 
@@ -511,7 +599,7 @@ def get_struct_copy(dst, src_name, src_type, size, types, level=0):
     global tmp_dst_idx
     global tmp_src_idx
 
-    allocation = "%s = vk_zalloc(queue->alloc, %s, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n      if (%s == NULL) goto err;\n" % (dst, size, dst)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s);\n      if (%s == NULL) goto err;\n" % (dst, size, dst)
     copy = "memcpy((void*)%s, %s, %s);" % (dst, src_name, size)
 
     level += 1
@@ -531,19 +619,6 @@ def get_struct_copy(dst, src_name, src_type, size, types, level=0):
     indent = "   " * level
     return "%s\n      %s\n      %s\n      %s\n      %s\n      %s\n%s} else {\n      %s\n%s}" % (if_stmt, allocation, copy, tmp_dst, tmp_src, member_copies, indent, null_assignment, indent)
 
-def get_struct_free(command, param, types):
-    field_name = "cmd->u.%s.%s" % (to_struct_field_name(command.name), to_field_name(param.name))
-    const_cast = remove_suffix(param.decl.replace("const", ""), param.name)
-    struct_free = "vk_free(queue->alloc, (%s)%s);" % (const_cast, field_name)
-    member_frees = ""
-    if (param.type in types):
-        for member in types[param.type].members:
-            if member.len and member.len != 'null-terminated':
-                member_name = "cmd->u.%s.%s->%s" % (to_struct_field_name(command.name), to_field_name(param.name), member.name)
-                const_cast = remove_suffix(member.decl.replace("const", ""), member.name)
-                member_frees += "vk_free(queue->alloc, (%s)%s);\n" % (const_cast, member_name)
-    return "%s      %s\n" % (member_frees, struct_free)
-
 EntrypointType = namedtuple('EntrypointType', 'name enum members extended_by guard')
 
 def get_types_defines(doc):
@@ -661,7 +736,6 @@ def main():
         'to_struct_name': to_struct_name,
         'get_array_copy': get_array_copy,
         'get_struct_copy': get_struct_copy,
-        'get_struct_free': get_struct_free,
         'types': types,
         'manual_commands': MANUAL_COMMANDS,
         'no_enqueue_commands': NO_ENQUEUE_COMMANDS,